@@ -43,11 +43,14 @@ window.APP_CONFIG = {
   // ==================== MQTT Topics ====================
   // Pump Control: dashboard publishes commands, ESP32 publishes state
   TOPIC_PUMP_CMD: "devices/esp32-pool-01/pump/set",      // Values: "ON", "OFF", "TOGGLE"
-  TOPIC_PUMP_STATE: "devices/esp32-pool-01/pump/state",  // Values: "ON", "OFF"
+  TOPIC_PUMP_STATE: "devices/esp32-pool-01/pump/state",  // JSON: {state: "ON"|"OFF", ts} - ts = device epoch ms of the switch
+  TOPIC_PUMP_POLICY: "devices/esp32-pool-01/pump/policy", // JSON: {state, target, pending, hold_ms, superseded, ...} - held/coalesced pump commands
+  TOPIC_PUMP_USAGE: "devices/esp32-pool-01/pump/usage",  // JSON: {date, runtime_s, starts, kwh, cascada: {...}, eyectores: {...}, watts, ts} - today
+  TOPIC_PUMP_USAGE_DAILY: "devices/esp32-pool-01/pump/usage/daily", // JSON: same per-day fields - last completed day
 
   // Valve Mode: dashboard publishes commands, ESP32 publishes state
   TOPIC_VALVE_CMD: "devices/esp32-pool-01/valve/set",    // Values: "1" (Cascada), "2" (Eyectores), "TOGGLE"
-  TOPIC_VALVE_STATE: "devices/esp32-pool-01/valve/state", // Values: "1", "2"
+  TOPIC_VALVE_STATE: "devices/esp32-pool-01/valve/state", // JSON: {mode: 1|2, ts}
 
   // WiFi Status and Control
   TOPIC_WIFI_STATE: "devices/esp32-pool-01/wifi/state",   // JSON: {status, ssid, ip, rssi, quality}
@@ -58,6 +61,13 @@ window.APP_CONFIG = {
   TOPIC_TIMER_STATE: "devices/esp32-pool-01/timer/state",  // JSON: {active, remaining, mode, duration}
 
   // Temperature Monitoring
-  TOPIC_TEMP_STATE: "devices/esp32-pool-01/temperature/state",    // Value: temperature in °C
-  TOPIC_TEMP_REFRESH: "devices/esp32-pool-01/temperature/refresh" // Command: force immediate reading
+  TOPIC_TEMP_STATE: "devices/esp32-pool-01/temperature/state",    // JSON: {value: °C, ts}
+  TOPIC_TEMP_REFRESH: "devices/esp32-pool-01/temperature/refresh", // Command: force immediate reading
+
+  // Command Acknowledgment
+  TOPIC_CMD_ACK: "devices/esp32-pool-01/cmd/ack",  // JSON: {id, topic, result, proc_us} - ack for enveloped commands
+
+  // Event Log (on-device flash history)
+  TOPIC_EVENTS_SET: "devices/esp32-pool-01/events/set",       // JSON: {id, from, to, limit} - epoch ms range query
+  TOPIC_EVENTS_RESULT: "devices/esp32-pool-01/events/result"  // JSON: {id, page, events: [{seq, boot, ts, up, type, code, value, arg}], more, total}
 };
@@ -256,6 +256,7 @@ const AppModule = (() => {
       "conn-indicator": "connIndicator",
       "wifi-icon": "wifiIcon",
       "wifi-ssid": "wifiSsid",
+      "cmd-latency": "cmdLatency",
       "temp-icon": "tempIcon",
       "temp-value": "tempValue",
       "temp-refresh-btn": "tempRefreshBtn",
@@ -344,6 +345,20 @@ const AppModule = (() => {
         updateTemperature(temperature);
       }
     );
+
+    // Command acks: show round-trip percentiles
+    MQTTModule.onAck((ack, stats) => {
+      updateCommandLatency(stats);
+      if (ack.result !== "ok") {
+        LogModule.append(`⚠️ Comando rechazado por el dispositivo (${ack.topic}: ${ack.result})`);
+      }
+    });
+
+    // Pump usage counted on the device (today)
+    MQTTModule.onUsage((usage) => {
+      const hours = (usage.runtime_s / 3600).toFixed(1);
+      LogModule.append(`Uso hoy: ${hours} h, ${usage.starts} arranques, ${usage.kwh.toFixed(2)} kWh`);
+    });
   }
 
   // ==================== UI Event Listeners ====================
@@ -584,7 +599,9 @@ const AppModule = (() => {
         valveState: window.APP_CONFIG.TOPIC_VALVE_STATE,
         wifiState: window.APP_CONFIG.TOPIC_WIFI_STATE,
         timerState: window.APP_CONFIG.TOPIC_TIMER_STATE,
-        tempState: window.APP_CONFIG.TOPIC_TEMP_STATE
+        tempState: window.APP_CONFIG.TOPIC_TEMP_STATE,
+        cmdAck: window.APP_CONFIG.TOPIC_CMD_ACK,
+        pumpUsage: window.APP_CONFIG.TOPIC_PUMP_USAGE
       },
       window.APP_CONFIG.DEVICE_ID,
       (msg) => LogModule.append(msg)
@@ -750,7 +767,7 @@ const AppModule = (() => {
    * - Orange: Weak (< -70 dBm)
    * - Red: Disconnected
    * 
-   * @param {Object} wifiState - {status, ssid, ip, rssi, quality}
+   * @param {Object} wifiState - {status, ssid, ip, rssi, quality, broker, broker_host, broker_ms}
    */
   function updateWiFiStatus(wifiState) {
     if (!wifiState || wifiState.status !== "connected") {
@@ -765,7 +782,7 @@ const AppModule = (() => {
     }
 
     // Connected state
-    const { ssid, ip, rssi, quality } = wifiState;
+    const { ssid, ip, rssi, quality, broker, broker_host, broker_ms } = wifiState;
     
     // Update icon based on signal quality
     let icon = "wifi";
@@ -790,7 +807,30 @@ const AppModule = (() => {
       elements.wifiIcon.className = `material-icons-round ${iconColor} text-lg`;
     }
     
-    if (elements.wifiSsid) elements.wifiSsid.textContent = ssid || "WiFi";
+    if (elements.wifiSsid) {
+      elements.wifiSsid.textContent = ssid || "WiFi";
+      // Broker endpoint in use (primary/secondary/lan) and its connect time
+      elements.wifiSsid.title = broker
+        ? `Broker: ${broker} (${broker_host}) · ${broker_ms} ms`
+        : "";
+    }
+  }
+
+  /**
+   * Update command latency display
+   * Shows round-trip percentiles (command sent -> ack received)
+   * 
+   * @param {Object} stats - {count, lost, p50, p90, p99} from MQTTModule.getCommandStats()
+   */
+  function updateCommandLatency(stats) {
+    if (!elements.cmdLatency) return;
+    if (!stats || stats.count === 0) {
+      elements.cmdLatency.textContent = "-- ms";
+      return;
+    }
+    const lost = stats.lost > 0 ? ` · ${stats.lost} sin ack` : "";
+    elements.cmdLatency.textContent = `p50 ${stats.p50} · p90 ${stats.p90} · p99 ${stats.p99} ms${lost}`;
+    elements.cmdLatency.title = `${stats.count} comandos`;
   }
 
   /**
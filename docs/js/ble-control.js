@@ -0,0 +1,138 @@
+/**
+ * Controlador Smart Pool - BLE Local Control Module
+ * Controls pump, valve and timer over Bluetooth when the MQTT broker is unreachable
+ *
+ * Requires ble-provisioning.js (shares its frame encoder/decoder).
+ * The firmware must be built with BLE_CONTROL_ENABLED; the first connection
+ * triggers the OS pairing prompt (passkey BLE_CONTROL_PASSKEY).
+ *
+ * Usage:
+ *   await ESP32BLEControl.connect(state => render(state));
+ *   await ESP32BLEControl.sendCommand('pump', 'TOGGLE');
+ *   await ESP32BLEControl.sendCommand('timer', '{"mode":1,"duration":3600}');
+ */
+
+const ESP32BLEControl = {
+  // BLE Service & Characteristic UUIDs (must match firmware/src/ble_control.cpp)
+  SERVICE_UUID: '027b05b6-6282-456e-8ede-df34b5ba7d8b',
+  RX_CHAR_UUID: '343455da-2b0b-44d5-8a4f-a1492822d621',
+  TX_CHAR_UUID: '4178c9a2-5a87-4fc2-ad20-d25a625db015',
+
+  OP: { COMMAND: 0x10, GET_STATE: 0x11, STATUS: 0x80, STATE: 0x90 },
+  TLV: { STATUS: 0x10, TARGET: 0x30, PAYLOAD: 0x31, STATE: 0x32 },
+  TARGET: { pump: 0x01, valve: 0x02, timer: 0x03, temp_refresh: 0x04 },
+
+  // State
+  device: null,
+  server: null,
+  rxCharacteristic: null,
+  txCharacteristic: null,
+  onState: null,
+
+  /**
+   * Connect (or reuse the provisioning connection) and subscribe to state
+   * @param {Function} onState - Called with {pump, valve, timer:{active, mode, remaining, duration}, temperature}
+   */
+  async connect(onState) {
+    const proto = ESP32BLEProvisioning;
+    if (!proto.isSupported()) {
+      throw new Error('Web Bluetooth no está disponible en este navegador');
+    }
+
+    this.onState = onState || null;
+    this.device = await navigator.bluetooth.requestDevice({
+      filters: [{ namePrefix: 'Controlador Smart Pool' }],
+      optionalServices: [this.SERVICE_UUID]
+    });
+    this.device.addEventListener('gattserverdisconnected', () => this.cleanup());
+    this.server = await this.device.gatt.connect();
+
+    const service = await this.server.getPrimaryService(this.SERVICE_UUID);
+    this.rxCharacteristic = await service.getCharacteristic(this.RX_CHAR_UUID);
+    this.txCharacteristic = await service.getCharacteristic(this.TX_CHAR_UUID);
+
+    // Subscribing to an authenticated characteristic triggers pairing on first use
+    await this.txCharacteristic.startNotifications();
+    this.txCharacteristic.addEventListener('characteristicvaluechanged', (event) => {
+      this.handleFrame(event.target.value);
+    });
+
+    await this.rxCharacteristic.writeValueWithResponse(proto.encodeFrame(this.OP.GET_STATE));
+    console.log('[BLE-CTL] ✓ Control channel ready');
+    return true;
+  },
+
+  /**
+   * Send a command with the same payload as the MQTT /set topic
+   * @param {string} target - 'pump' | 'valve' | 'timer' | 'temp_refresh'
+   * @param {string} payload - e.g. 'ON', 'TOGGLE', '2', '{"mode":1,"duration":600}'
+   */
+  async sendCommand(target, payload = '') {
+    if (!this.server || !this.server.connected) {
+      throw new Error('Control BLE no conectado');
+    }
+    if (!(target in this.TARGET)) {
+      throw new Error(`Destino desconocido: ${target}`);
+    }
+
+    const frame = ESP32BLEProvisioning.encodeFrame(this.OP.COMMAND, [
+      [this.TLV.TARGET, new Uint8Array([this.TARGET[target]])],
+      [this.TLV.PAYLOAD, new TextEncoder().encode(payload)]
+    ]);
+    await this.rxCharacteristic.writeValueWithResponse(frame);
+  },
+
+  /**
+   * Decode STATUS / STATE frames from the device
+   */
+  handleFrame(view) {
+    const frame = ESP32BLEProvisioning.decodeFrame(view);
+    if (!frame) return;
+
+    for (const [type, value] of frame.tlvs) {
+      if (type === this.TLV.STATUS && value[0] >= 0x80) {
+        console.warn(`[BLE-CTL] Command rejected: ${ESP32BLEProvisioning.STATUS[value[0]] || value[0]}`);
+      } else if (type === this.TLV.STATE && value.length >= 14) {
+        const dv = new DataView(value.buffer, value.byteOffset, value.byteLength);
+        const tempDeci = dv.getInt16(12, true);
+        const state = {
+          pump: value[0] ? 'ON' : 'OFF',
+          valve: String(value[1]),
+          timer: {
+            active: value[2] === 1,
+            mode: value[3],
+            remaining: dv.getUint32(4, true),
+            duration: dv.getUint32(8, true)
+          },
+          temperature: tempDeci === -32768 ? null : tempDeci / 10
+        };
+        if (this.onState) this.onState(state);
+      }
+    }
+  },
+
+  /**
+   * Disconnect from device
+   */
+  disconnect() {
+    if (this.device && this.device.gatt.connected) {
+      this.device.gatt.disconnect();
+    }
+    this.cleanup();
+  },
+
+  /**
+   * Clean up state
+   */
+  cleanup() {
+    this.device = null;
+    this.server = null;
+    this.rxCharacteristic = null;
+    this.txCharacteristic = null;
+  }
+};
+
+// Export for use in modules (optional)
+if (typeof module !== 'undefined' && module.exports) {
+  module.exports = ESP32BLEControl;
+}
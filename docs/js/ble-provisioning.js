@@ -1,31 +1,67 @@
 /**
  * Controlador Smart Pool - BLE Provisioning Module
  * Web Bluetooth API integration for WiFi credential provisioning
- * 
+ *
  * Usage:
  * 1. Include this script in your dashboard
  * 2. Call ESP32BLEProvisioning.provision() when user clicks "Add Device"
  * 3. Handle success/error callbacks
+ *
+ * Wire protocol (v1) - binary frames over one RX/TX characteristic pair:
+ *   [version:1][opcode:1][length:2 LE][TLV records][crc16:2 LE]
+ *   TLV record = [type:1][len:1][value]
+ *   CRC = CRC-16/CCITT-FALSE over everything before it
+ * Must match firmware/src/ble_provisioning.cpp
  */
 
 const ESP32BLEProvisioning = {
   // BLE Service & Characteristic UUIDs (must match firmware)
   SERVICE_UUID: '4fafc201-1fb5-459e-8fcc-c5c9c331914b',
-  SSID_CHAR_UUID: 'beb5483e-36e1-4688-b7f5-ea07361b26a8',
-  PASSWORD_CHAR_UUID: 'cba1d466-344c-4be3-ab3f-189f80dd7518',
-  STATUS_CHAR_UUID: '8d8218b6-97bc-4527-a8db-13094ac06b1d',
-  NETWORKS_CHAR_UUID: 'fa87c0d0-afac-11de-8a39-0800200c9a66',
-  COMMAND_CHAR_UUID: '8b9d68c4-57b8-4b02-bf19-6fd94b62f709',
+  RX_CHAR_UUID: '971810a1-d99e-435a-b6fe-e13cd5981cf6',  // Dashboard -> ESP32 (write)
+  TX_CHAR_UUID: '3ce0b731-d49f-4ccb-b609-3c02000a0aad',  // ESP32 -> dashboard (notify)
+
+  // Protocol constants (must match firmware)
+  PROTO_VERSION: 0x01,
+  OP: {
+    SCAN: 0x01,
+    SET_CREDENTIALS: 0x02,
+    CLEAR_WIFI: 0x03,
+    STATUS: 0x80,
+    NETWORKS: 0x81
+  },
+  TLV: {
+    SSID: 0x01,
+    PASSWORD: 0x02,
+    STATUS: 0x10,
+    MTU: 0x11,
+    NETWORK: 0x20,
+    FRAGMENT: 0x21
+  },
+  STATUS: {
+    0x00: 'waiting',
+    0x01: 'connected',
+    0x02: 'credentials_ready',
+    0x03: 'clear_wifi_requested',
+    0x04: 'scan_started',
+    0x05: 'command_queued',
+    0x80: 'error_checksum',
+    0x81: 'error_version',
+    0x82: 'error_malformed',
+    0x83: 'error_unknown_opcode',
+    0x84: 'error_busy',
+    0x85: 'error_not_provisioning'
+  },
+  RESPONSE_TIMEOUT_MS: 3000,   // Status replies (credentials, clear)
+  SCAN_TIMEOUT_MS: 15000,      // Full WiFi scan on the device
 
   // State
   device: null,
   server: null,
   service: null,
-  ssidCharacteristic: null,
-  passwordCharacteristic: null,
-  statusCharacteristic: null,
-  networksCharacteristic: null,
-  commandCharacteristic: null,
+  rxCharacteristic: null,
+  txCharacteristic: null,
+  mtu: 23,
+  pending: null,       // { opcode, resolve, reject, timer, networks }
 
   /**
    * Check if Web Bluetooth is supported
@@ -62,7 +98,7 @@ const ESP32BLEProvisioning = {
 
       console.log(`[BLE] Found device: ${this.device.name}`);
 
-      // Connect to GATT server
+      // Connect to GATT server (browser negotiates the ATT MTU automatically)
       console.log('[BLE] Connecting to GATT server...');
       this.server = await this.device.gatt.connect();
       console.log('[BLE] ✓ Connected to GATT server');
@@ -71,28 +107,19 @@ const ESP32BLEProvisioning = {
       this.service = await this.server.getPrimaryService(this.SERVICE_UUID);
       console.log('[BLE] ✓ Got provisioning service');
 
-      // Get characteristics
-      this.ssidCharacteristic = await this.service.getCharacteristic(this.SSID_CHAR_UUID);
-      this.passwordCharacteristic = await this.service.getCharacteristic(this.PASSWORD_CHAR_UUID);
-      this.networksCharacteristic = await this.service.getCharacteristic(this.NETWORKS_CHAR_UUID);
-      this.statusCharacteristic = await this.service.getCharacteristic(this.STATUS_CHAR_UUID);
-      
-      // Command characteristic is optional (for backwards compatibility with old firmware)
+      // Get characteristic pair
       try {
-        this.commandCharacteristic = await this.service.getCharacteristic(this.COMMAND_CHAR_UUID);
-        console.log('[BLE] ✓ Got command characteristic (clear WiFi supported)');
+        this.rxCharacteristic = await this.service.getCharacteristic(this.RX_CHAR_UUID);
+        this.txCharacteristic = await this.service.getCharacteristic(this.TX_CHAR_UUID);
       } catch (e) {
-        console.warn('[BLE] Command characteristic not available (old firmware or cached GATT)');
-        this.commandCharacteristic = null;
+        throw new Error('Firmware incompatible o caché GATT antigua. Actualiza el firmware o borra el dispositivo desde Configuración → Bluetooth.');
       }
-      
-      console.log('[BLE] ✓ Got all characteristics');
-
-      // Subscribe to status notifications
-      await this.statusCharacteristic.startNotifications();
-      this.statusCharacteristic.addEventListener('characteristicvaluechanged', (event) => {
-        const value = new TextDecoder().decode(event.target.value);
-        console.log(`[BLE] Status update: ${value}`);
+      console.log('[BLE] ✓ Got RX/TX characteristics');
+
+      // Subscribe to protocol frames from the device
+      await this.txCharacteristic.startNotifications();
+      this.txCharacteristic.addEventListener('characteristicvaluechanged', (event) => {
+        this.handleFrame(event.target.value);
       });
 
       return true;
@@ -104,51 +131,188 @@ const ESP32BLEProvisioning = {
   },
 
   /**
-   * Scan for available WiFi networks
-   * Request scan from ESP32 and get results via networks characteristic
-   * @returns {Promise<Array>} Array of networks: [{ssid, rssi, open}, ...]
+   * CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF)
+   * @param {Uint8Array} bytes
+   * @returns {number} 16-bit CRC
    */
-  async scanNetworks() {
+  crc16(bytes) {
+    let crc = 0xFFFF;
+    for (const b of bytes) {
+      crc ^= b << 8;
+      for (let bit = 0; bit < 8; bit++) {
+        crc = (crc & 0x8000) ? ((crc << 1) ^ 0x1021) & 0xFFFF : (crc << 1) & 0xFFFF;
+      }
+    }
+    return crc;
+  },
+
+  /**
+   * Build a protocol frame
+   * @param {number} opcode - Frame opcode
+   * @param {Array<[number, Uint8Array]>} tlvs - TLV records as [type, value]
+   * @returns {Uint8Array} Encoded frame
+   */
+  encodeFrame(opcode, tlvs = []) {
+    const payloadLen = tlvs.reduce((n, [, value]) => n + 2 + value.length, 0);
+    const frame = new Uint8Array(4 + payloadLen + 2);
+    frame[0] = this.PROTO_VERSION;
+    frame[1] = opcode;
+    frame[2] = payloadLen & 0xFF;
+    frame[3] = payloadLen >> 8;
+
+    let pos = 4;
+    for (const [type, value] of tlvs) {
+      frame[pos++] = type;
+      frame[pos++] = value.length;
+      frame.set(value, pos);
+      pos += value.length;
+    }
+
+    const crc = this.crc16(frame.subarray(0, pos));
+    frame[pos++] = crc & 0xFF;
+    frame[pos] = crc >> 8;
+    return frame;
+  },
+
+  /**
+   * Decode and validate a protocol frame
+   * @param {DataView} view - Raw notification value
+   * @returns {{opcode: number, tlvs: Array<[number, Uint8Array]>}|null} null if invalid
+   */
+  decodeFrame(view) {
+    const bytes = new Uint8Array(view.buffer, view.byteOffset, view.byteLength);
+    if (bytes.length < 6 || bytes[0] !== this.PROTO_VERSION) return null;
+
+    const payloadLen = bytes[2] | (bytes[3] << 8);
+    if (payloadLen + 6 !== bytes.length) return null;
+
+    const crc = bytes[bytes.length - 2] | (bytes[bytes.length - 1] << 8);
+    if (this.crc16(bytes.subarray(0, bytes.length - 2)) !== crc) return null;
+
+    const tlvs = [];
+    let pos = 4;
+    const end = 4 + payloadLen;
+    while (pos + 2 <= end) {
+      const type = bytes[pos];
+      const len = bytes[pos + 1];
+      if (pos + 2 + len > end) return null;
+      tlvs.push([type, bytes.slice(pos + 2, pos + 2 + len)]);
+      pos += 2 + len;
+    }
+    return { opcode: bytes[1], tlvs };
+  },
+
+  /**
+   * Dispatch a frame received on the TX characteristic
+   * Resolves the pending request when its final frame arrives
+   */
+  handleFrame(view) {
+    const frame = this.decodeFrame(view);
+    if (!frame) {
+      console.warn('[BLE] Dropped invalid frame');
+      return;
+    }
+
+    if (frame.opcode === this.OP.STATUS) {
+      let status = 'unknown';
+      for (const [type, value] of frame.tlvs) {
+        if (type === this.TLV.STATUS) status = this.STATUS[value[0]] || `0x${value[0].toString(16)}`;
+        if (type === this.TLV.MTU) this.mtu = value[0] | (value[1] << 8);
+      }
+      console.log(`[BLE] Status update: ${status}`);
+      this.onStatus(status);
+      return;
+    }
+
+    if (frame.opcode === this.OP.NETWORKS && this.pending && this.pending.opcode === this.OP.SCAN) {
+      let last = false;
+      for (const [type, value] of frame.tlvs) {
+        if (type === this.TLV.FRAGMENT) {
+          last = (value[1] & 0x01) !== 0;
+          if (value[1] & 0x02) console.warn(`[BLE] Some networks were omitted (MTU ${this.mtu})`);
+        } else if (type === this.TLV.NETWORK) {
+          this.pending.networks.push({
+            ssid: new TextDecoder().decode(value.subarray(2)),
+            rssi: (value[0] << 24) >> 24,   // int8
+            open: (value[1] & 0x01) !== 0
+          });
+        }
+      }
+      if (last) this.settle(null, this.pending.networks);
+    }
+  },
+
+  /**
+   * Route status codes to the pending request
+   */
+  onStatus(status) {
+    if (!this.pending) return;
+
+    if (status.startsWith('error_')) {
+      this.settle(new Error(`El dispositivo rechazó la solicitud (${status})`));
+      return;
+    }
+
+    const expected = {
+      [this.OP.SET_CREDENTIALS]: 'credentials_ready',
+      [this.OP.CLEAR_WIFI]: 'clear_wifi_requested'
+    }[this.pending.opcode];
+
+    if (status === expected) this.settle(null, status);
+  },
+
+  /**
+   * Complete the pending request
+   */
+  settle(error, result) {
+    const pending = this.pending;
+    if (!pending) return;
+    this.pending = null;
+    clearTimeout(pending.timer);
+    if (error) pending.reject(error);
+    else pending.resolve(result);
+  },
+
+  /**
+   * Write a single request frame and wait for its response
+   * @param {number} opcode - Request opcode
+   * @param {Array<[number, Uint8Array]>} tlvs - Request TLVs
+   * @param {number} timeoutMs - Response timeout
+   * @returns {Promise<*>} Response (status string or network list)
+   */
+  async request(opcode, tlvs, timeoutMs) {
     if (!this.server || !this.server.connected) {
       throw new Error('Not connected to device. Call connect() first.');
     }
+    if (this.pending) {
+      throw new Error('Another BLE request is in progress.');
+    }
+
+    const response = new Promise((resolve, reject) => {
+      this.pending = {
+        opcode, resolve, reject, networks: [],
+        timer: setTimeout(() => this.settle(new Error('Tiempo de espera agotado (BLE)')), timeoutMs)
+      };
+    });
 
-    if (!this.networksCharacteristic) {
-      throw new Error('Networks characteristic not found.');
+    try {
+      await this.rxCharacteristic.writeValueWithResponse(this.encodeFrame(opcode, tlvs));
+    } catch (error) {
+      this.settle(error);
     }
+    return response;
+  },
 
+  /**
+   * Scan for available WiFi networks
+   * The device streams results as notification frames sized to the negotiated MTU
+   * @returns {Promise<Array>} Array of networks: [{ssid, rssi, open}, ...]
+   */
+  async scanNetworks() {
     try {
       console.log('[BLE] Triggering network scan...');
-      
-      // Write "scan" to trigger the ESP32 to perform a WiFi scan
-      const encoder = new TextEncoder();
-      await this.networksCharacteristic.writeValue(encoder.encode('scan'));
-      
-      console.log('[BLE] Scan request sent, waiting for results...');
-      
-      // Wait for ESP32 to complete scan (2-3 seconds for WiFi scan)
-      await new Promise(resolve => setTimeout(resolve, 3000));
-      
-      // Read the networks characteristic to get scan results
-      const value = await this.networksCharacteristic.readValue();
-      let json = new TextDecoder().decode(value);
-      
-      console.log('[BLE] Raw data length:', value.byteLength);
-      console.log('[BLE] Raw data:', json);
-      
-      // Clean the JSON string - trim whitespace and remove any trailing garbage
-      json = json.trim();
-      
-      // Find the end of valid JSON (last closing bracket)
-      const lastBracket = json.lastIndexOf(']');
-      if (lastBracket !== -1) {
-        json = json.substring(0, lastBracket + 1);
-      }
-      
-      console.log('[BLE] Cleaned JSON:', json);
-      
-      const networks = JSON.parse(json);
-      console.log('[BLE] Parsed networks:', networks);
+      const networks = await this.request(this.OP.SCAN, [], this.SCAN_TIMEOUT_MS);
+      console.log(`[BLE] Received ${networks.length} networks (MTU ${this.mtu})`);
       return networks.sort((a, b) => b.rssi - a.rssi); // Sort by signal strength
     } catch (error) {
       console.error('[BLE] Scan error:', error);
@@ -158,29 +322,30 @@ const ESP32BLEProvisioning = {
 
   /**
    * Send WiFi credentials to ESP32
+   * SSID and password travel in a single checksummed write
    * @param {string} ssid - WiFi network name
    * @param {string} password - WiFi password
-   * @returns {Promise<boolean>} true if sent successfully
+   * @returns {Promise<boolean>} true if the device accepted the credentials
    */
   async sendCredentials(ssid, password) {
-    if (!this.server || !this.server.connected) {
-      throw new Error('Not connected to device. Call connect() first.');
+    const encoder = new TextEncoder();
+    const ssidBytes = encoder.encode(ssid);
+    const passwordBytes = encoder.encode(password || '');
+
+    if (ssidBytes.length === 0 || ssidBytes.length > 32) {
+      throw new Error('El SSID debe tener entre 1 y 32 bytes');
+    }
+    if (passwordBytes.length > 63) {
+      throw new Error('La contraseña no puede superar 63 bytes');
     }
 
     try {
-      console.log(`[BLE] Sending SSID: ${ssid}`);
-      const ssidEncoder = new TextEncoder();
-      await this.ssidCharacteristic.writeValue(ssidEncoder.encode(ssid));
-      console.log('[BLE] ✓ SSID sent');
-
-      // Small delay between writes
-      await new Promise(resolve => setTimeout(resolve, 100));
-
-      console.log('[BLE] Sending password...');
-      const passwordEncoder = new TextEncoder();
-      await this.passwordCharacteristic.writeValue(passwordEncoder.encode(password));
-      console.log('[BLE] ✓ Password sent');
-
+      console.log(`[BLE] Sending credentials for: ${ssid}`);
+      await this.request(this.OP.SET_CREDENTIALS, [
+        [this.TLV.SSID, ssidBytes],
+        [this.TLV.PASSWORD, passwordBytes]
+      ], this.RESPONSE_TIMEOUT_MS);
+      console.log('[BLE] ✓ Credentials accepted');
       return true;
     } catch (error) {
       console.error('[BLE] Error sending credentials:', error);
@@ -203,37 +368,29 @@ const ESP32BLEProvisioning = {
    * Clean up state
    */
   cleanup() {
+    this.settle(new Error('BLE desconectado'));
     this.device = null;
     this.server = null;
     this.service = null;
-    this.ssidCharacteristic = null;
-    this.passwordCharacteristic = null;
-    this.statusCharacteristic = null;
-    this.commandCharacteristic = null;
+    this.rxCharacteristic = null;
+    this.txCharacteristic = null;
+    this.mtu = 23;
   },
 
   /**
-   * Ask the ESP32 to clear stored WiFi credentials via BLE command characteristic
+   * Ask the ESP32 to clear stored WiFi credentials
    */
   async clearWiFiCredentials() {
     if (!this.isSupported()) {
       throw new Error('Web Bluetooth no está disponible en este navegador');
     }
 
-    // Ensure we are connected and have the command characteristic
+    // Ensure we are connected
     if (!this.server || !this.server.connected) {
       await this.connect();
     }
-    
-    if (!this.commandCharacteristic) {
-      throw new Error('Comando no soportado. Actualiza el firmware del ESP32 o borra el dispositivo desde Configuración de Windows → Bluetooth para refrescar la caché.');
-    }
-
-    const encoder = new TextEncoder();
-    await this.commandCharacteristic.writeValue(encoder.encode('clear_wifi'));
 
-    // Small pause to let the device process and send ack (best-effort)
-    await new Promise(resolve => setTimeout(resolve, 300));
+    await this.request(this.OP.CLEAR_WIFI, [], this.RESPONSE_TIMEOUT_MS);
   },
 
     /**
@@ -255,7 +412,7 @@ const ESP32BLEProvisioning = {
         if (onProgress) onProgress('Usando conexión existente...');
       }
 
-      // Step 2: Send credentials
+      // Step 2: Send credentials (resolves once the device confirms the frame)
       if (onProgress) onProgress('Enviando credenciales WiFi...');
       await this.sendCredentials(ssid, password);
 
@@ -263,9 +420,6 @@ const ESP32BLEProvisioning = {
       // We consider this a success - the ESP32 is now connecting to WiFi
       if (onProgress) onProgress('¡Credenciales enviadas! ESP32 conectando a WiFi...');
 
-      // Give ESP32 a moment to start WiFi connection, then disconnect our side
-      await new Promise(resolve => setTimeout(resolve, 1000));
-
       // Disconnect (ESP32 might have already disconnected)
       try {
         this.disconnect();
@@ -280,14 +434,14 @@ const ESP32BLEProvisioning = {
       console.log('[BLE]  Provisioning completed successfully');
     } catch (error) {
       console.error('[BLE] Provisioning failed:', error);
-      
+
       // Clean up on error
       try {
         this.disconnect();
       } catch (e) {
         // Ignore cleanup errors
       }
-      
+
       if (onError) onError(error);
       throw error;
     }
@@ -298,4 +452,3 @@ const ESP32BLEProvisioning = {
 if (typeof module !== 'undefined' && module.exports) {
   module.exports = ESP32BLEProvisioning;
 }
-
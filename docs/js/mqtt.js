@@ -5,6 +5,9 @@
  */
 
 const MQTTModule = (() => {
+  const ACK_TIMEOUT_MS = 10000;    // Commands without ack after this are counted as lost
+  const RTT_WINDOW = 100;          // Round-trip samples kept for percentiles
+
   let client = null;
   let pumpState = "UNKNOWN";   // "ON" | "OFF" | "UNKNOWN"
   let valveMode = "UNKNOWN";   // "1" | "2" | "UNKNOWN"
@@ -19,6 +22,19 @@ const MQTTModule = (() => {
   let onWiFiStateChange = null;   // Callback for WiFi status updates
   let onTimerStateChange = null;  // Callback for Timer status updates
   let onTemperatureChange = null; // Callback for Temperature updates
+  let onCommandAck = null;        // Callback when a command ack arrives
+  let onPumpUsage = null;         // Callback for pump usage counters
+
+  // Command acknowledgment tracking
+  let ackTopic = null;                    // Set when the device acks enveloped commands
+  let usageTopic = null;                  // Today's pump usage (optional)
+  let commandSeq = 0;                     // Sequence ID of the last command sent
+  const pendingCommands = new Map();      // id -> {topic, sentAt}
+  const rttSamples = [];                  // Most recent round trips (ms)
+  let lostCommands = 0;
+
+  // Device event time ("ts", epoch ms) of the last state applied per topic
+  const lastStateTs = new Map();
 
   /**
    * Register callbacks for MQTT events
@@ -34,8 +50,127 @@ const MQTTModule = (() => {
     onTemperatureChange = tempChangeCb || null;
   }
 
+  /**
+   * Register callback for command acks
+   * @param {Function} cb - Called with ({id, topic, result, rttMs, deviceMs}, stats)
+   */
+  function onAck(cb) {
+    onCommandAck = cb || null;
+  }
+
+  /**
+   * Register callback for pump usage counters
+   * @param {Function} cb - Called with {date, runtime_s, starts, kwh, cascada, eyectores, watts, ts}
+   */
+  function onUsage(cb) {
+    onPumpUsage = cb || null;
+  }
+
+  /**
+   * Parse a state payload: JSON with device "ts", or a plain value (older firmware)
+   * @param {string} msg - Payload
+   * @param {string} field - JSON field holding the value
+   * @returns {{value: *, ts: ?number}}
+   */
+  function parseState(msg, field) {
+    if (msg.startsWith("{")) {
+      try {
+        const parsed = JSON.parse(msg);
+        return { value: parsed[field], ts: Number.isFinite(parsed.ts) ? parsed.ts : null };
+      } catch (_) {}
+    }
+    return { value: msg, ts: null };
+  }
+
+  /**
+   * Whether a state is older than the one already shown for its topic
+   * (out-of-order delivery or a replay after reconnect); records it otherwise
+   */
+  function isStale(topic, ts) {
+    if (ts === null) return false;
+    const last = lastStateTs.get(topic);
+    if (last !== undefined && ts < last) return true;
+    lastStateTs.set(topic, ts);
+    return false;
+  }
+
+  /**
+   * Percentile of a sorted array (nearest rank)
+   */
+  function percentile(sorted, p) {
+    if (sorted.length === 0) return null;
+    const rank = Math.ceil((p / 100) * sorted.length);
+    return sorted[Math.min(sorted.length, Math.max(1, rank)) - 1];
+  }
+
+  /**
+   * Command round-trip statistics over the last RTT_WINDOW acks
+   * @returns {{count: number, lost: number, p50: ?number, p90: ?number, p99: ?number}}
+   */
+  function getCommandStats() {
+    const sorted = [...rttSamples].sort((a, b) => a - b);
+    return {
+      count: sorted.length,
+      lost: lostCommands,
+      p50: percentile(sorted, 50),
+      p90: percentile(sorted, 90),
+      p99: percentile(sorted, 99),
+    };
+  }
+
+  /**
+   * Wrap a command in an envelope with a sequence ID and send timestamp
+   * Plain commands become {"id","ts","cmd"}; JSON commands (timer) get id/ts added.
+   */
+  function wrapCommand(command, topic) {
+    const id = ++commandSeq;
+    let envelope;
+    try {
+      const parsed = JSON.parse(command);
+      envelope = (parsed && typeof parsed === "object") ? { ...parsed, id, ts: Date.now() } : null;
+    } catch (_) {
+      envelope = null;
+    }
+    if (!envelope) envelope = { id, ts: Date.now(), cmd: command };
+
+    pendingCommands.set(String(id), { topic, sentAt: performance.now() });
+    setTimeout(() => {
+      if (pendingCommands.delete(String(id))) lostCommands++;
+    }, ACK_TIMEOUT_MS);
+
+    return JSON.stringify(envelope);
+  }
+
+  /**
+   * Match an ack with its pending command and record the round trip
+   */
+  function handleAck(msg, logFn) {
+    let ack;
+    try {
+      ack = JSON.parse(msg);
+    } catch (e) {
+      logFn(`✗ Error parseando ack: ${e.message}`);
+      return;
+    }
+
+    const pending = pendingCommands.get(String(ack.id));
+    if (!pending) return; // Sent by another dashboard, or already timed out
+    pendingCommands.delete(String(ack.id));
+
+    const rttMs = Math.round(performance.now() - pending.sentAt);
+    rttSamples.push(rttMs);
+    if (rttSamples.length > RTT_WINDOW) rttSamples.shift();
+
+    const deviceMs = Math.round((ack.proc_us || 0) / 1000);
+    logFn(`✓ Ack #${ack.id} ${ack.topic}: ${ack.result} (${rttMs} ms, dispositivo ${deviceMs} ms)`);
+    if (onCommandAck) {
+      onCommandAck({ id: ack.id, topic: ack.topic, result: ack.result, rttMs, deviceMs }, getCommandStats());
+    }
+  }
+
   /**
    * Connect to MQTT broker
+   * topics.cmdAck is optional: when set, commands are sent as envelopes and acked
    */
   function connect(brokerUrl, username, password, topics, deviceId, logFn) {
     if (client) {
@@ -45,6 +180,8 @@ const MQTTModule = (() => {
       client = null;
     }
 
+    ackTopic = topics.cmdAck || null;
+    usageTopic = topics.pumpUsage || null;
     const clientId = "dashboard-" + Math.random().toString(16).slice(2, 10);
 
     logFn(`Device: ${deviceId}`);
@@ -106,6 +243,26 @@ const MQTTModule = (() => {
         }
       });
 
+      if (ackTopic) {
+        client.subscribe(ackTopic, { qos: 0 }, (err) => {
+          if (!err) {
+            logFn("✓ Suscripto a cmd/ack");
+          } else {
+            logFn("✗ Error suscripción ack: " + err.message);
+          }
+        });
+      }
+
+      if (usageTopic) {
+        client.subscribe(usageTopic, { qos: 0 }, (err) => {
+          if (!err) {
+            logFn("✓ Suscripto a pump/usage");
+          } else {
+            logFn("✗ Error suscripción usage: " + err.message);
+          }
+        });
+      }
+
       if (onConnected) onConnected();
     });
 
@@ -134,19 +291,24 @@ const MQTTModule = (() => {
     // Message received
     client.on("message", (topic, payload) => {
       const msg = payload.toString().trim();
-      const msgUpper = msg.toUpperCase();
-      
+
       if (topic === topics.pumpState) {
-        logFn(`Pump estado: ${msgUpper}`);
-        if (msgUpper === "ON" || msgUpper === "OFF") {
-          pumpState = msgUpper;
-          if (onPumpStateChange) onPumpStateChange(msgUpper);
+        const { value, ts } = parseState(msg, "state");
+        const state = String(value).toUpperCase();
+        if (isStale(topic, ts)) return;
+        logFn(`Pump estado: ${state}`);
+        if (state === "ON" || state === "OFF") {
+          pumpState = state;
+          if (onPumpStateChange) onPumpStateChange(state);
         }
       } else if (topic === topics.valveState) {
-        logFn(`Valve modo: ${msg}`);
-        if (msg === "1" || msg === "2") {
-          valveMode = msg;
-          if (onValveStateChange) onValveStateChange(msg);
+        const { value, ts } = parseState(msg, "mode");
+        const mode = String(value);
+        if (isStale(topic, ts)) return;
+        logFn(`Valve modo: ${mode}`);
+        if (mode === "1" || mode === "2") {
+          valveMode = mode;
+          if (onValveStateChange) onValveStateChange(mode);
         }
       } else if (topic === topics.wifiState) {
         try {
@@ -165,13 +327,24 @@ const MQTTModule = (() => {
           logFn(`✗ Error parseando Timer status: ${e.message}`);
         }
       } else if (topic === topics.tempState) {
-        const temperature = parseFloat(msg);
+        const { value, ts } = parseState(msg, "value");
+        if (isStale(topic, ts)) return;
+        const temperature = parseFloat(value);
         if (!isNaN(temperature)) {
           logFn(`Temperatura: ${temperature.toFixed(1)}°C`);
           if (onTemperatureChange) onTemperatureChange(temperature);
         } else {
           logFn(`✗ Error parseando temperatura: ${msg}`);
         }
+      } else if (topic === ackTopic) {
+        handleAck(msg, logFn);
+      } else if (topic === usageTopic) {
+        try {
+          const usage = JSON.parse(msg);
+          if (onPumpUsage) onPumpUsage(usage);
+        } catch (_) {
+          logFn(`✗ Error parseando uso de bomba: ${msg}`);
+        }
       }
     });
   }
@@ -190,6 +363,7 @@ const MQTTModule = (() => {
 
   /**
    * Publish a command to MQTT
+   * Commands to .../set topics are wrapped in an ack envelope when cmd/ack is subscribed
    * @param {string} command - "ON"/"OFF" for pump, "1"/"2" for valve
    * @param {string} topic - Topic to publish to
    * @param {Function} logFn - Function to call for logging
@@ -200,7 +374,9 @@ const MQTTModule = (() => {
       return;
     }
 
-    client.publish(topic, command, { qos: 0 }, (err) => {
+    const payload = (ackTopic && topic.endsWith("/set")) ? wrapCommand(command, topic) : command;
+
+    client.publish(topic, payload, { qos: 0 }, (err) => {
       if (err) {
         logFn(`✗ Publish error: ${err.message}`);
       } else {
@@ -218,9 +394,12 @@ const MQTTModule = (() => {
 
   return {
     onEvents,
+    onAck,
+    onUsage,
     connect,
     disconnect,
     publish,
     isConnected,
+    getCommandStats,
   };
 })();
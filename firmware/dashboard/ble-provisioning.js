@@ -1,31 +1,67 @@
 /**
  * ESP32 Pool Controller - BLE Provisioning Module
  * Web Bluetooth API integration for WiFi credential provisioning
- * 
+ *
  * Usage:
  * 1. Include this script in your dashboard
  * 2. Call ESP32BLEProvisioning.provision() when user clicks "Add Device"
  * 3. Handle success/error callbacks
+ *
+ * Wire protocol (v1) - binary frames over one RX/TX characteristic pair:
+ *   [version:1][opcode:1][length:2 LE][TLV records][crc16:2 LE]
+ *   TLV record = [type:1][len:1][value]
+ *   CRC = CRC-16/CCITT-FALSE over everything before it
+ * Must match firmware/src/ble_provisioning.cpp
  */
 
 const ESP32BLEProvisioning = {
   // BLE Service & Characteristic UUIDs (must match ESP32 firmware)
   SERVICE_UUID: '4fafc201-1fb5-459e-8fcc-c5c9c331914b',
-  SSID_CHAR_UUID: 'beb5483e-36e1-4688-b7f5-ea07361b26a8',
-  PASSWORD_CHAR_UUID: 'cba1d466-344c-4be3-ab3f-189f80dd7518',
-  STATUS_CHAR_UUID: '8d8218b6-97bc-4527-a8db-13094ac06b1d',
-  NETWORKS_CHAR_UUID: 'fa87c0d0-afac-11de-8a39-0800200c9a66',
-  COMMAND_CHAR_UUID: '8b9d68c4-57b8-4b02-bf19-6fd94b62f709',
+  RX_CHAR_UUID: '971810a1-d99e-435a-b6fe-e13cd5981cf6',  // Dashboard -> ESP32 (write)
+  TX_CHAR_UUID: '3ce0b731-d49f-4ccb-b609-3c02000a0aad',  // ESP32 -> dashboard (notify)
+
+  // Protocol constants (must match ESP32 firmware)
+  PROTO_VERSION: 0x01,
+  OP: {
+    SCAN: 0x01,
+    SET_CREDENTIALS: 0x02,
+    CLEAR_WIFI: 0x03,
+    STATUS: 0x80,
+    NETWORKS: 0x81
+  },
+  TLV: {
+    SSID: 0x01,
+    PASSWORD: 0x02,
+    STATUS: 0x10,
+    MTU: 0x11,
+    NETWORK: 0x20,
+    FRAGMENT: 0x21
+  },
+  STATUS: {
+    0x00: 'waiting',
+    0x01: 'connected',
+    0x02: 'credentials_ready',
+    0x03: 'clear_wifi_requested',
+    0x04: 'scan_started',
+    0x05: 'command_queued',
+    0x80: 'error_checksum',
+    0x81: 'error_version',
+    0x82: 'error_malformed',
+    0x83: 'error_unknown_opcode',
+    0x84: 'error_busy',
+    0x85: 'error_not_provisioning'
+  },
+  RESPONSE_TIMEOUT_MS: 3000,   // Status replies (credentials, clear)
+  SCAN_TIMEOUT_MS: 15000,      // Full WiFi scan on the device
 
   // State
   device: null,
   server: null,
   service: null,
-  ssidCharacteristic: null,
-  passwordCharacteristic: null,
-  statusCharacteristic: null,
-  networksCharacteristic: null,
-  commandCharacteristic: null,
+  rxCharacteristic: null,
+  txCharacteristic: null,
+  mtu: 23,
+  pending: null,       // { opcode, resolve, reject, timer, networks }
 
   /**
    * Check if Web Bluetooth is supported
@@ -50,20 +86,19 @@ const ESP32BLEProvisioning = {
     }
 
     try {
-      console.log('[BLE] Scanning for ESP32 Pool devices...');
+      console.log('[BLE] Scanning for Smart Pool devices...');
 
       // Request device with our service UUID filter
       this.device = await navigator.bluetooth.requestDevice({
         filters: [
-          { namePrefix: 'ESP32-Pool' },
-          { services: [this.SERVICE_UUID] }
+          { namePrefix: 'Controlador Smart Pool' }
         ],
         optionalServices: [this.SERVICE_UUID]
       });
 
       console.log(`[BLE] Found device: ${this.device.name}`);
 
-      // Connect to GATT server
+      // Connect to GATT server (browser negotiates the ATT MTU automatically)
       console.log('[BLE] Connecting to GATT server...');
       this.server = await this.device.gatt.connect();
       console.log('[BLE] ✓ Connected to GATT server');
@@ -72,30 +107,19 @@ const ESP32BLEProvisioning = {
       this.service = await this.server.getPrimaryService(this.SERVICE_UUID);
       console.log('[BLE] ✓ Got provisioning service');
 
-      // Get characteristics
-      this.ssidCharacteristic = await this.service.getCharacteristic(this.SSID_CHAR_UUID);
-      this.passwordCharacteristic = await this.service.getCharacteristic(this.PASSWORD_CHAR_UUID);
-      this.statusCharacteristic = await this.service.getCharacteristic(this.STATUS_CHAR_UUID);
-      // Optional characteristics used by advanced flows (scan / clear commands)
+      // Get characteristic pair
       try {
-        this.networksCharacteristic = await this.service.getCharacteristic(this.NETWORKS_CHAR_UUID);
-      } catch (err) {
-        console.warn('[BLE] Networks characteristic not found; WiFi scan over BLE will be disabled', err);
+        this.rxCharacteristic = await this.service.getCharacteristic(this.RX_CHAR_UUID);
+        this.txCharacteristic = await this.service.getCharacteristic(this.TX_CHAR_UUID);
+      } catch (e) {
+        throw new Error('Firmware incompatible o caché GATT antigua. Actualiza el firmware o borra el dispositivo desde Configuración → Bluetooth.');
       }
+      console.log('[BLE] ✓ Got RX/TX characteristics');
 
-      try {
-        this.commandCharacteristic = await this.service.getCharacteristic(this.COMMAND_CHAR_UUID);
-      } catch (err) {
-        console.warn('[BLE] Command characteristic not found; remote commands like clear_wifi will be disabled', err);
-      }
-
-      console.log('[BLE] ✓ Got all characteristics');
-
-      // Subscribe to status notifications
-      await this.statusCharacteristic.startNotifications();
-      this.statusCharacteristic.addEventListener('characteristicvaluechanged', (event) => {
-        const value = new TextDecoder().decode(event.target.value);
-        console.log(`[BLE] Status update: ${value}`);
+      // Subscribe to protocol frames from the device
+      await this.txCharacteristic.startNotifications();
+      this.txCharacteristic.addEventListener('characteristicvaluechanged', (event) => {
+        this.handleFrame(event.target.value);
       });
 
       return true;
@@ -107,46 +131,224 @@ const ESP32BLEProvisioning = {
   },
 
   /**
-   * Send WiFi credentials to ESP32 with automatic retry on failure
-   * @param {string} ssid - WiFi network name
-   * @param {string} password - WiFi password
-   * @param {number} maxRetries - Maximum retry attempts (default: 3)
-   * @returns {Promise<boolean>} true if sent successfully
+   * CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF)
+   * @param {Uint8Array} bytes
+   * @returns {number} 16-bit CRC
    */
-  async sendCredentials(ssid, password, maxRetries = 3) {
-    if (!this.server || !this.server.connected) {
-      throw new Error('Not connected to device. Call connect() first.');
+  crc16(bytes) {
+    let crc = 0xFFFF;
+    for (const b of bytes) {
+      crc ^= b << 8;
+      for (let bit = 0; bit < 8; bit++) {
+        crc = (crc & 0x8000) ? ((crc << 1) ^ 0x1021) & 0xFFFF : (crc << 1) & 0xFFFF;
+      }
     }
+    return crc;
+  },
 
-    for (let attempt = 1; attempt <= maxRetries; attempt++) {
-      try {
-        console.log(`[BLE] Sending SSID: ${ssid} (attempt ${attempt}/${maxRetries})`);
-        const ssidEncoder = new TextEncoder();
-        await this.ssidCharacteristic.writeValue(ssidEncoder.encode(ssid));
-        console.log('[BLE] ✓ SSID sent');
-
-        // Small delay between writes
-        await new Promise(resolve => setTimeout(resolve, 100));
-
-        console.log('[BLE] Sending password...');
-        const passwordEncoder = new TextEncoder();
-        await this.passwordCharacteristic.writeValue(passwordEncoder.encode(password));
-        console.log('[BLE] ✓ Password sent');
-
-        return true;
-      } catch (error) {
-        console.warn(`[BLE] Credential send attempt ${attempt} failed:`, error);
-        
-        if (attempt === maxRetries) {
-          console.error(`[BLE] All ${maxRetries} attempts failed`);
-          throw error;
+  /**
+   * Build a protocol frame
+   * @param {number} opcode - Frame opcode
+   * @param {Array<[number, Uint8Array]>} tlvs - TLV records as [type, value]
+   * @returns {Uint8Array} Encoded frame
+   */
+  encodeFrame(opcode, tlvs = []) {
+    const payloadLen = tlvs.reduce((n, [, value]) => n + 2 + value.length, 0);
+    const frame = new Uint8Array(4 + payloadLen + 2);
+    frame[0] = this.PROTO_VERSION;
+    frame[1] = opcode;
+    frame[2] = payloadLen & 0xFF;
+    frame[3] = payloadLen >> 8;
+
+    let pos = 4;
+    for (const [type, value] of tlvs) {
+      frame[pos++] = type;
+      frame[pos++] = value.length;
+      frame.set(value, pos);
+      pos += value.length;
+    }
+
+    const crc = this.crc16(frame.subarray(0, pos));
+    frame[pos++] = crc & 0xFF;
+    frame[pos] = crc >> 8;
+    return frame;
+  },
+
+  /**
+   * Decode and validate a protocol frame
+   * @param {DataView} view - Raw notification value
+   * @returns {{opcode: number, tlvs: Array<[number, Uint8Array]>}|null} null if invalid
+   */
+  decodeFrame(view) {
+    const bytes = new Uint8Array(view.buffer, view.byteOffset, view.byteLength);
+    if (bytes.length < 6 || bytes[0] !== this.PROTO_VERSION) return null;
+
+    const payloadLen = bytes[2] | (bytes[3] << 8);
+    if (payloadLen + 6 !== bytes.length) return null;
+
+    const crc = bytes[bytes.length - 2] | (bytes[bytes.length - 1] << 8);
+    if (this.crc16(bytes.subarray(0, bytes.length - 2)) !== crc) return null;
+
+    const tlvs = [];
+    let pos = 4;
+    const end = 4 + payloadLen;
+    while (pos + 2 <= end) {
+      const type = bytes[pos];
+      const len = bytes[pos + 1];
+      if (pos + 2 + len > end) return null;
+      tlvs.push([type, bytes.slice(pos + 2, pos + 2 + len)]);
+      pos += 2 + len;
+    }
+    return { opcode: bytes[1], tlvs };
+  },
+
+  /**
+   * Dispatch a frame received on the TX characteristic
+   * Resolves the pending request when its final frame arrives
+   */
+  handleFrame(view) {
+    const frame = this.decodeFrame(view);
+    if (!frame) {
+      console.warn('[BLE] Dropped invalid frame');
+      return;
+    }
+
+    if (frame.opcode === this.OP.STATUS) {
+      let status = 'unknown';
+      for (const [type, value] of frame.tlvs) {
+        if (type === this.TLV.STATUS) status = this.STATUS[value[0]] || `0x${value[0].toString(16)}`;
+        if (type === this.TLV.MTU) this.mtu = value[0] | (value[1] << 8);
+      }
+      console.log(`[BLE] Status update: ${status}`);
+      this.onStatus(status);
+      return;
+    }
+
+    if (frame.opcode === this.OP.NETWORKS && this.pending && this.pending.opcode === this.OP.SCAN) {
+      let last = false;
+      for (const [type, value] of frame.tlvs) {
+        if (type === this.TLV.FRAGMENT) {
+          last = (value[1] & 0x01) !== 0;
+        } else if (type === this.TLV.NETWORK) {
+          this.pending.networks.push({
+            ssid: new TextDecoder().decode(value.subarray(2)),
+            rssi: (value[0] << 24) >> 24,   // int8
+            open: (value[1] & 0x01) !== 0
+          });
         }
-        
-        // Exponential backoff: 500ms, 1000ms, 2000ms...
-        const backoff = Math.min(500 * Math.pow(2, attempt - 1), 5000);
-        console.log(`[BLE] Retrying in ${backoff}ms...`);
-        await new Promise(resolve => setTimeout(resolve, backoff));
       }
+      if (last) this.settle(null, this.pending.networks);
+    }
+  },
+
+  /**
+   * Route status codes to the pending request
+   */
+  onStatus(status) {
+    if (!this.pending) return;
+
+    if (status.startsWith('error_')) {
+      this.settle(new Error(`El dispositivo rechazó la solicitud (${status})`));
+      return;
+    }
+
+    const expected = {
+      [this.OP.SET_CREDENTIALS]: 'credentials_ready',
+      [this.OP.CLEAR_WIFI]: 'clear_wifi_requested'
+    }[this.pending.opcode];
+
+    if (status === expected) this.settle(null, status);
+  },
+
+  /**
+   * Complete the pending request
+   */
+  settle(error, result) {
+    const pending = this.pending;
+    if (!pending) return;
+    this.pending = null;
+    clearTimeout(pending.timer);
+    if (error) pending.reject(error);
+    else pending.resolve(result);
+  },
+
+  /**
+   * Write a single request frame and wait for its response
+   * @param {number} opcode - Request opcode
+   * @param {Array<[number, Uint8Array]>} tlvs - Request TLVs
+   * @param {number} timeoutMs - Response timeout
+   * @returns {Promise<*>} Response (status string or network list)
+   */
+  async request(opcode, tlvs, timeoutMs) {
+    if (!this.server || !this.server.connected) {
+      throw new Error('Not connected to device. Call connect() first.');
+    }
+    if (this.pending) {
+      throw new Error('Another BLE request is in progress.');
+    }
+
+    const response = new Promise((resolve, reject) => {
+      this.pending = {
+        opcode, resolve, reject, networks: [],
+        timer: setTimeout(() => this.settle(new Error('Tiempo de espera agotado (BLE)')), timeoutMs)
+      };
+    });
+
+    try {
+      await this.rxCharacteristic.writeValueWithResponse(this.encodeFrame(opcode, tlvs));
+    } catch (error) {
+      this.settle(error);
+    }
+    return response;
+  },
+
+  /**
+   * Scan for available WiFi networks
+   * The device streams results as notification frames sized to the negotiated MTU
+   * @returns {Promise<Array>} Array of networks: [{ssid, rssi, open}, ...]
+   */
+  async scanNetworks() {
+    try {
+      console.log('[BLE] Triggering network scan...');
+      const networks = await this.request(this.OP.SCAN, [], this.SCAN_TIMEOUT_MS);
+      console.log(`[BLE] Received ${networks.length} networks (MTU ${this.mtu})`);
+      return networks.sort((a, b) => b.rssi - a.rssi); // Sort by signal strength
+    } catch (error) {
+      console.error('[BLE] Scan error:', error);
+      throw error;
+    }
+  },
+
+  /**
+   * Send WiFi credentials to ESP32
+   * SSID and password travel in a single checksummed write
+   * @param {string} ssid - WiFi network name
+   * @param {string} password - WiFi password
+   * @returns {Promise<boolean>} true if the device accepted the credentials
+   */
+  async sendCredentials(ssid, password) {
+    const encoder = new TextEncoder();
+    const ssidBytes = encoder.encode(ssid);
+    const passwordBytes = encoder.encode(password || '');
+
+    if (ssidBytes.length === 0 || ssidBytes.length > 32) {
+      throw new Error('El SSID debe tener entre 1 y 32 bytes');
+    }
+    if (passwordBytes.length > 63) {
+      throw new Error('La contraseña no puede superar 63 bytes');
+    }
+
+    try {
+      console.log(`[BLE] Sending credentials for: ${ssid}`);
+      await this.request(this.OP.SET_CREDENTIALS, [
+        [this.TLV.SSID, ssidBytes],
+        [this.TLV.PASSWORD, passwordBytes]
+      ], this.RESPONSE_TIMEOUT_MS);
+      console.log('[BLE] ✓ Credentials accepted');
+      return true;
+    } catch (error) {
+      console.error('[BLE] Error sending credentials:', error);
+      throw error;
     }
   },
 
@@ -165,17 +367,32 @@ const ESP32BLEProvisioning = {
    * Clean up state
    */
   cleanup() {
+    this.settle(new Error('BLE desconectado'));
     this.device = null;
     this.server = null;
     this.service = null;
-    this.ssidCharacteristic = null;
-    this.passwordCharacteristic = null;
-    this.statusCharacteristic = null;
-    this.networksCharacteristic = null;
-    this.commandCharacteristic = null;
+    this.rxCharacteristic = null;
+    this.txCharacteristic = null;
+    this.mtu = 23;
   },
 
   /**
+   * Ask the ESP32 to clear stored WiFi credentials
+   */
+  async clearWiFiCredentials() {
+    if (!this.isSupported()) {
+      throw new Error('Web Bluetooth no está disponible en este navegador');
+    }
+
+    // Ensure we are connected
+    if (!this.server || !this.server.connected) {
+      await this.connect();
+    }
+
+    await this.request(this.OP.CLEAR_WIFI, [], this.RESPONSE_TIMEOUT_MS);
+  },
+
+    /**
    * Complete provisioning flow (high-level API)
    * @param {string} ssid - WiFi network name
    * @param {string} password - WiFi password
@@ -186,51 +403,45 @@ const ESP32BLEProvisioning = {
     const { onProgress, onSuccess, onError } = callbacks;
 
     try {
-      // Step 1: Connect to device
-      if (onProgress) onProgress('Scanning for ESP32 devices...');
-      await this.connect();
+      // Step 1: Connect to device (if not already connected)
+      if (!this.server || !this.server.connected) {
+        if (onProgress) onProgress('Buscando dispositivo ESP32...');
+        await this.connect();
+      } else {
+        if (onProgress) onProgress('Usando conexión existente...');
+      }
 
-      // Step 2: Send credentials
-      if (onProgress) onProgress('Sending WiFi credentials...');
+      // Step 2: Send credentials (resolves once the device confirms the frame)
+      if (onProgress) onProgress('Enviando credenciales WiFi...');
       await this.sendCredentials(ssid, password);
 
-      // Step 3: Wait a moment for ESP32 to process
-      if (onProgress) onProgress('ESP32 connecting to WiFi...');
-      await new Promise(resolve => setTimeout(resolve, 3000));
+      // Step 3: ESP32 will disconnect BLE after receiving credentials
+      // We consider this a success - the ESP32 is now connecting to WiFi
+      if (onProgress) onProgress('¡Credenciales enviadas! ESP32 conectando a WiFi...');
 
-      // Step 4: Disconnect
-      this.disconnect();
+      // Disconnect (ESP32 might have already disconnected)
+      try {
+        this.disconnect();
+      } catch (e) {
+        // Ignore disconnect errors - ESP32 may have already disconnected
+        console.log('[BLE] Device already disconnected (expected)');
+      }
 
-      if (onProgress) onProgress('Provisioning complete!');
+      if (onProgress) onProgress('¡Configuración completada!');
       if (onSuccess) onSuccess();
 
-      console.log('[BLE] ✓ Provisioning completed successfully');
+      console.log('[BLE]  Provisioning completed successfully');
     } catch (error) {
       console.error('[BLE] Provisioning failed:', error);
-      this.disconnect();
-      if (onError) onError(error);
-      throw error;
-    }
-  },
-
-  /**
-   * Request the device to forget its stored WiFi credentials
-   * This writes the "clear_wifi" verb to the command characteristic.
-   */
-  async clearWifiCredentials() {
-    if (!this.server || !this.server.connected) {
-      throw new Error('Not connected to device. Call connect() first.');
-    }
 
-    if (!this.commandCharacteristic) {
-      throw new Error(`Command characteristic ${this.COMMAND_CHAR_UUID} not available on this device.`);
-    }
+      // Clean up on error
+      try {
+        this.disconnect();
+      } catch (e) {
+        // Ignore cleanup errors
+      }
 
-    try {
-      await this.commandCharacteristic.writeValue(new TextEncoder().encode('clear_wifi'));
-      console.log('[BLE] ✓ clear_wifi command sent');
-    } catch (error) {
-      console.error('[BLE] Failed to send clear_wifi command:', error);
+      if (onError) onError(error);
       throw error;
     }
   }
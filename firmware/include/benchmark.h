@@ -0,0 +1,80 @@
+/**
+ * @file benchmark.h
+ * @brief Micro-benchmarks for firmware hot paths (BENCHMARK_ENABLED builds and host)
+ *
+ * The hot paths in main.cpp (command dispatch, publish serializers, timer
+ * ticks) depend on the Arduino core, PubSubClient and NVS, so they are
+ * measured on the chip. The platform-independent modules they sit on
+ * (json_parse, msg_pool, mqtt_transport, coalescing_client) are also measured
+ * on the host, where runs are repeatable and need no board:
+ *   pio test -e native -f bench/test_hot_paths
+ *
+ * Each case runs for at least BENCH_MIN_TIME_MS and reports:
+ * - ns/op: wall time per call (esp_timer on the chip, steady_clock on the
+ *   host). Cases marked quiet run with Serial stopped, so a handler that logs
+ *   is not timed at the speed of the UART; the event log is paused during the
+ *   on-device suite, so no case includes a flash write
+ * - allocs/op and bytes/op: heap allocations made by the call. On the chip
+ *   malloc/calloc/realloc are wrapped at link time (see the esp32dev-bench
+ *   environment in platformio.ini) and only the calling task is counted; on
+ *   the host operator new is counted.
+ *
+ * Output is one JSON object per line, prefixed with "BENCH " so it can be
+ * grepped from a monitor log and compared with tools/bench_compare.py:
+ *   BENCH {"suite":"firmware","cpu_mhz":240,"heap_free":182344}
+ *   BENCH {"case":"publish_pump_state","iterations":5120,"ns_per_op":4810,"allocs_per_op":0.00,"bytes_per_op":0.0}
+ *
+ * Flow:
+ * 1. runBenchmarks() in main.cpp builds the BenchCase tables (the hot paths live there)
+ * 2. setup() calls beginBenchmarkSuite(), then runBenchmarkSuite() per group of cases
+ */
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <Arduino.h>
+
+#define BENCH_MIN_TIME_MS       250      // Run each case at least this long
+#define BENCH_MIN_ITERATIONS    16
+#define BENCH_MAX_ITERATIONS    200000
+#define BENCH_OUTPUT_PREFIX     "BENCH "
+#define BENCH_SERIAL_BAUD       115200   // Restored after a quiet case (same as setup())
+
+typedef void (*BenchFunction)(void* context);
+
+/**
+ * One benchmark case
+ */
+struct BenchCase {
+  const char* name;           // snake_case, stable across runs (used to compare)
+  BenchFunction run;          // Called once per iteration
+  void* context;
+  bool quiet;                 // Serial stopped while the case runs (cases that log)
+};
+
+/**
+ * Result of one case
+ */
+struct BenchResult {
+  uint32_t iterations;
+  uint32_t nsPerOp;
+  float allocsPerOp;
+  float bytesPerOp;
+};
+
+/**
+ * Run one case until BENCH_MIN_TIME_MS has elapsed
+ */
+void runBenchmark(const BenchCase& bench, BenchResult* result);
+
+/**
+ * Print the suite header line (CPU clock, free heap)
+ */
+void beginBenchmarkSuite(Print& out);
+
+/**
+ * Run every case and print one result line per case
+ */
+void runBenchmarkSuite(const BenchCase* cases, int count, Print& out);
+
+#endif // BENCHMARK_H
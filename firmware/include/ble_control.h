@@ -0,0 +1,92 @@
+/**
+ * @file ble_control.h
+ * @brief BLE local control service for pump, valve and timer
+ *
+ * Optional GATT service (BLE_CONTROL_ENABLED in config.h) that stays active
+ * alongside WiFi, so the pool can be controlled from a nearby phone when the
+ * broker or internet is unreachable.
+ *
+ * Flow:
+ * 1. Dashboard pairs with the device (passkey BLE_CONTROL_PASSKEY from secrets.h)
+ * 2. Dashboard writes COMMAND frames (target + same payload as the MQTT /set topics)
+ * 3. NimBLE task queues the command and wakes the main loop
+ * 4. Main loop dispatches it through the MQTT command handler
+ * 5. State changes are notified back as STATE frames
+ *
+ * Frames use the binary TLV format described in ble_protocol.h.
+ */
+
+#ifndef BLE_CONTROL_H
+#define BLE_CONTROL_H
+
+#include <Arduino.h>
+
+class NimBLEServer;
+
+#define BLE_CONTROL_MAX_PAYLOAD 64   // Max command payload (timer JSON fits comfortably)
+
+/**
+ * Command targets - each maps to one MQTT command topic
+ */
+enum BLEControlTarget : uint8_t {
+  BLE_TARGET_PUMP         = 0x01,  // TOPIC_PUMP_SET payload (ON/OFF/TOGGLE)
+  BLE_TARGET_VALVE        = 0x02,  // TOPIC_VALVE_SET payload (1/2/TOGGLE)
+  BLE_TARGET_TIMER        = 0x03,  // TOPIC_TIMER_SET payload ({"mode":1,"duration":3600})
+  BLE_TARGET_TEMP_REFRESH = 0x04,  // TOPIC_TEMP_REFRESH (empty payload)
+  BLE_TARGET_STATE        = 0x7F   // Internal: client asked for a state snapshot
+};
+
+/**
+ * Command received over BLE, waiting for the main loop
+ */
+struct BLEControlCommand {
+  uint8_t target;                          // BLEControlTarget
+  uint8_t length;                          // Payload length in bytes
+  byte payload[BLE_CONTROL_MAX_PAYLOAD];   // Not null-terminated
+};
+
+/**
+ * Controller state notified to BLE clients
+ */
+struct BLEControlState {
+  bool pumpOn;
+  uint8_t valveMode;         // 1 (Cascada) or 2 (Eyectores)
+  bool timerActive;
+  uint8_t timerMode;         // 1 or 2
+  uint32_t timerRemaining;   // Seconds
+  uint32_t timerDuration;    // Seconds
+  int16_t temperatureDeci;   // Tenths of °C, INT16_MIN if unavailable
+};
+
+/**
+ * Start the BLE stack with the control service
+ * Call once from setup() before WiFi provisioning
+ * @param passkey 6-digit pairing PIN required to read state or send commands
+ */
+void initBLEControl(uint32_t passkey);
+
+/**
+ * Check if the control service is running
+ */
+bool isBLEControlActive();
+
+/**
+ * Fetch the next queued command (non-blocking, main loop only)
+ * @param cmd Output command
+ * @return true if a command was dequeued
+ */
+bool pollBLEControlCommand(BLEControlCommand* cmd);
+
+/**
+ * Notify controller state to connected clients (main loop only)
+ * @param state Current state
+ * @param force Notify even if nothing changed since the last call
+ */
+void updateBLEControlState(const BLEControlState& state, bool force);
+
+/**
+ * Add the control service to the GATT server (called by startBLEStack())
+ */
+void createBLEControlService(NimBLEServer* server);
+
+#endif // BLE_CONTROL_H
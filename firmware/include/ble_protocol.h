@@ -0,0 +1,122 @@
+/**
+ * @file ble_protocol.h
+ * @brief Binary frame format shared by the BLE provisioning and control services
+ *
+ * Every characteristic value exchanged with the dashboard is one frame:
+ *
+ *   [version:1][opcode:1][length:2 LE][TLV records: length bytes][crc16:2 LE]
+ *
+ * Each TLV record is [type:1][len:1][value:len]. The CRC is CRC-16/CCITT-FALSE
+ * over everything before it. Service-specific opcodes and TLV types live in
+ * ble_provisioning.cpp / ble_control.cpp and are mirrored in docs/js.
+ */
+
+#ifndef BLE_PROTOCOL_H
+#define BLE_PROTOCOL_H
+
+#include <Arduino.h>
+
+class NimBLEServer;
+class NimBLECharacteristic;
+
+// ==================== Frame Layout ====================
+#define PROTO_VERSION       0x01
+#define PROTO_HEADER_SIZE   4
+#define PROTO_CRC_SIZE      2
+#define PROTO_OVERHEAD      (PROTO_HEADER_SIZE + PROTO_CRC_SIZE)
+#define PROTO_MAX_FRAME     512   // Max characteristic value length (long writes)
+
+// ==================== Common Opcodes / TLVs ====================
+#define OP_STATUS           0x80  // ESP32 -> dashboard: TLV_STATUS (+ optional TLV_MTU)
+#define TLV_STATUS          0x10  // [code:1]
+#define TLV_MTU             0x11  // [mtu:2 LE]
+
+// Status codes (TLV_STATUS) - 0x00-0x7F informational, 0x80-0xFE errors
+#define STATUS_WAITING              0x00
+#define STATUS_CONNECTED            0x01  // With TLV_MTU: on TX subscribe and on a later MTU change
+#define STATUS_CREDENTIALS_READY    0x02
+#define STATUS_CLEAR_WIFI_REQUESTED 0x03
+#define STATUS_SCAN_STARTED         0x04
+#define STATUS_COMMAND_QUEUED       0x05
+#define STATUS_ERR_CHECKSUM         0x80
+#define STATUS_ERR_VERSION          0x81
+#define STATUS_ERR_MALFORMED        0x82
+#define STATUS_ERR_UNKNOWN_OPCODE   0x83
+#define STATUS_ERR_BUSY             0x84  // Previous request not yet consumed
+#define STATUS_ERR_NOT_PROVISIONING 0x85  // Provisioning request outside provisioning mode
+#define FRAME_OK                    0xFF  // Internal: frame passed validation
+
+/**
+ * Outgoing frame being assembled in a fixed buffer
+ */
+struct FrameWriter {
+  uint8_t buf[PROTO_MAX_FRAME];
+  size_t len;
+  size_t limit;  // Max frame size for this transfer (MTU bound)
+};
+
+/**
+ * CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF), same as dashboard JS
+ */
+uint16_t protoCrc16(const uint8_t* data, size_t length);
+
+/**
+ * Start a frame
+ * @param limit Maximum total frame size (use protoMaxNotifyFrame() for notifications)
+ */
+void frameBegin(FrameWriter& f, uint8_t opcode, size_t limit);
+
+/**
+ * Append a TLV record
+ * @return false if the record does not fit (frame left unchanged)
+ */
+bool frameAddTLV(FrameWriter& f, uint8_t type, const uint8_t* value, uint8_t valueLen);
+
+/**
+ * Fill in length and CRC
+ * @return Total frame size
+ */
+size_t frameFinish(FrameWriter& f);
+
+/**
+ * Validate version, length and CRC of an incoming frame
+ * @return FRAME_OK or an error status code
+ */
+uint8_t frameValidate(const uint8_t* data, size_t len);
+
+/**
+ * Finish a frame and notify it on a characteristic (also kept as its readable value)
+ */
+void frameSend(NimBLECharacteristic* characteristic, FrameWriter& f);
+
+/**
+ * Notify a single status code on a characteristic
+ */
+void frameSendStatus(NimBLECharacteristic* characteristic, uint8_t code);
+
+/**
+ * Largest frame that fits in a single notification at the negotiated MTU
+ */
+size_t protoMaxNotifyFrame();
+
+// ==================== Shared BLE Stack ====================
+
+/**
+ * Initialize NimBLE, the GATT server and all enabled services, and start advertising
+ * Safe to call more than once (no-op when already running)
+ * @return GATT server instance
+ */
+NimBLEServer* startBLEStack();
+
+/**
+ * Check if the NimBLE stack is running
+ */
+bool isBLEStackActive();
+
+/**
+ * Wake the task that started the stack (see waitForBLEEvent())
+ * Called from NimBLE callbacks after publishing an event for the main loop
+ */
+void signalBLEEvent();
+
+#endif // BLE_PROTOCOL_H
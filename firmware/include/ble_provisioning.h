@@ -8,16 +8,30 @@
  * 
  * Flow:
  * 1. ESP32 boots and starts BLE advertising (if no WiFi credentials)
- * 2. Dashboard uses Web Bluetooth API to scan and connect
- * 3. Dashboard writes WiFi SSID and password to BLE characteristics
+ * 2. Dashboard uses Web Bluetooth API to scan and connect (MTU/PHY negotiated)
+ * 3. Dashboard writes SSID + password in one checksummed frame to the RX characteristic
  * 4. ESP32 saves credentials to NVS and attempts WiFi connection
  * 5. BLE is disabled after successful WiFi connection (saves power)
+ *
+ * Frames use the versioned binary TLV format described in ble_protocol.h.
+ * Opcodes and TLV types are listed in ble_provisioning.cpp and mirrored in
+ * docs/js/ble-provisioning.js.
+ *
+ * When BLE_CONTROL_ENABLED is set, the stack is shared with the local control
+ * service (ble_control.h) and keeps running after provisioning stops.
  */
 
 #ifndef BLE_PROVISIONING_H
 #define BLE_PROVISIONING_H
 
 #include <Arduino.h>
+#include "wifi_survey.h"   // WiFiNetworkInfo, cached scan results
+
+// Maximum number of networks reported by a single scan
+#define BLE_MAX_NETWORKS 20
+
+// Max time a network list request waits for the first survey scan (ms)
+#define BLE_SCAN_WAIT    8000
 
 /**
  * Initialize BLE provisioning service
@@ -37,6 +51,16 @@ void stopBLEProvisioning();
  */
 bool isBLEProvisioningActive();
 
+/**
+ * Block the calling task until a BLE event arrives or the timeout expires
+ * Events (credentials received, clear WiFi requested) are signaled from the
+ * NimBLE task via a task notification, so the caller wakes within milliseconds.
+ * Must be called from the task that called initBLEProvisioning().
+ * @param timeoutMs Maximum time to block in milliseconds
+ * @return true if an event was signaled, false on timeout
+ */
+bool waitForBLEEvent(uint32_t timeoutMs);
+
 /**
  * Check if new WiFi credentials were received via BLE
  * @return true if credentials are ready to be used
@@ -58,11 +82,15 @@ bool getBLEWiFiSSID(char* ssid);
 bool getBLEWiFiPassword(char* password);
 
 /**
- * Scan available WiFi networks and return JSON array
- * @return JSON string with network list: [{"ssid":"NETWORK1","rssi":-50,"open":false},...]
- * Call this in response to a scan request from the dashboard
+ * List available WiFi networks (from the survey cache, see wifi_survey.h)
+ * Call this in response to a scan request from the dashboard. A cached list
+ * is returned at once (a stale one also schedules a new scan); only an empty
+ * cache waits, up to BLE_SCAN_WAIT, for the loop to finish a scan.
+ * @param networks Output array (hidden networks are skipped, one entry per SSID)
+ * @param maxNetworks Capacity of the output array
+ * @return Number of networks stored (0 if none found or scan failed)
  */
-String scanWiFiNetworks();
+int scanWiFiNetworks(WiFiNetworkInfo* networks, int maxNetworks);
 
 /**
  * Clear the received credentials flag
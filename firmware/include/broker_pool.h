@@ -0,0 +1,154 @@
+/**
+ * @file broker_pool.h
+ * @brief MQTT broker endpoints with latency-based selection and failover
+ *
+ * Up to three endpoints (primary, secondary, LAN), each with its own port,
+ * TLS flag and credentials. The list starts from config.h/secrets.h and can
+ * be replaced at runtime with TOPIC_BROKER_SET; it is kept in NVS together
+ * with the endpoint last connected to, which is tried first after a reboot.
+ *
+ * Selection:
+ * - Failover: after BROKER_MAX_FAILURES failed connects in a row an endpoint
+ *   is skipped for BROKER_RETRY_BACKOFF and the next best one is used
+ * - Probing: while connected, every BROKER_PROBE_INTERVAL each endpoint gets a
+ *   TCP connect (DNS + handshake) timed; results are smoothed per endpoint
+ * - Failback: when a reachable endpoint probes BROKER_SWITCH_MARGIN % faster
+ *   than the active one (or the active one stops answering), the caller is
+ *   told to reconnect, which then lands on the faster endpoint
+ *
+ * LAN-first (MQTT_MODE other than MQTT_MODE_CLOUD, see config.h):
+ * - An available LAN endpoint is always selected; the cloud endpoints are
+ *   the fallback, and the session returns to the LAN broker as soon as a
+ *   probe finds it answering again
+ * - Without a LAN endpoint in config.h or TOPIC_BROKER_SET, the LAN broker is
+ *   discovered over mDNS as _secure-mqtt._tcp and only used over TLS with a
+ *   certificate the trust store verifies. A plain _mqtt._tcp broker would
+ *   get the whole command surface from any host that advertises one, so it
+ *   is only used when pinned. The result lives in RAM only and is looked up
+ *   again while it keeps failing
+ * - MQTT_MODE_LAN_DUAL: selectCloudBroker() picks the best cloud endpoint
+ *   for the second session
+ *
+ * Flow:
+ * 1. setup() calls initBrokerPool() after initStateStore()
+ * 2. startNetworkServices() calls discoverLanBroker() before the first connect
+ * 3. connectMqtt() asks selectBroker() for the endpoint to use and reports
+ *    the outcome with reportBrokerConnect()
+ * 4. loop() calls probeBrokers() and discoverLanBroker() and reconnects when
+ *    either returns true
+ */
+
+#ifndef BROKER_POOL_H
+#define BROKER_POOL_H
+
+#include <Arduino.h>
+#include "state_store.h"
+
+#define BROKER_MAX_ENDPOINTS    STATE_MAX_BROKERS
+#define BROKER_MAX_FAILURES     2        // Consecutive failed connects before failing over
+#define BROKER_RETRY_BACKOFF    300000   // Failed endpoint skipped for this long (ms)
+#define BROKER_FIRST_PROBE      60000    // First latency probe after boot (ms)
+#define BROKER_PROBE_INTERVAL   600000   // Latency probe of every endpoint (ms)
+#define BROKER_PROBE_TIMEOUT    2000     // TCP connect timeout per probe (ms)
+#define BROKER_SWITCH_MARGIN    30       // Switch only to an endpoint this much faster (%)
+#define BROKER_DISCOVERY_INTERVAL 600000 // mDNS lookup while the LAN broker is missing or failing (ms)
+
+/**
+ * Endpoint slots (fixed roles)
+ */
+enum BrokerSlot : uint8_t {
+  BROKER_PRIMARY   = 0,
+  BROKER_SECONDARY = 1,
+  BROKER_LAN       = 2
+};
+
+/**
+ * Runtime view of one endpoint (for state/diagnostics)
+ */
+struct BrokerStatus {
+  const char* role;        // "primary", "secondary", "lan"
+  const char* host;
+  uint16_t port;
+  bool tls;
+  bool active;             // Endpoint in use (or being connected to)
+  bool cloud;              // Endpoint of the second (cloud) session
+  bool discovered;         // LAN endpoint found over mDNS
+  bool reachable;          // Last probe answered
+  uint32_t probeMs;        // Smoothed probe latency, 0 = not probed yet
+  uint32_t connectMs;      // Last successful TCP + TLS + MQTT CONNECT time
+  uint8_t failures;        // Consecutive failed connects
+  uint32_t connects;       // Successful connects since boot
+};
+
+/**
+ * Load endpoints from NVS, or the compile-time defaults
+ */
+void initBrokerPool();
+
+/**
+ * Pick the endpoint for the next connect attempt
+ * @return Endpoint (stays valid until the list is changed)
+ */
+const PersistedBroker& selectBroker();
+
+/**
+ * Report the result of a connect attempt to the endpoint from selectBroker()
+ * @param ok true if the MQTT session is up
+ * @param elapsedMs Time the attempt took
+ */
+void reportBrokerConnect(bool ok, uint32_t elapsedMs);
+
+/**
+ * Pick the endpoint for the second (cloud) session (MQTT_MODE_LAN_DUAL)
+ * @return Best primary/secondary endpoint, nullptr if none is configured
+ */
+const PersistedBroker* selectCloudBroker();
+
+/**
+ * Report the result of a connect attempt to the endpoint from selectCloudBroker()
+ */
+void reportCloudConnect(bool ok, uint32_t elapsedMs);
+
+/**
+ * The second session was closed (its endpoint is no longer reported as in use)
+ */
+void releaseCloudBroker();
+
+/**
+ * Look up the LAN broker over mDNS when due (blocking, a few seconds)
+ * Only in the LAN modes and while no LAN endpoint is configured.
+ * @return true if the LAN endpoint changed: reconnect if connected
+ */
+bool discoverLanBroker();
+
+/**
+ * Probe endpoint latency when due (blocking, up to BROKER_PROBE_TIMEOUT per endpoint)
+ * @return true if another endpoint should be used: disconnect and connect again
+ */
+bool probeBrokers();
+
+/**
+ * Replace or clear one endpoint (persisted immediately)
+ * @param slot BrokerSlot
+ * @param endpoint New endpoint, host "" to clear the slot
+ * @return false if the slot is invalid or the last endpoint would be cleared
+ */
+bool setBrokerEndpoint(uint8_t slot, const PersistedBroker& endpoint);
+
+/**
+ * Slot in use (or being connected to)
+ */
+uint8_t activeBrokerSlot();
+
+/**
+ * Slot of the second session's endpoint (valid after selectCloudBroker())
+ */
+uint8_t cloudBrokerSlot();
+
+/**
+ * Get the runtime view of one endpoint
+ * @return false if the slot is unused
+ */
+bool getBrokerStatus(uint8_t slot, BrokerStatus* status);
+
+#endif // BROKER_POOL_H
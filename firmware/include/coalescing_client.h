@@ -0,0 +1,125 @@
+/**
+ * @file coalescing_client.h
+ * @brief Client wrapper that batches small socket writes into one TLS record
+ *
+ * WiFiClientSecure turns every write() into its own TLS record: for a burst of
+ * small publishes (state + acks after a command, the initial state after a
+ * reconnect) that means a record header, MAC/tag and usually a TCP segment per
+ * MQTT packet, plus one encryption pass each.
+ *
+ * CoalescingClient sits between PubSubClient and the TLS client and holds
+ * outgoing bytes in a buffer until:
+ * - flushWrites() is called (mqtt_transport does this at the end of every drain)
+ * - the buffer is full
+ * - PubSubClient reads (CONNACK, incoming messages), so nothing it waits for
+ *   can be stuck in the buffer
+ * - the connection is closed (disconnect() sends DISCONNECT, then flush())
+ *
+ * A failed flush stops the socket: part of a packet may have been written, so
+ * the session cannot continue and PubSubClient reconnects as usual.
+ *
+ * Inbound bytes are scanned for PUBACK packets on their way to PubSubClient,
+ * which reads and ignores them. The packet IDs are handed to the handler set
+ * with onPuback(), so mqtt_transport can track its QoS 1 publishes.
+ *
+ * Build with -DMQTT_COALESCE_WRITES=0 to pass writes straight through; the
+ * counters keep running, so diagnostics compare both modes on the device.
+ * The saving is in records (and writeUs), not bytes: every record adds its
+ * header, nonce and tag on the wire and one encryption setup. The host suite
+ * test/bench/test_coalesced_writes checks records per burst in both modes
+ * (env:native and env:native-passthrough).
+ */
+
+#ifndef COALESCING_CLIENT_H
+#define COALESCING_CLIENT_H
+
+#include <Arduino.h>
+#include <Client.h>
+
+#ifndef MQTT_COALESCE_WRITES
+#define MQTT_COALESCE_WRITES    1     // 0 = one TLS record per MQTT write (for comparison)
+#endif
+
+#ifndef MQTT_COALESCE_BUFFER
+#define MQTT_COALESCE_BUFFER    1024  // Max bytes per coalesced record (mbedTLS allows up to 4096)
+#endif
+
+/**
+ * Write metrics (since boot)
+ */
+struct CoalescingStats {
+  uint32_t writes;        // write() calls from PubSubClient (packets and packet pieces)
+  uint32_t records;       // Writes handed to the TLS client (one TLS record each)
+  uint32_t bytes;         // Plaintext handed to the TLS client (the same in both modes)
+  uint32_t writeUs;       // Time spent inside TLS writes (encryption + socket)
+  uint32_t failed;        // Flushes that could not write the whole buffer
+  uint16_t largest;       // Largest single record written (bytes)
+};
+
+/**
+ * Called for every PUBACK received (from PubSubClient's read, main loop)
+ */
+typedef void (*PubackHandler)(uint16_t packetId, void* context);
+
+class CoalescingClient : public Client {
+ public:
+  explicit CoalescingClient(Client& inner);
+
+  /**
+   * Switch the underlying client (e.g. TLS or plain TCP per broker)
+   * Stops the current one; call while disconnected.
+   */
+  void setInner(Client& client);
+
+  /**
+   * Write buffered bytes as one record
+   * @return false if the write failed (the socket has been stopped)
+   */
+  bool flushWrites();
+
+  /**
+   * Report PUBACK packet IDs to a handler
+   */
+  void onPuback(PubackHandler handler, void* context);
+
+  /**
+   * Get write metrics
+   */
+  void getStats(CoalescingStats* out) const;
+
+  // Client
+  int connect(IPAddress ip, uint16_t port) override;
+  int connect(const char* host, uint16_t port) override;
+  size_t write(uint8_t b) override;
+  size_t write(const uint8_t* buf, size_t size) override;
+  int available() override;
+  int read() override;
+  int read(uint8_t* buf, size_t size) override;
+  int peek() override;
+  void flush() override;
+  void stop() override;
+  uint8_t connected() override;
+  operator bool() override;
+
+ private:
+  size_t writeThrough(const uint8_t* buf, size_t size);
+  void scanInbound(const uint8_t* buf, size_t size);
+  void resetInbound();
+
+  Client* inner;
+  uint8_t buffer[MQTT_COALESCE_BUFFER];
+  size_t used = 0;
+  CoalescingStats stats = {};
+
+  // Inbound packet boundaries (fixed header, remaining length, body)
+  PubackHandler pubackHandler = nullptr;
+  void* pubackContext = nullptr;
+  uint8_t inState = 0;
+  uint8_t inType = 0;
+  uint32_t inRemaining = 0;
+  uint32_t inMultiplier = 1;
+  uint32_t inPos = 0;
+  uint16_t inPacketId = 0;
+};
+
+#endif // COALESCING_CLIENT_H
@@ -3,6 +3,29 @@
 #define MQTT_HOST "1f1fff2e23204fa08aef0663add440bc.s1.eu.hivemq.cloud"
 #define MQTT_PORT 8883
 
+// Brokers alternativos (opcionales, ver broker_pool.h). Puerto 1883 = sin TLS.
+// Credenciales: MQTT_USER_2/MQTT_PASS_2 y MQTT_LAN_USER/MQTT_LAN_PASS en secrets.h
+// (por defecto el secundario usa MQTT_USER/MQTT_PASS y el LAN ninguna).
+// También se configuran en runtime con TOPIC_BROKER_SET (se guardan en NVS).
+// #define MQTT_HOST_2 "xxxxxxxx.s1.eu.hivemq.cloud"
+// #define MQTT_PORT_2 8883
+// #define MQTT_LAN_HOST "192.168.1.10"
+// #define MQTT_LAN_PORT 1883
+
+// Modo de conexión (ver broker_pool.h y mqtt_routes.h):
+// MQTT_MODE_CLOUD      = un solo broker elegido por latencia (HiveMQ por defecto)
+// MQTT_MODE_LAN_BRIDGE = broker LAN primero (MQTT_LAN_HOST o descubierto por mDNS, solo TLS);
+//                        la nube la alcanza el bridge del broker LAN (ver README)
+// MQTT_MODE_LAN_DUAL   = broker LAN primero + segunda sesión a la nube con telemetría
+//                        reducida (reglas en mqtt_routes.cpp; ~40KB de RAM más por el TLS)
+// En los modos LAN, si el broker LAN no responde se usa la nube directamente.
+#define MQTT_MODE_CLOUD      0
+#define MQTT_MODE_LAN_BRIDGE 1
+#define MQTT_MODE_LAN_DUAL   2
+#ifndef MQTT_MODE
+#define MQTT_MODE MQTT_MODE_CLOUD
+#endif
+
 // Identidad del dispositivo (te ayuda a ordenar topics)
 #define DEVICE_ID "esp32-pool-01"
 
@@ -16,17 +39,54 @@
 // --- Inputs: Sensors ---
 #define TEMP_SENSOR_PIN     4   // DS18B20 temperature probe (OneWire) - 4.7kΩ pull-up to 3.3V (changed from GPIO 21 - was damaged during soldering)
 
+// ==================== Hora Local ====================
+// Desplazamiento respecto de UTC (minutos). Define el límite de día de los
+// contadores de uso de la bomba (pump_usage.h). Argentina: UTC-3, sin horario de verano.
+#define LOCAL_UTC_OFFSET_MIN  (-180)
+
+// ==================== BLE Local Control ====================
+// Optional GATT service for pump/valve/timer control without the cloud broker.
+// Keeps BLE running alongside WiFi (~30-50KB RAM). Requires BLE_CONTROL_PASSKEY in secrets.h.
+#ifndef BLE_CONTROL_ENABLED
+#define BLE_CONTROL_ENABLED 0
+#endif
+
+// ==================== Local HTTP API ====================
+// HTTP/JSON control on the LAN (local_api.h), advertised over mDNS as DEVICE_ID.local.
+// Requires LOCAL_API_TOKEN in secrets.h (sent as "Authorization: Bearer <token>").
+#ifndef LOCAL_API_ENABLED
+#define LOCAL_API_ENABLED 0
+#endif
+
+// ==================== Benchmarks ====================
+// Runs the hot-path benchmark suite at the end of setup() (benchmark.h).
+// Build with the esp32dev-bench environment, which also wraps malloc to count allocations.
+#ifndef BENCHMARK_ENABLED
+#define BENCHMARK_ENABLED 0
+#endif
+
 // ==================== MQTT Topics ====================
+// Todo estado/evento publicado es JSON con "ts": epoch ms del evento en el
+// dispositivo (time_sync.h); se omite mientras el reloj no está sincronizado
 
 // Pump Control:
 // TOPIC_PUMP_SET   = dashboard publica comando (ON/OFF/TOGGLE) -> ESP32 se suscribe
-// TOPIC_PUMP_STATE = ESP32 publica estado actual (ON/OFF) -> dashboard se suscribe
+// TOPIC_PUMP_STATE = ESP32 publica estado actual (JSON: state ON/OFF, ts) -> dashboard se suscribe
+// TOPIC_PUMP_POLICY = ESP32 publica cambio pendiente y contadores anti-ciclado
+// (JSON: state, target, pending, hold_ms, requests, switches, superseded, deferred)
 #define TOPIC_PUMP_SET      "devices/" DEVICE_ID "/pump/set"
 #define TOPIC_PUMP_STATE    "devices/" DEVICE_ID "/pump/state"
+#define TOPIC_PUMP_POLICY   "devices/" DEVICE_ID "/pump/policy"
+
+// Pump Usage (pump_usage.h):
+// TOPIC_PUMP_USAGE       = ESP32 publica uso del día en curso (JSON: date, runtime_s, starts, kwh, por modo)
+// TOPIC_PUMP_USAGE_DAILY = ESP32 publica el resumen del último día completo al cerrarlo (medianoche local)
+#define TOPIC_PUMP_USAGE       "devices/" DEVICE_ID "/pump/usage"
+#define TOPIC_PUMP_USAGE_DAILY "devices/" DEVICE_ID "/pump/usage/daily"
 
 // Valve Control (unified - single mode):
 // TOPIC_VALVE_SET   = dashboard publica modo (1/2/TOGGLE) -> ESP32 se suscribe
-// TOPIC_VALVE_STATE = ESP32 publica modo actual (1/2) -> dashboard se suscribe
+// TOPIC_VALVE_STATE = ESP32 publica modo actual (JSON: mode 1/2, ts) -> dashboard se suscribe
 #define TOPIC_VALVE_SET     "devices/" DEVICE_ID "/valve/set"
 #define TOPIC_VALVE_STATE   "devices/" DEVICE_ID "/valve/state"
 
@@ -42,8 +102,16 @@
 #define TOPIC_TIMER_SET     "devices/" DEVICE_ID "/timer/set"
 #define TOPIC_TIMER_STATE   "devices/" DEVICE_ID "/timer/state"
 
+// Diagnostics:
+// TOPIC_DIAG_STATE = ESP32 publica diagnóstico (JSON: uptime, heap, métricas MQTT) -> dashboard se suscribe
+#define TOPIC_DIAG_STATE    "devices/" DEVICE_ID "/diag/state"
+
+// Command subscription:
+// TOPIC_COMMAND_FILTER = un solo SUBSCRIBE cubre pump/valve/timer .../set; el ESP32 enruta localmente
+#define TOPIC_COMMAND_FILTER "devices/" DEVICE_ID "/+/set"
+
 // Temperature:
-// TOPIC_TEMP_STATE = ESP32 publica temperatura actual (°C) -> dashboard se suscribe
+// TOPIC_TEMP_STATE = ESP32 publica temperatura actual (JSON: value °C, ts) -> dashboard se suscribe
 // TOPIC_TEMP_REFRESH = dashboard publica comando para forzar lectura inmediata -> ESP32 se suscribe
 #define TOPIC_TEMP_STATE    "devices/" DEVICE_ID "/temperature/state"
 #define TOPIC_TEMP_REFRESH  "devices/" DEVICE_ID "/temperature/refresh"
@@ -52,3 +120,36 @@
 // TOPIC_TEMP_ERROR = ESP32 publica diagnóstico cuando no puede leer la sonda
 // Ejemplos: {"error":"sensor_disconnected"}, {"error":"read_failed"}
 #define TOPIC_TEMP_ERROR    "devices/" DEVICE_ID "/temperature/error"
+
+// Command Acknowledgment:
+// Los comandos pueden enviarse como sobre JSON con id y timestamp, ej: {"id":42,"ts":1700000000123,"cmd":"ON"}
+// TOPIC_CMD_ACK = ESP32 publica {id, topic, result, proc_us} por cada comando con id -> dashboard se suscribe
+#define TOPIC_CMD_ACK       "devices/" DEVICE_ID "/cmd/ack"
+
+// Broker Endpoints:
+// TOPIC_BROKER_SET = dashboard publica endpoint (JSON: slot, host, port, tls, user, pass) -> ESP32 se suscribe
+// slot: primary/secondary/lan (0/1/2); host "" lo elimina. Estado y latencia en wifi/state y diag/state
+#define TOPIC_BROKER_SET    "devices/" DEVICE_ID "/broker/set"
+
+// Firmware Update (OTA):
+// TOPIC_OTA_SET   = herramienta publica {url, size, sha256, sig, patch} o "ABORT" -> ESP32 se suscribe
+// sig = firma ECDSA P-256 de sha256 con la clave de release; se verifica con OTA_SIGNING_KEY (secrets.h)
+// TOPIC_OTA_CHUNK = sin url, la imagen/parche llega en trozos binarios (offset 4 bytes + datos)
+// TOPIC_OTA_STATE = ESP32 publica progreso (JSON: state, offset, size, error, pending_verify)
+// Ver tools/ota_tool.py para generar parches delta y enviar por MQTT
+#define TOPIC_OTA_SET       "devices/" DEVICE_ID "/ota/set"
+#define TOPIC_OTA_CHUNK     "devices/" DEVICE_ID "/ota/chunk"
+#define TOPIC_OTA_STATE     "devices/" DEVICE_ID "/ota/state"
+
+// Runtime Settings:
+// TOPIC_CONFIG_SET   = dashboard/flota publica ajustes (JSON, ej: {"temp_pub_ms":30000}) o {"reset":true}
+// TOPIC_CONFIG_STATE = ESP32 publica la configuración efectiva (JSON, retenido) para auditoría
+// Claves, valores por defecto y límites en runtime_config.cpp
+#define TOPIC_CONFIG_SET    "devices/" DEVICE_ID "/config/set"
+#define TOPIC_CONFIG_STATE  "devices/" DEVICE_ID "/config/state"
+
+// Event Log:
+// TOPIC_EVENTS_SET    = dashboard/herramienta pide un rango (JSON: id, from, to, limit; epoch ms) -> ESP32 se suscribe
+// TOPIC_EVENTS_RESULT = ESP32 publica los eventos en páginas (JSON: id, page, events[], more) hasta more=false
+#define TOPIC_EVENTS_SET    "devices/" DEVICE_ID "/events/set"
+#define TOPIC_EVENTS_RESULT "devices/" DEVICE_ID "/events/result"
@@ -0,0 +1,115 @@
+/**
+ * @file delta_patch.h
+ * @brief Streaming decoder for binary delta patches against the running image
+ *
+ * A patch rebuilds the new firmware image from the running one plus the bytes
+ * that changed, so an update downloads only the difference. Patches are made
+ * on the host with tools/ota_tool.py (diff/apply use the same format).
+ *
+ * Format (integers little-endian, lengths/offsets as unsigned LEB128 varints):
+ *   "ESPD" | u32 source size | u32 target size | source SHA-256 (32 bytes)
+ *   then operations until END:
+ *   0x01 COPY  <source offset> <length>    copy bytes of the running image
+ *   0x02 DATA  <length> <bytes...>         new bytes, carried in the patch
+ *   0x00 END                               target must be complete here
+ *
+ * The decoder is fed the patch in pieces of any size (MQTT chunks, HTTP reads)
+ * and writes the target sequentially through callbacks, so neither the patch
+ * nor the image is ever held in RAM. It has no Arduino dependencies and builds
+ * on the host as is.
+ */
+
+#ifndef DELTA_PATCH_H
+#define DELTA_PATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define DELTA_MAGIC            "ESPD"
+#define DELTA_HEADER_SIZE      44       // Magic + sizes + source SHA-256
+#define DELTA_COPY_BLOCK       256      // Source bytes read per step of a COPY
+
+#define DELTA_OP_END           0x00
+#define DELTA_OP_COPY          0x01
+#define DELTA_OP_DATA          0x02
+
+/**
+ * Patch header
+ */
+struct DeltaHeader {
+  uint32_t sourceSize;        // Image the patch was made against
+  uint32_t targetSize;        // Image the patch produces
+  uint8_t sourceSha256[32];
+};
+
+/**
+ * Decoder callbacks (context is passed back unchanged)
+ */
+struct DeltaCallbacks {
+  void* context;
+  // Header parsed: return false if the patch does not match the running image
+  bool (*header)(void* context, const DeltaHeader& header);
+  // Read len bytes of the running image at offset
+  bool (*readSource)(void* context, uint32_t offset, uint8_t* buf, size_t len);
+  // Append len bytes to the new image
+  bool (*writeTarget)(void* context, const uint8_t* buf, size_t len);
+};
+
+enum DeltaResult : uint8_t {
+  DELTA_OK = 0,           // Input consumed (more expected unless finished())
+  DELTA_ERR_FORMAT,       // Bad magic, opcode or varint
+  DELTA_ERR_SOURCE,       // Header rejected, or a COPY outside the source image
+  DELTA_ERR_SIZE,         // Output longer or shorter than the target size
+  DELTA_ERR_IO,           // A read or write callback failed
+  DELTA_ERR_TRAILING      // Input after END
+};
+
+class DeltaDecoder {
+ public:
+  /**
+   * Start a new patch
+   */
+  void begin(const DeltaCallbacks& callbacks);
+
+  /**
+   * Decode the next piece of the patch
+   * @return DELTA_OK, or the error that stopped decoding (sticky)
+   */
+  DeltaResult feed(const uint8_t* data, size_t len);
+
+  /**
+   * END was reached and the target is complete
+   */
+  bool finished() const { return state == STATE_DONE; }
+
+  /**
+   * Target bytes written so far
+   */
+  uint32_t written() const { return outPos; }
+
+  const DeltaHeader& header() const { return hdr; }
+
+  static const char* resultName(DeltaResult result);
+
+ private:
+  enum State : uint8_t { STATE_HEADER, STATE_OP, STATE_ARG1, STATE_ARG2, STATE_DATA, STATE_DONE, STATE_ERROR };
+
+  DeltaResult fail(DeltaResult result);
+  bool readVarint(uint8_t byte, uint32_t* value);
+  DeltaResult copySource(uint32_t offset, uint32_t length);
+
+  DeltaCallbacks cb = {};
+  DeltaHeader hdr = {};
+  State state = STATE_HEADER;
+  DeltaResult error = DELTA_OK;
+  uint8_t headerBuf[DELTA_HEADER_SIZE];
+  uint8_t headerLen = 0;
+  uint8_t op = DELTA_OP_END;
+  uint32_t arg1 = 0;          // COPY offset / DATA length
+  uint32_t arg2 = 0;          // COPY length
+  uint32_t varint = 0;        // Varint being decoded
+  uint8_t varintShift = 0;
+  uint32_t outPos = 0;
+};
+
+#endif // DELTA_PATCH_H
@@ -0,0 +1,188 @@
+/**
+ * @file event_log.h
+ * @brief Append-only event log on a raw flash partition (relays, commands, boots, errors)
+ *
+ * NVS is sized for a handful of settings, not for thousands of writes a day.
+ * Events go to the data partition labelled EVENT_LOG_PARTITION (the "spiffs"
+ * slot of the default partition table, unused by this firmware) as a
+ * log-structured ring:
+ * - The partition is split into segments of one flash sector (the erase unit).
+ *   Each segment starts with a header carrying its sequence number, followed
+ *   by fixed-size records written in order into erased (0xFF) flash.
+ * - Every record carries a CRC-32. A record torn by a power cut fails the
+ *   check and is skipped; the slot is not reused.
+ * - When the head segment is full the log moves to the next sector. Once the
+ *   ring is full that sector holds the oldest segment, which is erased and
+ *   reused (rotation). The next sector is erased ahead of time from
+ *   eventLogLoop(), so an append only waits for an erase during a burst.
+ * - At boot the segment headers are scanned to find the head; nothing about
+ *   the log lives in RAM besides the write position.
+ *
+ * Wear: every sector is erased once per trip around the ring. With the default
+ * table (368 sectors, 127 records each, ~46700 events) and 5000 events/day a
+ * sector is erased every ~9 days, so 100k erase cycles last for centuries;
+ * retention, not wear, is the limit.
+ *
+ * Records logged before the clock is set have no time (ts 0); they keep the
+ * boot number and the uptime. A range query returns them when they follow a
+ * record that matched (log order).
+ *
+ * Flow:
+ * 1. setup() calls initEventLog() first, then logEvent(EVENT_BOOT, ...)
+ * 2. Relay switches, commands and errors call logEvent()
+ * 3. loop() calls eventLogLoop() (pre-erases the next sector)
+ * 4. A query command calls startEventQuery(); loop() pages the matching
+ *    records out with readEventQuery() until it reports no more
+ */
+
+#ifndef EVENT_LOG_H
+#define EVENT_LOG_H
+
+#include <Arduino.h>
+
+#define EVENT_LOG_PARTITION       "spiffs"  // Data partition label (default.csv)
+#define EVENT_LOG_SEGMENT_SIZE    4096      // One flash sector
+#define EVENT_LOG_RECORD_SIZE     32        // Header and record slot size (bytes)
+#define EVENT_LOG_PREERASE_SLOT   96        // Erase the next sector once the head has this many records
+#define EVENT_QUERY_PAGE          16        // Records per published page
+#define EVENT_QUERY_DEFAULT_LIMIT 500       // Records per query when no limit is given
+#define EVENT_QUERY_SCAN_SEGMENTS 2         // Segments scanned per readEventQuery() call
+
+/**
+ * What happened (record "type")
+ */
+enum EventType : uint8_t {
+  EVENT_BOOT = 1,    // code: esp_reset_reason_t, value: previous boot's longest stall (ms)
+  EVENT_PUMP,        // value: 1 ON / 0 OFF, arg: valve mode
+  EVENT_VALVE,       // value: mode
+  EVENT_COMMAND,     // code: EventChannel, value: CommandResult, arg: command topic index
+  EVENT_TIMER,       // code: EventTimerAction, value: duration (s), arg: mode
+  EVENT_ERROR,       // code: EventErrorCode, value: detail (e.g. MQTT rc)
+  EVENT_MQTT,        // code: 0 main / 1 cloud session, value: 1 connected / 0 lost, arg: broker slot
+  EVENT_OTA,         // Restarting into a verified new image
+  EVENT_ROAM         // code: 0 joined / 1 failed, value: target RSSI, arg: previous RSSI (dBm)
+};
+
+/**
+ * Where a command came from (EVENT_COMMAND code)
+ */
+enum EventChannel : uint8_t {
+  EVENT_CHANNEL_MQTT = 0,
+  EVENT_CHANNEL_BLE,
+  EVENT_CHANNEL_HTTP
+};
+
+/**
+ * Timer actions (EVENT_TIMER code)
+ */
+enum EventTimerAction : uint8_t {
+  EVENT_TIMER_START = 0,
+  EVENT_TIMER_STOP,
+  EVENT_TIMER_EXPIRE
+};
+
+/**
+ * Error kinds (EVENT_ERROR code)
+ */
+enum EventErrorCode : uint8_t {
+  EVENT_ERR_SENSOR = 0,      // Temperature sensor stopped answering
+  EVENT_ERR_MQTT_CONNECT,    // value: PubSubClient state
+  EVENT_ERR_WIFI_LOST
+};
+
+/**
+ * One record as stored in flash (EVENT_LOG_RECORD_SIZE bytes)
+ */
+struct EventRecord {
+  uint32_t seq;       // Monotonic across segments and boots
+  uint16_t boot;      // Boot number (increments every boot)
+  uint8_t type;       // EventType
+  uint8_t code;
+  uint64_t ts;        // Epoch ms, 0 if the clock was not set
+  uint32_t uptime;    // Seconds since boot
+  int32_t value;
+  int32_t arg;
+  uint32_t crc;       // CRC-32 of the fields above
+};
+
+/**
+ * Log metrics
+ */
+struct EventLogStats {
+  bool mounted;
+  uint16_t boot;
+  uint32_t nextSeq;
+  uint32_t records;        // Records stored (approximate once the ring wraps)
+  uint32_t capacity;       // Records the partition holds
+  uint16_t segments;       // Total
+  uint16_t segmentsUsed;
+  uint32_t cycles;         // Erase cycles per sector so far (trips around the ring)
+  uint32_t erases;         // Sectors erased this boot
+  uint32_t corrupt;        // Torn records found at the head at boot (power cut mid-write)
+  uint32_t writeErrors;
+  uint64_t oldestTs;       // Time of the oldest record (0 if unknown)
+};
+
+/**
+ * Find the partition and the head of the log (formats an empty partition)
+ * @return false if no partition is available (logging is then disabled)
+ */
+bool initEventLog();
+
+/**
+ * Append a record (blocks only for the flash write, ~100 µs)
+ * @return false if not mounted, paused or the write failed
+ */
+bool logEvent(EventType type, uint8_t code, int32_t value, int32_t arg = 0);
+
+/**
+ * Drop events instead of writing them (on-device benchmarks: a dispatch case
+ * would otherwise write one record per iteration and measure the flash)
+ */
+void pauseEventLog(bool paused);
+
+/**
+ * Erase the next sector ahead of time (call in loop)
+ */
+void eventLogLoop();
+
+/**
+ * Start a range query, replacing any running one
+ * @param fromMs Epoch ms, inclusive
+ * @param toMs Epoch ms, inclusive
+ * @param limit Max records returned
+ * @return false if the log is not mounted
+ */
+bool startEventQuery(uint64_t fromMs, uint64_t toMs, uint32_t limit);
+
+/**
+ * Collect the next matching records (call repeatedly while a query is active)
+ * Scans at most EVENT_QUERY_SCAN_SEGMENTS per call, so it may return 0 records with more = true.
+ * @param out Records, oldest first
+ * @param max Size of out
+ * @param more Output: false once the query is finished
+ * @return Records written to out
+ */
+int readEventQuery(EventRecord* out, int max, bool* more);
+
+/**
+ * True while a query has records left to return
+ */
+bool eventQueryActive();
+
+/**
+ * Drop the running query
+ */
+void cancelEventQuery();
+
+/**
+ * Name of an EventType ("boot", "pump", ...)
+ */
+const char* eventTypeName(uint8_t type);
+
+/**
+ * Get log metrics
+ */
+void getEventLogStats(EventLogStats* stats);
+
+#endif // EVENT_LOG_H
@@ -0,0 +1,45 @@
+/**
+ * @file json_parse.h
+ * @brief Values of flat JSON command objects without a JSON library
+ *
+ * Commands are small JSON objects ({"mode":1,"duration":3600}, broker
+ * endpoints, OTA requests, envelopes). ArduinoJson would need a document per
+ * message; these functions walk the text in place instead:
+ * - Strings run to the closing unescaped quote and escapes are decoded
+ *   (\uXXXX as UTF-8), so values may contain ',' '}' or quotes
+ * - Only top-level keys match; nested objects and arrays are skipped whole
+ * - Malformed input is reported, never half-read
+ *
+ * No allocation and no Arduino dependencies (host tests in test/ use it).
+ *
+ * Flow:
+ * 1. handleCommand() rejects payloads that fail jsonWellFormed()
+ * 2. Each command reads its keys with jsonValue()
+ */
+
+#ifndef JSON_PARSE_H
+#define JSON_PARSE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define JSON_MALFORMED  -2   // jsonValue(): the object could not be parsed
+
+/**
+ * Extracts the value of a key from a JSON object (top-level keys only)
+ * @param json JSON text, e.g. {"name":"morning","mode":1,"duration":3600}
+ * @param key Key without quotes (up to 23 chars)
+ * @param out Value with quotes removed and escapes decoded (strings), or its raw
+ *            text (numbers, true/false, nested objects); empty if absent
+ * @param outLen Size of out (longer values are truncated)
+ * @return Value length (>= outLen if truncated), -1 if the key is absent,
+ *         JSON_MALFORMED if the object up to the key (and its value) does not parse
+ */
+int jsonValue(const char* json, const char* key, char* out, size_t outLen);
+
+/**
+ * Checks that a payload is exactly one well-formed JSON object
+ */
+bool jsonWellFormed(const char* json);
+
+#endif // JSON_PARSE_H
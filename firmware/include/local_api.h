@@ -0,0 +1,135 @@
+/**
+ * @file local_api.h
+ * @brief HTTP/JSON control API on the LAN (esp_http_server + mDNS), token protected
+ *
+ * A command from a phone on the same WiFi used to travel to the cloud broker
+ * and back, and failed with the internet down. The local API answers on the LAN:
+ *   GET  /api/state      pump, valve, timer and temperature
+ *   GET  /api/timer | /api/config | /api/diag
+ *   POST /api/pump | /api/valve | /api/timer | /api/config | /api/temperature/refresh
+ * POST bodies are the payloads of the matching MQTT /set topics (envelopes
+ * included) and go through the same dispatcher, so HTTP, MQTT and BLE
+ * commands behave identically. Every request needs
+ * "Authorization: Bearer <LOCAL_API_TOKEN>".
+ *
+ * Threading: the server runs in its own task (esp_http_server, up to
+ * LOCAL_API_MAX_SOCKETS open connections). The main loop can block for
+ * seconds (MQTT connect with DNS and TLS, broker probes, WiFi reconnects), so
+ * the HTTP task never depends on it for reads:
+ * - GETs are answered by the HTTP task from snapshots the loop renders with
+ *   the MQTT serializers, every LOCAL_API_SNAPSHOT_INTERVAL (diagnostics every
+ *   LOCAL_API_DIAG_INTERVAL) and right after a local command. The body's "ts"
+ *   tells when it was rendered. The loop skips a refresh rather than wait for
+ *   a snapshot being sent.
+ * - POSTs are queued (LOCAL_API_QUEUE_DEPTH) for the loop, which runs them
+ *   through the dispatcher, so it stays single-threaded. A command the loop
+ *   does not answer within LOCAL_API_TIMEOUT gets 202 {"result":"queued"} and
+ *   still runs once the loop is back; the outcome shows in /api/state (and on
+ *   TOPIC_CMD_ACK for enveloped commands). Only a full queue gets 503.
+ * test/test_local_api runs both sides on two host threads, the loop blocked
+ * for the 202 and 503 cases.
+ *
+ * The device is advertised as <DEVICE_ID>.local (_http._tcp, TXT path=/api).
+ *
+ * Flow:
+ * 1. startNetworkServices() calls initLocalApi() once WiFi is up (LOCAL_API_ENABLED)
+ * 2. loop() refreshes the snapshots with beginLocalApiSnapshot()/endLocalApiSnapshot()
+ * 3. The HTTP task answers GETs from them, queues authenticated POSTs and waits
+ * 4. loop() calls pollLocalApiRequest(), writes the body to localApiResponse()
+ *    and calls completeLocalApiRequest()
+ */
+
+#ifndef LOCAL_API_H
+#define LOCAL_API_H
+
+#include <Arduino.h>
+
+#define LOCAL_API_PORT          80
+#define LOCAL_API_MAX_SOCKETS   4       // Concurrent connections (lwIP has 10 sockets in total)
+#define LOCAL_API_PATH_LEN      40      // Request path buffer (incl. null)
+#define LOCAL_API_MAX_BODY      256     // Larger POST bodies are rejected (413)
+#define LOCAL_API_RESPONSE_SIZE 4096    // Command response and diagnostics snapshot buffers
+#define LOCAL_API_SNAPSHOT_SIZE 1024    // State, timer and config snapshot buffers
+#define LOCAL_API_QUEUE_DEPTH   4       // Commands waiting for the main loop
+#define LOCAL_API_TIMEOUT       2000    // Wait for the main loop before answering 202 (ms)
+#define LOCAL_API_SNAPSHOT_INTERVAL 1000   // State, timer and config snapshots refreshed (ms)
+#define LOCAL_API_DIAG_INTERVAL     5000   // Diagnostics snapshot refreshed (ms)
+
+/**
+ * Resources served from snapshots (GET /api/<name>)
+ */
+enum LocalApiSnapshot : uint8_t {
+  LOCAL_API_STATE = 0,
+  LOCAL_API_TIMER,
+  LOCAL_API_CONFIG,
+  LOCAL_API_DIAG,
+  LOCAL_API_SNAPSHOT_COUNT
+};
+
+/**
+ * Authenticated command (POST) waiting for the main loop
+ */
+struct LocalApiRequest {
+  uint32_t id;
+  char path[LOCAL_API_PATH_LEN];        // Query string removed
+  uint16_t length;                      // Body length in bytes
+  byte body[LOCAL_API_MAX_BODY];        // Not null-terminated
+};
+
+/**
+ * API metrics (since boot)
+ */
+struct LocalApiStats {
+  bool running;
+  uint32_t requests;       // Received (any outcome)
+  uint32_t unauthorized;   // Missing or wrong token
+  uint32_t rejected;       // Path or body too long
+  uint32_t queued;         // Commands answered 202: loop busy past LOCAL_API_TIMEOUT
+  uint32_t busy;           // Commands refused with 503: queue full
+  uint32_t stale;          // GETs answered 503: snapshot not rendered yet
+  uint32_t maxWaitMs;      // Longest wait for the main loop (commands)
+};
+
+/**
+ * Start the HTTP server and the mDNS advertisement (once; later calls return true)
+ * @param token Bearer token required on every request
+ * @return false if the server could not start
+ */
+bool initLocalApi(const char* token);
+
+/**
+ * Start rewriting a snapshot (main loop only, never blocks)
+ * @return Print target, or nullptr if the HTTP task is sending it (retry later)
+ */
+Print* beginLocalApiSnapshot(LocalApiSnapshot snapshot);
+
+/**
+ * Publish the snapshot written since beginLocalApiSnapshot() to GET requests
+ */
+void endLocalApiSnapshot(LocalApiSnapshot snapshot);
+
+/**
+ * Fetch the next command (non-blocking, main loop only)
+ * The response body is written to localApiResponse() before completing it.
+ * @return true if a request was dequeued
+ */
+bool pollLocalApiRequest(LocalApiRequest* request);
+
+/**
+ * Response body of the request being handled (JSON)
+ */
+Print& localApiResponse();
+
+/**
+ * Send the response of a polled request
+ * @param id LocalApiRequest::id
+ * @param status HTTP status code
+ */
+void completeLocalApiRequest(uint32_t id, int status);
+
+/**
+ * Get API metrics
+ */
+void getLocalApiStats(LocalApiStats* stats);
+
+#endif // LOCAL_API_H
@@ -0,0 +1,56 @@
+/**
+ * @file mqtt_routes.h
+ * @brief Routing rules: which broker session a published topic goes to
+ *
+ * With MQTT_MODE_LAN_DUAL the device holds two sessions: the LAN broker,
+ * which gets everything (local clients, lowest latency), and a cloud broker,
+ * which gets the reduced set the remote dashboard needs. The rules table in
+ * mqtt_routes.cpp decides per topic:
+ * - MQTT_ROUTE_LAN: local only (high rate or bulky: live usage, diagnostics)
+ * - MQTT_ROUTE_BOTH: also to the cloud; a rule may thin the cloud copy out
+ *   to one every cloudMinMs (temperature, WiFi). MQTT_PRIO_CRITICAL
+ *   publishes (e.g. WiFi "disconnected") are never thinned.
+ * Topics without a rule go to both.
+ *
+ * Rules only apply while the cloud session is up. Before that, and in the
+ * other modes (cloud only, or LAN with the broker's own bridge), every topic
+ * goes to the single session.
+ *
+ * Flow:
+ * 1. mqttEnqueue() / mqttPublishStreamed() call mqttRouteFor() while the
+ *    cloud session is connected and send to the sessions it names
+ * 2. connectCloudMqtt() calls resetMqttRoutes() before queuing the state
+ */
+
+#ifndef MQTT_ROUTES_H
+#define MQTT_ROUTES_H
+
+#include <Arduino.h>
+#include "mqtt_transport.h"
+
+#define MQTT_CLOUD_TELEMETRY_INTERVAL 300000  // Thinned topics reach the cloud at most this often (ms)
+
+/**
+ * Destinations of a topic (bit mask)
+ */
+enum MqttRoute : uint8_t {
+  MQTT_ROUTE_LAN   = 0x01,
+  MQTT_ROUTE_CLOUD = 0x02,
+  MQTT_ROUTE_BOTH  = MQTT_ROUTE_LAN | MQTT_ROUTE_CLOUD
+};
+
+/**
+ * Destinations of one publish (call once per publish: thinned topics count it)
+ * @param topic Full topic
+ * @param priority MqttPriority of the publish
+ * @return MqttRoute mask
+ */
+uint8_t mqttRouteFor(const char* topic, MqttPriority priority);
+
+/**
+ * Let the next publish of every thinned topic through to the cloud
+ * (a new cloud session must get fresh retained state at once)
+ */
+void resetMqttRoutes();
+
+#endif // MQTT_ROUTES_H
@@ -0,0 +1,175 @@
+/**
+ * @file mqtt_transport.h
+ * @brief Prioritized outbound queue in front of the PubSubClient connection
+ *
+ * Publishers never touch the socket: they enqueue and return immediately.
+ * loop() drains the queue once per iteration, most important messages first,
+ * so a burst of telemetry cannot delay a relay state change or a command ack,
+ * and a command handler never blocks on a TLS write.
+ *
+ * Retained state topics are coalesced (a newer value replaces the queued one),
+ * and connectMqtt() re-enqueues every state topic after a reconnect, so the
+ * broker always ends up with the latest state.
+ *
+ * Retained critical and state publishes (relay, valve, timer, config...) go
+ * out at QoS 1: they keep their queue slot until the broker's PUBACK arrives.
+ * PubSubClient only builds QoS 0 packets and ignores PUBACK, so the transport
+ * writes these PUBLISH packets itself and the CoalescingClient reports the
+ * PUBACKs it sees on the read path. At most MQTT_INFLIGHT_WINDOW of them are
+ * unacknowledged per link; one not acknowledged within MQTT_ACK_TIMEOUT, or
+ * cut off by a disconnect, is resent with DUP and the same packet ID. A newer
+ * value of the topic replaces it (new packet ID). Telemetry and acks stay QoS 0.
+ *
+ * Payloads too large for the queue (diagnostics, dumps) are streamed instead:
+ * mqttPublishStreamed() runs a serializer twice, once to measure the payload
+ * and once to write it through beginPublish()/write()/endPublish() in
+ * MQTT_STREAM_CHUNK-byte pieces, so the full payload never exists in RAM.
+ *
+ * Everything written during one drain (or one streamed publish) leaves as a
+ * single TLS record: the transport flushes the CoalescingClient under
+ * PubSubClient once it is done, instead of one record per packet. Messages
+ * leave the queue only once that flush succeeded; if it fails they are
+ * pending again and rewritten after the reconnect.
+ *
+ * A second session (the cloud broker in MQTT_MODE_LAN_DUAL) can be attached
+ * as the cloud link. Every queued message then carries the links it still has
+ * to reach, chosen by the routing rules (mqtt_routes.h) while the cloud link
+ * is connected; a message leaves the queue once it reached all of them. The
+ * cloud link is best effort: when it drops, its pending copies are released
+ * (its reconnect queues the state again), so it never fills the queue.
+ *
+ * Flow:
+ * 1. setupMqtt() calls initMqttTransport(&mqtt, &mqttSocket)
+ *    (and attachMqttCloudLink(&cloudMqtt, &cloudSocket) for the second session)
+ * 2. publish*() functions call mqttEnqueue() (or mqttPublishStreamed() for large payloads)
+ * 3. loop() calls mqttDrain() after mqtt.loop()
+ */
+
+#ifndef MQTT_TRANSPORT_H
+#define MQTT_TRANSPORT_H
+
+#include <Arduino.h>
+
+class PubSubClient;
+class CoalescingClient;
+
+#ifndef MQTT_BUFFER_SIZE
+#define MQTT_BUFFER_SIZE        512   // PubSubClient packet buffer (override with -DMQTT_BUFFER_SIZE=...)
+#endif
+
+#define MQTT_QUEUE_LENGTH       12    // Outbound messages buffered
+#define MQTT_QUEUE_TOPIC_LEN    64    // Max topic length (incl. null)
+#define MQTT_QUEUE_PAYLOAD_LEN  (MQTT_BUFFER_SIZE - MQTT_QUEUE_TOPIC_LEN)  // Larger payloads must be streamed
+#define MQTT_DRAIN_BURST        6     // Max messages written per mqttDrain() call
+#define MQTT_DRAIN_BUDGET       50    // Max time spent per mqttDrain() call (ms)
+#define MQTT_INFLIGHT_WINDOW    4     // QoS 1 publishes awaiting PUBACK per link
+#define MQTT_ACK_TIMEOUT        10000 // Resend a QoS 1 publish not acknowledged by then (ms)
+#define MQTT_STREAM_CHUNK       128   // Bytes handed to the socket per write while streaming
+
+/**
+ * Outbound priority - lower value is sent first
+ */
+enum MqttPriority : uint8_t {
+  MQTT_PRIO_CRITICAL  = 0,  // Relay state, command acks
+  MQTT_PRIO_STATE     = 1,  // Timer and other controller state
+  MQTT_PRIO_TELEMETRY = 2   // WiFi, temperature, diagnostics
+};
+
+/**
+ * Sessions a message can go to
+ */
+enum MqttLink : uint8_t {
+  MQTT_LINK_MAIN  = 0,      // The session of connectMqtt() (LAN broker in the LAN modes)
+  MQTT_LINK_CLOUD = 1,      // Second session (MQTT_MODE_LAN_DUAL)
+  MQTT_LINK_COUNT
+};
+
+/**
+ * Queue metrics (since boot)
+ */
+struct MqttQueueStats {
+  uint8_t depth;        // Messages waiting now
+  uint8_t highWater;    // Max depth seen
+  uint32_t enqueued;    // Messages accepted
+  uint32_t sent;        // Messages flushed to the socket (main link)
+  uint32_t cloudSent;   // Messages flushed to the cloud link
+  uint32_t cloudReleased;  // Cloud copies discarded because the cloud link was down
+  uint32_t coalesced;   // Retained messages replaced by a newer value before sending
+  uint8_t inflight;     // QoS 1 publishes awaiting PUBACK now (all links)
+  uint32_t acked;       // QoS 1 publishes acknowledged by the broker
+  uint32_t redelivered; // QoS 1 publishes resent (PUBACK overdue or connection lost)
+  uint32_t dropped;     // Messages discarded because the queue was full
+  uint32_t oversize;    // Messages rejected for not fitting the queue/client buffer (stream them)
+  uint32_t failed;      // Publishes or flushes that failed (queued message kept for retry)
+  uint32_t streamed;    // Streamed publishes completed
+  uint32_t streamedBytes;  // Payload bytes sent by streamed publishes
+  uint32_t truncated;   // Streamed publishes cut short (connection dropped mid-payload)
+};
+
+/**
+ * Payload serializer for mqttPublishStreamed()
+ * Called twice and must produce identical output both times
+ * (snapshot changing values into the context first).
+ */
+typedef void (*MqttPayloadWriter)(Print& out, void* context);
+
+/**
+ * Attach the queue to the MQTT client
+ * @param client MQTT client
+ * @param socket Write-coalescing client PubSubClient writes through
+ */
+void initMqttTransport(PubSubClient* client, CoalescingClient* socket);
+
+/**
+ * Attach the second (cloud) session; routing rules apply while it is connected
+ * @param client MQTT client of the cloud session
+ * @param socket Write-coalescing client it writes through
+ */
+void attachMqttCloudLink(PubSubClient* client, CoalescingClient* socket);
+
+/**
+ * Queue a message for publishing (never blocks)
+ * When the queue is full, the oldest message of the least important priority
+ * is dropped to make room, unless the new message is less important than all
+ * queued ones, in which case it is dropped instead.
+ * @param topic Topic
+ * @param payload Null-terminated payload
+ * @param retain Retain flag (retained messages on the same topic are coalesced)
+ * @param priority MqttPriority
+ * @return false if the message was dropped
+ */
+bool mqttEnqueue(const char* topic, const char* payload, bool retain, MqttPriority priority);
+
+/**
+ * Stream a payload of any size straight to the socket (blocking, main loop only)
+ * Bypasses the queue: use for large, infrequent payloads while connected.
+ * Routed like queued messages; the writer runs twice per session it goes to.
+ * @param topic Topic
+ * @param retain Retain flag
+ * @param writer Serializer that prints the payload
+ * @param context Passed to writer
+ * @return false if the main link is not connected or a session did not get the whole payload
+ */
+bool mqttPublishStreamed(const char* topic, bool retain, MqttPayloadWriter writer, void* context);
+
+/**
+ * Publish queued messages (call in loop after mqtt.loop())
+ * Writes up to MQTT_DRAIN_BURST messages within MQTT_DRAIN_BUDGET ms, then
+ * flushes them (and anything else PubSubClient wrote this iteration) as one record.
+ * Does nothing on a disconnected main link; messages stay queued for it.
+ */
+void mqttDrain();
+
+/**
+ * Write everything queued, blocking up to timeoutMs (e.g. before a restart)
+ * Ignores the in-flight window and does not wait for PUBACKs.
+ * @return true if every queued message was written to its connected links
+ */
+bool mqttFlush(uint32_t timeoutMs);
+
+/**
+ * Get queue metrics
+ */
+void getMqttQueueStats(MqttQueueStats* stats);
+
+#endif // MQTT_TRANSPORT_H
@@ -0,0 +1,77 @@
+/**
+ * @file msg_pool.h
+ * @brief Fixed pool of per-message buffers (no heap allocation per message)
+ *
+ * The firmware runs 24/7 next to large, long-lived TLS and NimBLE allocations.
+ * Building every payload with Arduino String left short-lived holes between
+ * them, and the largest free block shrank over days. Incoming commands and
+ * outgoing JSON now use MsgBuffer instead: a Print that writes into one of
+ * MSG_POOL_BLOCKS blocks from a static arena and returns it when it goes out
+ * of scope. The heap is not touched on the message path.
+ *
+ * When every block is taken (or a payload does not fit), the buffer reports
+ * !ok() and the caller drops the message; both are counted in the stats.
+ * Main loop only (not thread-safe).
+ *
+ * Usage:
+ *   MsgBuffer json;
+ *   json.print("{\"rssi\":"); json.print(rssi); json.print("}");
+ *   if (json.ok()) mqttEnqueue(topic, json.c_str(), ...);
+ */
+
+#ifndef MSG_POOL_H
+#define MSG_POOL_H
+
+#include <Arduino.h>
+#include "mqtt_transport.h"
+
+#define MSG_POOL_BLOCKS       4                  // Buffers alive at once (handler + nested publishes)
+#define MSG_POOL_BLOCK_SIZE   MQTT_BUFFER_SIZE   // Largest message either way (incl. null)
+
+/**
+ * Pool metrics (since boot)
+ */
+struct MsgPoolStats {
+  uint8_t inUse;          // Blocks taken now
+  uint8_t highWater;      // Max blocks taken at once
+  uint32_t acquired;      // Buffers handed out
+  uint32_t exhausted;     // Buffers requested while every block was taken
+  uint32_t truncated;     // Messages that did not fit a block
+};
+
+class MsgBuffer : public Print {
+ public:
+  MsgBuffer();
+  ~MsgBuffer();
+
+  size_t write(uint8_t b) override;
+  size_t write(const uint8_t* data, size_t size) override;
+  using Print::write;
+
+  /**
+   * Null-terminated content ("" without a block)
+   */
+  const char* c_str() const { return data ? data : ""; }
+  size_t length() const { return used; }
+
+  /**
+   * true if a block was available and everything written fit
+   */
+  bool ok() const { return data && !overflow; }
+
+ private:
+  MsgBuffer(const MsgBuffer&) = delete;
+  MsgBuffer& operator=(const MsgBuffer&) = delete;
+
+  char* data;
+  uint8_t block;
+  size_t used = 0;
+  bool overflow = false;
+};
+
+/**
+ * Get pool metrics
+ */
+void getMsgPoolStats(MsgPoolStats* stats);
+
+#endif // MSG_POOL_H
@@ -0,0 +1,145 @@
+/**
+ * @file ota_update.h
+ * @brief Streaming firmware updates (HTTPS or MQTT chunks) with rollback
+ *
+ * An update is started with TOPIC_OTA_SET and streams straight into the
+ * inactive OTA partition; nothing is buffered beyond one read:
+ * - HTTPS: the device downloads "url" itself, OTA_READ_BUDGET bytes per loop
+ *   iteration, so control and MQTT keep running during the download
+ * - MQTT: the sender publishes chunks on TOPIC_OTA_CHUNK (4-byte big-endian
+ *   offset + data). Chunks must arrive in order; on a gap the device reports
+ *   the offset it expects on TOPIC_OTA_STATE and the sender rewinds
+ *
+ * The payload is either a full image or a delta patch against the running
+ * image (delta_patch.h). Integrity and authenticity:
+ * - The command carries an ECDSA P-256 signature ("sig") over the SHA-256 of
+ *   the resulting image, made with the release key (tools/ota_tool.py sign).
+ *   It is checked against OTA_SIGNING_KEY (public key, secrets.h) when the
+ *   update starts, so a forged request erases nothing, and again over the
+ *   hash of the image actually written right before it is made bootable.
+ *   Unsigned requests, and every request on a build without a key, are refused
+ * - Patches carry the SHA-256 of the image they apply to and are rejected
+ *   against any other
+ * - The SHA-256 of the image written must match the one in the command
+ * - esp_ota_end() validates the image before it is made bootable
+ *
+ * Rollback: the new image boots as "pending verify". It is kept once it has
+ * been connected to MQTT at an uptime of OTA_CONFIRM_UPTIME; if it resets
+ * before that, the bootloader returns to the previous image, and if it is
+ * still not confirmed at OTA_CONFIRM_DEADLINE it rolls back itself.
+ *
+ * Flow:
+ * 1. setup() calls initOta() with the public signing key
+ * 2. handleCommand() calls otaStart()/otaAbort(), onMqttMessage() passes chunks
+ *    to otaReceiveChunk()
+ * 3. loop() calls otaLoop() and restarts once otaRebootDue()
+ */
+
+#ifndef OTA_UPDATE_H
+#define OTA_UPDATE_H
+
+#include <Arduino.h>
+
+#define OTA_URL_LEN            192      // Download URL buffer (incl. null)
+#define OTA_SIG_MAX_LEN        72       // DER ECDSA P-256 signature (at most 72 bytes)
+#define OTA_READ_BUDGET        4096     // Max HTTPS bytes handled per loop iteration
+#define OTA_PROGRESS_STEP      8192     // Progress reported every N received bytes
+#define OTA_IDLE_TIMEOUT       60000    // Abort when no data arrives for this long (ms)
+#define OTA_HTTP_TIMEOUT       10000    // HTTPS connect/read timeout (ms)
+#define OTA_REBOOT_DELAY       2000     // Time to publish the result before restarting (ms)
+#define OTA_CONFIRM_UPTIME     60000    // New image must be connected at this uptime to be kept (ms)
+#define OTA_CONFIRM_DEADLINE   600000   // Roll back if the new image is not confirmed by then (ms)
+
+enum OtaPhase : uint8_t {
+  OTA_IDLE = 0,
+  OTA_RECEIVING,
+  OTA_DONE,          // New image is bootable, restart pending
+  OTA_FAILED
+};
+
+/**
+ * Update request (from TOPIC_OTA_SET)
+ */
+struct OtaRequest {
+  char url[OTA_URL_LEN];      // HTTPS download, "" = chunks over MQTT
+  uint32_t size;              // Bytes to transfer (image or patch), 0 = Content-Length
+  uint8_t sha256[32];         // SHA-256 of the resulting image
+  uint8_t sig[OTA_SIG_MAX_LEN];  // Release key signature over sha256 (DER)
+  uint8_t sigLen;             // 0 = unsigned (refused)
+  bool patch;                 // Payload is a delta patch against the running image
+};
+
+/**
+ * Update progress and running image state
+ */
+struct OtaStatus {
+  OtaPhase phase;
+  bool https;
+  bool patch;
+  uint32_t size;              // Bytes to transfer
+  uint32_t offset;            // Bytes received (next chunk offset expected)
+  uint32_t written;           // Image bytes written
+  const char* error;          // Reason of the last failure, "" if none
+  const char* partition;      // Running partition label
+  bool pendingVerify;         // Running image is new and not confirmed yet
+};
+
+/**
+ * Load the public signing key and check whether the running image is a new
+ * one waiting for confirmation
+ * @param signingKey PEM public key (OTA_SIGNING_KEY), nullptr = refuse all updates
+ */
+void initOta(const char* signingKey);
+
+/**
+ * Start an update (aborts one in progress)
+ * @return false if it could not start (reason in OtaStatus.error)
+ */
+bool otaStart(const OtaRequest& request);
+
+/**
+ * Cancel the update in progress
+ */
+void otaAbort(const char* reason);
+
+/**
+ * Handle one TOPIC_OTA_CHUNK message
+ * @return true if the status should be published (progress, gap, completion)
+ */
+bool otaReceiveChunk(const uint8_t* payload, unsigned int length);
+
+/**
+ * Download, timeouts and confirmation of a new image (call in loop)
+ * @param healthy Device is connected to MQTT
+ * @return true if the status should be published
+ */
+bool otaLoop(bool healthy);
+
+/**
+ * A new image is bootable and the result had time to be published
+ */
+bool otaRebootDue();
+
+/**
+ * Get update progress
+ */
+void getOtaStatus(OtaStatus* status);
+
+/**
+ * Phase name for logs and JSON
+ */
+const char* otaPhaseName(OtaPhase phase);
+
+/**
+ * Parse a 64-digit hex SHA-256
+ * @return false if the text is not a SHA-256
+ */
+bool otaParseSha256(const char* hex, uint8_t* out);
+
+/**
+ * Parse a hex DER signature (up to OTA_SIG_MAX_LEN bytes)
+ * @return false if the text is empty, too long or not hex
+ */
+bool otaParseSignature(const char* hex, uint8_t* out, uint8_t* len);
+
+#endif // OTA_UPDATE_H
@@ -0,0 +1,78 @@
+/**
+ * @file pump_policy.h
+ * @brief Actuation policy for the pump relay: command coalescing and anti-short-cycle
+ *
+ * Commands (MQTT, BLE, timers) no longer switch the 220 V relay directly. They
+ * set the desired state, and the policy decides when the relay may follow:
+ * - Coalescing: after a switch, commands arriving within PUMP_COALESCE_WINDOW
+ *   only update the desired state (last writer wins); the final one is applied
+ *   when the window closes, intermediate ones are counted as superseded
+ * - Minimum dwell: the relay stays on at least PUMP_MIN_ON_TIME and off at
+ *   least PUMP_MIN_OFF_TIME before switching again; a request that arrives
+ *   earlier is held (deferred), never dropped
+ *
+ * The first command after a quiet period is applied immediately, and a request
+ * that ends up equal to the relay state just cancels the pending switch.
+ * The dwell also counts from boot: the relay starts off and a saved ON state
+ * is requested like any command, so it waits PUMP_MIN_OFF_TIME and a reboot
+ * loop cannot chatter the relay.
+ *
+ * Flow:
+ * 1. setup() calls initPumpPolicy(false), then requestPump(true) if the saved
+ *    state (or a resumed timer) wants the pump on
+ * 2. Commands call requestPump()
+ * 3. loop() calls pollPumpSwitch() and drives the relay when it returns true
+ */
+
+#ifndef PUMP_POLICY_H
+#define PUMP_POLICY_H
+
+#include <Arduino.h>
+
+#define PUMP_COALESCE_WINDOW    1000     // Commands within this long after a switch are merged (ms)
+#define PUMP_MIN_ON_TIME        10000    // Minimum time the pump runs once started (ms)
+#define PUMP_MIN_OFF_TIME       20000    // Minimum time the pump rests before restarting (ms)
+
+/**
+ * Policy state and counters (since boot)
+ */
+struct PumpPolicyStatus {
+  bool relayOn;           // Relay state now
+  bool target;            // Last requested state (final intent)
+  bool pending;           // target differs from the relay, waiting for holdMs
+  uint32_t holdMs;        // Time until the pending switch is allowed (0 = now or none)
+  uint32_t requests;      // Requests received
+  uint32_t switches;      // Relay actuations
+  uint32_t superseded;    // Requests overwritten before they were applied
+  uint32_t deferred;      // Requests held back by the window or a dwell time
+};
+
+/**
+ * Start the policy with the relay state it has now (off at boot)
+ */
+void initPumpPolicy(bool relayOn);
+
+/**
+ * Ask for a pump state (last writer wins)
+ * @return true if the relay may switch right away (call pollPumpSwitch())
+ */
+bool requestPump(bool on);
+
+/**
+ * State the pump is heading to (use for TOGGLE instead of the relay state)
+ */
+bool pumpTarget();
+
+/**
+ * Check whether the pending request may be applied now
+ * @param on Output: relay state to apply
+ * @return true if the relay must switch (the policy already counts it as done)
+ */
+bool pollPumpSwitch(bool* on);
+
+/**
+ * Get policy state and counters
+ */
+void getPumpPolicyStatus(PumpPolicyStatus* status);
+
+#endif // PUMP_POLICY_H
@@ -0,0 +1,67 @@
+/**
+ * @file pump_usage.h
+ * @brief Pump runtime, starts and estimated energy per day and per valve mode
+ *
+ * Usage used to be reconstructed on the dashboard by replaying ON/OFF events,
+ * which breaks when an event is lost. The device now keeps the counters itself:
+ * - Runtime and energy accumulate while the relay is on, attributed to the
+ *   current valve mode (1 Cascada, 2 Eyectores). Energy uses the "pump_watts"
+ *   setting in effect at the time
+ * - Days are local (LOCAL_UTC_OFFSET_MIN). Counting starts before the clock is
+ *   set and the day is assigned at the first valid time. At midnight the day
+ *   is closed and kept as the last completed day
+ *
+ * Wear: counters are saved to NVS USAGE_SAVE_IDLE_DELAY after the pump stops
+ * (short cycles coalesce), at most every USAGE_SAVE_INTERVAL while it runs
+ * (bounds the loss on power cut), when a day closes and before a restart.
+ *
+ * Flow:
+ * 1. setup() calls initPumpUsage() after initStateStore(), before the relays are restored
+ * 2. setPumpRelay()/setValveRelay() call pumpUsageUpdate() on every switch
+ *    (a pump restored ON at boot counts as a start)
+ * 3. loop() calls pumpUsageLoop(); true means a day was closed
+ */
+
+#ifndef PUMP_USAGE_H
+#define PUMP_USAGE_H
+
+#include <Arduino.h>
+#include "state_store.h"
+
+#define USAGE_SAVE_INTERVAL      900000   // Max unsaved runtime while the pump runs (ms)
+#define USAGE_SAVE_IDLE_DELAY    60000    // Save once the pump has been off this long (ms)
+#define USAGE_PUBLISH_INTERVAL   900000   // Publish today's counters while running (ms)
+
+/**
+ * Load the saved counters
+ */
+void initPumpUsage();
+
+/**
+ * Report the relay state after a pump or valve switch
+ */
+void pumpUsageUpdate(bool pumpOn, int valveMode);
+
+/**
+ * Accumulate runtime, close the day at midnight, save when due (call in loop)
+ * @return true if a day was closed (publish the daily summary)
+ */
+bool pumpUsageLoop();
+
+/**
+ * Save unsaved counters now (before a restart)
+ */
+void flushPumpUsage();
+
+/**
+ * Get the counters (today's include the time up to now)
+ */
+void getPumpUsage(PersistedUsageDay* today, PersistedUsageDay* lastDay);
+
+/**
+ * Format a local day number as YYYY-MM-DD
+ * @return false if the day is not known (0)
+ */
+bool formatUsageDay(uint32_t day, char* out, size_t outLen);
+
+#endif // PUMP_USAGE_H
@@ -0,0 +1,97 @@
+/**
+ * @file runtime_config.h
+ * @brief Typed registry of settings that can be tuned without reflashing
+ *
+ * Publish intervals, reconnect intervals and the valve switch delay used to be
+ * #defines. They are now registry entries with a type, default and bounds:
+ * - TOPIC_CONFIG_SET sets any subset, e.g. {"temp_pub_ms": 30000, "wifi_state_ms": 60000}.
+ *   The whole command is validated first and rejected if any value is out of
+ *   range, so a setting is never half applied
+ * - Values are persisted in NVS (one key per setting, only when not default)
+ *   and read by the code on every use, so a change applies on the next loop
+ *   iteration without a reboot
+ * - The effective values are published retained on TOPIC_CONFIG_STATE, so the
+ *   configuration of every unit in the field can be audited
+ *
+ * Flow:
+ * 1. setup() calls initRuntimeConfig() after initStateStore()
+ * 2. Code reads settings with configValue()
+ * 3. handleCommand() validates with parseConfigValue() and applies with setConfigValue()
+ */
+
+#ifndef RUNTIME_CONFIG_H
+#define RUNTIME_CONFIG_H
+
+#include <Arduino.h>
+
+/**
+ * Registered settings (names and bounds in runtime_config.cpp)
+ */
+enum ConfigKey : uint8_t {
+  CFG_WIFI_STATE_INTERVAL = 0,   // WiFi state publish (ms)
+  CFG_TIMER_PUBLISH_INTERVAL,    // Timer state publish while running (ms)
+  CFG_TEMP_PUBLISH_INTERVAL,     // Temperature read + publish (ms)
+  CFG_DIAG_PUBLISH_INTERVAL,     // Diagnostics publish (ms)
+  CFG_WIFI_RECONNECT_INTERVAL,   // WiFi reconnect check (ms)
+  CFG_MQTT_RECONNECT_INTERVAL,   // Min time between MQTT reconnect attempts (ms)
+  CFG_VALVE_SWITCH_DELAY,        // Wait for the valves before starting the pump (ms)
+  CFG_TELEMETRY_ADAPTIVE,        // Adaptive telemetry strategy (bool, telemetry.h)
+  CFG_TEMP_FAST_INTERVAL,        // Temperature sampling while pumping or changing (ms)
+  CFG_TEMP_IDLE_INTERVAL,        // Longest temperature interval when idle and stable (ms)
+  CFG_RSSI_DELTA,                // RSSI change worth publishing (dB)
+  CFG_PUMP_WATTS,                // Pump power for the energy estimate (W, pump_usage.h)
+  CFG_KEY_COUNT
+};
+
+/**
+ * Value types
+ */
+enum ConfigType : uint8_t {
+  CONFIG_UINT = 0,    // Unsigned integer within [min, max]
+  CONFIG_BOOL         // true/false (stored as 1/0)
+};
+
+/**
+ * Registry entry
+ */
+struct ConfigEntry {
+  const char* name;           // JSON key and NVS key (max 15 chars)
+  ConfigType type;
+  uint32_t defaultValue;
+  uint32_t minValue;
+  uint32_t maxValue;
+};
+
+/**
+ * Load saved settings (falls back to defaults for missing or out-of-range values)
+ */
+void initRuntimeConfig();
+
+/**
+ * Current value of a setting
+ */
+uint32_t configValue(ConfigKey key);
+
+/**
+ * Registry entry of a setting
+ */
+const ConfigEntry& configEntry(ConfigKey key);
+
+/**
+ * Parse and validate a value for a setting (JSON text, quotes already removed)
+ * @return false if the text is not of the setting's type or out of range
+ */
+bool parseConfigValue(ConfigKey key, const char* text, uint32_t* value);
+
+/**
+ * Apply and persist a validated value
+ * @return true if the value changed
+ */
+bool setConfigValue(ConfigKey key, uint32_t value);
+
+/**
+ * Restore every setting to its default (and forget the saved values)
+ */
+void resetRuntimeConfig();
+
+#endif // RUNTIME_CONFIG_H
@@ -9,3 +9,19 @@
 
 #define MQTT_USER "ESP32-01"
 #define MQTT_PASS "1234"
+
+// Optional credentials for the secondary / LAN brokers (see config.h)
+// #define MQTT_USER_2 "ESP32-01"
+// #define MQTT_PASS_2 "1234"
+// #define MQTT_LAN_USER "pool"
+// #define MQTT_LAN_PASS "1234"
+
+// 6-digit pairing PIN for the BLE local control service (BLE_CONTROL_ENABLED)
+#define BLE_CONTROL_PASSKEY 123456
+
+// Bearer token for the local HTTP API (LOCAL_API_ENABLED); use a long random string
+#define LOCAL_API_TOKEN "change-me-to-a-long-random-token"
+
+// Public key firmware updates must be signed with (line printed by tools/ota_tool.py keygen).
+// Without it every OTA update is refused.
+// #define OTA_SIGNING_KEY "-----BEGIN PUBLIC KEY-----\n...\n-----END PUBLIC KEY-----\n"
@@ -0,0 +1,190 @@
+/**
+ * @file state_store.h
+ * @brief RAM-cached persistent storage for WiFi credentials and actuator state
+ *
+ * All NVS access goes through this module. Values are read once at boot and
+ * served from RAM afterwards. Actuator/timer changes only mark the cache dirty;
+ * flushStateStore() writes them in one NVS transaction after STATE_FLUSH_DELAY,
+ * so a burst of commands costs a single flash write.
+ *
+ * Flow:
+ * 1. setup() calls initStateStore() before touching the relays
+ * 2. setup() restores pump/valve/timer from getPersistedState()
+ * 3. Control code reports changes with persistActuatorState()/persistTimers()
+ * 4. loop() calls flushStateStore(false) every iteration
+ *
+ * Broker endpoints change rarely (config command, failover) and are written
+ * immediately, like WiFi credentials. So are runtime settings (runtime_config.h),
+ * one NVS key per setting, read once at boot.
+ *
+ * Pump usage counters are written when savePumpUsage() is called; pump_usage.h
+ * decides how often that is (flash wear).
+ */
+
+#ifndef STATE_STORE_H
+#define STATE_STORE_H
+
+#include <Arduino.h>
+
+#define STATE_FLUSH_DELAY       2000   // Coalescing window before dirty state is written (ms)
+#define STATE_MAX_TIMERS        4      // Concurrent timers persisted
+#define STATE_TIMER_NAME_LEN    16     // Timer name buffer (15 chars + null)
+#define STATE_MAX_BROKERS       3      // Broker endpoints (primary, secondary, LAN)
+#define STATE_BROKER_HOST_LEN   64     // Host name buffer (incl. null)
+#define STATE_BROKER_USER_LEN   32     // MQTT user buffer (incl. null)
+#define STATE_BROKER_PASS_LEN   64     // MQTT password buffer (incl. null)
+#define STATE_USAGE_MODES       2      // Valve modes with usage counters (1 Cascada, 2 Eyectores)
+
+/**
+ * One running timer as persisted across reboots
+ */
+struct PersistedTimer {
+  char name[STATE_TIMER_NAME_LEN];
+  uint8_t mode;               // Valve mode: 1 or 2
+  uint32_t durationSeconds;   // Total duration
+  uint32_t remainingSeconds;  // As of the last checkpoint (used when no wall clock)
+  int64_t wallDeadline;       // Epoch seconds when it expires, 0 if never anchored to NTP
+};
+
+/**
+ * Actuator and timer state persisted across reboots
+ */
+struct PersistedState {
+  bool pumpOn;
+  uint8_t valveMode;        // 1 (Cascada) or 2 (Eyectores)
+  uint8_t timerCount;       // Valid entries in timers[]
+  PersistedTimer timers[STATE_MAX_TIMERS];
+};
+
+/**
+ * One MQTT broker endpoint (host[0] == '\0' marks an unused slot)
+ */
+struct PersistedBroker {
+  char host[STATE_BROKER_HOST_LEN];
+  uint16_t port;
+  bool tls;
+  char user[STATE_BROKER_USER_LEN];
+  char pass[STATE_BROKER_PASS_LEN];
+};
+
+/**
+ * Broker endpoint list and the endpoint last connected to
+ */
+struct PersistedBrokers {
+  uint8_t selected;         // Slot to try first after a reboot
+  bool custom;              // Endpoints were set at runtime (otherwise config.h defaults apply)
+  PersistedBroker endpoints[STATE_MAX_BROKERS];
+};
+
+/**
+ * Pump usage of one day, per valve mode (index = mode - 1)
+ */
+struct PersistedUsageDay {
+  uint32_t day;                                 // Local days since epoch, 0 if not known yet
+  uint32_t runtimeSeconds[STATE_USAGE_MODES];
+  uint32_t energyWs[STATE_USAGE_MODES];         // Estimated energy (watt-seconds)
+  uint16_t starts[STATE_USAGE_MODES];           // OFF -> ON switches
+};
+
+/**
+ * Usage counters of the current and the last completed day
+ */
+struct PersistedUsage {
+  PersistedUsageDay today;
+  PersistedUsageDay lastDay;
+};
+
+/**
+ * Load credentials and actuator state from NVS into RAM
+ * Call once from setup() before any other function in this module
+ */
+void initStateStore();
+
+/**
+ * Get the state restored at boot (and kept current since)
+ */
+const PersistedState& getPersistedState();
+
+/**
+ * Record the current pump/valve state (written on the next flush)
+ */
+void persistActuatorState(bool pumpOn, int valveMode);
+
+/**
+ * Record the set of running timers (written on the next flush)
+ * The timer engine decides when progress is worth a write (see timer_engine.h)
+ * @param timers Running timers
+ * @param count Number of entries (max STATE_MAX_TIMERS)
+ */
+void persistTimers(const PersistedTimer* timers, uint8_t count);
+
+/**
+ * Write dirty state to NVS
+ * @param force true to write immediately (e.g. before restart), false to honor STATE_FLUSH_DELAY
+ */
+void flushStateStore(bool force);
+
+/**
+ * Get WiFi credentials from the RAM cache
+ * @param ssid Buffer for SSID (min 33 bytes)
+ * @param password Buffer for password (min 64 bytes)
+ * @return true if credentials exist, false otherwise
+ */
+bool loadWiFiCredentials(char* ssid, char* password);
+
+/**
+ * Save WiFi credentials to NVS and the RAM cache (written immediately)
+ * @param ssid WiFi SSID
+ * @param password WiFi password
+ */
+void saveWiFiCredentials(const char* ssid, const char* password);
+
+/**
+ * Clear WiFi credentials from NVS and the RAM cache
+ * Useful for testing or factory reset
+ */
+void clearWiFiCredentials();
+
+/**
+ * Get the broker endpoint list from the RAM cache
+ * @param config Output
+ * @return false if no list was ever saved (use compile-time defaults)
+ */
+bool loadBrokerConfig(PersistedBrokers* config);
+
+/**
+ * Save the broker endpoint list to NVS and the RAM cache (written immediately)
+ * Skipped when nothing changed.
+ */
+void saveBrokerConfig(const PersistedBrokers& config);
+
+/**
+ * Read a runtime setting (runtime_config.h reads each one once at boot)
+ * @param key Setting name (max 15 chars, NVS key limit)
+ * @param value Output
+ * @return false if never saved (use the default)
+ */
+bool loadConfigValue(const char* key, uint32_t* value);
+
+/**
+ * Save a runtime setting to NVS (written immediately)
+ */
+void saveConfigValue(const char* key, uint32_t value);
+
+/**
+ * Remove a runtime setting so the default applies again
+ */
+void removeConfigValue(const char* key);
+
+/**
+ * Read the pump usage counters (pump_usage.h reads them once at boot)
+ * @return false if never saved
+ */
+bool loadPumpUsage(PersistedUsage* usage);
+
+/**
+ * Save the pump usage counters to NVS (written immediately, skipped when unchanged)
+ */
+void savePumpUsage(const PersistedUsage& usage);
+
+#endif // STATE_STORE_H
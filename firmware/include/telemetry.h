@@ -0,0 +1,153 @@
+/**
+ * @file telemetry.h
+ * @brief Telemetry scheduler with pluggable sampling/publishing strategies
+ *
+ * Periodic telemetry (temperature, WiFi RSSI) no longer runs on fixed timers.
+ * The scheduler keeps the context of each stream (last sample, last published
+ * value, temperature trend, pump state) and asks a TelemetryStrategy:
+ * - interval(): how long until the next sample of a stream
+ * - worthPublishing(): whether a new sample should be published
+ *
+ * Built-in strategies (selected with the "telemetry_adapt" setting):
+ * - FixedTelemetry: temp_pub_ms / wifi_state_ms, every sample published
+ *   (the behavior before the scheduler existed)
+ * - AdaptiveTelemetry: temperature every temp_fast_ms while the pump runs or
+ *   the temperature moves faster than TELEMETRY_FAST_TREND; when idle and
+ *   stable the interval doubles per stable sample up to temp_idle_ms. RSSI is
+ *   sampled every wifi_state_ms but published only when it moved by
+ *   rssi_delta_db (or after TELEMETRY_MAX_SILENCE)
+ *
+ * To measure the saving, the scheduler also counts how many publishes the
+ * fixed intervals would have produced over the same time.
+ *
+ * Flow:
+ * 1. setup() calls setTelemetryStrategy()
+ * 2. loop() samples a stream when telemetrySampleDue() says so
+ * 3. The sample goes to telemetryOffer(), which says whether to publish it
+ * 4. Once it was actually published, telemetryPublished() counts it as sent
+ *    (a sample offered while MQTT is down is not, so the delta filter keeps
+ *    comparing against what the broker has)
+ */
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <Arduino.h>
+
+#define TELEMETRY_FAST_TREND     0.2f     // Temperature change that counts as "moving" (°C/min)
+#define TELEMETRY_STABLE_DELTA   0.2f     // Samples closer than this to the previous are stable (°C)
+#define TELEMETRY_MAX_SILENCE    600000   // Publish at least this often even without change (ms)
+
+enum TelemetryStream : uint8_t {
+  TELEMETRY_TEMPERATURE = 0,
+  TELEMETRY_WIFI,
+  TELEMETRY_STREAM_COUNT
+};
+
+/**
+ * Scheduler state of one stream
+ */
+struct TelemetrySeries {
+  float lastPublished;        // Value last published (NAN if none)
+  uint32_t lastSampleMs;      // millis() of the last sample
+  uint32_t lastPublishMs;     // millis() of the last publish
+  uint32_t samples;           // Samples taken
+  uint32_t sent;              // Samples published
+  uint32_t fixedEquivalent;   // Publishes the fixed intervals would have made
+  uint32_t lastFixedMs;       // Fixed-interval schedule being simulated
+};
+
+/**
+ * Everything a strategy may base its decisions on
+ */
+struct TelemetryContext {
+  bool pumpOn;
+  float lastTemperature;      // Last sample (NAN if none)
+  float tempTrend;            // Smoothed change (°C/min)
+  uint8_t stableSamples;      // Consecutive stable temperature samples
+  TelemetrySeries series[TELEMETRY_STREAM_COUNT];
+};
+
+/**
+ * Sampling/publishing policy
+ */
+class TelemetryStrategy {
+ public:
+  virtual ~TelemetryStrategy() {}
+  virtual const char* name() const = 0;
+
+  /**
+   * Time between samples of a stream in the current context (ms)
+   */
+  virtual uint32_t interval(TelemetryStream stream, const TelemetryContext& context) const = 0;
+
+  /**
+   * Whether a new sample should be published (context not yet updated with it)
+   */
+  virtual bool worthPublishing(TelemetryStream stream, float value, const TelemetryContext& context) const = 0;
+};
+
+class FixedTelemetry : public TelemetryStrategy {
+ public:
+  const char* name() const override { return "fixed"; }
+  uint32_t interval(TelemetryStream stream, const TelemetryContext& context) const override;
+  bool worthPublishing(TelemetryStream stream, float value, const TelemetryContext& context) const override;
+};
+
+class AdaptiveTelemetry : public TelemetryStrategy {
+ public:
+  const char* name() const override { return "adaptive"; }
+  uint32_t interval(TelemetryStream stream, const TelemetryContext& context) const override;
+  bool worthPublishing(TelemetryStream stream, float value, const TelemetryContext& context) const override;
+};
+
+/**
+ * Rates and savings (since boot)
+ */
+struct TelemetryStats {
+  const char* strategy;
+  uint32_t intervalMs[TELEMETRY_STREAM_COUNT];   // Current sample interval
+  uint32_t samples[TELEMETRY_STREAM_COUNT];
+  uint32_t sent[TELEMETRY_STREAM_COUNT];
+  uint32_t fixedEquivalent[TELEMETRY_STREAM_COUNT];
+};
+
+/**
+ * Use a strategy from now on (the stream context is kept)
+ */
+void setTelemetryStrategy(TelemetryStrategy* strategy);
+
+/**
+ * Report pump state changes (running pump = fast temperature sampling)
+ */
+void setTelemetryPumpState(bool on);
+
+/**
+ * Check whether a stream should be sampled now (call in loop)
+ * @return true once per interval; the sample is expected right away
+ */
+bool telemetrySampleDue(TelemetryStream stream);
+
+/**
+ * Hand a new sample to the scheduler
+ * @return true if it should be published
+ */
+bool telemetryOffer(TelemetryStream stream, float value);
+
+/**
+ * Record that a sample was published (counted as sent; the next offers are
+ * compared against it)
+ */
+void telemetryPublished(TelemetryStream stream, float value);
+
+/**
+ * Get rates and savings
+ */
+void getTelemetryStats(TelemetryStats* stats);
+
+/**
+ * Stream name for logs and JSON
+ */
+const char* telemetryStreamName(uint8_t stream);
+
+#endif // TELEMETRY_H
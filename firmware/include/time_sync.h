@@ -0,0 +1,83 @@
+/**
+ * @file time_sync.h
+ * @brief Background SNTP with periodic resync, drift estimate and event timestamps
+ *
+ * SNTP runs in the lwIP task: nothing waits for it. Each sync is recorded
+ * against the monotonic clock (esp_timer), which gives:
+ * - The crystal drift between syncs (ppm), used to correct epoch estimates
+ *   until the next resync
+ * - Epoch timestamps for any millis() stamp of this boot, including events
+ *   that happened before the first sync
+ *
+ * Published state and events carry "ts" (epoch ms of the event, not of the
+ * publish), so history can order out-of-order data and drop replays.
+ *
+ * TLS validates certificate dates, so the first connect waits for the clock,
+ * without blocking, for up to TIME_SYNC_WAIT (then it tries anyway).
+ *
+ * Flow:
+ * 1. setup() calls initTimeSync() once the WiFi stack is up
+ * 2. loop() calls timeSyncLoop(); it returns true when a sync was applied
+ * 3. Publishers stamp with timeEpochMs() / timeEpochMsAt(stamp)
+ */
+
+#ifndef TIME_SYNC_H
+#define TIME_SYNC_H
+
+#include <Arduino.h>
+
+#define TIME_SYNC_SERVER_1     "pool.ntp.org"
+#define TIME_SYNC_SERVER_2     "time.nist.gov"
+#define TIME_RESYNC_INTERVAL   3600000         // SNTP resync (ms)
+#define TIME_SYNC_WAIT         15000           // Max wait for the clock before a TLS connect (ms)
+#define TIME_MIN_VALID_EPOCH   1700000000LL    // Earlier clocks are not set (Nov 2023)
+#define TIME_DRIFT_MIN_SPAN    600000          // Syncs closer than this are too noisy for drift (ms)
+
+/**
+ * Clock state for diagnostics
+ */
+struct TimeSyncStatus {
+  bool valid;                 // Epoch timestamps available
+  uint32_t syncs;             // SNTP syncs since boot
+  uint32_t sinceSyncMs;       // Time since the last sync
+  int32_t lastCorrectionMs;   // Clock step at the last resync (server - local estimate)
+  float driftPpm;             // Estimated crystal drift (+ = local clock fast)
+};
+
+/**
+ * Start SNTP in the background (safe to call again, e.g. after provisioning)
+ */
+void initTimeSync();
+
+/**
+ * Apply syncs reported by SNTP (call in loop)
+ * @return true if a sync was applied
+ */
+bool timeSyncLoop();
+
+/**
+ * Whether the wall clock is set (synced this boot, or kept across a restart)
+ */
+bool timeIsValid();
+
+/**
+ * Whether a TLS connect can be attempted: clock valid or TIME_SYNC_WAIT elapsed
+ */
+bool timeSyncSettled();
+
+/**
+ * Current time (epoch ms), 0 if the clock is not valid
+ */
+uint64_t timeEpochMs();
+
+/**
+ * Epoch ms of a past millis() stamp, 0 if the clock is not valid
+ */
+uint64_t timeEpochMsAt(uint32_t stampMs);
+
+/**
+ * Get clock state
+ */
+void getTimeSyncStatus(TimeSyncStatus* status);
+
+#endif // TIME_SYNC_H
@@ -0,0 +1,111 @@
+/**
+ * @file timer_engine.h
+ * @brief Deadline-based engine for concurrent named pump timers
+ *
+ * Each timer stores the absolute deadline at which it expires on the monotonic
+ * clock (esp_timer, microseconds) instead of a countdown, so remaining time is
+ * always computed as deadline - now: no fractional seconds are lost and a
+ * blocking call (TLS connect, sensor read) only delays the expiry check, not
+ * the deadline itself.
+ *
+ * Once NTP is available the deadlines are also anchored to the wall clock and
+ * persisted, so a timer survives a reboot without losing the time the device
+ * was off. Before NTP, progress is checkpointed every TIMER_CHECKPOINT_INTERVAL.
+ *
+ * Flow:
+ * 1. setup() calls initTimerEngine() after initStateStore()
+ * 2. Commands call startNamedTimer()/cancelNamedTimer()
+ * 3. serviceTimeSync() calls anchorTimersToWallClock() once SNTP has synced
+ * 4. loop() drains pollExpiredTimer() and calls checkpointTimers()
+ */
+
+#ifndef TIMER_ENGINE_H
+#define TIMER_ENGINE_H
+
+#include <Arduino.h>
+#include "state_store.h"
+
+#define TIMER_MAX_COUNT            STATE_MAX_TIMERS
+#define TIMER_NAME_LEN             STATE_TIMER_NAME_LEN
+#define TIMER_DEFAULT_NAME         "manual"  // Used when a command does not name its timer
+#define TIMER_CHECKPOINT_INTERVAL  60        // Persist unanchored progress every N seconds
+
+/**
+ * Snapshot of one running timer
+ */
+struct TimerInfo {
+  char name[TIMER_NAME_LEN];
+  uint8_t mode;               // Valve mode: 1 or 2
+  uint32_t durationSeconds;   // Total duration
+  uint32_t remainingSeconds;  // Rounded up, 0 only once expired
+};
+
+/**
+ * Restore running timers from the state store
+ * Timers resume from their last checkpoint until anchorTimersToWallClock()
+ * corrects them for the time spent powered off.
+ */
+void initTimerEngine();
+
+/**
+ * Start (or restart) a named timer
+ * @param name Timer name (truncated to TIMER_NAME_LEN - 1), nullptr/empty for TIMER_DEFAULT_NAME
+ * @param mode Valve mode: 1 or 2
+ * @param durationSeconds Duration in seconds (> 0)
+ * @return false if the parameters are invalid or all slots are in use
+ */
+bool startNamedTimer(const char* name, int mode, uint32_t durationSeconds);
+
+/**
+ * Cancel a named timer
+ * @return true if a timer with that name was running
+ */
+bool cancelNamedTimer(const char* name);
+
+/**
+ * Cancel every running timer
+ */
+void cancelAllTimers();
+
+/**
+ * Number of running timers
+ */
+int activeTimerCount();
+
+/**
+ * Get a running timer by position (0 .. activeTimerCount() - 1)
+ * @return false if index is out of range
+ */
+bool getTimerInfo(int index, TimerInfo* info);
+
+/**
+ * Get the timer that expires last (the one that decides when the pump stops)
+ * @return false if no timer is running
+ */
+bool getPrimaryTimer(TimerInfo* info);
+
+/**
+ * Remove and return one expired timer (main loop, call until it returns false)
+ * @param info Output: the expired timer
+ * @return true if a timer expired
+ */
+bool pollExpiredTimer(TimerInfo* info);
+
+/**
+ * Time until the next timer expires (for a loop that sleeps)
+ * @return Milliseconds, rounded up (0 = already expired), UINT32_MAX if none is running
+ */
+uint32_t msUntilNextExpiry();
+
+/**
+ * Anchor deadlines to the wall clock (call after a successful NTP sync)
+ * Timers restored from a previous boot are corrected for the downtime.
+ */
+void anchorTimersToWallClock();
+
+/**
+ * Persist progress of timers not yet anchored to the wall clock (call in loop)
+ */
+void checkpointTimers();
+
+#endif // TIMER_ENGINE_H
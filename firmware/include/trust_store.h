@@ -0,0 +1,37 @@
+/**
+ * @file trust_store.h
+ * @brief TLS trust anchors from the embedded certificate bundle
+ *
+ * data/cert/x509_crt_bundle.bin (built from cacert.pem by gen_crt_bundle.py)
+ * is linked into the firmware through board_build.embed_files. It holds each
+ * root CA as DER subject name + public key, sorted by subject, so mbedTLS
+ * finds the anchor for a broker certificate with a binary search instead of
+ * parsing a PEM (base64 decode + full X.509 parse) on every connection.
+ *
+ * Any broker whose chain ends in a bundled root is accepted, so endpoints
+ * with different CAs need no reflash. If the bundle is missing or malformed
+ * the client falls back to the pinned ISRG Root X1 PEM from ca_cert.h.
+ *
+ * Flow:
+ * 1. setupMqtt() calls applyTrustStore(tlsClient) once
+ */
+
+#ifndef TRUST_STORE_H
+#define TRUST_STORE_H
+
+#include <Arduino.h>
+
+class WiFiClientSecure;
+
+#ifndef TLS_USE_CERT_BUNDLE
+#define TLS_USE_CERT_BUNDLE     1     // 0 = always use the pinned PEM from ca_cert.h
+#endif
+
+/**
+ * Install trust anchors on a TLS client
+ * @param client Client to configure (before connect)
+ * @return Number of trust anchors installed (1 when falling back to the PEM)
+ */
+uint16_t applyTrustStore(WiFiClientSecure& client);
+
+#endif // TRUST_STORE_H
@@ -0,0 +1,115 @@
+/**
+ * @file watchdog.h
+ * @brief Subsystem heartbeats, stall tracking and the ESP32 task watchdog
+ *
+ * Two layers:
+ * - Software: each subsystem (network, control, sensor, BLE) reports progress
+ *   with watchdogHeartbeat(). Once it has reported, it must do so again within
+ *   its deadline, otherwise a missed heartbeat is logged and counted (once per
+ *   episode) until watchdogIdle() says it stopped on purpose.
+ * - Hardware: the loop task is subscribed to the ESP32 task watchdog
+ *   (WATCHDOG_TIMEOUT_S). If the loop stops feeding it, the chip resets.
+ *
+ * Blocking calls (WiFi connect, TLS/MQTT connect, sensor read) are wrapped
+ * in named phases. A loop iteration longer than WATCHDOG_STALL_MIN is a stall,
+ * blamed on the longest phase it contained. The longest stall and the phase
+ * running right now live in RTC memory, which survives software and watchdog
+ * resets: after a reboot the previous boot's longest stall (or the phase that
+ * hung until the task watchdog fired) is logged and reported in diagnostics.
+ *
+ * Flow:
+ * 1. setup() calls initWatchdog() first
+ * 2. Blocking code runs between watchdogEnterPhase("name") / watchdogExitPhase()
+ * 3. Subsystems call watchdogHeartbeat() when they make progress
+ * 4. loop() calls watchdogLoop() every iteration
+ */
+
+#ifndef WATCHDOG_H
+#define WATCHDOG_H
+
+#include <Arduino.h>
+
+#define WATCHDOG_TIMEOUT_S         60      // Task watchdog: longer than any single blocking phase (s)
+#define WATCHDOG_STALL_MIN         2000    // Loop iterations longer than this are stalls (ms)
+#define WATCHDOG_PHASE_LEN         16      // Phase name buffer (incl. null)
+#define WATCHDOG_PHASE_DEPTH       4       // Max nested phases
+
+// Heartbeat deadlines per subsystem (ms)
+#define WATCHDOG_NETWORK_DEADLINE  60000   // MQTT session serviced
+#define WATCHDOG_CONTROL_DEADLINE  5000    // Timers/relays serviced
+#define WATCHDOG_SENSOR_DEADLINE   5000    // Temperature conversion completed
+#define WATCHDOG_BLE_DEADLINE      5000    // BLE events serviced
+
+/**
+ * Monitored subsystems
+ */
+enum WatchdogSubsystem : uint8_t {
+  WDT_NETWORK = 0,
+  WDT_CONTROL,
+  WDT_SENSOR,
+  WDT_BLE,
+  WDT_SUBSYSTEM_COUNT
+};
+
+/**
+ * One stall: how long, where, and when
+ */
+struct StallRecord {
+  uint32_t durationMs;                // 0 = none
+  char phase[WATCHDOG_PHASE_LEN];     // Phase blamed ("loop" if none was running)
+  uint32_t uptimeSeconds;             // When it ended
+};
+
+/**
+ * Watchdog metrics
+ */
+struct WatchdogReport {
+  StallRecord longest;                // Longest stall this boot
+  StallRecord previous;               // Longest stall of the previous boot (RTC memory)
+  const char* resetReason;            // Why the previous boot ended
+  uint32_t stalls;                    // Stalls this boot
+  uint32_t missed[WDT_SUBSYSTEM_COUNT];  // Missed heartbeat episodes per subsystem
+};
+
+/**
+ * Recover the previous boot's record from RTC memory and arm the task watchdog
+ */
+void initWatchdog();
+
+/**
+ * Start a named blocking phase (name must be a string literal; feeds the task watchdog)
+ */
+void watchdogEnterPhase(const char* phase);
+
+/**
+ * End the innermost phase
+ */
+void watchdogExitPhase();
+
+/**
+ * Report progress of a subsystem (starts monitoring it)
+ */
+void watchdogHeartbeat(WatchdogSubsystem subsystem);
+
+/**
+ * Stop monitoring a subsystem until its next heartbeat (e.g. BLE stopped)
+ */
+void watchdogIdle(WatchdogSubsystem subsystem);
+
+/**
+ * Feed the task watchdog, measure the loop iteration and check heartbeats
+ * Call once per loop iteration.
+ */
+void watchdogLoop();
+
+/**
+ * Get watchdog metrics
+ */
+void getWatchdogReport(WatchdogReport* report);
+
+/**
+ * Subsystem name for logs and JSON
+ */
+const char* watchdogSubsystemName(uint8_t subsystem);
+
+#endif // WATCHDOG_H
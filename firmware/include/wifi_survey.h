@@ -0,0 +1,155 @@
+/**
+ * @file wifi_survey.h
+ * @brief Background WiFi site survey: cached AP table, instant network lists, roaming
+ *
+ * Scans used to happen only when the dashboard asked for a network list during
+ * provisioning: the driver was power-cycled and a full active scan ran while
+ * the BLE request waited. While connected the device never looked at the air,
+ * so it stayed on whichever access point it joined first.
+ *
+ * The survey runs asynchronous scans from loop() and keeps a table of the
+ * access points seen (SSID, BSSID, channel, security, last WIFI_SURVEY_HISTORY
+ * RSSI readings):
+ * - Connected: a passive scan (no probe requests, WIFI_SURVEY_DWELL ms per
+ *   channel) every WIFI_SURVEY_INTERVAL
+ * - Provisioning: an active scan every WIFI_SURVEY_IDLE_INTERVAL, so the
+ *   list is already there when the dashboard asks
+ * - Otherwise (reconnecting) no scans: they would disturb the connect
+ *
+ * Network lists are read from the cache (strongest BSSID per SSID). Only an
+ * empty cache makes the reader wait for a scan.
+ *
+ * Roaming: after each connected scan, the survey looks for another BSSID of
+ * the same SSID. It must be WIFI_ROAM_MARGIN dB stronger than the current
+ * one over the last two scans, and the current link must be weaker than
+ * WIFI_ROAM_TRIGGER. findRoamTarget() then returns it. A BSSID that could
+ * not be joined is skipped for WIFI_ROAM_BACKOFF.
+ *
+ * Threading: the table is filled by the main loop and read by the NimBLE task
+ * (provisioning); both go through a mutex held only while copying.
+ *
+ * Flow:
+ * 1. setup() calls initWifiSurvey()
+ * 2. loop() calls wifiSurveyLoop() every iteration (also while provisioning);
+ *    a loop that sleeps wakes after wifiSurveyDueMs()
+ * 3. Provisioning calls getSurveyNetworks() (requestWifiSurvey() if stale)
+ * 4. loop() calls findRoamTarget() while connected, joins the BSSID and
+ *    reports the outcome with reportRoam()
+ */
+
+#ifndef WIFI_SURVEY_H
+#define WIFI_SURVEY_H
+
+#include <Arduino.h>
+
+#define WIFI_SURVEY_ENTRIES        24       // Access points remembered (least recently seen replaced)
+#define WIFI_SURVEY_HISTORY        4        // RSSI readings kept per access point
+#define WIFI_SURVEY_INTERVAL       300000   // Connected: passive scan period (ms)
+#define WIFI_SURVEY_IDLE_INTERVAL  30000    // Provisioning: active scan period (ms)
+#define WIFI_SURVEY_DWELL          120      // Time per channel (ms); ~1.6 s off the home channel per scan
+#define WIFI_SURVEY_TIMEOUT        15000    // A scan not finished by then is abandoned (ms)
+#define WIFI_SURVEY_POLL           100      // A running scan is checked at least this often (ms)
+#define WIFI_SURVEY_MAX_AGE        900000   // Access points not seen for this long are not listed (ms)
+#define WIFI_SURVEY_FRESH          60000    // Older lists are served but trigger a new scan (ms)
+#define WIFI_ROAM_TRIGGER          -67      // Only roam away from a link weaker than this (dBm)
+#define WIFI_ROAM_MARGIN           8        // Candidate must be this much stronger (dB)
+#define WIFI_ROAM_INTERVAL         600000   // Min time between roams (ms)
+#define WIFI_ROAM_BACKOFF          1800000  // A BSSID that could not be joined is skipped this long (ms)
+
+/**
+ * Network entry of a list (one per SSID)
+ */
+struct WiFiNetworkInfo {
+  char ssid[33];   // Null-terminated SSID (max 32 chars)
+  int8_t rssi;     // Signal strength in dBm (strongest BSSID)
+  bool open;       // true if the network has no encryption
+};
+
+/**
+ * What the survey is allowed to do this iteration
+ */
+enum WifiSurveyMode : uint8_t {
+  WIFI_SURVEY_PAUSED = 0,    // Connecting: finish a running scan, start none
+  WIFI_SURVEY_BACKGROUND,    // Connected: passive scans
+  WIFI_SURVEY_PROVISIONING   // Not connected, waiting for credentials: active scans
+};
+
+/**
+ * Access point to roam to
+ */
+struct WiFiRoamTarget {
+  char ssid[33];
+  uint8_t bssid[6];
+  uint8_t channel;
+  int8_t rssi;            // Candidate (average of the last two scans)
+  int8_t currentRssi;     // Current access point (same average)
+};
+
+/**
+ * Survey metrics (since boot)
+ */
+struct WiFiSurveyStats {
+  uint8_t entries;        // Access points in the table
+  uint32_t scans;         // Scans completed
+  uint32_t failed;        // Scans failed or abandoned
+  uint32_t lastScanMs;    // Duration of the last scan
+  uint32_t ageMs;         // Time since the last completed scan (UINT32_MAX = never)
+  uint32_t roams;         // Successful roams
+  uint32_t roamFailures;
+};
+
+/**
+ * Create the table lock (call once before the first scan or list request)
+ */
+void initWifiSurvey();
+
+/**
+ * Start, collect and schedule scans (call in loop)
+ * @param mode WifiSurveyMode
+ */
+void wifiSurveyLoop(WifiSurveyMode mode);
+
+/**
+ * Time until wifiSurveyLoop() has work in this mode (main loop, for a loop that sleeps)
+ * @param mode WifiSurveyMode the next call will get
+ * @return Milliseconds (0 = now, WIFI_SURVEY_POLL while a scan runs), UINT32_MAX if none
+ */
+uint32_t wifiSurveyDueMs(WifiSurveyMode mode);
+
+/**
+ * Scan as soon as the mode allows (any task)
+ */
+void requestWifiSurvey();
+
+/**
+ * Scans completed so far (any task; a change means the table was refreshed)
+ */
+uint32_t wifiSurveyCount();
+
+/**
+ * Networks seen recently, strongest first, hidden SSIDs skipped (any task)
+ * @param networks Output array
+ * @param maxNetworks Capacity of the output array
+ * @param ageMs Output: time since the last completed scan (UINT32_MAX = never)
+ * @return Networks stored
+ */
+int getSurveyNetworks(WiFiNetworkInfo* networks, int maxNetworks, uint32_t* ageMs);
+
+/**
+ * Stronger access point of the current network found by the last scan (main loop)
+ * Returns each finding once; call while connected.
+ * @return true if target was filled
+ */
+bool findRoamTarget(WiFiRoamTarget* target);
+
+/**
+ * Report whether joining a target from findRoamTarget() worked
+ */
+void reportRoam(const uint8_t* bssid, bool ok);
+
+/**
+ * Get survey metrics
+ */
+void getWifiSurveyStats(WiFiSurveyStats* stats);
+
+#endif // WIFI_SURVEY_H
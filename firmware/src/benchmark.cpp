@@ -0,0 +1,180 @@
+/**
+ * @file benchmark.cpp
+ * @brief Benchmark runner and allocation counters
+ */
+
+#include "config.h"
+
+#if BENCHMARK_ENABLED || !defined(ARDUINO)
+
+#include "benchmark.h"
+
+#ifdef ARDUINO
+#include <esp_task_wdt.h>
+#include <esp_timer.h>
+#else
+#include <chrono>
+#include <new>
+#endif
+
+static volatile bool counting = false;
+static volatile uint32_t allocCount = 0;
+static volatile uint32_t allocBytes = 0;
+
+#ifdef ARDUINO
+// ==================== Allocation Counting ====================
+// Linked with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc: every call
+// site in the image goes through these; only the benchmarking task counts
+
+static TaskHandle_t countingTask = nullptr;
+
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+static inline void countAlloc(size_t size) {
+  if (counting && xTaskGetCurrentTaskHandle() == countingTask) {
+    allocCount++;
+    allocBytes += size;
+  }
+}
+
+void* __wrap_malloc(size_t size) {
+  countAlloc(size);
+  return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+  countAlloc(count * size);
+  return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+  countAlloc(size);   // Growing a String or buffer is an allocation too
+  return __real_realloc(ptr, size);
+}
+}
+
+static void startCounting() {
+  countingTask = xTaskGetCurrentTaskHandle();
+  counting = true;
+}
+
+static int64_t nowUs() {
+  return esp_timer_get_time();
+}
+
+/**
+ * Stop Serial output for a case that logs: at 115200 baud the case would
+ * otherwise time the UART draining, not the code
+ */
+static void muteSerial(bool mute) {
+  if (mute) {
+    Serial.flush();
+    Serial.end();     // Writes are dropped while the UART is not installed
+  } else {
+    Serial.begin(BENCH_SERIAL_BAUD);
+  }
+}
+
+#else
+// ==================== Host (env:native) ====================
+// The platform-independent modules do not call malloc; operator new covers
+// what the C++ library allocates for them. Serial is silent on the host.
+
+static void countAlloc(size_t size) {
+  if (counting) {
+    allocCount++;
+    allocBytes += size;
+  }
+}
+
+void* operator new(size_t size) {
+  countAlloc(size);
+  void* p = malloc(size ? size : 1);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void* p) noexcept {
+  free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+  free(p);
+}
+
+static void startCounting() {
+  counting = true;
+}
+
+static int64_t nowUs() {
+  using namespace std::chrono;
+  return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+static void muteSerial(bool) {}
+#endif
+
+// ==================== Public Functions ====================
+
+void runBenchmark(const BenchCase& bench, BenchResult* result) {
+  if (bench.quiet) muteSerial(true);
+
+  // Warm-up: first calls fill pools, caches and lazily created objects
+  for (int i = 0; i < 4; i++) bench.run(bench.context);
+
+  allocCount = 0;
+  allocBytes = 0;
+  startCounting();
+
+  uint32_t iterations = 0;
+  int64_t start = nowUs();
+  int64_t elapsed = 0;
+  do {
+    bench.run(bench.context);
+    iterations++;
+    elapsed = nowUs() - start;
+  } while (iterations < BENCH_MAX_ITERATIONS &&
+           (iterations < BENCH_MIN_ITERATIONS || elapsed < (int64_t)BENCH_MIN_TIME_MS * 1000));
+
+  counting = false;
+  if (bench.quiet) muteSerial(false);
+
+  result->iterations = iterations;
+  result->nsPerOp = (uint32_t)(elapsed * 1000 / iterations);
+  result->allocsPerOp = (float)allocCount / iterations;
+  result->bytesPerOp = (float)allocBytes / iterations;
+}
+
+void beginBenchmarkSuite(Print& out) {
+#ifdef ARDUINO
+  out.print(BENCH_OUTPUT_PREFIX "{\"suite\":\"firmware\",\"cpu_mhz\":");
+  out.print(getCpuFrequencyMhz());
+  out.print(",\"heap_free\":");
+  out.print(ESP.getFreeHeap());
+  out.println("}");
+#else
+  out.println(BENCH_OUTPUT_PREFIX "{\"suite\":\"host\"}");
+#endif
+}
+
+void runBenchmarkSuite(const BenchCase* cases, int count, Print& out) {
+  for (int i = 0; i < count; i++) {
+    BenchResult r;
+    runBenchmark(cases[i], &r);
+#ifdef ARDUINO
+    esp_task_wdt_reset();   // Cases run back to back in setup()
+#endif
+
+    out.print(BENCH_OUTPUT_PREFIX "{\"case\":\"");  out.print(cases[i].name);
+    out.print("\",\"iterations\":");    out.print(r.iterations);
+    out.print(",\"ns_per_op\":");       out.print(r.nsPerOp);
+    out.print(",\"allocs_per_op\":");   out.print(r.allocsPerOp, 2);
+    out.print(",\"bytes_per_op\":");    out.print(r.bytesPerOp, 1);
+    out.println("}");
+  }
+}
+
+#endif // BENCHMARK_ENABLED || !defined(ARDUINO)
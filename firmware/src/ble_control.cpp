@@ -0,0 +1,218 @@
+/**
+ * @file ble_control.cpp
+ * @brief BLE local control service implementation
+ */
+
+#include "ble_control.h"
+#include "ble_protocol.h"
+#include <NimBLEDevice.h>
+
+// ==================== BLE UUIDs ====================
+// Keep in sync with docs/js/ble-control.js
+#define CONTROL_SERVICE_UUID  "027b05b6-6282-456e-8ede-df34b5ba7d8b"
+#define CONTROL_RX_CHAR_UUID  "343455da-2b0b-44d5-8a4f-a1492822d621"  // Dashboard -> ESP32 (write)
+#define CONTROL_TX_CHAR_UUID  "4178c9a2-5a87-4fc2-ad20-d25a625db015"  // ESP32 -> dashboard (notify)
+
+// ==================== Protocol Definitions ====================
+// Frame format and common status codes: see ble_protocol.h
+
+// Opcodes: dashboard -> ESP32
+#define OP_COMMAND          0x10  // TLV_TARGET + TLV_PAYLOAD
+#define OP_GET_STATE        0x11  // No TLVs, answered with OP_STATE
+
+// Opcodes: ESP32 -> dashboard
+#define OP_STATE            0x90  // TLV_STATE
+
+// TLV types
+#define TLV_TARGET          0x30  // [target:1] (BLEControlTarget)
+#define TLV_PAYLOAD         0x31  // Same text payload as the MQTT command topic
+#define TLV_STATE           0x32  // [pump:1][valve:1][timerActive:1][timerMode:1]
+                                  // [remaining:4 LE][duration:4 LE][tempDeci:2 LE]
+
+#define CONTROL_QUEUE_LENGTH 8   // Commands buffered between NimBLE task and loop
+
+// ==================== State Variables ====================
+static NimBLECharacteristic* pControlRxCharacteristic = nullptr;
+static NimBLECharacteristic* pControlTxCharacteristic = nullptr;
+static QueueHandle_t commandQueue = nullptr;   // NimBLE task -> main loop
+static uint32_t controlPasskey = 0;
+static bool controlActive = false;
+static BLEControlState lastState;              // Main loop only
+static bool lastStateValid = false;
+
+// ==================== Helper Functions ====================
+
+static void putLE32(uint8_t* out, uint32_t v) {
+  out[0] = v & 0xFF;
+  out[1] = (v >> 8) & 0xFF;
+  out[2] = (v >> 16) & 0xFF;
+  out[3] = (v >> 24) & 0xFF;
+}
+
+/**
+ * Queue a command for the main loop and wake it
+ * @return status code for the client
+ */
+static uint8_t queueCommand(const BLEControlCommand& cmd) {
+  if (xQueueSend(commandQueue, &cmd, 0) != pdTRUE) {
+    Serial.println("[BLE-CTL] Command queue full, dropping command");
+    return STATUS_ERR_BUSY;
+  }
+  signalBLEEvent();
+  return STATUS_COMMAND_QUEUED;
+}
+
+/**
+ * Decode a COMMAND frame into a queued command
+ */
+static uint8_t handleCommandFrame(const uint8_t* tlv, size_t len) {
+  BLEControlCommand cmd;
+  cmd.target = 0;
+  cmd.length = 0;
+
+  size_t pos = 0;
+  while (pos + 2 <= len) {
+    uint8_t type = tlv[pos];
+    uint8_t vlen = tlv[pos + 1];
+    if (pos + 2 + vlen > len) return STATUS_ERR_MALFORMED;
+
+    if (type == TLV_TARGET && vlen == 1) {
+      cmd.target = tlv[pos + 2];
+    } else if (type == TLV_PAYLOAD) {
+      if (vlen > BLE_CONTROL_MAX_PAYLOAD) return STATUS_ERR_MALFORMED;
+      memcpy(cmd.payload, &tlv[pos + 2], vlen);
+      cmd.length = vlen;
+    }
+
+    pos += 2 + vlen;
+  }
+  if (pos != len) return STATUS_ERR_MALFORMED;
+
+  if (cmd.target < BLE_TARGET_PUMP || cmd.target > BLE_TARGET_TEMP_REFRESH) {
+    return STATUS_ERR_MALFORMED;
+  }
+
+  return queueCommand(cmd);
+}
+
+// ==================== BLE Callbacks ====================
+
+/**
+ * RX characteristic callback - decodes control frames (runs in the NimBLE task)
+ */
+class ControlCallbacks : public NimBLECharacteristicCallbacks {
+  void onWrite(NimBLECharacteristic* pCharacteristic) {
+    std::string value = pCharacteristic->getValue();
+    const uint8_t* data = (const uint8_t*)value.data();
+    size_t len = value.size();
+
+    uint8_t result = frameValidate(data, len);
+    if (result == FRAME_OK) {
+      const uint8_t* tlv = data + PROTO_HEADER_SIZE;
+      size_t tlvLen = len - PROTO_OVERHEAD;
+
+      if (data[1] == OP_COMMAND) {
+        result = handleCommandFrame(tlv, tlvLen);
+      } else if (data[1] == OP_GET_STATE) {
+        BLEControlCommand cmd;
+        cmd.target = BLE_TARGET_STATE;
+        cmd.length = 0;
+        result = queueCommand(cmd);
+      } else {
+        result = STATUS_ERR_UNKNOWN_OPCODE;
+      }
+    }
+
+    if (result != STATUS_COMMAND_QUEUED) {
+      Serial.print("[BLE-CTL] Rejected frame, status 0x");
+      Serial.println(result, 16);
+    }
+    frameSendStatus(pControlTxCharacteristic, result);
+  }
+};
+
+// ==================== Public Functions ====================
+
+void createBLEControlService(NimBLEServer* server) {
+  // Control requires an authenticated (passkey) link; provisioning stays open
+  NimBLEDevice::setSecurityAuth(true /*bonding*/, true /*MITM*/, true /*secure connections*/);
+  NimBLEDevice::setSecurityPasskey(controlPasskey);
+  NimBLEDevice::setSecurityIOCap(BLE_HS_IO_DISPLAY_ONLY);
+
+  NimBLEService* pService = server->createService(CONTROL_SERVICE_UUID);
+
+  // Create RX Characteristic (Write - one command frame per write)
+  pControlRxCharacteristic = pService->createCharacteristic(
+    CONTROL_RX_CHAR_UUID,
+    NIMBLE_PROPERTY::WRITE | NIMBLE_PROPERTY::WRITE_ENC | NIMBLE_PROPERTY::WRITE_AUTHEN,
+    PROTO_MAX_FRAME
+  );
+  pControlRxCharacteristic->setCallbacks(new ControlCallbacks());
+
+  // Create TX Characteristic (Read/Notify - status and state frames)
+  pControlTxCharacteristic = pService->createCharacteristic(
+    CONTROL_TX_CHAR_UUID,
+    NIMBLE_PROPERTY::READ | NIMBLE_PROPERTY::READ_ENC | NIMBLE_PROPERTY::READ_AUTHEN |
+    NIMBLE_PROPERTY::NOTIFY,
+    PROTO_MAX_FRAME
+  );
+
+  pService->start();
+  lastStateValid = false;
+
+  Serial.print("[BLE-CTL] ✓ Control service UUID: ");
+  Serial.println(CONTROL_SERVICE_UUID);
+}
+
+void initBLEControl(uint32_t passkey) {
+  Serial.println("[BLE-CTL] Initializing BLE local control...");
+
+  controlPasskey = passkey;
+  if (!commandQueue) {
+    commandQueue = xQueueCreate(CONTROL_QUEUE_LENGTH, sizeof(BLEControlCommand));
+  }
+
+  startBLEStack();
+  controlActive = true;
+}
+
+bool isBLEControlActive() {
+  return controlActive && isBLEStackActive();
+}
+
+bool pollBLEControlCommand(BLEControlCommand* cmd) {
+  if (!commandQueue) return false;
+  return xQueueReceive(commandQueue, cmd, 0) == pdTRUE;
+}
+
+void updateBLEControlState(const BLEControlState& state, bool force) {
+  if (!isBLEControlActive() || !pControlTxCharacteristic) return;
+
+  bool changed = !lastStateValid ||
+    state.pumpOn != lastState.pumpOn ||
+    state.valveMode != lastState.valveMode ||
+    state.timerActive != lastState.timerActive ||
+    state.timerMode != lastState.timerMode ||
+    state.timerRemaining != lastState.timerRemaining ||
+    state.timerDuration != lastState.timerDuration ||
+    state.temperatureDeci != lastState.temperatureDeci;
+  if (!changed && !force) return;
+
+  lastState = state;
+  lastStateValid = true;
+
+  uint8_t value[14];
+  value[0] = state.pumpOn ? 1 : 0;
+  value[1] = state.valveMode;
+  value[2] = state.timerActive ? 1 : 0;
+  value[3] = state.timerMode;
+  putLE32(&value[4], state.timerRemaining);
+  putLE32(&value[8], state.timerDuration);
+  value[12] = (uint16_t)state.temperatureDeci & 0xFF;
+  value[13] = (uint16_t)state.temperatureDeci >> 8;
+
+  static FrameWriter f;   // Main loop only
+  frameBegin(f, OP_STATE, protoMaxNotifyFrame());
+  frameAddTLV(f, TLV_STATE, value, sizeof(value));
+  frameSend(pControlTxCharacteristic, f);
+}
@@ -0,0 +1,71 @@
+/**
+ * @file ble_protocol.cpp
+ * @brief Binary frame encoding/decoding shared by the BLE services
+ */
+
+#include "ble_protocol.h"
+#include <NimBLEDevice.h>
+
+uint16_t protoCrc16(const uint8_t* data, size_t length) {
+  uint16_t crc = 0xFFFF;
+  for (size_t i = 0; i < length; i++) {
+    crc ^= (uint16_t)data[i] << 8;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+    }
+  }
+  return crc;
+}
+
+void frameBegin(FrameWriter& f, uint8_t opcode, size_t limit) {
+  f.buf[0] = PROTO_VERSION;
+  f.buf[1] = opcode;
+  f.len = PROTO_HEADER_SIZE;
+  f.limit = limit < PROTO_MAX_FRAME ? limit : PROTO_MAX_FRAME;
+}
+
+bool frameAddTLV(FrameWriter& f, uint8_t type, const uint8_t* value, uint8_t valueLen) {
+  if (f.len + 2 + valueLen + PROTO_CRC_SIZE > f.limit) return false;
+  f.buf[f.len++] = type;
+  f.buf[f.len++] = valueLen;
+  memcpy(&f.buf[f.len], value, valueLen);
+  f.len += valueLen;
+  return true;
+}
+
+size_t frameFinish(FrameWriter& f) {
+  uint16_t payloadLen = f.len - PROTO_HEADER_SIZE;
+  f.buf[2] = payloadLen & 0xFF;
+  f.buf[3] = payloadLen >> 8;
+  uint16_t crc = protoCrc16(f.buf, f.len);
+  f.buf[f.len++] = crc & 0xFF;
+  f.buf[f.len++] = crc >> 8;
+  return f.len;
+}
+
+uint8_t frameValidate(const uint8_t* data, size_t len) {
+  if (len < PROTO_OVERHEAD) return STATUS_ERR_MALFORMED;
+  if (data[0] != PROTO_VERSION) return STATUS_ERR_VERSION;
+
+  size_t payloadLen = data[2] | ((size_t)data[3] << 8);
+  if (payloadLen + PROTO_OVERHEAD != len) return STATUS_ERR_MALFORMED;
+
+  uint16_t expected = data[len - 2] | ((uint16_t)data[len - 1] << 8);
+  if (protoCrc16(data, len - PROTO_CRC_SIZE) != expected) return STATUS_ERR_CHECKSUM;
+
+  return FRAME_OK;
+}
+
+void frameSend(NimBLECharacteristic* characteristic, FrameWriter& f) {
+  if (!characteristic) return;
+  size_t len = frameFinish(f);
+  characteristic->setValue(f.buf, len);
+  characteristic->notify();
+}
+
+void frameSendStatus(NimBLECharacteristic* characteristic, uint8_t code) {
+  FrameWriter f;
+  frameBegin(f, OP_STATUS, protoMaxNotifyFrame());
+  frameAddTLV(f, TLV_STATUS, &code, 1);
+  frameSend(characteristic, f);
+}
@@ -4,35 +4,211 @@
  */
 
 #include "ble_provisioning.h"
+#include "ble_protocol.h"
+#include "ble_control.h"
+#include "config.h"
 #include <NimBLEDevice.h>
 #include <Preferences.h>
 #include <WiFi.h>
+#include <atomic>
 
 // ==================== BLE UUIDs ====================
 // Custom UUIDs for Pool Controller WiFi Provisioning Service
 #define SERVICE_UUID        "4fafc201-1fb5-459e-8fcc-c5c9c331914b"
-#define SSID_CHAR_UUID      "beb5483e-36e1-4688-b7f5-ea07361b26a8"
-#define PASSWORD_CHAR_UUID  "cba1d466-344c-4be3-ab3f-189f80dd7518"
-#define STATUS_CHAR_UUID    "8d8218b6-97bc-4527-a8db-13094ac06b1d"
-#define NETWORKS_CHAR_UUID  "fa87c0d0-afac-11de-8a39-0800200c9a66"  // WiFi networks scan result
-// Remote commands (e.g., clear WiFi). Keep in sync with dashboard JS.
-#define COMMAND_CHAR_UUID   "8b9d68c4-57b8-4b02-bf19-6fd94b62f709"
+// Single characteristic pair carrying binary protocol frames. Keep in sync with dashboard JS.
+#define RX_CHAR_UUID        "971810a1-d99e-435a-b6fe-e13cd5981cf6"  // Dashboard -> ESP32 (write)
+#define TX_CHAR_UUID        "3ce0b731-d49f-4ccb-b609-3c02000a0aad"  // ESP32 -> dashboard (notify)
+
+// ==================== Link Parameters ====================
+#define BLE_PREFERRED_MTU   517   // Largest ATT MTU accepted by Web Bluetooth clients
+#define BLE_DEFAULT_MTU     23    // ATT MTU until the client negotiates a larger one
+#define BLE_MAX_NETWORK_FRAMES (BLE_MAX_NETWORKS + 1)  // NETWORKS notifications per scan
+
+// Classic ESP32 is a BLE 4.2 controller (1M PHY only); newer targets support 2M PHY
+#if !defined(CONFIG_IDF_TARGET_ESP32)
+#define BLE_PREFER_2M_PHY   1
+#else
+#define BLE_PREFER_2M_PHY   0
+#endif
+
+// ==================== Protocol Definitions ====================
+// Frame format and common status codes: see ble_protocol.h
+
+// Opcodes: dashboard -> ESP32
+#define OP_SCAN             0x01  // Scan WiFi networks (no TLVs)
+#define OP_SET_CREDENTIALS  0x02  // TLV_SSID + TLV_PASSWORD in one write
+#define OP_CLEAR_WIFI       0x03  // Erase stored WiFi credentials (no TLVs)
+
+// Opcodes: ESP32 -> dashboard
+#define OP_NETWORKS         0x81  // TLV_FRAGMENT + N x TLV_NETWORK
+
+// TLV types
+#define TLV_SSID            0x01  // UTF-8, 1..32 bytes
+#define TLV_PASSWORD        0x02  // UTF-8, 0..63 bytes
+#define TLV_NETWORK         0x20  // [rssi:int8][flags:1][ssid...] (flags bit0 = open)
+#define TLV_FRAGMENT        0x21  // [index:1][flags:1] (FRAGMENT_* flags)
+
+// TLV_FRAGMENT flags
+#define FRAGMENT_LAST       0x01  // No more NETWORKS frames follow
+#define FRAGMENT_OMITTED    0x02  // Some networks did not fit a frame at this MTU (last frame only)
 
 // ==================== Global BLE Objects ====================
 static NimBLEServer* pServer = nullptr;
-static NimBLECharacteristic* pSSIDCharacteristic = nullptr;
-static NimBLECharacteristic* pPasswordCharacteristic = nullptr;
-static NimBLECharacteristic* pStatusCharacteristic = nullptr;
-static NimBLECharacteristic* pNetworksCharacteristic = nullptr;
-static NimBLECharacteristic* pCommandCharacteristic = nullptr;
+static NimBLEService* pProvisioningService = nullptr;
+static NimBLECharacteristic* pRxCharacteristic = nullptr;
+static NimBLECharacteristic* pTxCharacteristic = nullptr;
 
 // ==================== State Variables ====================
-static bool bleActive = false;
-static bool newCredentialsReceived = false;
-static String receivedSSID = "";
-static String receivedPassword = "";
-static bool deviceConnected = false;
-static bool clearWiFiRequested = false;
+// Flags below are written by the NimBLE host task and read by the main loop task.
+// receivedSSID/receivedPassword are only written while newCredentialsReceived is false
+// and published with a release store, so the loop sees complete buffers after an acquire load.
+static bool bleStackActive = false;   // NimBLE running (provisioning and/or control)
+static bool bleActive = false;        // Provisioning mode (credentials accepted)
+static std::atomic<bool> newCredentialsReceived(false);
+static char receivedSSID[33] = "";
+static char receivedPassword[64] = "";
+static std::atomic<bool> deviceConnected(false);
+static std::atomic<bool> clearWiFiRequested(false);
+static std::atomic<uint16_t> negotiatedMTU(BLE_DEFAULT_MTU);
+static std::atomic<bool> statusSubscribed(false);  // Client enabled TX notifications
+static TaskHandle_t eventTask = nullptr;  // Task woken on credential/clear events
+
+// ==================== Frame Helpers ====================
+
+/**
+ * Notify a status code to the dashboard
+ */
+static void sendStatus(uint8_t code) {
+  if (code != STATUS_CONNECTED) {
+    frameSendStatus(pTxCharacteristic, code);
+    return;
+  }
+
+  // Connection status also reports the link MTU
+  FrameWriter f;
+  frameBegin(f, OP_STATUS, protoMaxNotifyFrame());
+  frameAddTLV(f, TLV_STATUS, &code, 1);
+  uint16_t mtu = negotiatedMTU;
+  uint8_t mtuBytes[2] = { (uint8_t)(mtu & 0xFF), (uint8_t)(mtu >> 8) };
+  frameAddTLV(f, TLV_MTU, mtuBytes, sizeof(mtuBytes));
+  frameSend(pTxCharacteristic, f);
+}
+
+/**
+ * Scan networks and stream them as NETWORKS frames sized to the negotiated MTU
+ * The last frame has the "last" fragment flag set (an empty list is one empty last frame).
+ * Entries that do not fit even an empty frame (long SSID before the client raised the
+ * MTU) are skipped and reported with the "omitted" fragment flag.
+ */
+static void sendNetworkList() {
+  static WiFiNetworkInfo networks[BLE_MAX_NETWORKS];
+  static FrameWriter f;
+
+  sendStatus(STATUS_SCAN_STARTED);
+  int count = scanWiFiNetworks(networks, BLE_MAX_NETWORKS);
+
+  uint8_t fragmentIndex = 0;
+  int next = 0;
+  int frames = 0;
+  int omitted = 0;
+  do {
+    frameBegin(f, OP_NETWORKS, protoMaxNotifyFrame());
+    // Reserve the fragment header; flags are patched once we know if more follow
+    uint8_t fragment[2] = { fragmentIndex, 0 };
+    frameAddTLV(f, TLV_FRAGMENT, fragment, sizeof(fragment));
+    size_t flagsOffset = f.len - 1;
+    size_t emptyLen = f.len;
+
+    while (next < count) {
+      uint8_t entry[2 + 32];
+      size_t ssidLen = strlen(networks[next].ssid);
+      entry[0] = (uint8_t)networks[next].rssi;
+      entry[1] = networks[next].open ? 0x01 : 0x00;
+      memcpy(&entry[2], networks[next].ssid, ssidLen);
+      if (frameAddTLV(f, TLV_NETWORK, entry, 2 + ssidLen)) {
+        next++;
+      } else if (f.len == emptyLen) {
+        omitted++;   // Never fits at this MTU: skip it, or this loop would not advance
+        next++;
+      } else {
+        break;
+      }
+    }
+
+    frames++;
+    if (next < count && frames == BLE_MAX_NETWORK_FRAMES) {
+      omitted += count - next;   // Hard bound on notifications per scan
+      next = count;
+    }
+    if (next >= count) {
+      f.buf[flagsOffset] = FRAGMENT_LAST | (omitted ? FRAGMENT_OMITTED : 0);
+    }
+    frameSend(pTxCharacteristic, f);
+    fragmentIndex++;
+  } while (next < count);
+
+  Serial.print("[BLE] Sent ");
+  Serial.print(count - omitted);
+  Serial.print(" networks in ");
+  Serial.print(frames);
+  Serial.print(" frame(s), MTU ");
+  Serial.println(negotiatedMTU);
+  if (omitted) {
+    Serial.print("[BLE] ⚠ ");
+    Serial.print(omitted);
+    Serial.println(" network(s) omitted: SSID too long for the MTU");
+  }
+}
+
+// ==================== Frame Decoding ====================
+
+/**
+ * Apply a SET_CREDENTIALS frame
+ * Credentials are only published to the main loop once the whole frame is valid
+ */
+static uint8_t handleSetCredentials(const uint8_t* tlv, size_t len) {
+  const uint8_t* ssid = nullptr;
+  const uint8_t* password = nullptr;
+  uint8_t ssidLen = 0;
+  uint8_t passwordLen = 0;
+
+  size_t pos = 0;
+  while (pos + 2 <= len) {
+    uint8_t type = tlv[pos];
+    uint8_t vlen = tlv[pos + 1];
+    if (pos + 2 + vlen > len) return STATUS_ERR_MALFORMED;
+
+    if (type == TLV_SSID) { ssid = &tlv[pos + 2]; ssidLen = vlen; }
+    else if (type == TLV_PASSWORD) { password = &tlv[pos + 2]; passwordLen = vlen; }
+    // Unknown TLVs are ignored so newer dashboards stay compatible
+
+    pos += 2 + vlen;
+  }
+  if (pos != len) return STATUS_ERR_MALFORMED;
+
+  if (!ssid || ssidLen == 0 || ssidLen > 32 || passwordLen > 63) {
+    return STATUS_ERR_MALFORMED;
+  }
+
+  // The loop owns the buffers until it calls clearBLECredentials()
+  if (newCredentialsReceived.load(std::memory_order_acquire)) {
+    return STATUS_ERR_BUSY;
+  }
+
+  memcpy(receivedSSID, ssid, ssidLen);
+  receivedSSID[ssidLen] = '\0';
+  if (password) memcpy(receivedPassword, password, passwordLen);
+  receivedPassword[passwordLen] = '\0';
+  newCredentialsReceived.store(true, std::memory_order_release);
+  signalBLEEvent();
+
+  Serial.print("[BLE] ✓ WiFi credentials received for: ");
+  Serial.print(receivedSSID);
+  Serial.print(" (password ");
+  Serial.print(passwordLen);
+  Serial.println(" chars)");
+  return STATUS_CREDENTIALS_READY;
+}
 
 // ==================== BLE Callbacks ====================
 
@@ -40,209 +216,236 @@ static bool clearWiFiRequested = false;
  * Server callback - handles client connect/disconnect events
  */
 class ServerCallbacks : public NimBLEServerCallbacks {
-  void onConnect(NimBLEServer* pServer) {
+  void onConnect(NimBLEServer* pServer, ble_gap_conn_desc* desc) {
     deviceConnected = true;
+    negotiatedMTU = BLE_DEFAULT_MTU;
     Serial.println("[BLE] Client connected");
-    
-    // Update status characteristic
-    if (pStatusCharacteristic) {
-      pStatusCharacteristic->setValue("connected");
-      pStatusCharacteristic->notify();
-    }
+
+    // Short connection interval (7.5-15 ms) for fast request/response
+    pServer->updateConnParams(desc->conn_handle, 6, 12, 0, 200);
+
+#if BLE_PREFER_2M_PHY
+    ble_gap_set_prefered_le_phy(desc->conn_handle, BLE_GAP_LE_PHY_2M_MASK,
+                                BLE_GAP_LE_PHY_2M_MASK, 0);
+#endif
+
+    // STATUS_CONNECTED waits for the TX subscription: a notification sent now
+    // is dropped (no subscriber yet) and would report the default MTU
   }
 
   void onDisconnect(NimBLEServer* pServer) {
     deviceConnected = false;
+    statusSubscribed = false;
+    negotiatedMTU = BLE_DEFAULT_MTU;
     Serial.println("[BLE] Client disconnected");
-    
+
     // Restart advertising so others can connect
     NimBLEDevice::startAdvertising();
     Serial.println("[BLE] Advertising restarted");
   }
+
+  void onMTUChange(uint16_t MTU, ble_gap_conn_desc* desc) {
+    negotiatedMTU = MTU;
+    Serial.print("[BLE] MTU negotiated: ");
+    Serial.println(MTU);
+
+    // Exchanged after the client subscribed: report the new MTU
+    if (statusSubscribed) sendStatus(STATUS_CONNECTED);
+  }
 };
 
 /**
- * Characteristic callbacks - handles write events for WiFi credentials
+ * TX characteristic callback - reports the link once the dashboard listens
+ */
+class StatusCallbacks : public NimBLECharacteristicCallbacks {
+  void onSubscribe(NimBLECharacteristic* pCharacteristic, ble_gap_conn_desc* desc, uint16_t subValue) {
+    statusSubscribed = (subValue & 0x0001) != 0;   // Notifications bit of the CCCD
+    if (!statusSubscribed) return;
+
+    // Web Bluetooth exchanges the MTU while connecting, before service discovery
+    uint16_t mtu = pServer->getPeerMTU(desc->conn_handle);
+    if (mtu > BLE_DEFAULT_MTU) negotiatedMTU = mtu;
+    sendStatus(STATUS_CONNECTED);
+  }
+};
+
+/**
+ * RX characteristic callback - decodes protocol frames written by the dashboard
  */
 class CharacteristicCallbacks : public NimBLECharacteristicCallbacks {
   void onWrite(NimBLECharacteristic* pCharacteristic) {
-    std::string uuid = pCharacteristic->getUUID().toString();
     std::string value = pCharacteristic->getValue();
-    
-    if (uuid == SSID_CHAR_UUID) {
-      receivedSSID = String(value.c_str());
-      Serial.print("[BLE] SSID received: ");
-      Serial.println(receivedSSID);
-      
-      // Update status
-      if (pStatusCharacteristic) {
-        pStatusCharacteristic->setValue("ssid_received");
-        pStatusCharacteristic->notify();
-      }
-    } 
-    else if (uuid == PASSWORD_CHAR_UUID) {
-      receivedPassword = String(value.c_str());
-      Serial.print("[BLE] Password received (");
-      Serial.print(receivedPassword.length());
-      Serial.println(" chars)");
-      
-      // Update status
-      if (pStatusCharacteristic) {
-        pStatusCharacteristic->setValue("password_received");
-        pStatusCharacteristic->notify();
-      }
-      
-      // Both credentials received
-      if (receivedSSID.length() > 0 && receivedPassword.length() > 0) {
-        newCredentialsReceived = true;
-        Serial.println("[BLE] ✓ WiFi credentials complete");
-        
-        if (pStatusCharacteristic) {
-          pStatusCharacteristic->setValue("credentials_ready");
-          pStatusCharacteristic->notify();
-        }
-      }
+    const uint8_t* data = (const uint8_t*)value.data();
+    size_t len = value.size();
+
+    uint8_t result = frameValidate(data, len);
+    if (result != FRAME_OK) {
+      Serial.print("[BLE] Rejected frame (");
+      Serial.print(len);
+      Serial.print(" bytes), status 0x");
+      Serial.println(result, 16);
+      sendStatus(result);
+      return;
     }
-    else if (uuid == NETWORKS_CHAR_UUID) {
-      // Trigger WiFi scan when client writes to networks characteristic
-      Serial.println("[BLE] Networks scan triggered via write");
-      String json = scanWiFiNetworks();
-      
-      // Update the characteristic with scan results
-      pCharacteristic->setValue((uint8_t*)json.c_str(), json.length());
-      Serial.print("[BLE] Networks characteristic updated, length: ");
-      Serial.println(json.length());
-      
-      // Notify client that new data is available
-      pCharacteristic->notify();
+
+    uint8_t opcode = data[1];
+    const uint8_t* tlv = data + PROTO_HEADER_SIZE;
+    size_t tlvLen = len - PROTO_OVERHEAD;
+
+    // With the control service enabled the stack outlives provisioning mode
+    if (!bleActive) {
+      sendStatus(STATUS_ERR_NOT_PROVISIONING);
+      return;
     }
-    else if (uuid == COMMAND_CHAR_UUID) {
-      // Handle simple command verbs from dashboard
-      if (value == "clear_wifi") {
-        clearWiFiRequested = true;
+
+    switch (opcode) {
+      case OP_SCAN:
+        Serial.println("[BLE] Networks scan requested");
+        sendNetworkList();
+        break;
+
+      case OP_SET_CREDENTIALS:
+        sendStatus(handleSetCredentials(tlv, tlvLen));
+        break;
+
+      case OP_CLEAR_WIFI:
+        clearWiFiRequested.store(true, std::memory_order_release);
+        signalBLEEvent();
         Serial.println("[BLE] Clear WiFi command received via BLE");
+        sendStatus(STATUS_CLEAR_WIFI_REQUESTED);
+        break;
 
-        if (pStatusCharacteristic) {
-          pStatusCharacteristic->setValue("clear_wifi_requested");
-          pStatusCharacteristic->notify();
-        }
-      }
-    }
-  }
-  
-  void onRead(NimBLECharacteristic* pCharacteristic) {
-    std::string uuid = pCharacteristic->getUUID().toString();
-    
-    // Log when networks characteristic is read
-    if (uuid == NETWORKS_CHAR_UUID) {
-      Serial.println("[BLE] Networks characteristic read");
+      default:
+        Serial.print("[BLE] Unknown opcode 0x");
+        Serial.println(opcode, 16);
+        sendStatus(STATUS_ERR_UNKNOWN_OPCODE);
+        break;
     }
   }
 };
 
-// Forward declaration for scanWiFiNetworks
-String scanWiFiNetworks();
+// ==================== Shared BLE Stack ====================
 
-// ==================== Public Functions ====================
+NimBLEServer* startBLEStack() {
+  if (bleStackActive) return pServer;
 
-void initBLEProvisioning() {
-  Serial.println("[BLE] Initializing BLE provisioning...");
-  
   // Generate device name with MAC address suffix
   uint8_t mac[6];
   esp_read_mac(mac, ESP_MAC_WIFI_STA);
   char deviceName[32];
-  // Add version suffix to break cached GATT on clients
-  snprintf(deviceName, sizeof(deviceName), "Controlador Smart Pool-%02X%02X-v2", mac[4], mac[5]);
-  
+  // Add version suffix to break cached GATT on clients (v3 = binary protocol)
+  snprintf(deviceName, sizeof(deviceName), "Controlador Smart Pool-%02X%02X-v3", mac[4], mac[5]);
+
   Serial.print("[BLE] Device name: ");
   Serial.println(deviceName);
-  
+
   // Initialize NimBLE
   NimBLEDevice::init(deviceName);
-  
+
+  // Accept the largest MTU the client offers (fewer fragments per scan result)
+  NimBLEDevice::setMTU(BLE_PREFERRED_MTU);
+
   // Create BLE Server
   pServer = NimBLEDevice::createServer();
   pServer->setCallbacks(new ServerCallbacks());
-  
-  // Create BLE Service
-  NimBLEService* pService = pServer->createService(SERVICE_UUID);
-  
-  // Create SSID Characteristic (Read/Write)
-  pSSIDCharacteristic = pService->createCharacteristic(
-    SSID_CHAR_UUID,
-    NIMBLE_PROPERTY::READ | NIMBLE_PROPERTY::WRITE
-  );
-  pSSIDCharacteristic->setCallbacks(new CharacteristicCallbacks());
-  pSSIDCharacteristic->setValue(""); // Initial empty value
-  
-  // Create Password Characteristic (Write only for security)
-  pPasswordCharacteristic = pService->createCharacteristic(
-    PASSWORD_CHAR_UUID,
-    NIMBLE_PROPERTY::WRITE
-  );
-  pPasswordCharacteristic->setCallbacks(new CharacteristicCallbacks());
-  pPasswordCharacteristic->setValue("");
-  
-  // Create Status Characteristic (Read/Notify)
-  pStatusCharacteristic = pService->createCharacteristic(
-    STATUS_CHAR_UUID,
-    NIMBLE_PROPERTY::READ | NIMBLE_PROPERTY::NOTIFY
-  );
-  pStatusCharacteristic->setValue("waiting");
-  
-  // Create Networks Characteristic (Read/Write - write triggers scan, read returns JSON)
-  pNetworksCharacteristic = pService->createCharacteristic(
-    NETWORKS_CHAR_UUID,
-    NIMBLE_PROPERTY::READ | NIMBLE_PROPERTY::WRITE | NIMBLE_PROPERTY::NOTIFY
+
+  // Create Provisioning Service
+  pProvisioningService = pServer->createService(SERVICE_UUID);
+
+  // Create RX Characteristic (Write - one complete frame per write, long writes allowed)
+  pRxCharacteristic = pProvisioningService->createCharacteristic(
+    RX_CHAR_UUID,
+    NIMBLE_PROPERTY::WRITE,
+    PROTO_MAX_FRAME
   );
-  pNetworksCharacteristic->setCallbacks(new CharacteristicCallbacks());
-  pNetworksCharacteristic->setValue("[]"); // Initial empty list
+  pRxCharacteristic->setCallbacks(new CharacteristicCallbacks());
 
-  // Create Command Characteristic (Write to request actions like clearing WiFi)
-  pCommandCharacteristic = pService->createCharacteristic(
-    COMMAND_CHAR_UUID,
-    NIMBLE_PROPERTY::READ | NIMBLE_PROPERTY::WRITE | NIMBLE_PROPERTY::NOTIFY
+  // Create TX Characteristic (Read/Notify - status and scan result frames)
+  pTxCharacteristic = pProvisioningService->createCharacteristic(
+    TX_CHAR_UUID,
+    NIMBLE_PROPERTY::READ | NIMBLE_PROPERTY::NOTIFY,
+    PROTO_MAX_FRAME
   );
-  pCommandCharacteristic->setCallbacks(new CharacteristicCallbacks());
-  pCommandCharacteristic->setValue("");
-  Serial.print("[BLE] Command characteristic UUID: ");
-  Serial.println(COMMAND_CHAR_UUID);
-  
+  pTxCharacteristic->setCallbacks(new StatusCallbacks());
+
   // Start the service
-  pService->start();
-  
+  pProvisioningService->start();
+
+#if BLE_CONTROL_ENABLED
+  // Local control service shares the GATT server and stays up after provisioning
+  createBLEControlService(pServer);
+#endif
+
   // Start advertising
   NimBLEAdvertising* pAdvertising = NimBLEDevice::getAdvertising();
   pAdvertising->addServiceUUID(SERVICE_UUID);
   pAdvertising->setScanResponse(true);
   pAdvertising->setMinPreferred(0x06);  // Apple connection parameter
   pAdvertising->setMaxPreferred(0x12);
-  
+
   NimBLEDevice::startAdvertising();
-  
+
+  // Events are delivered to the task that started the stack (the Arduino loop task)
+  eventTask = xTaskGetCurrentTaskHandle();
+  bleStackActive = true;
+
+  Serial.print("[BLE] ✓ Stack started, service UUID: ");
+  Serial.println(SERVICE_UUID);
+  return pServer;
+}
+
+bool isBLEStackActive() {
+  return bleStackActive;
+}
+
+size_t protoMaxNotifyFrame() {
+  return negotiatedMTU - 3;  // ATT notification header
+}
+
+void signalBLEEvent() {
+  if (eventTask) xTaskNotifyGive(eventTask);
+}
+
+// ==================== Public Functions ====================
+
+void initBLEProvisioning() {
+  Serial.println("[BLE] Initializing BLE provisioning...");
+
+  startBLEStack();
   bleActive = true;
-  
+  sendStatus(STATUS_WAITING);
+
   Serial.println("[BLE] ✓ Provisioning service started");
   Serial.println("[BLE] Waiting for dashboard connection...");
-  Serial.print("[BLE] Service UUID: ");
-  Serial.println(SERVICE_UUID);
 }
 
 void stopBLEProvisioning() {
   if (!bleActive) return;
-  
+
+  bleActive = false;
+
+#if BLE_CONTROL_ENABLED
+  // Keep the stack running for the local control service
+  Serial.println("[BLE] ✓ Provisioning stopped (control service stays active)");
+  return;
+#endif
+
   Serial.println("[BLE] Stopping provisioning service...");
-  
+
   NimBLEDevice::stopAdvertising();
-  
+
   // deinit() automatically disconnects all clients
   NimBLEDevice::deinit(true);
-  
-  bleActive = false;
+
+  bleStackActive = false;
   deviceConnected = false;
+  statusSubscribed = false;
+  eventTask = nullptr;
   pServer = nullptr;
-  
+  pProvisioningService = nullptr;
+  pRxCharacteristic = nullptr;
+  pTxCharacteristic = nullptr;
+
   Serial.println("[BLE] ✓ Provisioning stopped");
 }
 
@@ -250,112 +453,74 @@ bool isBLEProvisioningActive() {
   return bleActive;
 }
 
+bool waitForBLEEvent(uint32_t timeoutMs) {
+  return ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeoutMs)) > 0;
+}
+
 bool hasNewWiFiCredentials() {
-  return newCredentialsReceived;
+  return newCredentialsReceived.load(std::memory_order_acquire);
 }
 
 bool getBLEWiFiSSID(char* ssid) {
-  if (receivedSSID.length() == 0) return false;
-  
-  strncpy(ssid, receivedSSID.c_str(), 32);
+  if (receivedSSID[0] == '\0') return false;
+
+  strncpy(ssid, receivedSSID, 32);
   ssid[32] = '\0';
   return true;
 }
 
 bool getBLEWiFiPassword(char* password) {
-  if (receivedPassword.length() == 0) return false;
-  
-  strncpy(password, receivedPassword.c_str(), 63);
+  // Empty password is valid (open network) once the credentials frame was accepted
+  if (!newCredentialsReceived.load(std::memory_order_acquire)) return false;
+
+  strncpy(password, receivedPassword, 63);
   password[63] = '\0';
   return true;
 }
 
 void clearBLECredentials() {
-  newCredentialsReceived = false;
-  receivedSSID = "";
-  receivedPassword = "";
+  receivedSSID[0] = '\0';
+  receivedPassword[0] = '\0';
+  // Hand the buffers back to the BLE task
+  newCredentialsReceived.store(false, std::memory_order_release);
 }
 
 /**
- * Scan available WiFi networks and return JSON array
- * @return JSON string with network list: [{"ssid":"NETWORK1","rssi":-50,"open":false},...]
+ * List WiFi networks from the survey cache (NimBLE task)
  */
-String scanWiFiNetworks() {
-  Serial.println("[BLE] Scanning WiFi networks...");
-  
-  // Properly reset WiFi driver state for BLE coexistence
-  // After WiFi.disconnect(true, true) the driver may be in inconsistent state
-  WiFi.mode(WIFI_OFF);
-  delay(100);
-  WiFi.mode(WIFI_STA);
-  delay(200);  // Give WiFi radio time to initialize after BLE is active
-  
-  // Perform WiFi scan
-  int numNetworks = WiFi.scanNetworks();
-  
-  if (numNetworks == 0 || numNetworks == -1) {
-    Serial.println("[BLE] No networks found or scan failed");
-    Serial.print("[BLE] WiFi status code: ");
-    Serial.println(WiFi.status());
-    return "[]";
+int scanWiFiNetworks(WiFiNetworkInfo* networks, int maxNetworks) {
+  uint32_t ageMs;
+  int count = getSurveyNetworks(networks, maxNetworks, &ageMs);
+  if (count > 0 && ageMs < WIFI_SURVEY_FRESH) {
+    Serial.print("[BLE] Networks from survey cache (");
+    Serial.print(ageMs / 1000);
+    Serial.println(" s old)");
+    return count;
   }
-  
-  Serial.print("[BLE] Found ");
-  Serial.print(numNetworks);
-  Serial.println(" networks");
-  
-  // Build JSON array
-  String json = "[";
-  int networkCount = 0;
-  
-  for (int i = 0; i < numNetworks; i++) {
-    String ssid = WiFi.SSID(i);
-    int rssi = WiFi.RSSI(i);
-    uint8_t encryption = WiFi.encryptionType(i);
-    bool open = (encryption == WIFI_AUTH_OPEN);
-    
-    // Skip empty SSIDs
-    if (ssid.length() == 0) continue;
-    
-    // Build network entry
-    String entry = "{\"ssid\":\"";
-    entry += ssid;
-    entry += "\",\"rssi\":";
-    entry += String(rssi);
-    entry += ",\"open\":";
-    entry += (open ? "true" : "false");
-    entry += "}";
-    
-    // Check if adding this entry would exceed safe BLE MTU (~400 bytes for reliable transmission)
-    int projectedSize = json.length() + entry.length() + (networkCount > 0 ? 1 : 0) + 1; // +1 for comma, +1 for ]
-    if (projectedSize > 400) {
-      Serial.println("[BLE] Network list too large, stopping here");
-      break;
-    }
-    
-    if (networkCount > 0) json += ",";
-    json += entry;
-    networkCount++;
+
+  // Stale or empty: the loop scans next (woken out of waitForBLEEvent)
+  uint32_t scans = wifiSurveyCount();
+  requestWifiSurvey();
+  if (eventTask) xTaskNotifyGive(eventTask);
+  if (count > 0) {
+    Serial.println("[BLE] Networks from stale survey cache, rescanning");
+    return count;
+  }
+
+  Serial.println("[BLE] Survey cache empty, waiting for a scan...");
+  uint32_t start = millis();
+  while (wifiSurveyCount() == scans && millis() - start < BLE_SCAN_WAIT) {
+    vTaskDelay(pdMS_TO_TICKS(100));
   }
-  
-  json += "]";
-  
-  // Clean up
-  WiFi.scanDelete();
-  
-  Serial.print("[BLE] JSON size: ");
-  Serial.print(json.length());
-  Serial.println(" bytes");
-  Serial.print("[BLE] JSON: ");
-  Serial.println(json);
-  
-  return json;
+  count = getSurveyNetworks(networks, maxNetworks, &ageMs);
+  if (count == 0) Serial.println("[BLE] No networks found or scan failed");
+  return count;
 }
 
 bool isClearWiFiRequested() {
-  return clearWiFiRequested;
+  return clearWiFiRequested.load(std::memory_order_acquire);
 }
 
 void resetClearWiFiRequest() {
-  clearWiFiRequested = false;
+  clearWiFiRequested.store(false, std::memory_order_release);
 }
@@ -0,0 +1,469 @@
+/**
+ * @file broker_pool.cpp
+ * @brief Broker endpoint selection, probing and failover implementation
+ */
+
+#include "broker_pool.h"
+#include <WiFi.h>
+#include <ESPmDNS.h>
+#include "config.h"
+#include "secrets.h"
+#include "watchdog.h"
+
+// ==================== Compile-time Defaults ====================
+// Secondary and LAN brokers are optional (see config.h / secrets.h)
+#if defined(MQTT_HOST_2)
+#ifndef MQTT_PORT_2
+#define MQTT_PORT_2 MQTT_PORT
+#endif
+#ifndef MQTT_USER_2
+#define MQTT_USER_2 MQTT_USER
+#define MQTT_PASS_2 MQTT_PASS
+#endif
+#endif
+
+#if defined(MQTT_LAN_HOST)
+#ifndef MQTT_LAN_PORT
+#define MQTT_LAN_PORT 1883
+#endif
+#endif
+
+// Also used for a LAN broker found over mDNS
+#ifndef MQTT_LAN_USER
+#define MQTT_LAN_USER ""
+#define MQTT_LAN_PASS ""
+#endif
+
+#define MQTT_PLAIN_PORT 1883   // Default endpoints on this port connect without TLS
+
+static const char* const ROLE_NAMES[BROKER_MAX_ENDPOINTS] = { "primary", "secondary", "lan" };
+
+/**
+ * What has been measured about one endpoint (RAM only)
+ */
+struct EndpointHealth {
+  bool reachable;          // Last probe answered (assumed until probed)
+  uint32_t probeMs;        // Smoothed probe latency, 0 = not probed yet
+  uint32_t connectMs;      // Last successful connect time
+  uint8_t failures;        // Consecutive failed connects
+  uint32_t retryAfter;     // millis() when a failed endpoint may be tried again
+  uint32_t connects;       // Successful connects
+};
+
+// ==================== State Variables ====================
+static PersistedBrokers brokers;                    // Endpoint list + persisted selection
+static EndpointHealth health[BROKER_MAX_ENDPOINTS];
+static PersistedBroker discovered;                  // LAN endpoint found over mDNS (RAM only, never persisted)
+static uint8_t activeSlot = BROKER_PRIMARY;
+static uint8_t cloudSlot = BROKER_PRIMARY;          // Endpoint of the second session
+static bool cloudSession = false;                   // A second session is using cloudSlot
+static uint32_t lastProbe = 0;
+static bool probedOnce = false;
+static uint32_t lastDiscovery = 0;
+static bool discoveredOnce = false;
+
+// ==================== Helper Functions ====================
+
+/**
+ * Endpoint of a slot: the configured one, or for an unconfigured LAN slot the discovered one
+ */
+static const PersistedBroker& endpointOf(uint8_t slot) {
+  if (slot == BROKER_LAN && brokers.endpoints[slot].host[0] == '\0') return discovered;
+  return brokers.endpoints[slot];
+}
+
+static bool slotUsed(uint8_t slot) {
+  return endpointOf(slot).host[0] != '\0';
+}
+
+static bool slotConfigured(uint8_t slot) {
+  return brokers.endpoints[slot].host[0] != '\0';
+}
+
+static bool lanFirst() {
+  return MQTT_MODE != MQTT_MODE_CLOUD;
+}
+
+/**
+ * The LAN endpoint may take the session: pinned (config.h / TOPIC_BROKER_SET),
+ * or discovered and reached over TLS (the certificate is verified on connect)
+ */
+static bool lanTrusted() {
+  return slotConfigured(BROKER_LAN) || discovered.tls;
+}
+
+static void resetHealth(uint8_t slot) {
+  health[slot] = {};
+  health[slot].reachable = true;
+}
+
+static void setDefault(uint8_t slot, const char* host, uint16_t port, const char* user, const char* pass) {
+  PersistedBroker& ep = brokers.endpoints[slot];
+  strncpy(ep.host, host, sizeof(ep.host) - 1);
+  ep.port = port;
+  ep.tls = port != MQTT_PLAIN_PORT;
+  strncpy(ep.user, user, sizeof(ep.user) - 1);
+  strncpy(ep.pass, pass, sizeof(ep.pass) - 1);
+}
+
+static void loadDefaults() {
+  memset(brokers.endpoints, 0, sizeof(brokers.endpoints));
+  setDefault(BROKER_PRIMARY, MQTT_HOST, MQTT_PORT, MQTT_USER, MQTT_PASS);
+#if defined(MQTT_HOST_2)
+  setDefault(BROKER_SECONDARY, MQTT_HOST_2, MQTT_PORT_2, MQTT_USER_2, MQTT_PASS_2);
+#endif
+#if defined(MQTT_LAN_HOST)
+  setDefault(BROKER_LAN, MQTT_LAN_HOST, MQTT_LAN_PORT, MQTT_LAN_USER, MQTT_LAN_PASS);
+#endif
+}
+
+/**
+ * May this endpoint be tried now? (failed endpoints wait out their backoff)
+ */
+static bool slotAvailable(uint8_t slot, uint32_t now) {
+  if (!slotUsed(slot)) return false;
+  return health[slot].failures < BROKER_MAX_FAILURES || (int32_t)(now - health[slot].retryAfter) >= 0;
+}
+
+/**
+ * Sort key: probed and reachable by latency, then unprobed, then unreachable (slot order within)
+ */
+static uint32_t slotRank(uint8_t slot) {
+  const EndpointHealth& h = health[slot];
+  if (!h.reachable) return UINT32_MAX - BROKER_MAX_ENDPOINTS + slot;
+  if (h.probeMs == 0) return UINT32_MAX / 2 + slot;
+  return h.probeMs;
+}
+
+/**
+ * Best endpoint to use now; when every endpoint is backing off, the best of all
+ * In the LAN modes an available LAN endpoint wins regardless of latency.
+ * @param cloudOnly Leave the LAN endpoint out (second session)
+ */
+static uint8_t bestSlot(uint32_t now, bool cloudOnly = false) {
+  if (!cloudOnly && lanFirst() && lanTrusted() && slotAvailable(BROKER_LAN, now)) return BROKER_LAN;
+
+  int best = -1;
+  for (uint8_t pass = 0; pass < 2 && best < 0; pass++) {
+    for (uint8_t i = 0; i < BROKER_MAX_ENDPOINTS; i++) {
+      if ((cloudOnly || !lanTrusted()) && i == BROKER_LAN) continue;
+      if (pass == 0 ? !slotAvailable(i, now) : !slotUsed(i)) continue;
+      if (best < 0 || slotRank(i) < slotRank(best)) best = i;
+    }
+  }
+  return best < 0 ? BROKER_PRIMARY : best;
+}
+
+/**
+ * Account one connect attempt to an endpoint (failures start the backoff)
+ */
+static void recordConnect(uint8_t slot, bool ok, uint32_t elapsedMs) {
+  EndpointHealth& h = health[slot];
+
+  if (ok) {
+    h.failures = 0;
+    h.connectMs = elapsedMs;
+    h.connects++;
+    h.reachable = true;
+    return;
+  }
+
+  if (h.failures < UINT8_MAX) h.failures++;
+  if (h.failures >= BROKER_MAX_FAILURES) {
+    h.retryAfter = millis() + BROKER_RETRY_BACKOFF;
+    Serial.print("[BROKER] ");
+    Serial.print(ROLE_NAMES[slot]);
+    Serial.print(" failed ");
+    Serial.print(h.failures);
+    Serial.println(" times in a row, backing off");
+  }
+}
+
+/**
+ * Browse for a TLS MQTT broker on the LAN (blocking, up to the MDNS query timeout)
+ * Anyone on the WiFi can advertise a service, so only _secure-mqtt._tcp is
+ * used: the session then only comes up if the broker's certificate verifies
+ * against the trust store. Plain _mqtt._tcp brokers are never picked up; they
+ * must be pinned (MQTT_LAN_HOST or TOPIC_BROKER_SET). The address is used
+ * rather than the .local name, which the DNS resolver cannot look up, so the
+ * certificate must be valid for it.
+ * @param found Output, host "" if nothing answered
+ */
+static void browseLanBroker(PersistedBroker* found) {
+  memset(found, 0, sizeof(*found));
+  watchdogEnterPhase("mdns_query");
+  if (MDNS.queryService("secure-mqtt", "tcp") > 0) {
+    strncpy(found->host, MDNS.IP(0).toString().c_str(), sizeof(found->host) - 1);
+    found->port = MDNS.port(0);
+    found->tls = true;
+    strncpy(found->user, MQTT_LAN_USER, sizeof(found->user) - 1);
+    strncpy(found->pass, MQTT_LAN_PASS, sizeof(found->pass) - 1);
+  }
+  watchdogExitPhase();
+}
+
+static void probeEndpoint(uint8_t slot) {
+  const PersistedBroker& ep = endpointOf(slot);
+  EndpointHealth& h = health[slot];
+
+  WiFiClient probe;
+  watchdogEnterPhase("broker_probe");
+  uint32_t start = millis();
+  bool ok = probe.connect(ep.host, ep.port, BROKER_PROBE_TIMEOUT);
+  uint32_t elapsed = millis() - start;
+  probe.stop();
+  watchdogExitPhase();
+
+  h.reachable = ok;
+  if (ok) {
+    if (elapsed == 0) elapsed = 1;   // 0 means "not probed"
+    h.probeMs = h.probeMs ? (h.probeMs * 3 + elapsed) / 4 : elapsed;
+  }
+
+  Serial.print("[BROKER] Probe ");
+  Serial.print(ROLE_NAMES[slot]);
+  Serial.print(" (");
+  Serial.print(ep.host);
+  Serial.print("): ");
+  if (ok) {
+    Serial.print(elapsed);
+    Serial.print(" ms, avg ");
+    Serial.print(h.probeMs);
+    Serial.println(" ms");
+  } else {
+    Serial.println("unreachable");
+  }
+}
+
+// ==================== Public Functions ====================
+
+void initBrokerPool() {
+  PersistedBrokers saved;
+  bool found = loadBrokerConfig(&saved);
+
+  memset(&brokers, 0, sizeof(brokers));
+  if (found && saved.custom) {
+    brokers = saved;
+  } else {
+    loadDefaults();
+    if (found) brokers.selected = saved.selected;
+  }
+
+  for (uint8_t i = 0; i < BROKER_MAX_ENDPOINTS; i++) resetHealth(i);
+
+  activeSlot = slotUsed(brokers.selected) ? brokers.selected : bestSlot(millis());
+
+  Serial.print("[BROKER] Endpoints:");
+  for (uint8_t i = 0; i < BROKER_MAX_ENDPOINTS; i++) {
+    if (!slotUsed(i)) continue;
+    Serial.print(" ");
+    Serial.print(ROLE_NAMES[i]);
+    Serial.print("=");
+    Serial.print(endpointOf(i).host);
+    Serial.print(":");
+    Serial.print(endpointOf(i).port);
+    if (i == activeSlot) Serial.print("*");
+  }
+  Serial.println(brokers.custom ? " (runtime list)" : " (config.h)");
+}
+
+const PersistedBroker& selectBroker() {
+  uint32_t now = millis();
+  if (!slotAvailable(activeSlot, now)) {
+    uint8_t next = bestSlot(now);
+    if (next != activeSlot) {
+      Serial.print("[BROKER] Failing over from ");
+      Serial.print(ROLE_NAMES[activeSlot]);
+      Serial.print(" to ");
+      Serial.println(ROLE_NAMES[next]);
+      activeSlot = next;
+    }
+  }
+  return endpointOf(activeSlot);
+}
+
+void reportBrokerConnect(bool ok, uint32_t elapsedMs) {
+  recordConnect(activeSlot, ok, elapsedMs);
+
+  // Start from this endpoint after a reboot
+  if (ok && brokers.selected != activeSlot) {
+    brokers.selected = activeSlot;
+    saveBrokerConfig(brokers);
+  }
+}
+
+const PersistedBroker* selectCloudBroker() {
+  uint8_t slot = bestSlot(millis(), true /*cloudOnly*/);
+  if (slot == BROKER_LAN || !slotUsed(slot)) {
+    cloudSession = false;
+    return nullptr;
+  }
+  cloudSlot = slot;
+  cloudSession = true;
+  return &endpointOf(slot);
+}
+
+void reportCloudConnect(bool ok, uint32_t elapsedMs) {
+  recordConnect(cloudSlot, ok, elapsedMs);
+}
+
+void releaseCloudBroker() {
+  cloudSession = false;
+}
+
+bool discoverLanBroker() {
+  if (!lanFirst() || slotConfigured(BROKER_LAN)) return false;  // Pinned in config.h or with TOPIC_BROKER_SET
+
+  // Once at startup; again while the found broker fails (it may have a new address) or none was found
+  uint32_t now = millis();
+  bool failing = !slotUsed(BROKER_LAN) || health[BROKER_LAN].failures >= BROKER_MAX_FAILURES;
+  if (discoveredOnce && (!failing || now - lastDiscovery < BROKER_DISCOVERY_INTERVAL)) return false;
+  discoveredOnce = true;
+  lastDiscovery = now;
+
+  if (!MDNS.begin(DEVICE_ID)) {
+    Serial.println("[BROKER] mDNS failed - LAN broker not discovered");
+    return false;
+  }
+
+  PersistedBroker found;
+  browseLanBroker(&found);
+  lastDiscovery = millis();
+
+  bool same = strcmp(found.host, discovered.host) == 0 && found.port == discovered.port &&
+              found.tls == discovered.tls;
+  if (same) {
+    if (!found.host[0]) Serial.println("[BROKER] No TLS LAN broker answered over mDNS");
+    return false;
+  }
+
+  discovered = found;
+  resetHealth(BROKER_LAN);
+  if (found.host[0]) {
+    Serial.print("[BROKER] LAN broker discovered: ");
+    Serial.print(found.host);
+    Serial.print(":");
+    Serial.print(found.port);
+    Serial.println(" (TLS)");
+    activeSlot = BROKER_LAN;
+  } else {
+    Serial.println("[BROKER] LAN broker gone from mDNS");
+    if (activeSlot == BROKER_LAN) activeSlot = bestSlot(millis());
+  }
+  return true;
+}
+
+bool probeBrokers() {
+  uint32_t now = millis();
+  if (now - lastProbe < (probedOnce ? BROKER_PROBE_INTERVAL : BROKER_FIRST_PROBE)) return false;
+  lastProbe = now;
+  probedOnce = true;
+
+  uint8_t used = 0;
+  for (uint8_t i = 0; i < BROKER_MAX_ENDPOINTS; i++) {
+    if (slotUsed(i)) used++;
+  }
+  if (used < 2) return false;  // Nothing to choose from
+
+  for (uint8_t i = 0; i < BROKER_MAX_ENDPOINTS; i++) {
+    if (slotUsed(i)) probeEndpoint(i);
+  }
+
+  uint8_t best = bestSlot(millis());
+  if (best == activeSlot) return false;
+
+  const EndpointHealth& current = health[activeSlot];
+  const EndpointHealth& candidate = health[best];
+  if (!candidate.reachable || candidate.probeMs == 0) return false;
+
+  // Hysteresis: similar latencies must not make the device hop between brokers
+  // (LAN-first: back to the LAN broker as soon as it answers)
+  bool faster = !current.reachable || (lanFirst() && best == BROKER_LAN) ||
+                (uint64_t)candidate.probeMs * 100 < (uint64_t)current.probeMs * (100 - BROKER_SWITCH_MARGIN);
+  if (!faster) return false;
+
+  Serial.print("[BROKER] Switching from ");
+  Serial.print(ROLE_NAMES[activeSlot]);
+  Serial.print(" to ");
+  Serial.print(ROLE_NAMES[best]);
+  Serial.print(" (");
+  Serial.print(candidate.probeMs);
+  Serial.print(" ms vs ");
+  Serial.print(current.probeMs);
+  Serial.println(" ms)");
+  activeSlot = best;
+  return true;
+}
+
+bool setBrokerEndpoint(uint8_t slot, const PersistedBroker& endpoint) {
+  if (slot >= BROKER_MAX_ENDPOINTS) return false;
+
+  bool clearing = endpoint.host[0] == '\0';
+  if (clearing) {
+    bool othersUsed = false;
+    for (uint8_t i = 0; i < BROKER_MAX_ENDPOINTS; i++) {
+      if (i != slot && slotConfigured(i)) othersUsed = true;   // A discovered LAN broker may vanish
+    }
+    if (!othersUsed) {
+      Serial.println("[BROKER] ERROR: Cannot remove the last endpoint");
+      return false;
+    }
+  }
+
+  PersistedBroker& ep = brokers.endpoints[slot];
+  memset(&ep, 0, sizeof(ep));
+  if (!clearing) {
+    strncpy(ep.host, endpoint.host, sizeof(ep.host) - 1);
+    ep.port = endpoint.port;
+    ep.tls = endpoint.tls;
+    strncpy(ep.user, endpoint.user, sizeof(ep.user) - 1);
+    strncpy(ep.pass, endpoint.pass, sizeof(ep.pass) - 1);
+  }
+  resetHealth(slot);
+
+  if (clearing && slot == activeSlot) activeSlot = bestSlot(millis());
+  brokers.selected = activeSlot;
+  brokers.custom = true;
+  saveBrokerConfig(brokers);
+
+  Serial.print("[BROKER] ");
+  Serial.print(ROLE_NAMES[slot]);
+  if (clearing) {
+    Serial.println(" endpoint removed");
+  } else {
+    Serial.print(" endpoint set to ");
+    Serial.print(ep.host);
+    Serial.print(":");
+    Serial.print(ep.port);
+    Serial.println(ep.tls ? " (TLS)" : " (plain)");
+  }
+  return true;
+}
+
+uint8_t activeBrokerSlot() {
+  return activeSlot;
+}
+
+uint8_t cloudBrokerSlot() {
+  return cloudSlot;
+}
+
+bool getBrokerStatus(uint8_t slot, BrokerStatus* status) {
+  if (slot >= BROKER_MAX_ENDPOINTS || !slotUsed(slot)) return false;
+
+  const PersistedBroker& ep = endpointOf(slot);
+  const EndpointHealth& h = health[slot];
+  status->role = ROLE_NAMES[slot];
+  status->host = ep.host;
+  status->port = ep.port;
+  status->tls = ep.tls;
+  status->active = slot == activeSlot;
+  status->cloud = cloudSession && slot == cloudSlot;
+  status->discovered = slot == BROKER_LAN && !slotConfigured(slot);
+  status->reachable = h.reachable;
+  status->probeMs = h.probeMs;
+  status->connectMs = h.connectMs;
+  status->failures = h.failures;
+  status->connects = h.connects;
+  return true;
+}
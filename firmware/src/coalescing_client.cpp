@@ -0,0 +1,189 @@
+/**
+ * @file coalescing_client.cpp
+ * @brief Write-coalescing Client wrapper implementation
+ */
+
+#include "coalescing_client.h"
+
+CoalescingClient::CoalescingClient(Client& inner) : inner(&inner) {}
+
+void CoalescingClient::setInner(Client& client) {
+  if (&client == inner) return;
+  stop();
+  inner = &client;
+}
+
+// ==================== Write Path ====================
+
+/**
+ * Hand bytes to the TLS client (one record) and account for it
+ */
+size_t CoalescingClient::writeThrough(const uint8_t* buf, size_t size) {
+  uint32_t start = micros();
+  size_t written = inner->write(buf, size);
+  stats.writeUs += micros() - start;
+
+  stats.records++;
+  stats.bytes += written;
+  if (written > stats.largest) stats.largest = written;
+  if (written != size) stats.failed++;
+  return written;
+}
+
+bool CoalescingClient::flushWrites() {
+  if (used == 0) return true;
+
+  size_t pending = used;
+  used = 0;
+
+  // Nothing to deliver to: PubSubClient notices on its next connected() check
+  if (!inner->connected()) return false;
+
+  if (writeThrough(buffer, pending) != pending) {
+    // A partial packet may be on the wire: the MQTT session is unusable
+    Serial.println("[MQTT] ERROR: coalesced write failed, dropping connection");
+    inner->stop();
+    return false;
+  }
+  return true;
+}
+
+size_t CoalescingClient::write(uint8_t b) {
+  return write(&b, 1);
+}
+
+size_t CoalescingClient::write(const uint8_t* buf, size_t size) {
+  stats.writes++;
+
+#if MQTT_COALESCE_WRITES
+  if (used + size > sizeof(buffer)) {
+    if (!flushWrites()) return 0;
+  }
+  if (size > sizeof(buffer)) {
+    return writeThrough(buf, size);  // Larger than a batch: send as is
+  }
+  memcpy(buffer + used, buf, size);
+  used += size;
+  return size;
+#else
+  return writeThrough(buf, size);
+#endif
+}
+
+void CoalescingClient::getStats(CoalescingStats* out) const {
+  *out = stats;
+}
+
+// ==================== Inbound Scan ====================
+
+#define IN_HEADER   0   // Expecting the fixed header byte
+#define IN_LENGTH   1   // Remaining length (variable byte integer)
+#define IN_BODY     2   // Skipping (or, for PUBACK, reading) the body
+
+#define PACKET_PUBACK 4
+
+void CoalescingClient::onPuback(PubackHandler handler, void* context) {
+  pubackHandler = handler;
+  pubackContext = context;
+}
+
+void CoalescingClient::resetInbound() {
+  inState = IN_HEADER;
+}
+
+/**
+ * Follow packet boundaries in the bytes PubSubClient reads and report PUBACKs
+ */
+void CoalescingClient::scanInbound(const uint8_t* buf, size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    uint8_t b = buf[i];
+    switch (inState) {
+      case IN_HEADER:
+        inType = b >> 4;
+        inRemaining = 0;
+        inMultiplier = 1;
+        inState = IN_LENGTH;
+        break;
+
+      case IN_LENGTH:
+        inRemaining += (b & 0x7F) * inMultiplier;
+        inMultiplier *= 128;
+        if (b & 0x80) break;
+        inPos = 0;
+        inPacketId = 0;
+        inState = inRemaining ? IN_BODY : IN_HEADER;
+        break;
+
+      case IN_BODY:
+        if (inType == PACKET_PUBACK && inPos < 2) inPacketId = (inPacketId << 8) | b;
+        if (++inPos < inRemaining) break;
+        if (inType == PACKET_PUBACK && inRemaining >= 2 && pubackHandler) {
+          pubackHandler(inPacketId, pubackContext);
+        }
+        inState = IN_HEADER;
+        break;
+    }
+  }
+}
+
+// ==================== Client ====================
+
+int CoalescingClient::connect(IPAddress ip, uint16_t port) {
+  used = 0;  // Leftovers belong to the previous session
+  resetInbound();
+  return inner->connect(ip, port);
+}
+
+int CoalescingClient::connect(const char* host, uint16_t port) {
+  used = 0;
+  resetInbound();
+  return inner->connect(host, port);
+}
+
+// Reads flush first: PubSubClient may be waiting for the reply to a buffered packet
+
+int CoalescingClient::available() {
+  flushWrites();
+  return inner->available();
+}
+
+int CoalescingClient::read() {
+  flushWrites();
+  int b = inner->read();
+  if (b >= 0) {
+    uint8_t byte = (uint8_t)b;
+    scanInbound(&byte, 1);
+  }
+  return b;
+}
+
+int CoalescingClient::read(uint8_t* buf, size_t size) {
+  flushWrites();
+  int n = inner->read(buf, size);
+  if (n > 0) scanInbound(buf, n);
+  return n;
+}
+
+int CoalescingClient::peek() {
+  flushWrites();
+  return inner->peek();
+}
+
+void CoalescingClient::flush() {
+  flushWrites();
+  inner->flush();
+}
+
+void CoalescingClient::stop() {
+  used = 0;
+  resetInbound();
+  inner->stop();
+}
+
+uint8_t CoalescingClient::connected() {
+  return inner->connected();
+}
+
+CoalescingClient::operator bool() {
+  return (bool)*inner;
+}
@@ -0,0 +1,145 @@
+/**
+ * @file delta_patch.cpp
+ * @brief Streaming delta patch decoder implementation
+ */
+
+#include "delta_patch.h"
+#include <string.h>
+
+static uint32_t readLe32(const uint8_t* p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+void DeltaDecoder::begin(const DeltaCallbacks& callbacks) {
+  cb = callbacks;
+  hdr = {};
+  state = STATE_HEADER;
+  error = DELTA_OK;
+  headerLen = 0;
+  varint = 0;
+  varintShift = 0;
+  outPos = 0;
+}
+
+DeltaResult DeltaDecoder::fail(DeltaResult result) {
+  state = STATE_ERROR;
+  error = result;
+  return result;
+}
+
+/**
+ * Accumulate one varint byte
+ * @return true once the value is complete
+ */
+bool DeltaDecoder::readVarint(uint8_t byte, uint32_t* value) {
+  varint |= (uint32_t)(byte & 0x7F) << varintShift;
+  varintShift += 7;
+  if (byte & 0x80) return false;
+
+  *value = varint;
+  varint = 0;
+  varintShift = 0;
+  return true;
+}
+
+DeltaResult DeltaDecoder::copySource(uint32_t offset, uint32_t length) {
+  if (offset > hdr.sourceSize || length > hdr.sourceSize - offset) return fail(DELTA_ERR_SOURCE);
+  if (length > hdr.targetSize - outPos) return fail(DELTA_ERR_SIZE);
+
+  uint8_t block[DELTA_COPY_BLOCK];
+  while (length > 0) {
+    size_t n = length < sizeof(block) ? length : sizeof(block);
+    if (!cb.readSource(cb.context, offset, block, n)) return fail(DELTA_ERR_IO);
+    if (!cb.writeTarget(cb.context, block, n)) return fail(DELTA_ERR_IO);
+    offset += n;
+    length -= n;
+    outPos += n;
+  }
+  return DELTA_OK;
+}
+
+DeltaResult DeltaDecoder::feed(const uint8_t* data, size_t len) {
+  size_t i = 0;
+  while (i < len) {
+    switch (state) {
+      case STATE_HEADER: {
+        size_t n = DELTA_HEADER_SIZE - headerLen;
+        if (n > len - i) n = len - i;
+        memcpy(headerBuf + headerLen, data + i, n);
+        headerLen += n;
+        i += n;
+        if (headerLen < DELTA_HEADER_SIZE) break;
+
+        if (memcmp(headerBuf, DELTA_MAGIC, 4) != 0) return fail(DELTA_ERR_FORMAT);
+        hdr.sourceSize = readLe32(headerBuf + 4);
+        hdr.targetSize = readLe32(headerBuf + 8);
+        memcpy(hdr.sourceSha256, headerBuf + 12, sizeof(hdr.sourceSha256));
+        if (cb.header && !cb.header(cb.context, hdr)) return fail(DELTA_ERR_SOURCE);
+        state = STATE_OP;
+        break;
+      }
+
+      case STATE_OP:
+        op = data[i++];
+        if (op == DELTA_OP_END) {
+          if (outPos != hdr.targetSize) return fail(DELTA_ERR_SIZE);
+          state = STATE_DONE;
+        } else if (op == DELTA_OP_COPY || op == DELTA_OP_DATA) {
+          state = STATE_ARG1;
+        } else {
+          return fail(DELTA_ERR_FORMAT);
+        }
+        break;
+
+      case STATE_ARG1:
+      case STATE_ARG2: {
+        if (varintShift > 28) return fail(DELTA_ERR_FORMAT);   // Longer than 32 bits
+        uint32_t value;
+        if (!readVarint(data[i++], &value)) break;
+
+        if (state == STATE_ARG2) {
+          arg2 = value;
+          if (copySource(arg1, arg2) != DELTA_OK) return error;
+          state = STATE_OP;
+        } else if (op == DELTA_OP_COPY) {
+          arg1 = value;
+          state = STATE_ARG2;
+        } else {
+          arg1 = value;
+          if (arg1 > hdr.targetSize - outPos) return fail(DELTA_ERR_SIZE);
+          state = arg1 > 0 ? STATE_DATA : STATE_OP;
+        }
+        break;
+      }
+
+      case STATE_DATA: {
+        size_t n = arg1 < len - i ? arg1 : len - i;
+        if (!cb.writeTarget(cb.context, data + i, n)) return fail(DELTA_ERR_IO);
+        i += n;
+        arg1 -= n;
+        outPos += n;
+        if (arg1 == 0) state = STATE_OP;
+        break;
+      }
+
+      case STATE_DONE:
+        return fail(DELTA_ERR_TRAILING);
+
+      case STATE_ERROR:
+        return error;
+    }
+  }
+  return state == STATE_ERROR ? error : DELTA_OK;
+}
+
+const char* DeltaDecoder::resultName(DeltaResult result) {
+  switch (result) {
+    case DELTA_OK:           return "ok";
+    case DELTA_ERR_FORMAT:   return "patch_format";
+    case DELTA_ERR_SOURCE:   return "patch_source";
+    case DELTA_ERR_SIZE:     return "patch_size";
+    case DELTA_ERR_IO:       return "patch_io";
+    case DELTA_ERR_TRAILING: return "patch_trailing";
+    default:                 return "unknown";
+  }
+}
@@ -0,0 +1,403 @@
+/**
+ * @file event_log.cpp
+ * @brief Append-only flash event log implementation (esp_partition, sector ring)
+ */
+
+#include "event_log.h"
+#include "time_sync.h"
+#include <esp_partition.h>
+#include <esp_rom_crc.h>
+
+// ==================== Flash Layout ====================
+// Segment = one sector: [header: 1 slot][records: RECORDS_PER_SEGMENT slots]
+#define SEGMENT_MAGIC        0x45564C31   // "EVL1" - bump when EventRecord changes
+#define RECORDS_PER_SEGMENT  (EVENT_LOG_SEGMENT_SIZE / EVENT_LOG_RECORD_SIZE - 1)
+#define READ_BLOCK           8            // Records read per flash access
+
+/**
+ * Segment header (first slot of every sector)
+ */
+struct SegmentHeader {
+  uint32_t magic;
+  uint32_t sequence;      // Increments every time the log moves to a new sector
+  uint8_t reserved[20];   // Left erased
+  uint32_t crc;           // CRC-32 of the fields above
+};
+
+static_assert(sizeof(EventRecord) == EVENT_LOG_RECORD_SIZE, "EventRecord must fill one slot");
+static_assert(sizeof(SegmentHeader) == EVENT_LOG_RECORD_SIZE, "SegmentHeader must fill one slot");
+
+enum SlotState {
+  SLOT_FREE,      // Erased, never written
+  SLOT_VALID,
+  SLOT_CORRUPT    // Written, CRC mismatch (torn write)
+};
+
+// ==================== State Variables ====================
+static const esp_partition_t* partition = nullptr;   // nullptr = disabled
+static uint16_t segmentCount = 0;
+static uint16_t headSegment = 0;       // Sector being written
+static uint32_t headSequence = 0;      // Its segment sequence number
+static uint16_t usedSegments = 0;      // Sectors holding the log, ending at the head
+static uint16_t writeSlot = 0;         // Next free slot in the head segment
+static bool nextErased = false;        // Sector after the head is erased and ready
+static uint32_t nextSeq = 1;
+static uint16_t bootNumber = 0;
+static bool paused = false;            // pauseEventLog(): events are dropped
+
+static uint32_t erases = 0;
+static uint32_t corrupt = 0;
+static uint32_t writeErrors = 0;
+
+// Read cache: one block of records
+static EventRecord block[READ_BLOCK];
+static int32_t blockSegment = -1;
+static uint16_t blockFirst = 0;
+
+// Running query
+static bool queryActive = false;
+static uint64_t queryFrom = 0;
+static uint64_t queryTo = 0;
+static uint32_t queryLeft = 0;         // Records still allowed by the limit
+static uint16_t querySegment = 0;
+static uint16_t querySegmentsLeft = 0; // Including querySegment
+static uint16_t querySlot = 0;
+static bool queryInRange = false;      // Last timestamped record matched
+
+// ==================== Helper Functions ====================
+
+static uint32_t crc32(const void* data, size_t len) {
+  return esp_rom_crc32_le(0, (const uint8_t*)data, len);
+}
+
+static size_t segmentOffset(uint16_t segment) {
+  return (size_t)segment * EVENT_LOG_SEGMENT_SIZE;
+}
+
+static size_t slotOffset(uint16_t segment, uint16_t slot) {
+  return segmentOffset(segment) + (size_t)(slot + 1) * EVENT_LOG_RECORD_SIZE;
+}
+
+static uint16_t nextSegment(uint16_t segment) {
+  return (segment + 1) % segmentCount;
+}
+
+static bool readHeader(uint16_t segment, uint32_t* sequence) {
+  SegmentHeader h;
+  if (esp_partition_read(partition, segmentOffset(segment), &h, sizeof(h)) != ESP_OK) return false;
+  if (h.magic != SEGMENT_MAGIC || h.crc != crc32(&h, offsetof(SegmentHeader, crc))) return false;
+  *sequence = h.sequence;
+  return true;
+}
+
+static void writeHeader(uint16_t segment, uint32_t sequence) {
+  SegmentHeader h;
+  memset(&h, 0xFF, sizeof(h));
+  h.magic = SEGMENT_MAGIC;
+  h.sequence = sequence;
+  h.crc = crc32(&h, offsetof(SegmentHeader, crc));
+  if (esp_partition_write(partition, segmentOffset(segment), &h, sizeof(h)) != ESP_OK) writeErrors++;
+}
+
+static void eraseSegment(uint16_t segment) {
+  if (esp_partition_erase_range(partition, segmentOffset(segment), EVENT_LOG_SEGMENT_SIZE) != ESP_OK) {
+    writeErrors++;
+  }
+  erases++;
+  if (blockSegment == segment) blockSegment = -1;
+}
+
+/**
+ * Read one record slot (through the block cache)
+ */
+static SlotState readSlot(uint16_t segment, uint16_t slot, EventRecord* record) {
+  uint16_t first = slot - slot % READ_BLOCK;
+  if (blockSegment != segment || blockFirst != first) {
+    uint16_t count = min(READ_BLOCK, RECORDS_PER_SEGMENT - first);
+    if (esp_partition_read(partition, slotOffset(segment, first), block, count * sizeof(EventRecord)) != ESP_OK) {
+      blockSegment = -1;
+      return SLOT_CORRUPT;
+    }
+    blockSegment = segment;
+    blockFirst = first;
+  }
+  *record = block[slot - first];
+
+  const uint8_t* bytes = (const uint8_t*)record;
+  bool erased = true;
+  for (size_t i = 0; i < sizeof(EventRecord) && erased; i++) erased = bytes[i] == 0xFF;
+  if (erased) return SLOT_FREE;
+  return record->crc == crc32(record, offsetof(EventRecord, crc)) ? SLOT_VALID : SLOT_CORRUPT;
+}
+
+/**
+ * Scan a segment for its last valid record and first free slot
+ * @return true if the segment holds a valid record
+ */
+static bool scanSegment(uint16_t segment, EventRecord* last, uint16_t* freeSlot, uint32_t* torn) {
+  bool found = false;
+  uint16_t slot = 0;
+  EventRecord r;
+  for (; slot < RECORDS_PER_SEGMENT; slot++) {
+    SlotState state = readSlot(segment, slot, &r);
+    if (state == SLOT_FREE) break;
+    if (state == SLOT_VALID) {
+      *last = r;
+      found = true;
+    } else if (torn) {
+      (*torn)++;
+    }
+  }
+  if (freeSlot) *freeSlot = slot;
+  return found;
+}
+
+/**
+ * Erase the sector after the head (drops the oldest segment once the ring is full)
+ */
+static void prepareNextSegment() {
+  if (usedSegments == segmentCount) usedSegments--;
+  eraseSegment(nextSegment(headSegment));
+  nextErased = true;
+}
+
+/**
+ * Move the head to the next sector
+ */
+static void advanceSegment() {
+  if (!nextErased) prepareNextSegment();
+  headSegment = nextSegment(headSegment);
+  headSequence++;
+  writeHeader(headSegment, headSequence);
+  usedSegments++;
+  writeSlot = 0;
+  nextErased = false;
+}
+
+/**
+ * Time of the first record of a segment (0 if none or unknown)
+ */
+static uint64_t firstRecordTs(uint16_t segment) {
+  EventRecord r;
+  return readSlot(segment, 0, &r) == SLOT_VALID ? r.ts : 0;
+}
+
+static void advanceQuerySegment() {
+  querySegment = nextSegment(querySegment);
+  querySegmentsLeft--;
+  querySlot = 0;
+}
+
+// ==================== Public Functions ====================
+
+bool initEventLog() {
+  partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, EVENT_LOG_PARTITION);
+  if (!partition || partition->size < 2 * EVENT_LOG_SEGMENT_SIZE) {
+    Serial.println("[EVLOG] No '" EVENT_LOG_PARTITION "' data partition - event log disabled");
+    partition = nullptr;
+    return false;
+  }
+  segmentCount = partition->size / EVENT_LOG_SEGMENT_SIZE;
+
+  // Head: the valid segment with the highest sequence number
+  bool found = false;
+  for (uint16_t s = 0; s < segmentCount; s++) {
+    uint32_t sequence;
+    if (readHeader(s, &sequence) && (!found || sequence > headSequence)) {
+      headSegment = s;
+      headSequence = sequence;
+      found = true;
+    }
+  }
+
+  EventRecord last;
+  bool haveLast = false;
+  if (!found) {
+    Serial.println("[EVLOG] No log found, formatting");
+    headSegment = 0;
+    headSequence = 1;
+    eraseSegment(headSegment);
+    writeHeader(headSegment, headSequence);
+    usedSegments = 1;
+    writeSlot = 0;
+  } else {
+    // The log is the run of sectors behind the head with consecutive sequence numbers
+    usedSegments = 1;
+    while (usedSegments < segmentCount) {
+      uint16_t s = (headSegment + segmentCount - usedSegments) % segmentCount;
+      uint32_t sequence;
+      if (!readHeader(s, &sequence) || sequence != headSequence - usedSegments) break;
+      usedSegments++;
+    }
+
+    haveLast = scanSegment(headSegment, &last, &writeSlot, &corrupt);
+    if (!haveLast && usedSegments > 1) {
+      haveLast = scanSegment((headSegment + segmentCount - 1) % segmentCount, &last, nullptr, nullptr);
+    }
+  }
+
+  nextSeq = haveLast ? last.seq + 1 : 1;
+  bootNumber = haveLast ? last.boot + 1 : 1;
+
+  Serial.print("[EVLOG] Boot ");
+  Serial.print(bootNumber);
+  Serial.print(", next seq ");
+  Serial.print(nextSeq);
+  Serial.print(", ");
+  Serial.print(usedSegments);
+  Serial.print("/");
+  Serial.print(segmentCount);
+  Serial.println(" segments used");
+  if (corrupt > 0) {
+    Serial.print("[EVLOG] Skipped ");
+    Serial.print(corrupt);
+    Serial.println(" torn record(s) at the head");
+  }
+  return true;
+}
+
+bool logEvent(EventType type, uint8_t code, int32_t value, int32_t arg) {
+  if (!partition || paused) return false;
+  if (writeSlot >= RECORDS_PER_SEGMENT) advanceSegment();
+
+  EventRecord r;
+  r.seq = nextSeq++;
+  r.boot = bootNumber;
+  r.type = type;
+  r.code = code;
+  r.ts = timeEpochMs();
+  r.uptime = millis() / 1000;
+  r.value = value;
+  r.arg = arg;
+  r.crc = crc32(&r, offsetof(EventRecord, crc));
+
+  // The slot is used even if the write fails (flash can only be written once per erase)
+  bool ok = esp_partition_write(partition, slotOffset(headSegment, writeSlot), &r, sizeof(r)) == ESP_OK;
+  writeSlot++;
+  if (blockSegment == headSegment) blockSegment = -1;
+  if (!ok) {
+    writeErrors++;
+    Serial.println("[EVLOG] ERROR: Write failed");
+  }
+  return ok;
+}
+
+void pauseEventLog(bool pause) {
+  paused = pause;
+}
+
+void eventLogLoop() {
+  if (!partition || nextErased || writeSlot < EVENT_LOG_PREERASE_SLOT) return;
+  prepareNextSegment();
+}
+
+bool startEventQuery(uint64_t fromMs, uint64_t toMs, uint32_t limit) {
+  if (!partition) return false;
+  queryFrom = fromMs;
+  queryTo = toMs;
+  queryLeft = limit > 0 ? limit : EVENT_QUERY_DEFAULT_LIMIT;
+  querySegmentsLeft = usedSegments;
+  querySegment = (headSegment + segmentCount - usedSegments + 1) % segmentCount;   // Oldest
+  querySlot = 0;
+  queryInRange = false;
+  queryActive = true;
+  return true;
+}
+
+int readEventQuery(EventRecord* out, int max, bool* more) {
+  int count = 0;
+  int scanned = 0;
+
+  while (queryActive && count < max && scanned < EVENT_QUERY_SCAN_SEGMENTS) {
+    if (querySegmentsLeft == 0 || queryLeft == 0) {
+      queryActive = false;
+      break;
+    }
+
+    bool head = querySegment == headSegment;
+    if (querySlot == 0) {
+      uint64_t first = firstRecordTs(querySegment);
+      if (first != 0 && first > queryTo) {
+        queryActive = false;   // The rest of the log is newer
+        break;
+      }
+      // Skip whole segments that end before the range: the next one starts before it
+      uint64_t following = head ? 0 : firstRecordTs(nextSegment(querySegment));
+      if (following != 0 && following < queryFrom) {
+        advanceQuerySegment();
+        scanned++;
+        continue;
+      }
+    }
+
+    EventRecord r;
+    SlotState state = querySlot < RECORDS_PER_SEGMENT ? readSlot(querySegment, querySlot, &r) : SLOT_FREE;
+    if (state == SLOT_FREE) {
+      if (head) {
+        queryActive = false;   // Reached the write position
+        break;
+      }
+      advanceQuerySegment();
+      scanned++;
+      continue;
+    }
+    querySlot++;
+    if (state != SLOT_VALID) continue;
+
+    bool match;
+    if (r.ts == 0) {
+      match = queryInRange;    // No clock yet: goes with the record before it
+    } else {
+      match = r.ts >= queryFrom && r.ts <= queryTo;
+      queryInRange = match;
+    }
+    if (match) {
+      out[count++] = r;
+      queryLeft--;
+    }
+  }
+
+  *more = queryActive;
+  return count;
+}
+
+bool eventQueryActive() {
+  return queryActive;
+}
+
+void cancelEventQuery() {
+  queryActive = false;
+}
+
+const char* eventTypeName(uint8_t type) {
+  switch (type) {
+    case EVENT_BOOT:    return "boot";
+    case EVENT_PUMP:    return "pump";
+    case EVENT_VALVE:   return "valve";
+    case EVENT_COMMAND: return "command";
+    case EVENT_TIMER:   return "timer";
+    case EVENT_ERROR:   return "error";
+    case EVENT_MQTT:    return "mqtt";
+    case EVENT_OTA:     return "ota";
+    case EVENT_ROAM:    return "roam";
+    default:            return "unknown";
+  }
+}
+
+void getEventLogStats(EventLogStats* stats) {
+  memset(stats, 0, sizeof(*stats));
+  stats->mounted = partition != nullptr;
+  if (!partition) return;
+
+  stats->boot = bootNumber;
+  stats->nextSeq = nextSeq;
+  stats->records = (uint32_t)(usedSegments - 1) * RECORDS_PER_SEGMENT + writeSlot;
+  stats->capacity = (uint32_t)segmentCount * RECORDS_PER_SEGMENT;
+  stats->segments = segmentCount;
+  stats->segmentsUsed = usedSegments;
+  stats->cycles = headSequence / segmentCount;
+  stats->erases = erases;
+  stats->corrupt = corrupt;
+  stats->writeErrors = writeErrors;
+  stats->oldestTs = firstRecordTs((headSegment + segmentCount - usedSegments + 1) % segmentCount);
+}
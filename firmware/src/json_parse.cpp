@@ -0,0 +1,160 @@
+/**
+ * @file json_parse.cpp
+ * @brief Minimal JSON object parser for command payloads
+ */
+
+#include "json_parse.h"
+#include <ctype.h>
+#include <string.h>
+
+// ==================== Helper Functions ====================
+
+/**
+ * Skips whitespace
+ */
+static const char* jsonSkipSpace(const char* p) {
+  while (*p && isspace((unsigned char)*p)) p++;
+  return p;
+}
+
+/**
+ * Reads a JSON string starting at its opening quote, decoding escapes
+ * @param out Decoded text (nullptr to only skip it), truncated to outLen - 1
+ * @param length Output: decoded length
+ * @return Position after the closing quote, nullptr if malformed
+ */
+static const char* jsonReadString(const char* p, char* out, size_t outLen, size_t* length) {
+  size_t n = 0;
+  for (p++; *p != '"'; p++) {
+    if (*p == '\0' || (unsigned char)*p < 0x20) return nullptr;
+
+    uint32_t c = (unsigned char)*p;
+    bool unicode = false;
+    if (c == '\\') {
+      p++;
+      switch (*p) {
+        case '"': case '\\': case '/': c = *p; break;
+        case 'b': c = '\b'; break;
+        case 'f': c = '\f'; break;
+        case 'n': c = '\n'; break;
+        case 'r': c = '\r'; break;
+        case 't': c = '\t'; break;
+        case 'u': {
+          unicode = true;
+          c = 0;
+          for (int i = 0; i < 4; i++) {
+            char h = *++p;
+            if (!isxdigit((unsigned char)h)) return nullptr;
+            c = (c << 4) | (isdigit((unsigned char)h) ? h - '0' : (tolower(h) - 'a' + 10));
+          }
+          if (c == 0) return nullptr;   // Would cut the C string
+          break;
+        }
+        default: return nullptr;
+      }
+    }
+
+    // \u escapes are stored as UTF-8; other bytes as they come
+    uint8_t bytes[3];
+    size_t count = 0;
+    if (!unicode || c < 0x80) {
+      bytes[count++] = c;
+    } else if (c < 0x800) {
+      bytes[count++] = 0xC0 | (c >> 6);
+      bytes[count++] = 0x80 | (c & 0x3F);
+    } else {
+      bytes[count++] = 0xE0 | (c >> 12);
+      bytes[count++] = 0x80 | ((c >> 6) & 0x3F);
+      bytes[count++] = 0x80 | (c & 0x3F);
+    }
+    for (size_t i = 0; i < count; i++, n++) {
+      if (out && n < outLen - 1) out[n] = bytes[i];
+    }
+  }
+  if (out) out[n < outLen - 1 ? n : outLen - 1] = '\0';
+  *length = n;
+  return p + 1;
+}
+
+/**
+ * Skips any JSON value (nested objects and arrays included)
+ * @return Position after it, nullptr if malformed
+ */
+static const char* jsonSkipValue(const char* p) {
+  size_t length;
+  if (*p == '"') return jsonReadString(p, nullptr, 0, &length);
+
+  if (*p == '{' || *p == '[') {
+    char close = *p == '{' ? '}' : ']';
+    p = jsonSkipSpace(p + 1);
+    if (*p == close) return p + 1;
+    while (true) {
+      if (close == '}') {
+        if (*p != '"' || !(p = jsonReadString(p, nullptr, 0, &length))) return nullptr;
+        p = jsonSkipSpace(p);
+        if (*p != ':') return nullptr;
+        p = jsonSkipSpace(p + 1);
+      }
+      if (!(p = jsonSkipValue(p))) return nullptr;
+      p = jsonSkipSpace(p);
+      if (*p == close) return p + 1;
+      if (*p != ',') return nullptr;
+      p = jsonSkipSpace(p + 1);
+    }
+  }
+
+  // Number, true, false, null
+  const char* start = p;
+  while (*p && !isspace((unsigned char)*p) && !strchr(",}]\"", *p)) p++;
+  return p > start ? p : nullptr;
+}
+
+// ==================== Public Functions ====================
+
+int jsonValue(const char* json, const char* key, char* out, size_t outLen) {
+  out[0] = '\0';
+
+  const char* p = jsonSkipSpace(json);
+  if (*p != '{') return JSON_MALFORMED;
+  p = jsonSkipSpace(p + 1);
+  if (*p == '}') return -1;
+
+  char name[24];
+  while (true) {
+    size_t nameLen;
+    if (*p != '"' || !(p = jsonReadString(p, name, sizeof(name), &nameLen))) return JSON_MALFORMED;
+    p = jsonSkipSpace(p);
+    if (*p != ':') return JSON_MALFORMED;
+    p = jsonSkipSpace(p + 1);
+
+    if (nameLen < sizeof(name) && strcmp(name, key) == 0) {
+      size_t length;
+      if (*p == '"') {
+        if (!jsonReadString(p, out, outLen, &length)) {
+          out[0] = '\0';
+          return JSON_MALFORMED;
+        }
+        return length;
+      }
+      const char* end = jsonSkipValue(p);
+      if (!end) return JSON_MALFORMED;
+      length = end - p;
+      size_t copied = length < outLen - 1 ? length : outLen - 1;
+      memcpy(out, p, copied);
+      out[copied] = '\0';
+      return length;
+    }
+
+    if (!(p = jsonSkipValue(p))) return JSON_MALFORMED;
+    p = jsonSkipSpace(p);
+    if (*p == '}') return -1;
+    if (*p != ',') return JSON_MALFORMED;
+    p = jsonSkipSpace(p + 1);
+  }
+}
+
+bool jsonWellFormed(const char* json) {
+  const char* p = jsonSkipSpace(json);
+  if (*p != '{' || !(p = jsonSkipValue(p))) return false;
+  return *jsonSkipSpace(p) == '\0';
+}
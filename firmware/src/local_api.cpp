@@ -0,0 +1,282 @@
+/**
+ * @file local_api.cpp
+ * @brief Local HTTP/JSON API implementation (HTTP task <-> main loop handoff)
+ */
+
+#include "local_api.h"
+#include "config.h"
+#include <esp_http_server.h>
+#include <ESPmDNS.h>
+#include <atomic>
+
+/**
+ * Fixed response buffer (written by the main loop, sent by the HTTP task)
+ */
+class ResponseBuffer : public Print {
+ public:
+  ResponseBuffer(char* storage, size_t capacity) : data(storage), capacity(capacity) {}
+
+  size_t write(uint8_t b) override { return write(&b, 1); }
+  size_t write(const uint8_t* src, size_t size) override {
+    size_t room = capacity - used;
+    if (size > room) {
+      overflow = true;
+      size = room;
+    }
+    memcpy(data + used, src, size);
+    used += size;
+    return size;
+  }
+  using Print::write;
+
+  void reset() {
+    used = 0;
+    overflow = false;
+  }
+
+  char* const data;
+  const size_t capacity;
+  size_t used = 0;
+  bool overflow = false;
+};
+
+/**
+ * GET resource rendered by the main loop
+ */
+struct Snapshot {
+  const char* path;
+  ResponseBuffer buffer;
+  bool ready;                 // Rendered at least once
+};
+
+static char stateData[LOCAL_API_SNAPSHOT_SIZE];
+static char timerData[LOCAL_API_SNAPSHOT_SIZE];
+static char configData[LOCAL_API_SNAPSHOT_SIZE];
+static char diagData[LOCAL_API_RESPONSE_SIZE];
+static char responseData[LOCAL_API_RESPONSE_SIZE];
+
+// ==================== State Variables ====================
+static httpd_handle_t server = nullptr;
+static const char* apiToken = "";
+static QueueHandle_t requestQueue = nullptr;     // HTTP task -> main loop (commands)
+static SemaphoreHandle_t responseReady = nullptr; // Main loop -> HTTP task
+static SemaphoreHandle_t snapshotLock = nullptr;  // Held while a snapshot is rendered or sent
+static ResponseBuffer response(responseData, sizeof(responseData));
+static Snapshot snapshots[LOCAL_API_SNAPSHOT_COUNT] = {
+  { "/api/state",  ResponseBuffer(stateData, sizeof(stateData)),   false },
+  { "/api/timer",  ResponseBuffer(timerData, sizeof(timerData)),   false },
+  { "/api/config", ResponseBuffer(configData, sizeof(configData)), false },
+  { "/api/diag",   ResponseBuffer(diagData, sizeof(diagData)),     false },
+};
+static std::atomic<uint32_t> completedId{0};   // Published last: status and response are written before it
+static int completedStatus = 0;
+static uint32_t lastRequestId = 0;               // HTTP task only
+static LocalApiStats stats = {};
+
+// ==================== Helper Functions ====================
+
+static const char* statusLine(int status) {
+  switch (status) {
+    case 200: return "200 OK";
+    case 202: return "202 Accepted";
+    case 400: return "400 Bad Request";
+    case 401: return "401 Unauthorized";
+    case 404: return "404 Not Found";
+    case 409: return "409 Conflict";
+    case 413: return "413 Payload Too Large";
+    case 414: return "414 URI Too Long";
+    case 503: return "503 Service Unavailable";
+    default:  return "500 Internal Server Error";
+  }
+}
+
+static esp_err_t sendJson(httpd_req_t* req, int status, const char* body, size_t length) {
+  httpd_resp_set_status(req, statusLine(status));
+  httpd_resp_set_type(req, "application/json");
+  httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+  return httpd_resp_send(req, body, length);
+}
+
+static esp_err_t sendError(httpd_req_t* req, int status, const char* error) {
+  char body[48];
+  int length = snprintf(body, sizeof(body), "{\"error\":\"%s\"}", error);
+  return sendJson(req, status, body, length);
+}
+
+/**
+ * Check "Authorization: Bearer <token>" (constant time over the token length)
+ */
+static bool authorized(httpd_req_t* req) {
+  char header[96];
+  size_t length = httpd_req_get_hdr_value_len(req, "Authorization");
+  if (length == 0 || length >= sizeof(header)) return false;
+  if (httpd_req_get_hdr_value_str(req, "Authorization", header, sizeof(header)) != ESP_OK) return false;
+  if (strncmp(header, "Bearer ", 7) != 0) return false;
+
+  const char* given = header + 7;
+  size_t tokenLength = strlen(apiToken);
+  if (strlen(given) != tokenLength) return false;
+  uint8_t diff = 0;
+  for (size_t i = 0; i < tokenLength; i++) diff |= given[i] ^ apiToken[i];
+  return diff == 0;
+}
+
+/**
+ * GET (HTTP task): send the snapshot of the resource, without the main loop
+ */
+static esp_err_t sendSnapshot(httpd_req_t* req, const char* path) {
+  Snapshot* snapshot = nullptr;
+  for (auto& s : snapshots) {
+    if (strcmp(path, s.path) == 0) snapshot = &s;
+  }
+  if (!snapshot) return sendError(req, 404, "not_found");
+
+  // Held for the send, so the loop does not rewrite the buffer meanwhile (it skips the refresh)
+  if (xSemaphoreTake(snapshotLock, pdMS_TO_TICKS(LOCAL_API_TIMEOUT)) != pdTRUE) {
+    stats.stale++;
+    return sendError(req, 503, "busy");
+  }
+  esp_err_t err;
+  if (!snapshot->ready) {
+    stats.stale++;
+    err = sendError(req, 503, "starting");
+  } else if (snapshot->buffer.overflow) {
+    err = sendError(req, 500, "response_too_large");
+  } else {
+    err = sendJson(req, 200, snapshot->buffer.data, snapshot->buffer.used);
+  }
+  xSemaphoreGive(snapshotLock);
+  return err;
+}
+
+/**
+ * URI handler (HTTP task): authenticate; answer GETs from the snapshots,
+ * hand commands over to the loop, wait, send
+ */
+static esp_err_t handleRequest(httpd_req_t* req) {
+  stats.requests++;
+  if (!authorized(req)) {
+    stats.unauthorized++;
+    return sendError(req, 401, "unauthorized");
+  }
+
+  LocalApiRequest request;
+  size_t pathLength = strcspn(req->uri, "?");
+  if (pathLength >= sizeof(request.path)) {
+    stats.rejected++;
+    return sendError(req, 414, "path_too_long");
+  }
+  if (req->content_len > LOCAL_API_MAX_BODY) {
+    stats.rejected++;
+    return sendError(req, 413, "body_too_large");
+  }
+
+  memcpy(request.path, req->uri, pathLength);
+  request.path[pathLength] = '\0';
+  if (req->method != HTTP_POST) return sendSnapshot(req, request.path);
+
+  request.id = ++lastRequestId;
+  request.length = 0;
+  while (request.length < req->content_len) {
+    int n = httpd_req_recv(req, (char*)request.body + request.length, req->content_len - request.length);
+    if (n == HTTPD_SOCK_ERR_TIMEOUT) continue;
+    if (n <= 0) return ESP_FAIL;   // Client went away: close the socket
+    request.length += n;
+  }
+
+  // Commands queued earlier (answered 202) still run first, in order
+  uint32_t start = millis();
+  if (xQueueSend(requestQueue, &request, 0) != pdTRUE) {
+    stats.busy++;
+    return sendError(req, 503, "busy");
+  }
+
+  // Completions of queued requests are skipped by id. The HTTP task serves
+  // one request at a time, so ours is the last in the queue and the loop does
+  // not touch the response buffer again before we have sent it.
+  while (completedId.load(std::memory_order_acquire) != request.id) {
+    uint32_t waited = millis() - start;
+    if (waited >= LOCAL_API_TIMEOUT ||
+        xSemaphoreTake(responseReady, pdMS_TO_TICKS(LOCAL_API_TIMEOUT - waited)) != pdTRUE) {
+      const char* body = "{\"result\":\"queued\"}";
+      stats.queued++;
+      return sendJson(req, 202, body, strlen(body));
+    }
+  }
+
+  uint32_t waited = millis() - start;
+  if (waited > stats.maxWaitMs) stats.maxWaitMs = waited;
+  if (response.overflow) return sendError(req, 500, "response_too_large");
+  return sendJson(req, completedStatus, response.data, response.used);
+}
+
+// ==================== Public Functions ====================
+
+bool initLocalApi(const char* token) {
+  if (server) return true;
+  apiToken = token;
+
+  if (!requestQueue) requestQueue = xQueueCreate(LOCAL_API_QUEUE_DEPTH, sizeof(LocalApiRequest));
+  if (!responseReady) responseReady = xSemaphoreCreateBinary();
+  if (!snapshotLock) snapshotLock = xSemaphoreCreateMutex();
+
+  httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+  config.server_port = LOCAL_API_PORT;
+  config.max_open_sockets = LOCAL_API_MAX_SOCKETS;
+  config.lru_purge_enable = true;              // A new client evicts the idlest connection
+  config.uri_match_fn = httpd_uri_match_wildcard;
+
+  if (httpd_start(&server, &config) != ESP_OK) {
+    Serial.println("[API] ERROR: HTTP server did not start");
+    server = nullptr;
+    return false;
+  }
+
+  httpd_uri_t get = { "/api/*", HTTP_GET, handleRequest, nullptr };
+  httpd_uri_t post = { "/api/*", HTTP_POST, handleRequest, nullptr };
+  httpd_register_uri_handler(server, &get);
+  httpd_register_uri_handler(server, &post);
+  stats.running = true;
+
+  if (MDNS.begin(DEVICE_ID)) {
+    MDNS.addService("http", "tcp", LOCAL_API_PORT);
+    MDNS.addServiceTxt("http", "tcp", "path", "/api");
+    MDNS.addServiceTxt("http", "tcp", "auth", "bearer");
+  } else {
+    Serial.println("[API] mDNS failed - reach the API by IP");
+  }
+
+  Serial.println("[API] ✓ Local API on http://" DEVICE_ID ".local/api");
+  return true;
+}
+
+Print* beginLocalApiSnapshot(LocalApiSnapshot snapshot) {
+  if (!snapshotLock || xSemaphoreTake(snapshotLock, 0) != pdTRUE) return nullptr;
+  snapshots[snapshot].buffer.reset();
+  return &snapshots[snapshot].buffer;
+}
+
+void endLocalApiSnapshot(LocalApiSnapshot snapshot) {
+  snapshots[snapshot].ready = true;
+  xSemaphoreGive(snapshotLock);
+}
+
+bool pollLocalApiRequest(LocalApiRequest* request) {
+  if (!requestQueue || xQueueReceive(requestQueue, request, 0) != pdTRUE) return false;
+  response.reset();
+  return true;
+}
+
+Print& localApiResponse() {
+  return response;
+}
+
+void completeLocalApiRequest(uint32_t id, int status) {
+  completedStatus = status;
+  completedId.store(id, std::memory_order_release);
+  xSemaphoreGive(responseReady);
+}
+
+void getLocalApiStats(LocalApiStats* out) {
+  *out = stats;
+}
@@ -4,43 +4,71 @@
 #include <WiFiClientSecure.h>  // TLS Client (HTTPS/MQTTS)
 #include <WiFiManager.h>       // WiFiManager for captive portal provisioning (fallback)
 #include <PubSubClient.h>      // MQTT client (uses a Client underneath)
-#include <time.h>              // For NTP (system time)
 #include <OneWire.h>           // OneWire protocol for DS18B20
 #include <DallasTemperature.h> // DS18B20 temperature sensor library
-#include <Preferences.h>       // NVS storage for WiFi credentials
 
 // =================== Project Includes ====================
 #include "config.h"    // host/ports/topics/device_id (NO secrets)
 #include "secrets.h"   // wifi and mqtt user/pass (SECRET)
-#include "ca_cert.h"   // Root CA certificate (public)
 #include "ble_provisioning.h"  // BLE provisioning for WiFi credentials
+#include "ble_control.h"       // BLE local control (optional, BLE_CONTROL_ENABLED)
+#include "state_store.h"       // NVS-backed credentials and actuator state (RAM cached)
+#include "timer_engine.h"      // Deadline-based named timers
+#include "mqtt_transport.h"    // Prioritized outbound MQTT queue
+#include "mqtt_routes.h"       // Which topics reach the cloud session (MQTT_MODE_LAN_DUAL)
+#include "coalescing_client.h" // Batches MQTT writes into one TLS record
+#include "trust_store.h"       // Root CAs from the embedded certificate bundle
+#include "broker_pool.h"       // Broker endpoints, latency probing and failover
+#include "watchdog.h"          // Subsystem heartbeats, stall records, task watchdog
+#include "msg_pool.h"          // Pooled per-message buffers (no heap churn)
+#include "pump_policy.h"       // Pump command coalescing and anti-short-cycle
+#include "ota_update.h"        // Streaming OTA (HTTPS/MQTT, delta patches, rollback)
+#include "runtime_config.h"    // Settings tunable over MQTT, persisted in NVS
+#include "telemetry.h"         // Telemetry scheduler (fixed/adaptive strategies)
+#include "time_sync.h"         // Background SNTP, epoch timestamps for publishes
+#include "benchmark.h"         // Hot-path benchmarks (BENCHMARK_ENABLED builds)
+#include "pump_usage.h"        // Pump runtime/energy per day and mode
+#include "event_log.h"         // Append-only flash event log, range queries
+#include "local_api.h"         // HTTP/JSON API on the LAN (optional, LOCAL_API_ENABLED)
+#include "wifi_survey.h"       // Background WiFi scans, cached AP table, roaming
+#include "json_parse.h"        // Values of flat JSON command objects
+
+#if BLE_CONTROL_ENABLED && !defined(BLE_CONTROL_PASSKEY)
+#error "BLE_CONTROL_ENABLED requires BLE_CONTROL_PASSKEY in secrets.h"
+#endif
+
+#if LOCAL_API_ENABLED && !defined(LOCAL_API_TOKEN)
+#error "LOCAL_API_ENABLED requires LOCAL_API_TOKEN in secrets.h"
+#endif
+
+#ifndef OTA_SIGNING_KEY
+#define OTA_SIGNING_KEY nullptr   // Updates are refused (initOta() logs it at boot)
+#endif
 
 // ==================== Timing Constants ====================
-#define VALVE_SWITCH_DELAY      500       // Delay for valve switching (ms)
+// Publish/reconnect intervals and the valve delay are runtime settings (runtime_config.h)
 #define WIFI_CONNECT_TIMEOUT    15000     // Timeout for WiFi connection (ms)
-#define WIFI_RECONNECT_INTERVAL 10000     // Check WiFi status every 10 seconds
 #define WIFI_RETRY_ATTEMPTS     3         // Number of connection retry attempts
 #define WIFI_RETRY_DELAY        5000      // Delay between retry attempts (ms)
-#define NTP_SYNC_TIMEOUT        15000     // Timeout for NTP synchronization (ms)
-#define WIFI_STATE_INTERVAL     30000     // Interval to publish WiFi state (ms)
-#define TIMER_PUBLISH_INTERVAL  10000     // Interval to publish timer state (ms)
-#define TEMP_PUBLISH_INTERVAL   60000     // Interval to publish temperature (ms) - 60 seconds
-#define BLE_CHECK_INTERVAL      1000      // Check for BLE credentials every 1 second
-#define MIN_VALID_EPOCH         1700000000L // Minimum valid epoch for NTP (Nov 2023)
+#define BLE_EVENT_WAIT_TIMEOUT  1000      // Max time loop() blocks waiting for a BLE event (ms), less if a deadline is nearer
+#define TEMP_CONVERSION_TIME    750       // DS18B20 12-bit conversion time (ms)
+#define TLS_HANDSHAKE_TIMEOUT   30        // TLS handshake limit (s), default 120 would outlast the task watchdog
+#define HEAP_SAMPLE_INTERVAL    10000     // Interval to sample heap fragmentation (ms)
+#define CMD_ID_LEN              24        // Envelope sequence ID buffer (incl. null)
+#define CMD_WORD_LEN            16        // Plain command buffer, e.g. "TOGGLE" (incl. null)
 
 // ==================== Hardware State ====================
-static bool pumpState = false;     // Logical pump state (ON/OFF)
+static bool pumpState = false;     // Pump relay state (ON/OFF); commands go through pump_policy
 static int valveMode = 1;          // Valve mode: 1 or 2
 static float currentTemperature = 0.0; // Current temperature in °C
+static uint32_t pumpChangedMs = 0;     // millis() of the last relay switch (event "ts")
+static uint32_t valveChangedMs = 0;    // millis() of the last valve switch
+static uint32_t temperatureReadMs = 0; // millis() of the last sensor reading
+static bool tempReadRequested = false;     // A reading should be started
+static bool tempConversionRunning = false; // Sensor is converting, result not read yet
+static uint32_t tempConversionStart = 0;   // millis() when the conversion started
 static bool wifiProvisioned = false;   // Flag to track if provisioning completed
 
-// ==================== Timer State ====================
-static bool timerActive = false;   // Timer is running
-static int timerMode = 1;          // Timer mode (1=Cascada, 2=Eyectores)
-static uint32_t timerDuration = 0; // Total timer duration in seconds
-static uint32_t timerRemaining = 0; // Remaining time in seconds
-static uint32_t timerLastUpdate = 0; // Last millis() for countdown
-
 // ==================== Temperature Sensor ====================
 // Setup OneWire on GPIO 21
 OneWire oneWire(TEMP_SENSOR_PIN);
@@ -50,36 +78,99 @@ DallasTemperature tempSensor(&oneWire);
 // TLS Client (used to connect to a server with certificate)
 WiFiClientSecure tlsClient;
 
-// MQTT Client that travels over the tlsClient
-PubSubClient mqtt(tlsClient);
-
-// ==================== Forward Declarations ====================
-void clearWiFiCredentials();
+// Plain TCP Client (LAN broker without TLS)
+WiFiClient plainClient;
+
+// Buffers PubSubClient writes so a burst of packets becomes one TLS record
+// (switched to plainClient for endpoints without TLS)
+CoalescingClient mqttSocket(tlsClient);
+
+// MQTT Client that travels over the tlsClient (through mqttSocket)
+PubSubClient mqtt(mqttSocket);
+
+#if MQTT_MODE == MQTT_MODE_LAN_DUAL
+// Second session to a cloud broker while mqtt is on the LAN broker (reduced telemetry, remote commands)
+WiFiClientSecure cloudTlsClient;
+WiFiClient cloudPlainClient;
+CoalescingClient cloudSocket(cloudTlsClient);
+PubSubClient cloudMqtt(cloudSocket);
+#endif
+
+// Connect-to-ready timing of the last (re)connect
+// connect: TCP + TLS + MQTT CONNECT; ready: until the initial state left the queue
+static uint32_t mqttConnectStart = 0;
+static uint32_t mqttConnectMs = 0;
+static uint32_t mqttReadyMs = 0;
+static bool mqttReadyPending = false;
+static bool brokerReconnectPending = false;   // Active endpoint was reconfigured
+static bool mqttSessionLogged = false;        // Connect logged; the next loss is logged once
+static bool mqttFailureLogged = false;        // One connect failure logged per outage
+static bool cloudSessionUp = false;           // Second session connected (loss is logged once)
+
+// ==================== Telemetry ====================
+static FixedTelemetry fixedTelemetry;         // temp_pub_ms / wifi_state_ms, always published
+static AdaptiveTelemetry adaptiveTelemetry;   // Pump/trend driven rates, RSSI on change
+
+// ==================== Event Log Query ====================
+static char eventQueryId[CMD_ID_LEN] = "";    // "id" of the query being streamed
+static uint16_t eventQueryPage = 0;
+static uint32_t eventQueryTotal = 0;
+
+// ==================== Heap Health ====================
+// Sampled every HEAP_SAMPLE_INTERVAL: the largest free block shrinking while
+// free memory stays flat means the heap is fragmenting
+static uint32_t heapMaxBlockLow = 0;   // Lowest largest-free-block seen (0 = not sampled yet)
+static uint8_t heapFragPeak = 0;       // Highest fragmentation seen (%)
 
 // ==================== Helper Functions ====================
 
 /**
- * Converts MQTT payload (bytes) to String
+ * Copies an MQTT payload (bytes) into a pooled buffer, trimming whitespace
+ * @param out Destination buffer
  * @param payload Byte array received from MQTT broker
  * @param length Payload length in bytes
- * @return String with payload content (trimmed)
  */
-String payloadToString(const byte* payload, unsigned int length) {
-  String s;
-  s.reserve(length);
-  for (unsigned int i = 0; i < length; i++) s += (char)payload[i];
-  s.trim();
-  return s;
+void copyPayload(MsgBuffer& out, const byte* payload, unsigned int length) {
+  unsigned int start = 0;
+  while (start < length && isspace(payload[start])) start++;
+  while (length > start && isspace(payload[length - 1])) length--;
+  out.write(payload + start, length - start);
+}
+
+/**
+ * Fragmentation: share of free heap not usable as one block (%)
+ */
+uint8_t heapFragmentation(uint32_t freeHeap, uint32_t maxBlock) {
+  if (freeHeap == 0 || maxBlock >= freeHeap) return 0;
+  return 100 - (uint8_t)((uint64_t)maxBlock * 100 / freeHeap);
+}
+
+/**
+ * Samples the heap and keeps the worst values since boot
+ */
+void sampleHeap() {
+  uint32_t maxBlock = ESP.getMaxAllocHeap();
+  uint8_t frag = heapFragmentation(ESP.getFreeHeap(), maxBlock);
+
+  if (heapMaxBlockLow == 0 || maxBlock < heapMaxBlockLow) heapMaxBlockLow = maxBlock;
+  if (frag > heapFragPeak) {
+    heapFragPeak = frag;
+    Serial.print("[HEAP] Fragmentation peak: ");
+    Serial.print(frag);
+    Serial.print("% (largest block ");
+    Serial.print(maxBlock);
+    Serial.println(" bytes)");
+  }
 }
 
 // ==================== Temperature Sensor ====================
 
 /**
- * Reads temperature from DS18B20 sensor
+ * Reads the last converted temperature from DS18B20 sensor
+ * The conversion is started by serviceTemperature() TEMP_CONVERSION_TIME earlier
  * @return Temperature in Celsius degrees, or NAN if error
  */
 float readTemperature() {
-  tempSensor.requestTemperatures();
   float temp = tempSensor.getTempCByIndex(0);
   
   Serial.print("[SENSOR] Temperature: ");
@@ -93,39 +184,222 @@ float readTemperature() {
   return temp;
 }
 
+/**
+ * Asks for a temperature reading; the result is published when ready
+ */
+void requestTemperatureRead() {
+  tempReadRequested = true;
+}
+
 // ==================== MQTT State Publishing ====================
+// Publishes are queued by priority (mqtt_transport.h) and sent from loop()
+// Every state/event payload is JSON with "ts": epoch ms of the event (time_sync.h),
+// omitted while the clock is not set
+
+/**
+ * Appends ,"ts":<epoch ms> to a JSON object being written (nothing if unknown)
+ */
+void printTimestamp(Print& out, uint64_t epochMs) {
+  if (epochMs == 0) return;
+  out.print(",\"ts\":");
+  out.print(epochMs);
+}
+
+/**
+ * Serializes pump state: {"state":"ON","ts":1704067200000} ("ts" = when the relay switched)
+ */
+void writePumpState(Print& out) {
+  out.print("{\"state\":\""); out.print(pumpState ? "ON" : "OFF");
+  out.print("\"");
+  printTimestamp(out, timeEpochMsAt(pumpChangedMs));
+  out.print("}");
+}
 
 /**
  * Publishes current pump state to MQTT topic
  * Uses retain=true so last value is stored in the broker
  */
 void publishPumpState() {
-  const char* msg = pumpState ? "ON" : "OFF";
-  bool ok = mqtt.publish(TOPIC_PUMP_STATE, msg, true /*retain*/);
-  
-  Serial.print("[MQTT] publish ");
-  Serial.print(TOPIC_PUMP_STATE);
-  Serial.print(" = ");
-  Serial.print(msg);
-  Serial.println(ok ? " OK" : " FAIL");
+  MsgBuffer json;
+  writePumpState(json);
+
+  if (json.ok()) mqttEnqueue(TOPIC_PUMP_STATE, json.c_str(), true /*retain*/, MQTT_PRIO_CRITICAL);
+}
+
+/**
+ * Publishes the pump actuation policy: pending switch and coalescing counters
+ * Format: {"state":"ON","target":"OFF","pending":true,"hold_ms":8200,"requests":12,...}
+ */
+void publishPumpPolicy() {
+  PumpPolicyStatus p;
+  getPumpPolicyStatus(&p);
+
+  MsgBuffer json;
+  json.print("{\"state\":\"");     json.print(p.relayOn ? "ON" : "OFF");
+  json.print("\",\"target\":\"");  json.print(p.target ? "ON" : "OFF");
+  json.print("\",\"pending\":");    json.print(p.pending ? "true" : "false");
+  json.print(",\"hold_ms\":");      json.print(p.holdMs);
+  json.print(",\"requests\":");     json.print(p.requests);
+  json.print(",\"switches\":");     json.print(p.switches);
+  json.print(",\"superseded\":");   json.print(p.superseded);
+  json.print(",\"deferred\":");     json.print(p.deferred);
+  printTimestamp(json, timeEpochMs());
+  json.print("}");
+
+  if (json.ok()) mqttEnqueue(TOPIC_PUMP_POLICY, json.c_str(), true /*retain*/, MQTT_PRIO_STATE);
+}
+
+/**
+ * Writes one day of pump usage as JSON members (no braces)
+ * Format: "date":"2026-10-18","runtime_s":5400,"starts":3,"kwh":1.125,
+ *         "cascada":{"runtime_s":3600,"starts":2,"kwh":0.750},"eyectores":{...}
+ */
+void writeUsageDay(Print& out, const PersistedUsageDay& d) {
+  static const char* const MODE_NAMES[STATE_USAGE_MODES] = { "cascada", "eyectores" };
+  char date[11];
+
+  out.print("\"date\":");
+  if (formatUsageDay(d.day, date, sizeof(date))) {
+    out.print("\""); out.print(date); out.print("\"");
+  } else {
+    out.print("null");
+  }
+  out.print(",\"runtime_s\":"); out.print(d.runtimeSeconds[0] + d.runtimeSeconds[1]);
+  out.print(",\"starts\":");    out.print(d.starts[0] + d.starts[1]);
+  out.print(",\"kwh\":");       out.print((d.energyWs[0] + d.energyWs[1]) / 3600000.0f, 3);
+  for (int i = 0; i < STATE_USAGE_MODES; i++) {
+    out.print(",\"");  out.print(MODE_NAMES[i]);
+    out.print("\":{\"runtime_s\":"); out.print(d.runtimeSeconds[i]);
+    out.print(",\"starts\":");        out.print(d.starts[i]);
+    out.print(",\"kwh\":");           out.print(d.energyWs[i] / 3600000.0f, 3);
+    out.print("}");
+  }
+}
+
+/**
+ * Publishes today's pump usage (runtime, starts, estimated energy per valve mode)
+ * Format: {"date":"2026-10-18","runtime_s":5400,...,"watts":750,"ts":...}
+ */
+void publishPumpUsage() {
+  PersistedUsageDay today, lastDay;
+  getPumpUsage(&today, &lastDay);
+
+  MsgBuffer json;
+  json.print("{");
+  writeUsageDay(json, today);
+  json.print(",\"watts\":"); json.print(configValue(CFG_PUMP_WATTS));
+  printTimestamp(json, timeEpochMs());
+  json.print("}");
+
+  if (json.ok()) mqttEnqueue(TOPIC_PUMP_USAGE, json.c_str(), true /*retain*/, MQTT_PRIO_STATE);
+}
+
+/**
+ * Publishes the summary of the last completed day (retained until the next one)
+ */
+void publishPumpUsageDaily() {
+  PersistedUsageDay today, lastDay;
+  getPumpUsage(&today, &lastDay);
+  if (lastDay.day == 0) return;   // No day completed yet
+
+  MsgBuffer json;
+  json.print("{");
+  writeUsageDay(json, lastDay);
+  printTimestamp(json, timeEpochMs());
+  json.print("}");
+
+  if (json.ok()) mqttEnqueue(TOPIC_PUMP_USAGE_DAILY, json.c_str(), true /*retain*/, MQTT_PRIO_STATE);
+}
+
+/**
+ * Publishes OTA progress and the running image state
+ * Format: {"state":"receiving","offset":8192,"size":1048576,"written":8192,"patch":false,...}
+ * "offset" is the next chunk offset the device expects (MQTT transfers)
+ */
+void publishOtaState() {
+  OtaStatus o;
+  getOtaStatus(&o);
+
+  MsgBuffer json;
+  json.print("{\"state\":\"");      json.print(otaPhaseName(o.phase));
+  json.print("\",\"source\":\"");   json.print(o.https ? "https" : "mqtt");
+  json.print("\",\"patch\":");       json.print(o.patch ? "true" : "false");
+  json.print(",\"offset\":");        json.print(o.offset);
+  json.print(",\"size\":");          json.print(o.size);
+  json.print(",\"written\":");       json.print(o.written);
+  json.print(",\"error\":\"");       json.print(o.error);
+  json.print("\",\"partition\":\""); json.print(o.partition);
+  json.print("\",\"pending_verify\":"); json.print(o.pendingVerify ? "true" : "false");
+  printTimestamp(json, timeEpochMs());
+  json.print("}");
+
+  if (json.ok()) mqttEnqueue(TOPIC_OTA_STATE, json.c_str(), true /*retain*/, MQTT_PRIO_STATE);
+}
+
+/**
+ * Serializes the effective runtime settings
+ * Format: {"wifi_state_ms":30000,"timer_pub_ms":10000,...,"custom":["temp_pub_ms"]}
+ * "custom" lists the settings that differ from the firmware defaults
+ */
+void writeConfigState(Print& json) {
+  json.print("{");
+  for (int i = 0; i < CFG_KEY_COUNT; i++) {
+    const ConfigEntry& entry = configEntry((ConfigKey)i);
+    uint32_t value = configValue((ConfigKey)i);
+    json.print("\"");  json.print(entry.name);  json.print("\":");
+    if (entry.type == CONFIG_BOOL) json.print(value ? "true" : "false");
+    else json.print(value);
+    json.print(",");
+  }
+  json.print("\"custom\":[");
+  bool first = true;
+  for (int i = 0; i < CFG_KEY_COUNT; i++) {
+    const ConfigEntry& entry = configEntry((ConfigKey)i);
+    if (configValue((ConfigKey)i) == entry.defaultValue) continue;
+    if (!first) json.print(",");
+    first = false;
+    json.print("\"");  json.print(entry.name);  json.print("\"");
+  }
+  json.print("]");
+  printTimestamp(json, timeEpochMs());
+  json.print("}");
+}
+
+/**
+ * Publishes the effective runtime settings (for fleet audits)
+ */
+void publishConfigState() {
+  MsgBuffer json;
+  writeConfigState(json);
+
+  if (json.ok()) mqttEnqueue(TOPIC_CONFIG_STATE, json.c_str(), true /*retain*/, MQTT_PRIO_STATE);
+}
+
+/**
+ * Selects the telemetry strategy from the "telemetry_adapt" setting
+ */
+void applyTelemetryStrategy() {
+  setTelemetryStrategy(configValue(CFG_TELEMETRY_ADAPTIVE) ? (TelemetryStrategy*)&adaptiveTelemetry
+                                                           : (TelemetryStrategy*)&fixedTelemetry);
+}
+
+/**
+ * Serializes valve state: {"mode":1,"ts":1704067200000} (mode 1 or 2, "ts" = when the valve switched)
+ */
+void writeValveState(Print& out) {
+  out.print("{\"mode\":"); out.print(valveMode);
+  printTimestamp(out, timeEpochMsAt(valveChangedMs));
+  out.print("}");
 }
 
 /**
  * Publishes current valve state to MQTT topic
- * Sends "1" or "2" depending on active mode
  */
 void publishValveState() {
-  char msg[2];
-  msg[0] = '0' + valveMode;  // Convert 1 or 2 to "1" or "2"
-  msg[1] = '\0';
-  
-  bool ok = mqtt.publish(TOPIC_VALVE_STATE, msg, true /*retain*/);
-  
-  Serial.print("[MQTT] publish ");
-  Serial.print(TOPIC_VALVE_STATE);
-  Serial.print(" = ");
-  Serial.print(msg);
-  Serial.println(ok ? " OK" : " FAIL");
+  MsgBuffer json;
+  writeValveState(json);
+
+  if (json.ok()) mqttEnqueue(TOPIC_VALVE_STATE, json.c_str(), true /*retain*/, MQTT_PRIO_CRITICAL);
 }
 
 /**
@@ -138,13 +412,17 @@ void publishValveState() {
  * - weak: < -70 dBm
  */
 void publishWiFiState() {
+  MsgBuffer json;
   if (WiFi.status() != WL_CONNECTED) {
-    mqtt.publish(TOPIC_WIFI_STATE, "{\"status\":\"disconnected\"}", true);
+    json.print("{\"status\":\"disconnected\"");
+    printTimestamp(json, timeEpochMs());
+    json.print("}");
+    if (json.ok()) mqttEnqueue(TOPIC_WIFI_STATE, json.c_str(), true, MQTT_PRIO_TELEMETRY);
     return;
   }
   
   int rssi = WiFi.RSSI();
-  String quality;
+  const char* quality;
   
   // Determinar calidad de señal basado en RSSI
   if (rssi >= -50) quality = "excellent";
@@ -153,71 +431,351 @@ void publishWiFiState() {
   else quality = "weak";
   
   // Build JSON
-  String json = "{";
-  json += "\"status\":\"connected\",";
-  json += "\"ssid\":\"" + WiFi.SSID() + "\",";
-  json += "\"ip\":\"" + WiFi.localIP().toString() + "\",";
-  json += "\"rssi\":" + String(rssi) + ",";
-  json += "\"quality\":\"" + quality + "\"";
-  json += "}";
-  
-  bool ok = mqtt.publish(TOPIC_WIFI_STATE, json.c_str(), true /*retain*/);
+  json.print("{\"status\":\"connected\",\"ssid\":\"");
+  json.print(WiFi.SSID());
+  json.print("\",\"ip\":\"");   json.print(WiFi.localIP());
+  json.print("\",\"bssid\":\""); json.print(WiFi.BSSIDstr());
+  json.print("\",\"channel\":"); json.print(WiFi.channel());
+  json.print(",\"rssi\":");       json.print(rssi);
+  json.print(",\"quality\":\""); json.print(quality);
+  json.print("\"");
+
+  // Broker in use and how long its last connect took
+  BrokerStatus broker;
+  if (getBrokerStatus(activeBrokerSlot(), &broker)) {
+    json.print(",\"broker\":\"");      json.print(broker.role);
+    json.print("\",\"broker_host\":\""); json.print(broker.host);
+    json.print("\",\"broker_ms\":");   json.print(broker.connectMs);
+  }
+  printTimestamp(json, timeEpochMs());
+  json.print("}");
   
-  Serial.print("[MQTT] publish ");
-  Serial.print(TOPIC_WIFI_STATE);
-  Serial.print(" = ");
-  Serial.print(json);
-  Serial.println(ok ? " OK" : " FAIL");
+  if (json.ok()) mqttEnqueue(TOPIC_WIFI_STATE, json.c_str(), true /*retain*/, MQTT_PRIO_TELEMETRY);
 }
 
 /**
- * Publishes timer state in JSON format
- * Includes: active (bool), remaining (seconds), mode (1 or 2), duration (total seconds)
+ * Values reported on the diagnostics topic, captured once per publish
+ * (the streamed serializer runs twice and must see the same values)
+ */
+struct DiagnosticsSnapshot {
+  uint32_t uptimeSeconds;
+  uint32_t heapFree;
+  uint32_t heapMin;
+  uint32_t heapMaxBlock;
+  int rssi;
+  MsgPoolStats pool;
+  MqttQueueStats mqtt;
+  CoalescingStats tls;
+  BrokerStatus brokers[BROKER_MAX_ENDPOINTS];
+  bool brokerUsed[BROKER_MAX_ENDPOINTS];
+  WatchdogReport watchdog;
+  TelemetryStats telemetry;
+  TimeSyncStatus time;
+  EventLogStats events;
+  LocalApiStats localApi;
+  WiFiSurveyStats survey;
+  bool cloudConnected;
+  uint64_t epochMs;
+};
+
+/**
+ * Serializes diagnostics JSON (MqttPayloadWriter for mqttPublishStreamed)
+ */
+void writeDiagnostics(Print& out, void* context) {
+  const DiagnosticsSnapshot& d = *(const DiagnosticsSnapshot*)context;
+
+  out.print("{\"uptime_s\":");   out.print(d.uptimeSeconds);
+  out.print(",\"heap\":{\"free\":"); out.print(d.heapFree);
+  out.print(",\"min_free\":");   out.print(d.heapMin);
+  out.print(",\"max_block\":");  out.print(d.heapMaxBlock);
+  out.print(",\"max_block_low\":"); out.print(heapMaxBlockLow);
+  out.print(",\"frag_pct\":");   out.print(heapFragmentation(d.heapFree, d.heapMaxBlock));
+  out.print(",\"frag_peak\":");  out.print(heapFragPeak);
+  out.print("},\"rssi\":");      out.print(d.rssi);
+
+  // Message buffer pool: exhausted/truncated should stay 0
+  out.print(",\"pool\":{\"blocks\":"); out.print(MSG_POOL_BLOCKS);
+  out.print(",\"block_size\":"); out.print(MSG_POOL_BLOCK_SIZE);
+  out.print(",\"in_use\":");     out.print(d.pool.inUse);
+  out.print(",\"high_water\":"); out.print(d.pool.highWater);
+  out.print(",\"acquired\":");   out.print(d.pool.acquired);
+  out.print(",\"exhausted\":");  out.print(d.pool.exhausted);
+  out.print(",\"truncated\":");  out.print(d.pool.truncated);
+  out.print("}");
+
+  // Outbound MQTT queue and streaming health
+  out.print(",\"mqtt\":{\"buffer\":");  out.print(MQTT_BUFFER_SIZE);
+  out.print(",\"depth\":");       out.print(d.mqtt.depth);
+  out.print(",\"high_water\":");  out.print(d.mqtt.highWater);
+  out.print(",\"mode\":");        out.print(MQTT_MODE);
+  out.print(",\"sent\":");        out.print(d.mqtt.sent);
+  out.print(",\"cloud_connected\":"); out.print(d.cloudConnected ? "true" : "false");
+  out.print(",\"cloud_sent\":");  out.print(d.mqtt.cloudSent);
+  out.print(",\"cloud_released\":"); out.print(d.mqtt.cloudReleased);
+  out.print(",\"coalesced\":");   out.print(d.mqtt.coalesced);
+  out.print(",\"inflight\":");    out.print(d.mqtt.inflight);
+  out.print(",\"acked\":");       out.print(d.mqtt.acked);
+  out.print(",\"redelivered\":"); out.print(d.mqtt.redelivered);
+  out.print(",\"dropped\":");     out.print(d.mqtt.dropped);
+  out.print(",\"oversize\":");    out.print(d.mqtt.oversize);
+  out.print(",\"failed\":");      out.print(d.mqtt.failed);
+  out.print(",\"streamed\":");    out.print(d.mqtt.streamed);
+  out.print(",\"streamed_bytes\":"); out.print(d.mqtt.streamedBytes);
+  out.print(",\"truncated\":");   out.print(d.mqtt.truncated);
+  out.print(",\"connect_ms\":");  out.print(mqttConnectMs);
+  out.print(",\"ready_ms\":");    out.print(mqttReadyMs);
+
+  // TLS write coalescing: records < writes is the saving (compare with MQTT_COALESCE_WRITES=0)
+  out.print("},\"tls\":{\"coalesce\":"); out.print(MQTT_COALESCE_WRITES);
+  out.print(",\"writes\":");     out.print(d.tls.writes);
+  out.print(",\"records\":");    out.print(d.tls.records);
+  out.print(",\"bytes\":");      out.print(d.tls.bytes);
+  out.print(",\"write_us\":");   out.print(d.tls.writeUs);
+  out.print(",\"largest\":");    out.print(d.tls.largest);
+  out.print(",\"failed\":");     out.print(d.tls.failed);
+
+  // Broker endpoints: active one, probe/connect latency, failures
+  out.print("},\"brokers\":[");
+  bool first = true;
+  for (int i = 0; i < BROKER_MAX_ENDPOINTS; i++) {
+    if (!d.brokerUsed[i]) continue;
+    const BrokerStatus& b = d.brokers[i];
+    if (!first) out.print(",");
+    first = false;
+    out.print("{\"role\":\"");     out.print(b.role);
+    out.print("\",\"host\":\"");  out.print(b.host);
+    out.print("\",\"port\":");     out.print(b.port);
+    out.print(",\"tls\":");         out.print(b.tls ? "true" : "false");
+    out.print(",\"active\":");      out.print(b.active ? "true" : "false");
+    out.print(",\"cloud\":");       out.print(b.cloud ? "true" : "false");
+    out.print(",\"discovered\":");  out.print(b.discovered ? "true" : "false");
+    out.print(",\"reachable\":");   out.print(b.reachable ? "true" : "false");
+    out.print(",\"probe_ms\":");    out.print(b.probeMs);
+    out.print(",\"connect_ms\":");  out.print(b.connectMs);
+    out.print(",\"failures\":");    out.print(b.failures);
+    out.print(",\"connects\":");    out.print(b.connects);
+    out.print("}");
+  }
+
+  // Stalls this boot and the previous one, missed subsystem heartbeats
+  const WatchdogReport& w = d.watchdog;
+  out.print("],\"watchdog\":{\"reset_reason\":\""); out.print(w.resetReason);
+  out.print("\",\"stalls\":");         out.print(w.stalls);
+  out.print(",\"longest_ms\":");       out.print(w.longest.durationMs);
+  out.print(",\"longest_phase\":\"");  out.print(w.longest.phase);
+  out.print("\",\"longest_at_s\":");   out.print(w.longest.uptimeSeconds);
+  out.print(",\"prev_longest_ms\":");  out.print(w.previous.durationMs);
+  out.print(",\"prev_longest_phase\":\""); out.print(w.previous.phase);
+  out.print("\",\"missed\":{");
+  for (int i = 0; i < WDT_SUBSYSTEM_COUNT; i++) {
+    if (i > 0) out.print(",");
+    out.print("\"");
+    out.print(watchdogSubsystemName(i));
+    out.print("\":");
+    out.print(w.missed[i]);
+  }
+
+  // Telemetry rates and publishes saved versus the fixed intervals (negative = more)
+  const TelemetryStats& t = d.telemetry;
+  out.print("}},\"telemetry\":{\"strategy\":\""); out.print(t.strategy);
+  out.print("\"");
+  for (int i = 0; i < TELEMETRY_STREAM_COUNT; i++) {
+    out.print(",\"");
+    out.print(telemetryStreamName(i));
+    out.print("\":{\"interval_ms\":"); out.print(t.intervalMs[i]);
+    out.print(",\"samples\":");        out.print(t.samples[i]);
+    out.print(",\"sent\":");           out.print(t.sent[i]);
+    out.print(",\"fixed\":");          out.print(t.fixedEquivalent[i]);
+    out.print(",\"saved\":");          out.print((int32_t)(t.fixedEquivalent[i] - t.sent[i]));
+    out.print("}");
+  }
+
+  // Clock: SNTP resyncs, last correction and estimated crystal drift
+  const TimeSyncStatus& c = d.time;
+  out.print("},\"time\":{\"valid\":"); out.print(c.valid ? "true" : "false");
+  out.print(",\"syncs\":");          out.print(c.syncs);
+  out.print(",\"since_sync_s\":");   out.print(c.sinceSyncMs / 1000);
+  out.print(",\"correction_ms\":");  out.print(c.lastCorrectionMs);
+  out.print(",\"drift_ppm\":");      out.print(c.driftPpm, 1);
+
+  // Event log: fill level and flash wear
+  const EventLogStats& e = d.events;
+  out.print("},\"events\":{\"mounted\":"); out.print(e.mounted ? "true" : "false");
+  out.print(",\"boot\":");          out.print(e.boot);
+  out.print(",\"next_seq\":");      out.print(e.nextSeq);
+  out.print(",\"records\":");       out.print(e.records);
+  out.print(",\"capacity\":");      out.print(e.capacity);
+  out.print(",\"segments_used\":"); out.print(e.segmentsUsed);
+  out.print(",\"segments\":");      out.print(e.segments);
+  out.print(",\"cycles\":");        out.print(e.cycles);
+  out.print(",\"erases\":");        out.print(e.erases);
+  out.print(",\"torn\":");          out.print(e.corrupt);
+  out.print(",\"write_errors\":");  out.print(e.writeErrors);
+  out.print(",\"oldest_ts\":");     out.print(e.oldestTs);
+
+  // Local HTTP API: load and how long commands waited for the loop
+  const LocalApiStats& a = d.localApi;
+  out.print("},\"local_api\":{\"running\":"); out.print(a.running ? "true" : "false");
+  out.print(",\"requests\":");      out.print(a.requests);
+  out.print(",\"unauthorized\":");  out.print(a.unauthorized);
+  out.print(",\"rejected\":");      out.print(a.rejected);
+  out.print(",\"queued\":");        out.print(a.queued);
+  out.print(",\"busy\":");          out.print(a.busy);
+  out.print(",\"stale\":");         out.print(a.stale);
+  out.print(",\"max_wait_ms\":");   out.print(a.maxWaitMs);
+
+  // WiFi site survey and roaming (age_s -1 = no scan yet)
+  const WiFiSurveyStats& sv = d.survey;
+  out.print("},\"survey\":{\"aps\":"); out.print(sv.entries);
+  out.print(",\"scans\":");         out.print(sv.scans);
+  out.print(",\"failed\":");        out.print(sv.failed);
+  out.print(",\"scan_ms\":");       out.print(sv.lastScanMs);
+  out.print(",\"age_s\":");         out.print(sv.ageMs == UINT32_MAX ? -1 : (long)(sv.ageMs / 1000));
+  out.print(",\"roams\":");         out.print(sv.roams);
+  out.print(",\"roam_failures\":"); out.print(sv.roamFailures);
+  out.print("}");
+  printTimestamp(out, d.epochMs);
+  out.print("}");
+}
+
+/**
+ * Collects the values reported in diagnostics
+ */
+void snapshotDiagnostics(DiagnosticsSnapshot& d) {
+  d.uptimeSeconds = millis() / 1000;
+  d.heapFree = ESP.getFreeHeap();
+  d.heapMin = ESP.getMinFreeHeap();
+  d.heapMaxBlock = ESP.getMaxAllocHeap();
+  d.rssi = WiFi.RSSI();
+  getMsgPoolStats(&d.pool);
+  getMqttQueueStats(&d.mqtt);
+  mqttSocket.getStats(&d.tls);
+  for (int i = 0; i < BROKER_MAX_ENDPOINTS; i++) {
+    d.brokerUsed[i] = getBrokerStatus(i, &d.brokers[i]);
+  }
+  getWatchdogReport(&d.watchdog);
+  getTelemetryStats(&d.telemetry);
+  getTimeSyncStatus(&d.time);
+  getEventLogStats(&d.events);
+  getLocalApiStats(&d.localApi);
+  getWifiSurveyStats(&d.survey);
+#if MQTT_MODE == MQTT_MODE_LAN_DUAL
+  d.cloudConnected = cloudMqtt.connected();
+#else
+  d.cloudConnected = false;
+#endif
+  d.epochMs = timeEpochMs();
+}
+
+/**
+ * Publishes diagnostics JSON (heap, buffer pool, uptime, MQTT transport metrics, broker endpoints, watchdog)
+ * Streamed in chunks, so it is not limited by MQTT_BUFFER_SIZE
+ */
+void publishDiagnostics() {
+  DiagnosticsSnapshot d;
+  snapshotDiagnostics(d);
+
+  mqttPublishStreamed(TOPIC_DIAG_STATE, true /*retain*/, writeDiagnostics, &d);
+}
+
+/**
+ * Serializes timer state
+ * Top-level fields describe the primary timer (the one that expires last and
+ * therefore decides when the pump stops): active (bool), remaining (seconds),
+ * mode (1 or 2), duration (total seconds). "timers" lists every running timer.
+ */
+void writeTimerState(Print& json) {
+  TimerInfo primary;
+  bool active = getPrimaryTimer(&primary);
+
+  json.print("{\"active\":");    json.print(active ? "true" : "false");
+  json.print(",\"remaining\":"); json.print(active ? primary.remainingSeconds : 0);
+  json.print(",\"mode\":");      json.print(active ? primary.mode : 1);
+  json.print(",\"duration\":");  json.print(active ? primary.durationSeconds : 0);
+  json.print(",\"timers\":[");
+  TimerInfo info;
+  for (int i = 0; getTimerInfo(i, &info); i++) {
+    if (i > 0) json.print(",");
+    json.print("{\"name\":\"");     json.print(info.name);
+    json.print("\",\"remaining\":"); json.print(info.remainingSeconds);
+    json.print(",\"mode\":");        json.print(info.mode);
+    json.print(",\"duration\":");    json.print(info.durationSeconds);
+    json.print("}");
+  }
+  json.print("]");
+  printTimestamp(json, timeEpochMs());
+  json.print("}");
+}
+
+/**
+ * Publishes timer state in JSON format (see writeTimerState)
  */
 void publishTimerState() {
-  String json = "{";
-  json += "\"active\":" + String(timerActive ? "true" : "false") + ",";
-  json += "\"remaining\":" + String(timerRemaining) + ",";
-  json += "\"mode\":" + String(timerMode) + ",";
-  json += "\"duration\":" + String(timerDuration);
-  json += "}";
+  MsgBuffer json;
+  writeTimerState(json);
   
-  bool ok = mqtt.publish(TOPIC_TIMER_STATE, json.c_str(), true /*retain*/);
-  
-  Serial.print("[MQTT] publish ");
-  Serial.print(TOPIC_TIMER_STATE);
-  Serial.print(" = ");
-  Serial.print(json);
-  Serial.println(ok ? " OK" : " FAIL");
+  if (json.ok()) mqttEnqueue(TOPIC_TIMER_STATE, json.c_str(), true /*retain*/, MQTT_PRIO_STATE);
 }
 
 /**
  * Publishes current temperature to MQTT topic
- * Format: decimal number with 1 decimal place (e.g., "25.3")
+ * Format: {"value":25.3,"ts":1704067200000} (1 decimal, "ts" = when it was read)
  */
 void publishTemperature() {
+  MsgBuffer json;
   if (isnan(currentTemperature)) {
     Serial.println("[MQTT] Skip temperature publish - invalid reading");
     // Publish diagnostic to error topic for visibility
-    String err = "{\"error\":\"sensor_disconnected\"}";
-    mqtt.publish(TOPIC_TEMP_ERROR, err.c_str(), true /*retain*/);
-    Serial.print("[MQTT] publish ");
-    Serial.print(TOPIC_TEMP_ERROR);
-    Serial.print(" = ");
-    Serial.println(err);
+    json.print("{\"error\":\"sensor_disconnected\"");
+    printTimestamp(json, timeEpochMsAt(temperatureReadMs));
+    json.print("}");
+    if (json.ok()) mqttEnqueue(TOPIC_TEMP_ERROR, json.c_str(), true /*retain*/, MQTT_PRIO_TELEMETRY);
     return;
   }
-  
-  char tempStr[8];
-  dtostrf(currentTemperature, 4, 1, tempStr); // Format: "XX.X"
-  
-  bool ok = mqtt.publish(TOPIC_TEMP_STATE, tempStr, true);
-  
-  Serial.print("[MQTT] publish ");
-  Serial.print(TOPIC_TEMP_STATE);
-  Serial.print(" = ");
-  Serial.print(tempStr);
-  Serial.println(ok ? " OK" : " FAIL");
+
+  json.print("{\"value\":"); json.print(currentTemperature, 1);
+  printTimestamp(json, timeEpochMsAt(temperatureReadMs));
+  json.print("}");
+
+  if (json.ok()) mqttEnqueue(TOPIC_TEMP_STATE, json.c_str(), true /*retain*/, MQTT_PRIO_TELEMETRY);
+}
+
+/**
+ * Runs the non-blocking sensor conversion (call in loop)
+ * Starts a conversion when requested and reads/publishes it once
+ * TEMP_CONVERSION_TIME has elapsed, instead of blocking ~750 ms per reading.
+ */
+void serviceTemperature() {
+  if (!tempConversionRunning) {
+    if (!tempReadRequested) return;
+    tempReadRequested = false;
+    tempSensor.requestTemperatures();   // Returns immediately (setWaitForConversion(false))
+    tempConversionStart = millis();
+    tempConversionRunning = true;
+    watchdogHeartbeat(WDT_SENSOR);      // The conversion must complete within its deadline
+    return;
+  }
+
+  if (millis() - tempConversionStart < TEMP_CONVERSION_TIME) return;
+  tempConversionRunning = false;
+
+  watchdogEnterPhase("sensor_read");
+  currentTemperature = readTemperature();
+  temperatureReadMs = millis();
+  watchdogExitPhase();
+  watchdogIdle(WDT_SENSOR);
+
+  // Log the sensor dropping out once, not every reading
+  static bool sensorFailed = false;
+  if (isnan(currentTemperature) != sensorFailed) {
+    sensorFailed = !sensorFailed;
+    if (sensorFailed) logEvent(EVENT_ERROR, EVENT_ERR_SENSOR, 0);
+  }
+  // Offered while offline too (it feeds the trend); only a publish counts as sent
+  if (telemetryOffer(TELEMETRY_TEMPERATURE, currentTemperature) && mqtt.connected()) {
+    publishTemperature();
+    telemetryPublished(TELEMETRY_TEMPERATURE, currentTemperature);
+  }
 }
 
 // ==================== Relay Control ====================
@@ -232,6 +790,11 @@ void setPumpRelay(bool targetState) {
   
   digitalWrite(PUMP_RELAY_PIN, targetState ? HIGH : LOW);
   pumpState = targetState;
+  pumpChangedMs = millis();
+  setTelemetryPumpState(pumpState);
+  pumpUsageUpdate(pumpState, valveMode);
+  persistActuatorState(pumpState, valveMode);
+  logEvent(EVENT_PUMP, 0, pumpState ? 1 : 0, valveMode);
 }
 
 /**
@@ -251,20 +814,44 @@ void setValveRelay(int targetMode) {
   // Mode 1 (Cascada) = LOW, Mode 2 (Eyectores) = HIGH
   digitalWrite(VALVE_RELAY_PIN, (targetMode == 2) ? HIGH : LOW);
   valveMode = targetMode;
+  valveChangedMs = millis();
+  pumpUsageUpdate(pumpState, valveMode);
+  persistActuatorState(pumpState, valveMode);
+  logEvent(EVENT_VALVE, 0, valveMode);
 }
 
 // ==================== Control Logic ====================
 
 /**
- * Controls pump: sets relay state and publishes
+ * Applies a pump switch once the actuation policy allows it (call in loop)
+ * @return true if the relay switched
+ */
+bool servicePump() {
+  bool on;
+  if (!pollPumpSwitch(&on)) return false;
+
+  setPumpRelay(on);
+  publishPumpState();
+  publishPumpPolicy();
+  publishPumpUsage();
+  return true;
+}
+
+/**
+ * Controls pump: requests the state from the actuation policy and publishes
+ * The relay follows right away, or once the coalescing window / minimum dwell
+ * has passed (see pump_policy.h); only the last request is applied.
  * @param targetState Desired state: true=ON, false=OFF
  */
 void setPumpState(bool targetState) {
   Serial.print("[CONTROL] Pump target state: ");
   Serial.println(targetState ? "ON" : "OFF");
   
-  setPumpRelay(targetState);
-  publishPumpState();
+  if (!requestPump(targetState) || !servicePump()) {
+    // Held or unchanged: confirm the actual relay state and the pending decision
+    publishPumpState();
+    publishPumpPolicy();
+  }
 }
 
 /**
@@ -295,299 +882,680 @@ void setValveMode(int targetMode) {
 // ==================== Timer Control ====================
 
 /**
- * Starts timer with specified mode and duration
+ * Starts (or restarts) a named timer with specified mode and duration
  * Sequence:
- * 1. Validates parameters (mode 1 or 2, duration > 0)
- * 2. Configures timer variables
- * 3. Sets valve mode
- * 4. Turns on pump
- * 5. Publishes initial state
+ * 1. Registers the deadline with the timer engine (validates mode and duration)
+ * 2. Sets valve mode
+ * 3. Turns on pump
+ * 4. Publishes initial state
+ * @param name Timer name, nullptr for the default timer
  * @param mode Valve mode: 1 (Cascada) or 2 (Eyectores)
  * @param durationSeconds Duration in seconds
+ * @return false if the timer engine rejected the timer
  */
-void startTimer(int mode, uint32_t durationSeconds) {
-  if (mode != 1 && mode != 2) {
-    Serial.println("[TIMER] ERROR: Invalid mode. Use 1 or 2");
-    return;
-  }
-  
-  if (durationSeconds == 0) {
-    Serial.println("[TIMER] ERROR: Duration must be > 0");
-    return;
-  }
-  
-  Serial.print("[TIMER] Starting timer: mode=");
+bool startTimer(const char* name, int mode, uint32_t durationSeconds) {
+  Serial.print("[TIMER] Starting timer '");
+  Serial.print(name ? name : TIMER_DEFAULT_NAME);
+  Serial.print("': mode=");
   Serial.print(mode);
   Serial.print(", duration=");
   Serial.print(durationSeconds);
   Serial.println("s");
-  
-  // Configure timer
-  timerActive = true;
-  timerMode = mode;
-  timerDuration = durationSeconds;
-  timerRemaining = durationSeconds;
-  timerLastUpdate = millis();
-  
+
+  if (!startNamedTimer(name, mode, durationSeconds)) return false;
+  logEvent(EVENT_TIMER, EVENT_TIMER_START, durationSeconds, mode);
+
   // Set valve mode
-  setValveMode(mode);
-  delay(VALVE_SWITCH_DELAY); // Wait for valves to switch completely
-  
+  if (valveMode != mode) {
+    setValveMode(mode);
+    delay(configValue(CFG_VALVE_SWITCH_DELAY)); // Wait for valves to switch completely
+  }
+
   // Turn on pump
-  setPumpState(true);
-  
+  if (!pumpTarget()) setPumpState(true);
+
   // Publish initial timer state
   publishTimerState();
+  return true;
 }
 
 /**
- * Stops timer
- * Turns off pump and publishes new state (inactive)
+ * Stops one named timer, or all timers when name is nullptr
+ * Turns off the pump once no timer is left and publishes the new state
  */
-void stopTimer() {
-  if (!timerActive) return;
-  
-  Serial.println("[TIMER] Stopping timer");
-  
-  timerActive = false;
-  timerRemaining = 0;
-  
-  // Turn off pump
-  setPumpState(false);
-  
+void stopTimer(const char* name) {
+  if (activeTimerCount() == 0) return;
+
+  if (name) {
+    Serial.print("[TIMER] Stopping timer '");
+    Serial.print(name);
+    Serial.println("'");
+    if (!cancelNamedTimer(name)) {
+      Serial.println("[TIMER] No timer with that name");
+      return;
+    }
+  } else {
+    Serial.println("[TIMER] Stopping all timers");
+    cancelAllTimers();
+  }
+  logEvent(EVENT_TIMER, EVENT_TIMER_STOP, 0);
+
+  // Turn off pump when the last timer is gone
+  if (activeTimerCount() == 0) {
+    setPumpState(false);
+  }
+
   // Publish timer state
   publishTimerState();
 }
 
 /**
- * Updates timer countdown (call in loop)
- * Decrements remaining time every second and publishes state periodically
- * When timer expires (remaining=0), stops automatically
+ * Handles expired timers and periodic timer publishing (call in loop)
+ * Remaining time is derived from absolute deadlines, so a slow loop iteration
+ * delays the check but never stretches the timer.
  */
 void updateTimer() {
-  if (!timerActive) return;
-  
-  uint32_t now = millis();
-  uint32_t elapsed = (now - timerLastUpdate) / 1000; // Elapsed seconds
-  
-  if (elapsed >= 1) {
-    timerLastUpdate = now;
-    
-    if (timerRemaining > 0) {
-      timerRemaining--;
-      
-      // Publish state every 10 seconds or when little time remains
-      static uint32_t lastPublish = 0;
-      if (timerRemaining % 10 == 0 || timerRemaining <= 10 || (now - lastPublish) > TIMER_PUBLISH_INTERVAL) {
-        lastPublish = now;
-        publishTimerState();
-      }
-      
-      // Display remaining time on Serial
-      if (timerRemaining % 60 == 0 || timerRemaining <= 60) {
-        Serial.print("[TIMER] Remaining: ");
-        Serial.print(timerRemaining / 60);
-        Serial.print("m ");
-        Serial.print(timerRemaining % 60);
-        Serial.println("s");
-      }
+  TimerInfo expired;
+  bool anyExpired = false;
+  while (pollExpiredTimer(&expired)) {
+    anyExpired = true;
+    Serial.print("[TIMER] Time expired for '");
+    Serial.print(expired.name);
+    Serial.println("'!");
+    logEvent(EVENT_TIMER, EVENT_TIMER_EXPIRE, expired.durationSeconds, expired.mode);
+  }
+
+  if (anyExpired) {
+    TimerInfo primary;
+    if (getPrimaryTimer(&primary)) {
+      // Another timer keeps the pump running in its own mode
+      if (valveMode != primary.mode) setValveMode(primary.mode);
     } else {
-      // Timer finished
-      Serial.println("[TIMER] Time expired!");
-      stopTimer();
+      setPumpState(false);
     }
+    publishTimerState();
+    return;
+  }
+
+  checkpointTimers();
+
+  TimerInfo primary;
+  if (!getPrimaryTimer(&primary)) return;
+
+  // Publish every timer_pub_ms, and every second near the end
+  static uint32_t lastPublish = 0;
+  static uint32_t lastPublishedRemaining = 0;
+  uint32_t now = millis();
+  if (primary.remainingSeconds != lastPublishedRemaining &&
+      (primary.remainingSeconds <= 10 || now - lastPublish >= configValue(CFG_TIMER_PUBLISH_INTERVAL))) {
+    lastPublish = now;
+    lastPublishedRemaining = primary.remainingSeconds;
+    publishTimerState();
+
+    // Display remaining time on Serial
+    Serial.print("[TIMER] Remaining: ");
+    Serial.print(primary.remainingSeconds / 60);
+    Serial.print("m ");
+    Serial.print(primary.remainingSeconds % 60);
+    Serial.println("s");
   }
 }
 
-// ==================== MQTT Message Handler ====================
+// ==================== Command Dispatch ====================
 
 /**
- * Callback invoked when MQTT message arrives
+ * Outcome of a command, reported in the ack
+ */
+enum CommandResult {
+  CMD_OK,        // Applied
+  CMD_INVALID,   // Payload could not be parsed
+  CMD_FAILED     // Valid, but could not be applied (e.g. all timer slots in use)
+};
+
+const char* commandResultName(CommandResult result) {
+  switch (result) {
+    case CMD_OK:      return "ok";
+    case CMD_INVALID: return "invalid";
+    default:          return "failed";
+  }
+}
+
+/**
+ * Command topics by index, as stored in EVENT_COMMAND records (append only)
+ */
+static const char* const COMMAND_TOPICS[] = {
+  TOPIC_PUMP_SET, TOPIC_VALVE_SET, TOPIC_TIMER_SET, TOPIC_BROKER_SET, TOPIC_OTA_SET,
+  TOPIC_CONFIG_SET, TOPIC_TEMP_REFRESH, TOPIC_WIFI_CLEAR, TOPIC_EVENTS_SET
+};
+#define COMMAND_TOPIC_COUNT (int)(sizeof(COMMAND_TOPICS) / sizeof(COMMAND_TOPICS[0]))
+
+/**
+ * Topic relative to the device prefix, e.g. "pump/set"
+ */
+const char* deviceTopic(const char* topic) {
+  const char* prefix = "devices/" DEVICE_ID "/";
+  return strncmp(topic, prefix, strlen(prefix)) == 0 ? topic + strlen(prefix) : topic;
+}
+
+/**
+ * Records a received command in the event log
+ */
+void logCommandEvent(const char* topic, CommandResult result, EventChannel channel) {
+  int index = -1;
+  for (int i = 0; i < COMMAND_TOPIC_COUNT && index < 0; i++) {
+    if (strcmp(topic, COMMAND_TOPICS[i]) == 0) index = i;
+  }
+  logEvent(EVENT_COMMAND, channel, result, index);
+}
+
+/**
+ * Dispatches a command addressed to one of the command topics
+ * Shared by MQTT (onMqttMessage) and the BLE local control service
  * Handles 3 types of commands:
  * 1. Pump (TOPIC_PUMP_SET): ON/OFF/TOGGLE
  * 2. Valves (TOPIC_VALVE_SET): 1/2/TOGGLE
- * 3. Timer (TOPIC_TIMER_SET): JSON with {mode, duration}
- * @param topic Topic of received message
+ * 3. Timer (TOPIC_TIMER_SET): JSON with {mode, duration} and optional name
+ * 4. Broker endpoint (TOPIC_BROKER_SET): JSON with {slot, host, port, tls, user, pass}
+ * 5. Firmware update (TOPIC_OTA_SET): JSON with {url, size, sha256, sig, patch}, or ABORT
+ * 6. Runtime settings (TOPIC_CONFIG_SET): JSON with any registry keys, or {"reset": true}
+ * 7. Event log query (TOPIC_EVENTS_SET): JSON with {from, to, limit}
+ *
+ * Any command may be sent as an envelope carrying a sequence ID and the sender
+ * timestamp, e.g. {"id":42,"ts":1700000000123,"cmd":"ON"}. Timer commands add
+ * "id"/"ts" to their own JSON object (so do broker commands). The ID is returned so the caller can ack it.
+ * @param topic Command topic
  * @param payload Message content (bytes)
  * @param length Payload length
+ * @param commandId Output: envelope sequence ID, empty for plain commands (optional)
+ * @return Command outcome
  */
-void onMqttMessage(char* topic, byte* payload, unsigned int length) {
-  String t = String(topic);
-  String msg = payloadToString(payload, length);
-  msg.toUpperCase();
+CommandResult handleCommand(const char* topic, const byte* payload, unsigned int length,
+                            char* commandId = nullptr) {
+  MsgBuffer raw;   // Timer JSON keys/names are case-sensitive
+  copyPayload(raw, payload, length);
+  if (!raw.ok()) {
+    Serial.println("[CMD] ERROR: Payload too large (or no free message buffer)");
+    return CMD_FAILED;
+  }
 
-  Serial.print("[MQTT] RX ");
-  Serial.print(t);
+  bool envelope = raw.c_str()[0] == '{';
+  if (envelope && !jsonWellFormed(raw.c_str())) {
+    Serial.print("[CMD] ERROR: Malformed JSON on ");
+    Serial.println(topic);
+    return CMD_INVALID;
+  }
+  bool jsonCommand = strcmp(topic, TOPIC_TIMER_SET) == 0 || strcmp(topic, TOPIC_BROKER_SET) == 0 ||
+                     strcmp(topic, TOPIC_OTA_SET) == 0 || strcmp(topic, TOPIC_CONFIG_SET) == 0 ||
+                     strcmp(topic, TOPIC_EVENTS_SET) == 0;
+  char msg[CMD_WORD_LEN];
+  if (envelope && !jsonCommand) {
+    jsonValue(raw.c_str(), "cmd", msg, sizeof(msg));
+  } else {
+    strncpy(msg, raw.c_str(), sizeof(msg) - 1);
+    msg[sizeof(msg) - 1] = '\0';
+  }
+  for (char* c = msg; *c; c++) *c = toupper(*c);
+  if (commandId && envelope) jsonValue(raw.c_str(), "id", commandId, CMD_ID_LEN);
+
+  Serial.print("[CMD] RX ");
+  Serial.print(topic);
   Serial.print(" : ");
-  Serial.println(msg);
+  Serial.println(strcmp(topic, TOPIC_BROKER_SET) == 0 ? "(credentials hidden)" : raw.c_str());
 
   // ===== Pump Control =====
-  if (t == TOPIC_PUMP_SET) {
-    if (msg == "ON" || msg == "1") {
+  if (strcmp(topic, TOPIC_PUMP_SET) == 0) {
+    if (strcmp(msg, "ON") == 0 || strcmp(msg, "1") == 0) {
       setPumpState(true);
-    } else if (msg == "OFF" || msg == "0") {
+    } else if (strcmp(msg, "OFF") == 0 || strcmp(msg, "0") == 0) {
       setPumpState(false);
-    } else if (msg == "TOGGLE") {
+    } else if (strcmp(msg, "TOGGLE") == 0) {
       // Toggle: invert current state
-      setPumpState(!pumpState);
+      setPumpState(!pumpTarget());   // Relative to the pending request, not the relay
     } else {
       Serial.println("[MQTT] Unknown pump command. Use: ON/OFF/TOGGLE");
+      return CMD_INVALID;
     }
-    return;
+    return CMD_OK;
   }
 
   // ===== Valve Control =====
-  if (t == TOPIC_VALVE_SET) {
-    if (msg == "1") {
+  if (strcmp(topic, TOPIC_VALVE_SET) == 0) {
+    if (strcmp(msg, "1") == 0) {
       setValveMode(1);
-    } else if (msg == "2") {
+    } else if (strcmp(msg, "2") == 0) {
       setValveMode(2);
-    } else if (msg == "TOGGLE") {
+    } else if (strcmp(msg, "TOGGLE") == 0) {
       // Toggle: alternate between mode 1 and 2
       setValveMode(valveMode == 1 ? 2 : 1);
     } else {
       Serial.println("[MQTT] Unknown valve command. Use: 1/2/TOGGLE");
+      return CMD_INVALID;
     }
-    return;
+    return CMD_OK;
   }
 
   // ===== Timer Control =====
-  if (t == TOPIC_TIMER_SET) {
-    // Parse simple JSON: {"mode": 1, "duration": 3600}
-    // Note: Uses manual parsing instead of ArduinoJson to save memory
-    int modeIdx = msg.indexOf("\"mode\":");
-    int durationIdx = msg.indexOf("\"duration\":");
-    
-    if (modeIdx == -1 || durationIdx == -1) {
+  if (strcmp(topic, TOPIC_TIMER_SET) == 0) {
+    // Parse simple JSON: {"name": "morning", "mode": 1, "duration": 3600}
+    char modeStr[8];
+    char durationStr[12];
+    char name[TIMER_NAME_LEN];
+    jsonValue(raw.c_str(), "mode", modeStr, sizeof(modeStr));
+    jsonValue(raw.c_str(), "duration", durationStr, sizeof(durationStr));
+    jsonValue(raw.c_str(), "name", name, sizeof(name));   // Longer names are truncated
+
+    if (durationStr[0] == '\0' || (modeStr[0] == '\0' && atol(durationStr) != 0)) {
       Serial.println("[MQTT] ERROR: Timer command must be JSON with mode and duration");
-      return;
+      return CMD_INVALID;
     }
-    
-    // Extract values (simple parsing)
-    int modeStart = msg.indexOf(":", modeIdx) + 1;
-    int modeEnd = msg.indexOf(",", modeStart);
-    if (modeEnd == -1) modeEnd = msg.indexOf("}", modeStart);
-    String modeStr = msg.substring(modeStart, modeEnd);
-    modeStr.trim();
-    int mode = modeStr.toInt();
-    
-    int durationStart = msg.indexOf(":", durationIdx) + 1;
-    int durationEnd = msg.indexOf("}", durationStart);
-    if (durationEnd == -1) durationEnd = msg.length();
-    String durationStr = msg.substring(durationStart, durationEnd);
-    durationStr.trim();
-    uint32_t duration = durationStr.toInt();
-    
+
+    int mode = atoi(modeStr);
+    uint32_t duration = atol(durationStr);
+    const char* timerName = name[0] != '\0' ? name : nullptr;
+
     if (duration == 0) {
-      // Command to stop timer
+      // Command to stop one named timer, or all of them
       Serial.println("[MQTT] Timer stop command received");
-      stopTimer();
-    } else {
-      // Command to start timer
-      Serial.print("[MQTT] Timer start command: mode=");
-      Serial.print(mode);
-      Serial.print(", duration=");
-      Serial.println(duration);
-      startTimer(mode, duration);
+      stopTimer(timerName);
+      return CMD_OK;
     }
-    return;
+
+    // Command to start timer
+    Serial.print("[MQTT] Timer start command: mode=");
+    Serial.print(mode);
+    Serial.print(", duration=");
+    Serial.println(duration);
+    if (mode != 1 && mode != 2) {
+      Serial.println("[TIMER] ERROR: Invalid mode. Use 1 or 2");
+      return CMD_INVALID;
+    }
+    return startTimer(timerName, mode, duration) ? CMD_OK : CMD_FAILED;
+  }
+
+  // ===== Broker Endpoint =====
+  if (strcmp(topic, TOPIC_BROKER_SET) == 0) {
+    // {"slot": "secondary", "host": "x.hivemq.cloud", "port": 8883, "tls": true, "user": "u", "pass": "p"}
+    // host "" removes the endpoint; slot may be 0/1/2 or primary/secondary/lan
+    // Host, user and pass are read straight into the endpoint; overlong values are rejected
+    // Only the LAN slot may use plain TCP (the cloud slots carry the full command surface)
+    PersistedBroker endpoint = {};
+    char slotStr[12];
+    char portStr[8];
+    char tlsStr[8];
+    jsonValue(raw.c_str(), "slot", slotStr, sizeof(slotStr));
+    jsonValue(raw.c_str(), "port", portStr, sizeof(portStr));
+    jsonValue(raw.c_str(), "tls", tlsStr, sizeof(tlsStr));
+    bool fits = jsonValue(raw.c_str(), "host", endpoint.host, sizeof(endpoint.host)) < (int)sizeof(endpoint.host) &&
+                jsonValue(raw.c_str(), "user", endpoint.user, sizeof(endpoint.user)) < (int)sizeof(endpoint.user) &&
+                jsonValue(raw.c_str(), "pass", endpoint.pass, sizeof(endpoint.pass)) < (int)sizeof(endpoint.pass);
+
+    int slot = -1;
+    if (strcmp(slotStr, "primary") == 0 || strcmp(slotStr, "0") == 0) slot = BROKER_PRIMARY;
+    else if (strcmp(slotStr, "secondary") == 0 || strcmp(slotStr, "1") == 0) slot = BROKER_SECONDARY;
+    else if (strcmp(slotStr, "lan") == 0 || strcmp(slotStr, "2") == 0) slot = BROKER_LAN;
+
+    bool tls = tlsStr[0] != '\0' ? (strcmp(tlsStr, "true") == 0 || strcmp(tlsStr, "1") == 0) : atol(portStr) != 1883;
+    long port = portStr[0] != '\0' ? atol(portStr) : (tls ? 8883 : 1883);
+    if (slot < 0 || !fits || port <= 0 || port > 65535) {
+      Serial.println("[MQTT] ERROR: Broker command needs slot and host (port/tls/user/pass optional)");
+      return CMD_INVALID;
+    }
+    if (endpoint.host[0] != '\0' && !tls && slot != BROKER_LAN) {
+      Serial.println("[MQTT] ERROR: Primary/secondary broker must use TLS");
+      return CMD_INVALID;
+    }
+
+    endpoint.port = port;
+    endpoint.tls = tls;
+
+    bool wasActive = slot == activeBrokerSlot();
+    if (!setBrokerEndpoint(slot, endpoint)) return CMD_FAILED;
+
+    // Reconnect once the ack is out if the session runs on the changed endpoint
+    if (wasActive) brokerReconnectPending = true;
+    return CMD_OK;
+  }
+
+  // ===== Firmware Update =====
+  if (strcmp(topic, TOPIC_OTA_SET) == 0) {
+    // {"url": "https://host/firmware.bin", "size": 1048576, "sha256": "<image hex>", "sig": "<DER hex>", "patch": false}
+    // sig is the release key signature over sha256 (tools/ota_tool.py sign). Without url the image (or patch) follows as chunks on TOPIC_OTA_CHUNK
+    if (strcmp(msg, "ABORT") == 0) {
+      otaAbort("aborted");
+      publishOtaState();
+      return CMD_OK;
+    }
+
+    OtaRequest request = {};
+    char sizeStr[12];
+    char shaStr[72];
+    char sigStr[OTA_SIG_MAX_LEN * 2 + 8];
+    char patchStr[8];
+    bool urlFits = jsonValue(raw.c_str(), "url", request.url, sizeof(request.url)) < (int)sizeof(request.url);
+    jsonValue(raw.c_str(), "size", sizeStr, sizeof(sizeStr));
+    jsonValue(raw.c_str(), "sha256", shaStr, sizeof(shaStr));
+    jsonValue(raw.c_str(), "sig", sigStr, sizeof(sigStr));
+    jsonValue(raw.c_str(), "patch", patchStr, sizeof(patchStr));
+    request.size = strtoul(sizeStr, nullptr, 10);
+    request.patch = strcmp(patchStr, "true") == 0 || strcmp(patchStr, "1") == 0;
+
+    if (!urlFits || !otaParseSha256(shaStr, request.sha256) ||
+        !otaParseSignature(sigStr, request.sig, &request.sigLen) || (request.url[0] == '\0' && request.size == 0)) {
+      Serial.println("[MQTT] ERROR: OTA command needs sha256, sig and url or size (patch optional)");
+      return CMD_INVALID;
+    }
+
+    bool started = otaStart(request);
+    publishOtaState();
+    return started ? CMD_OK : CMD_FAILED;
+  }
+
+  // ===== Runtime Settings =====
+  if (strcmp(topic, TOPIC_CONFIG_SET) == 0) {
+    // {"temp_pub_ms": 30000, "wifi_state_ms": 60000}: all values are validated before any is applied
+    char text[16];
+    if (jsonValue(raw.c_str(), "reset", text, sizeof(text)) >= 0 && strcmp(text, "true") == 0) {
+      Serial.println("[CONFIG] Restoring defaults");
+      resetRuntimeConfig();
+      applyTelemetryStrategy();
+      publishConfigState();
+      return CMD_OK;
+    }
+
+    uint32_t parsed[CFG_KEY_COUNT];
+    bool present[CFG_KEY_COUNT];
+    int found = 0;
+    for (int i = 0; i < CFG_KEY_COUNT; i++) {
+      ConfigKey key = (ConfigKey)i;
+      int length = jsonValue(raw.c_str(), configEntry(key).name, text, sizeof(text));
+      present[i] = length >= 0;
+      if (!present[i]) continue;
+      if (length >= (int)sizeof(text) || !parseConfigValue(key, text, &parsed[i])) {
+        Serial.print("[MQTT] ERROR: Invalid value for ");
+        Serial.println(configEntry(key).name);
+        return CMD_INVALID;
+      }
+      found++;
+    }
+    if (found == 0) {
+      Serial.println("[MQTT] ERROR: Config command has no known setting");
+      return CMD_INVALID;
+    }
+
+    for (int i = 0; i < CFG_KEY_COUNT; i++) {
+      if (present[i]) setConfigValue((ConfigKey)i, parsed[i]);
+    }
+    applyTelemetryStrategy();
+    publishConfigState();
+    return CMD_OK;
+  }
+
+  // ===== Event Log Query =====
+  if (strcmp(topic, TOPIC_EVENTS_SET) == 0) {
+    // {"id": "q1", "from": 1700000000000, "to": 1700086400000, "limit": 200}: all optional
+    // Matching records are streamed in pages on TOPIC_EVENTS_RESULT by serviceEventQuery()
+    char fromStr[24];
+    char toStr[24];
+    char limitStr[12];
+    jsonValue(raw.c_str(), "from", fromStr, sizeof(fromStr));
+    jsonValue(raw.c_str(), "to", toStr, sizeof(toStr));
+    jsonValue(raw.c_str(), "limit", limitStr, sizeof(limitStr));
+    uint64_t from = strtoull(fromStr, nullptr, 10);
+    uint64_t to = toStr[0] != '\0' ? strtoull(toStr, nullptr, 10) : UINT64_MAX;
+    if (to < from) {
+      Serial.println("[MQTT] ERROR: Event query needs from <= to");
+      return CMD_INVALID;
+    }
+
+    if (!startEventQuery(from, to, strtoul(limitStr, nullptr, 10))) return CMD_FAILED;
+    jsonValue(raw.c_str(), "id", eventQueryId, sizeof(eventQueryId));
+    eventQueryPage = 0;
+    eventQueryTotal = 0;
+    return CMD_OK;
   }
 
   // ===== Temperature Refresh Command =====
-  if (t == TOPIC_TEMP_REFRESH) {
+  if (strcmp(topic, TOPIC_TEMP_REFRESH) == 0) {
     Serial.println("[MQTT] Temperature refresh command received");
-    // Force immediate temperature reading
-    currentTemperature = readTemperature();
-    if (mqtt.connected()) {
-      publishTemperature();
-    }
-    return;
+    // Reading is published by serviceTemperature() once the conversion completes
+    requestTemperatureRead();
+    return CMD_OK;
   }
 
   // ===== WiFi Clear Command =====
-  if (t == TOPIC_WIFI_CLEAR) {
+  if (strcmp(topic, TOPIC_WIFI_CLEAR) == 0) {
     Serial.println("[MQTT] WiFi clear command received from dashboard");
     
     // Publish disconnected state before dropping connection
-    mqtt.publish(TOPIC_WIFI_STATE, "{\"status\":\"disconnected\"}", true /*retain*/);
-    delay(100); // Let message send
+    mqttEnqueue(TOPIC_WIFI_STATE, "{\"status\":\"disconnected\"}", true /*retain*/, MQTT_PRIO_CRITICAL);
+    mqttFlush(1000); // Send it (and anything still queued) before dropping the connection
     mqtt.disconnect();
     
     // Disconnect WiFi and erase credentials
     WiFi.disconnect(true /*wifioff*/, true /*erasePersistent*/);
     clearWiFiCredentials();
     
+    flushStateStore(true);
     Serial.println("[WiFi] Credentials erased. Restarting in 2 seconds...");
     delay(2000);
     
     // Restart ESP32 to cleanly enter BLE provisioning mode
     ESP.restart();
-    return;
+    return CMD_OK;
   }
+
+  Serial.println("[CMD] Unknown command topic");
+  return CMD_INVALID;
 }
 
+// ==================== MQTT Message Handler ====================
 
-// ==================== WiFi Connection (Provisioning) ====================
+/**
+ * Publishes the ack for an enveloped command
+ * Format: {"id":"42","topic":"pump/set","result":"ok","proc_us":1830}
+ * proc_us is the time spent on the device from reception to the end of the
+ * handler (includes relay switching delays). The dashboard measures the
+ * round trip on its side and correlates by id.
+ * @param id Sequence ID from the envelope
+ * @param topic Command topic
+ * @param result Command outcome
+ * @param processingUs On-device processing time (µs)
+ */
+void publishCommandAck(const char* id, const char* topic, CommandResult result, uint32_t processingUs) {
+  MsgBuffer json;
+  json.print("{\"id\":\"");      json.print(id);
+  json.print("\",\"topic\":\""); json.print(deviceTopic(topic));
+  json.print("\",\"result\":\""); json.print(commandResultName(result));
+  json.print("\",\"proc_us\":");  json.print(processingUs);
+  printTimestamp(json, timeEpochMs());
+  json.print("}");
+
+  if (json.ok()) mqttEnqueue(TOPIC_CMD_ACK, json.c_str(), false, MQTT_PRIO_CRITICAL);
+}
 
-// NVS storage instance for WiFi credentials
-Preferences preferences;
+/**
+ * Callback invoked when MQTT message arrives
+ * Enveloped commands are acknowledged on TOPIC_CMD_ACK
+ * @param topic Topic of received message
+ * @param payload Message content (bytes)
+ * @param length Payload length
+ */
+void onMqttMessage(char* topic, byte* payload, unsigned int length) {
+  // Firmware chunks are binary and frequent: straight to the OTA writer
+  if (strcmp(topic, TOPIC_OTA_CHUNK) == 0) {
+    if (otaReceiveChunk(payload, length)) publishOtaState();
+    return;
+  }
+
+  uint32_t start = micros();
+  char commandId[CMD_ID_LEN] = "";
+  CommandResult result = handleCommand(topic, payload, length, commandId);
+  logCommandEvent(topic, result, EVENT_CHANNEL_MQTT);
+
+  if (commandId[0] != '\0') {
+    publishCommandAck(commandId, topic, result, micros() - start);
+  }
+}
+
+// ==================== BLE Local Control ====================
 
 /**
- * Load WiFi credentials from NVS (non-volatile storage)
- * @param ssid Buffer for SSID (min 33 bytes)
- * @param password Buffer for password (min 64 bytes)
- * @return true if credentials exist in NVS, false otherwise
+ * Applies commands received over the BLE control service and notifies state
+ * Commands are mapped to their MQTT command topic and go through handleCommand(),
+ * so local and cloud control behave identically. Runs every loop iteration,
+ * including while WiFi or the broker is unreachable.
  */
-bool loadWiFiCredentials(char* ssid, char* password) {
-  preferences.begin("wifi", true); // read-only
-  
-  String savedSSID = preferences.getString("ssid", "");
-  String savedPassword = preferences.getString("password", "");
-  
-  preferences.end();
-  
-  if (savedSSID.length() == 0) {
-    Serial.println("[NVS] No WiFi credentials stored");
-    return false;
+void processBLEControl() {
+#if BLE_CONTROL_ENABLED
+  if (!isBLEControlActive()) return;
+  watchdogHeartbeat(WDT_BLE);
+
+  BLEControlCommand cmd;
+  bool force = false;
+  while (pollBLEControlCommand(&cmd)) {
+    const char* topic = nullptr;
+    switch (cmd.target) {
+      case BLE_TARGET_PUMP:         topic = TOPIC_PUMP_SET; break;
+      case BLE_TARGET_VALVE:        topic = TOPIC_VALVE_SET; break;
+      case BLE_TARGET_TIMER:        topic = TOPIC_TIMER_SET; break;
+      case BLE_TARGET_TEMP_REFRESH: topic = TOPIC_TEMP_REFRESH; break;
+      default: break;
+    }
+    if (topic) logCommandEvent(topic, handleCommand(topic, cmd.payload, cmd.length), EVENT_CHANNEL_BLE);
+    force = true;  // Always answer a command with the resulting state
   }
-  
-  strncpy(ssid, savedSSID.c_str(), 32);
-  ssid[32] = '\0';
-  strncpy(password, savedPassword.c_str(), 63);
-  password[63] = '\0';
-  
-  Serial.print("[NVS] ✓ Loaded WiFi credentials for: ");
-  Serial.println(ssid);
-  return true;
+
+  TimerInfo primary;
+  bool timerActive = getPrimaryTimer(&primary);
+
+  BLEControlState state;
+  state.pumpOn = pumpState;
+  state.valveMode = valveMode;
+  state.timerActive = timerActive;
+  state.timerMode = timerActive ? primary.mode : 1;
+  state.timerRemaining = timerActive ? primary.remainingSeconds : 0;
+  state.timerDuration = timerActive ? primary.durationSeconds : 0;
+  state.temperatureDeci = isnan(currentTemperature) ? INT16_MIN
+                                                    : (int16_t)lroundf(currentTemperature * 10);
+  updateBLEControlState(state, force);
+#endif
 }
 
+// ==================== Local HTTP API ====================
+
 /**
- * Save WiFi credentials to NVS (non-volatile storage)
- * @param ssid WiFi SSID
- * @param password WiFi password
+ * POST paths of the local API and the command topic each one maps to
  */
-void saveWiFiCredentials(const char* ssid, const char* password) {
-  preferences.begin("wifi", false); // read-write
-  
-  preferences.putString("ssid", ssid);
-  preferences.putString("password", password);
-  
-  preferences.end();
-  
-  Serial.print("[NVS] ✓ Saved WiFi credentials for: ");
-  Serial.println(ssid);
+static const struct {
+  const char* path;
+  const char* topic;
+} API_COMMANDS[] = {
+  { "/api/pump",                TOPIC_PUMP_SET },
+  { "/api/valve",               TOPIC_VALVE_SET },
+  { "/api/timer",               TOPIC_TIMER_SET },
+  { "/api/config",              TOPIC_CONFIG_SET },
+  { "/api/temperature/refresh", TOPIC_TEMP_REFRESH },
+};
+
+/**
+ * Serializes the controller state for GET /api/state
+ * Format: {"pump":{"state":"ON","ts":...},"valve":{"mode":1,...},"timer":{...},
+ *          "temperature":{"value":25.3,"ts":...},"ts":...} (value null without a reading)
+ */
+void writeLocalState(Print& out) {
+  out.print("{\"pump\":");   writePumpState(out);
+  out.print(",\"valve\":");  writeValveState(out);
+  out.print(",\"timer\":");  writeTimerState(out);
+  out.print(",\"temperature\":{\"value\":");
+  if (isnan(currentTemperature) || temperatureReadMs == 0) out.print("null");
+  else out.print(currentTemperature, 1);
+  printTimestamp(out, timeEpochMsAt(temperatureReadMs));
+  out.print("}");
+  printTimestamp(out, timeEpochMs());
+  out.print("}");
 }
 
+#if LOCAL_API_ENABLED
 /**
- * Clear WiFi credentials from NVS
- * Useful for testing or factory reset
+ * Renders one GET resource of the local API into its snapshot
+ * @return false if the HTTP task is sending it (retry next iteration)
  */
-void clearWiFiCredentials() {
-  preferences.begin("wifi", false);
-  preferences.clear();
-  preferences.end();
-  Serial.println("[NVS] WiFi credentials cleared");
+static bool renderLocalSnapshot(LocalApiSnapshot which) {
+  Print* out = beginLocalApiSnapshot(which);
+  if (!out) return false;
+  switch (which) {
+    case LOCAL_API_STATE:  writeLocalState(*out); break;
+    case LOCAL_API_TIMER:  writeTimerState(*out); break;
+    case LOCAL_API_CONFIG: writeConfigState(*out); break;
+    case LOCAL_API_DIAG: {
+      DiagnosticsSnapshot d;
+      snapshotDiagnostics(d);
+      writeDiagnostics(*out, &d);
+      break;
+    }
+    default: break;
+  }
+  endLocalApiSnapshot(which);
+  return true;
 }
+#endif
+
+/**
+ * Answers commands from the local HTTP API and refreshes its GET snapshots (call in loop)
+ * GETs are answered by the HTTP task from snapshots rendered here with the same
+ * serializers as the MQTT state topics, so they keep working while the loop is
+ * blocked (see local_api.h). POSTs go through handleCommand() like MQTT and BLE
+ * commands (so the cloud dashboard sees the resulting state too) and answer
+ * with the outcome and the new state:
+ * {"result":"ok","id":"42","proc_us":1830,"state":{...}}
+ */
+void serviceLocalApi() {
+#if LOCAL_API_ENABLED
+  static uint32_t lastSnapshot[LOCAL_API_SNAPSHOT_COUNT] = {};
+  static bool dirty[LOCAL_API_SNAPSHOT_COUNT] = { true, true, true, true };
+
+  LocalApiRequest request;
+  while (pollLocalApiRequest(&request)) {
+    Print& out = localApiResponse();
+    int status = 200;
+
+    const char* topic = nullptr;
+    for (const auto& command : API_COMMANDS) {
+      if (strcmp(request.path, command.path) == 0) topic = command.topic;
+    }
+    if (topic) {
+      uint32_t start = micros();
+      char commandId[CMD_ID_LEN] = "";
+      CommandResult result = handleCommand(topic, request.body, request.length, commandId);
+      uint32_t processingUs = micros() - start;
+      logCommandEvent(topic, result, EVENT_CHANNEL_HTTP);
+      status = result == CMD_OK ? 200 : (result == CMD_INVALID ? 400 : 409);
+      dirty[LOCAL_API_STATE] = dirty[LOCAL_API_TIMER] = dirty[LOCAL_API_CONFIG] = true;   // A GET right after sees it
+
+      out.print("{\"result\":\""); out.print(commandResultName(result));
+      out.print("\",\"id\":\"");  out.print(commandId);
+      out.print("\",\"proc_us\":"); out.print(processingUs);
+      out.print(",\"state\":");     writeLocalState(out);
+      out.print("}");
+    } else {
+      status = 404;
+      out.print("{\"error\":\"not_found\"}");
+    }
+    completeLocalApiRequest(request.id, status);
+  }
+
+  for (uint8_t i = 0; i < LOCAL_API_SNAPSHOT_COUNT; i++) {
+    uint32_t interval = i == LOCAL_API_DIAG ? LOCAL_API_DIAG_INTERVAL : LOCAL_API_SNAPSHOT_INTERVAL;
+    if ((dirty[i] || millis() - lastSnapshot[i] >= interval) && renderLocalSnapshot((LocalApiSnapshot)i)) {
+      dirty[i] = false;
+      lastSnapshot[i] = millis();
+    }
+  }
+#endif
+}
+
+
+// ==================== WiFi Connection (Provisioning) ====================
 
 /**
  * Connect to WiFi using stored credentials with retry logic
@@ -606,10 +1574,16 @@ bool connectWiFi(const char* ssid, const char* password, int retryAttempts = WIF
       Serial.print(attempt);
       Serial.print("/");
       Serial.println(retryAttempts);
+      watchdogEnterPhase("wifi_backoff");
       delay(WIFI_RETRY_DELAY);
+      watchdogExitPhase();
     }
     
+    watchdogEnterPhase("wifi_connect");
     WiFi.mode(WIFI_STA);
+    // Scan every channel and join the strongest access point, not the first one answering
+    WiFi.setScanMethod(WIFI_ALL_CHANNEL_SCAN);
+    WiFi.setSortMethod(WIFI_CONNECT_AP_BY_SIGNAL);
     WiFi.begin(ssid, password);
     
     uint32_t startTime = millis();
@@ -618,6 +1592,7 @@ bool connectWiFi(const char* ssid, const char* password, int retryAttempts = WIF
       Serial.print(".");
     }
     Serial.println();
+    watchdogExitPhase();
     
     if (WiFi.status() == WL_CONNECTED) {
       Serial.println("[WiFi] ✓ CONNECTED");
@@ -756,71 +1731,110 @@ bool initWiFiManagerFallback() {
   return true;
 }
 
-// ==================== NTP Time Synchronization ====================
+// ==================== Time Synchronization ====================
 
 /**
- * Synchronizes ESP32 clock with NTP servers
- * IMPORTANT: TLS validates certificate dates. If ESP32 has incorrect time,
- * handshake may fail. That's why we synchronize NTP BEFORE connecting to MQTT TLS.
- * @return true if synchronized successfully, false if timeout
+ * Applies SNTP syncs (call in loop)
+ * SNTP runs in the background (time_sync.h); the first sync corrects restored
+ * timers for the time spent powered off and re-stamps the retained actuator
+ * state published before the clock was known.
  */
-bool syncTimeNTP() {
-  Serial.println("[NTP] Synchronizing time...");
-  configTime(0, 0, "pool.ntp.org", "time.nist.gov");
-
-  time_t now = time(nullptr);
-  const uint32_t start = millis();
+void serviceTimeSync() {
+  static bool firstSync = true;
+  if (!timeSyncLoop()) return;
 
-  // Wait until time is "reasonable" (after Nov 2023)
-  while (now < MIN_VALID_EPOCH && (millis() - start) < NTP_SYNC_TIMEOUT) {
-    Serial.print(".");
-    delay(500);
-    now = time(nullptr);
-  }
-  Serial.println();
-
-  if (now < MIN_VALID_EPOCH) {
-    Serial.println("[NTP] WARN: not synchronized (timeout). TLS may fail.");
-    return false;
+  anchorTimersToWallClock();
+  if (firstSync && mqtt.connected()) {
+    publishPumpState();
+    publishValveState();
   }
-
-  Serial.print("[NTP] ✓ OK epoch: ");
-  Serial.println((long)now);
-  return true;
+  firstSync = false;
 }
 
 // ==================== MQTT TLS Connection ====================
 
 /**
  * Configures MQTT client with TLS
- * - Sets server and port (defined in config.h)
  * - Registers callback for incoming messages
  * - Loads root CA certificate for TLS validation
  */
 void setupMqtt() {
-  // Broker MQTT TLS endpoint (8883)
-  mqtt.setServer(MQTT_HOST, MQTT_PORT);
+  // Server is chosen per connect attempt by the broker pool (see connectMqtt)
 
   // Callback for incoming messages
   mqtt.setCallback(onMqttMessage);
 
-  // Load root CA so ESP32 can validate broker certificate
-  tlsClient.setCACert(LETS_ENCRYPT_ISRG_ROOT_X1);
+  // Timer state lists every running timer (default 256 bytes is too small for four)
+  mqtt.setBufferSize(MQTT_BUFFER_SIZE);
+
+  // Publishes go through the outbound queue, drained from loop()
+  initMqttTransport(&mqtt, &mqttSocket);
+
+  // Root CAs from the embedded bundle (pre-parsed, looked up by subject)
+  applyTrustStore(tlsClient);
+
+  // A hung handshake must end before the task watchdog resets the chip
+  tlsClient.setHandshakeTimeout(TLS_HANDSHAKE_TIMEOUT);
+
+#if MQTT_MODE == MQTT_MODE_LAN_DUAL
+  // Cloud session: same handler (remote commands), cloud link of the outbound queue
+  cloudMqtt.setCallback(onMqttMessage);
+  cloudMqtt.setBufferSize(MQTT_BUFFER_SIZE);
+  attachMqttCloudLink(&cloudMqtt, &cloudSocket);
+  applyTrustStore(cloudTlsClient);
+  cloudTlsClient.setHandshakeTimeout(TLS_HANDSHAKE_TIMEOUT);
+#endif
 }
 
 /**
- * Connects to MQTT broker with authentication
- * After connecting:
- * 1. Subscribes to command topics (pump, valve, timer)
- * 2. Publishes initial state of all components (pump, valve, wifi, timer)
- * 3. Reads and publishes initial temperature
+ * Subscribes a session to every command topic (the /set filter is routed by handleCommand())
+ * PubSubClient does not wait for SUBACK, so the SUBSCRIBEs go out back to back.
+ */
+void subscribeCommands(PubSubClient& client) {
+  const char* filters[] = { TOPIC_COMMAND_FILTER, TOPIC_TEMP_REFRESH, TOPIC_WIFI_CLEAR, TOPIC_OTA_CHUNK };
+  for (const char* filter : filters) {
+    bool subscribed = client.subscribe(filter);
+    Serial.print("[MQTT] Subscribed: ");
+    Serial.print(filter);
+    Serial.println(subscribed ? "" : " FAIL");
+  }
+}
+
+/**
+ * Queues every retained state topic (drained from loop, most important first)
+ */
+void queueFullState() {
+  publishPumpState();
+  publishValveState();
+  publishTimerState();
+  publishPumpPolicy();
+  publishOtaState();
+  publishConfigState();
+  publishPumpUsage();
+  publishPumpUsageDaily();
+}
+
+/**
+ * Connects to the MQTT broker chosen by the broker pool, with its credentials
+ * The attempt (success and time taken) is reported back for failover.
+ * After connecting (without waiting in between):
+ * 1. Subscribes to every command topic with one wildcard filter plus refresh/clear
+ * 2. Queues initial state (pump, valve, timer); WiFi state follows once ready
+ * 3. Requests a temperature reading, published when the conversion completes
  * @return true if connected successfully, false otherwise
  */
 bool connectMqtt() {
+  mqttConnectStart = millis();
+
+  const PersistedBroker& broker = selectBroker();
+  mqttSocket.setInner(broker.tls ? (Client&)tlsClient : (Client&)plainClient);
+  mqtt.setServer(broker.host, broker.port);
+
   Serial.print("[MQTT] Connecting to ");
-  Serial.print(MQTT_HOST);
+  Serial.print(broker.host);
   Serial.print(":");
-  Serial.println(MQTT_PORT);
+  Serial.print(broker.port);
+  Serial.println(broker.tls ? " (TLS)" : " (plain)");
 
   // ClientID: should be stable and unique.
   // DEVICE_ID comes from config.h
@@ -833,54 +1847,514 @@ bool connectMqtt() {
   uint8_t lwt_qos = 0;
   boolean lwt_retain = true;
 
-  // MQTT_USER / MQTT_PASS vienen de secrets.h
+  // Credentials per endpoint (defaults: MQTT_USER / MQTT_PASS from secrets.h); none for an open LAN broker
   // connect(clientId, user, pass, willTopic, willQoS, willRetain, willMessage)
-  bool ok = mqtt.connect(clientId, MQTT_USER, MQTT_PASS, lwt_topic, lwt_qos, lwt_retain, lwt_message);
+  const char* user = broker.user[0] ? broker.user : nullptr;
+  const char* pass = broker.user[0] ? broker.pass : nullptr;
+  watchdogEnterPhase("mqtt_connect");
+  bool ok = mqtt.connect(clientId, user, pass, lwt_topic, lwt_qos, lwt_retain, lwt_message);
+  watchdogExitPhase();
+  reportBrokerConnect(ok, millis() - mqttConnectStart);
 
   if (!ok) {
     Serial.print("[MQTT] ERROR connect rc=");
     Serial.println(mqtt.state()); // PubSubClient error code
+    if (!mqttFailureLogged) {
+      mqttFailureLogged = true;
+      logEvent(EVENT_ERROR, EVENT_ERR_MQTT_CONNECT, mqtt.state(), activeBrokerSlot());
+    }
     return false;
   }
+  mqttFailureLogged = false;
+  mqttSessionLogged = true;
+  logEvent(EVENT_MQTT, 0, 1, activeBrokerSlot());
 
-  Serial.println("[MQTT] ✓ CONNECTED (with Last Will configured)");
+  mqttConnectMs = millis() - mqttConnectStart;
+  Serial.print("[MQTT] ✓ CONNECTED (with Last Will configured) in ");
+  Serial.print(mqttConnectMs);
+  Serial.println(" ms");
 
-  Serial.println("[MQTT] ✓ CONNECTED");
+  subscribeCommands(mqtt);
+  queueFullState();
 
-  // Subscribe to command topics
-  mqtt.subscribe(TOPIC_PUMP_SET);
-  Serial.print("[MQTT] Subscribed: ");
-  Serial.println(TOPIC_PUMP_SET);
-  
-  mqtt.subscribe(TOPIC_VALVE_SET);
-  Serial.print("[MQTT] Subscribed: ");
-  Serial.println(TOPIC_VALVE_SET);
+  // Temperature is read without blocking and published when ready
+  requestTemperatureRead();
 
-  mqtt.subscribe(TOPIC_TIMER_SET);
-  Serial.print("[MQTT] Subscribed: ");
-  Serial.println(TOPIC_TIMER_SET);
+  mqttReadyPending = true;
+  return true;
+}
 
-  mqtt.subscribe(TOPIC_WIFI_CLEAR);
-  Serial.print("[MQTT] Subscribed: ");
-  Serial.println(TOPIC_WIFI_CLEAR);
+/**
+ * Completes the connect-to-ready measurement (call in loop after mqttDrain)
+ * Ready = the initial state queued by connectMqtt() has left the queue
+ * (written, and acknowledged by the broker for the QoS 1 state topics).
+ * WiFi state and diagnostics (carrying the timings) are published then.
+ */
+void checkMqttReady() {
+  if (!mqttReadyPending || !mqtt.connected()) return;
+
+  MqttQueueStats q;
+  getMqttQueueStats(&q);
+  if (q.depth > 0) return;
+
+  mqttReadyPending = false;
+  mqttReadyMs = millis() - mqttConnectStart;
+  Serial.print("[MQTT] ✓ Ready in ");
+  Serial.print(mqttReadyMs);
+  Serial.println(" ms");
+  publishWiFiState();
+  publishDiagnostics();
+}
 
-  mqtt.subscribe(TOPIC_TEMP_REFRESH);
-  Serial.print("[MQTT] Subscribed: ");
-  Serial.println(TOPIC_TEMP_REFRESH);
+// ==================== Cloud Session (MQTT_MODE_LAN_DUAL) ====================
 
-  // Publish initial state
-  publishPumpState();
-  publishValveState();
+/**
+ * Closes the cloud session (no-op in the other modes)
+ */
+void stopCloudMqtt() {
+#if MQTT_MODE == MQTT_MODE_LAN_DUAL
+  if (cloudMqtt.connected()) {
+    Serial.println("[MQTT] Closing cloud session");
+    cloudMqtt.disconnect();
+  }
+  if (cloudSessionUp) {
+    cloudSessionUp = false;
+    logEvent(EVENT_MQTT, 1, 0, cloudBrokerSlot());
+  }
+  releaseCloudBroker();
+#endif
+}
+
+/**
+ * Connects the second session to the best cloud endpoint
+ * Client ID DEVICE_ID "-cloud", same Last Will and subscriptions as the main
+ * session. The routing rules (mqtt_routes.h) decide what it publishes; the
+ * state is queued again so the cloud gets it at once (the LAN broker gets a
+ * duplicate of its retained state).
+ * @return true if connected
+ */
+bool connectCloudMqtt() {
+#if MQTT_MODE == MQTT_MODE_LAN_DUAL
+  const PersistedBroker* broker = selectCloudBroker();
+  if (!broker) return false;
+
+  cloudSocket.setInner(broker->tls ? (Client&)cloudTlsClient : (Client&)cloudPlainClient);
+  cloudMqtt.setServer(broker->host, broker->port);
+  Serial.print("[MQTT] Connecting cloud session to ");
+  Serial.print(broker->host);
+  Serial.print(":");
+  Serial.println(broker->port);
+
+  const char* user = broker->user[0] ? broker->user : nullptr;
+  const char* pass = broker->user[0] ? broker->pass : nullptr;
+  uint32_t start = millis();
+  watchdogEnterPhase("mqtt_cloud");
+  bool ok = cloudMqtt.connect(DEVICE_ID "-cloud", user, pass, TOPIC_WIFI_STATE, 0, true,
+                              "{\"status\":\"disconnected\"}");
+  watchdogExitPhase();
+  reportCloudConnect(ok, millis() - start);
+
+  if (!ok) {
+    Serial.print("[MQTT] ERROR cloud connect rc=");
+    Serial.println(cloudMqtt.state());
+    releaseCloudBroker();
+    return false;
+  }
+  cloudSessionUp = true;
+  logEvent(EVENT_MQTT, 1, 1, cloudBrokerSlot());
+  Serial.print("[MQTT] ✓ Cloud session CONNECTED in ");
+  Serial.print(millis() - start);
+  Serial.println(" ms");
+
+  subscribeCommands(cloudMqtt);
+  resetMqttRoutes();
+  queueFullState();
+  requestTemperatureRead();
   publishWiFiState();
-  publishTimerState();
-  
-  // Read and publish initial temperature
-  currentTemperature = readTemperature();
-  publishTemperature();
-  
   return true;
+#else
+  return false;
+#endif
+}
+
+/**
+ * Keeps the cloud session up while the main session is on the LAN broker (call in loop)
+ * On a cloud fallback the main session reaches the cloud itself, so the
+ * second session is closed.
+ */
+void serviceCloudMqtt() {
+#if MQTT_MODE == MQTT_MODE_LAN_DUAL
+  if (!mqtt.connected() || activeBrokerSlot() != BROKER_LAN) {
+    stopCloudMqtt();
+    return;
+  }
+  if (cloudMqtt.loop()) return;
+
+  if (cloudSessionUp) {
+    Serial.println("[MQTT] Cloud session lost");
+    stopCloudMqtt();
+  }
+
+  static uint32_t lastAttempt = 0;
+  if (!timeSyncSettled() || millis() - lastAttempt < configValue(CFG_MQTT_RECONNECT_INTERVAL)) return;
+  lastAttempt = millis();
+  connectCloudMqtt();
+#endif
 }
 
+/**
+ * Looks the LAN broker up over mDNS when due and moves the session to it (call in loop)
+ */
+void serviceLanDiscovery() {
+  if (discoverLanBroker() && mqtt.connected()) brokerReconnectPending = true;
+}
+
+/**
+ * Moves the session to another broker endpoint when needed (call in loop while connected)
+ * - The active endpoint was reconfigured by a broker command or rediscovered
+ * - A latency probe found a clearly faster endpoint (failback)
+ */
+void serviceBrokerPool() {
+  if (!mqtt.connected()) return;
+  if (!brokerReconnectPending && !probeBrokers()) return;
+  brokerReconnectPending = false;
+
+  Serial.println("[MQTT] Changing broker endpoint, reconnecting...");
+  stopCloudMqtt();   // The "disconnected" below must not reach a cloud session that stays up
+  mqttEnqueue(TOPIC_WIFI_STATE, "{\"status\":\"disconnected\"}", true /*retain*/, MQTT_PRIO_CRITICAL);
+  mqttFlush(1000); // Leave nothing behind on the old broker
+  mqtt.disconnect();
+  connectMqtt();
+}
+
+/**
+ * Accounts pump usage and publishes it (call in loop)
+ * Today's counters go out on every switch (servicePump) and every
+ * USAGE_PUBLISH_INTERVAL while the pump runs; the daily summary at midnight.
+ */
+void servicePumpUsage() {
+  static uint32_t lastPublish = 0;
+  if (pumpUsageLoop() && mqtt.connected()) {
+    publishPumpUsageDaily();
+    publishPumpUsage();
+  }
+
+  if (pumpState && millis() - lastPublish >= USAGE_PUBLISH_INTERVAL) {
+    lastPublish = millis();
+    if (mqtt.connected()) publishPumpUsage();
+  }
+}
+
+/**
+ * One page of event log query results (snapshot for the streamed writer)
+ */
+struct EventPage {
+  EventRecord records[EVENT_QUERY_PAGE];
+  int count;
+  bool more;
+  uint64_t epochMs;
+};
+
+/**
+ * Serializes one query page (MqttPayloadWriter for mqttPublishStreamed)
+ * Format: {"id":"q1","page":0,"events":[{"seq":812,"boot":14,"ts":...,"up":3605,
+ *          "type":"pump","code":0,"value":1,"arg":2},...],"more":true,"ts":...}
+ * ts is null for records logged before the clock was set; commands add their "topic".
+ * The last page has "more":false and the "total" returned.
+ */
+void writeEventPage(Print& out, void* context) {
+  const EventPage& p = *(const EventPage*)context;
+
+  out.print("{\"id\":\"");    out.print(eventQueryId);
+  out.print("\",\"page\":");  out.print(eventQueryPage);
+  out.print(",\"events\":[");
+  for (int i = 0; i < p.count; i++) {
+    const EventRecord& r = p.records[i];
+    if (i > 0) out.print(",");
+    out.print("{\"seq\":");     out.print(r.seq);
+    out.print(",\"boot\":");    out.print(r.boot);
+    out.print(",\"ts\":");
+    if (r.ts != 0) out.print(r.ts); else out.print("null");
+    out.print(",\"up\":");      out.print(r.uptime);
+    out.print(",\"type\":\""); out.print(eventTypeName(r.type));
+    out.print("\",\"code\":"); out.print(r.code);
+    out.print(",\"value\":");   out.print(r.value);
+    out.print(",\"arg\":");     out.print(r.arg);
+    if (r.type == EVENT_COMMAND && r.arg >= 0 && r.arg < COMMAND_TOPIC_COUNT) {
+      out.print(",\"topic\":\""); out.print(deviceTopic(COMMAND_TOPICS[r.arg])); out.print("\"");
+    }
+    out.print("}");
+  }
+  out.print("],\"more\":"); out.print(p.more ? "true" : "false");
+  if (!p.more) {
+    out.print(",\"total\":"); out.print(eventQueryTotal);
+  }
+  printTimestamp(out, p.epochMs);
+  out.print("}");
+}
+
+/**
+ * Streams the running event log query, one page per loop iteration (call in loop)
+ * Pages are published as they fill, so a query never holds more than one page
+ * in RAM. The query is dropped if the broker connection is lost.
+ */
+void serviceEventQuery() {
+  if (!eventQueryActive()) return;
+  if (!mqtt.connected()) {
+    cancelEventQuery();
+    return;
+  }
+
+  EventPage page;
+  page.count = readEventQuery(page.records, EVENT_QUERY_PAGE, &page.more);
+  if (page.count == 0 && page.more) return;   // Scanned sectors without a match, continue next iteration
+
+  eventQueryTotal += page.count;
+  page.epochMs = timeEpochMs();
+  mqttPublishStreamed(TOPIC_EVENTS_RESULT, false, writeEventPage, &page);
+  eventQueryPage++;
+}
+
+/**
+ * Drives firmware updates: HTTPS download, confirmation of a new image, and
+ * the restart once a verified image is bootable (call in loop)
+ */
+void serviceOta() {
+  if (otaLoop(mqtt.connected())) publishOtaState();
+  if (!otaRebootDue()) return;
+
+  Serial.println("[OTA] Restarting into the new image...");
+  logEvent(EVENT_OTA, 0, 1);
+  mqttEnqueue(TOPIC_WIFI_STATE, "{\"status\":\"disconnected\"}", true /*retain*/, MQTT_PRIO_CRITICAL);
+  mqttFlush(1000); // Result and last state go out before the restart
+  mqtt.disconnect();
+  flushStateStore(true);
+  flushPumpUsage();
+  ESP.restart();
+}
+
+/**
+ * Joins a stronger access point of the current network (blocking, up to WIFI_CONNECT_TIMEOUT)
+ * The broker session is closed first and reopened on the new link. If the
+ * access point cannot be joined, any access point of the network is joined
+ * again (the regular WiFi/MQTT recovery in loop() takes over from there).
+ */
+void roamWiFi(const WiFiRoamTarget& target) {
+  char ssid[33];
+  char password[64];
+  if (!loadWiFiCredentials(ssid, password) || strcmp(ssid, target.ssid) != 0) return;
+
+  char bssid[18];
+  snprintf(bssid, sizeof(bssid), "%02X:%02X:%02X:%02X:%02X:%02X", target.bssid[0], target.bssid[1],
+           target.bssid[2], target.bssid[3], target.bssid[4], target.bssid[5]);
+  Serial.print("[WiFi] Roaming to ");
+  Serial.print(bssid);
+  Serial.print(" (channel ");
+  Serial.print(target.channel);
+  Serial.print(", ");
+  Serial.print(target.rssi);
+  Serial.print(" dBm vs ");
+  Serial.print(target.currentRssi);
+  Serial.println(" dBm)");
+
+  bool hadMqtt = mqtt.connected();
+  if (hadMqtt) {
+    mqttFlush(500);   // Leave nothing behind on the old link
+    stopCloudMqtt();
+    mqtt.disconnect();
+  }
+
+  watchdogEnterPhase("wifi_roam");
+  WiFi.begin(ssid, password, target.channel, target.bssid);
+  uint32_t start = millis();
+  bool joined = false;
+  while (!joined && millis() - start < WIFI_CONNECT_TIMEOUT) {
+    delay(100);
+    const uint8_t* bssid = WiFi.BSSID();
+    joined = WiFi.status() == WL_CONNECTED && bssid && memcmp(bssid, target.bssid, 6) == 0;
+  }
+  watchdogExitPhase();
+
+  reportRoam(target.bssid, joined);
+  logEvent(EVENT_ROAM, joined ? 0 : 1, target.rssi, target.currentRssi);
+  if (!joined) {
+    Serial.println("[WiFi] Roam failed, rejoining the network");
+    WiFi.begin(ssid, password);
+    return;
+  }
+
+  Serial.print("[WiFi] ✓ Roamed in ");
+  Serial.print(millis() - start);
+  Serial.println(" ms");
+  if (hadMqtt && timeSyncSettled()) connectMqtt();
+}
+
+/**
+ * What the site survey may do now: scans pause while connecting and during
+ * firmware downloads
+ */
+WifiSurveyMode currentSurveyMode() {
+  OtaStatus ota;
+  getOtaStatus(&ota);
+
+  if (WiFi.status() == WL_CONNECTED) {
+    return ota.phase != OTA_RECEIVING ? WIFI_SURVEY_BACKGROUND : WIFI_SURVEY_PAUSED;
+  }
+  return isBLEProvisioningActive() ? WIFI_SURVEY_PROVISIONING : WIFI_SURVEY_PAUSED;
+}
+
+/**
+ * Drives the background site survey and roaming (call in loop, also while provisioning)
+ */
+void serviceWifiSurvey() {
+  WifiSurveyMode mode = currentSurveyMode();
+  wifiSurveyLoop(mode);
+
+  WiFiRoamTarget target;
+  if (mode == WIFI_SURVEY_BACKGROUND && findRoamTarget(&target)) roamWiFi(target);
+}
+
+
+/**
+ * Starts the clock and the broker session once WiFi is up
+ * IMPORTANT: TLS validates certificate dates. If the clock is not set yet the
+ * connect is left to loop(), which retries once timeSyncSettled().
+ */
+void startNetworkServices() {
+  initTimeSync();
+#if LOCAL_API_ENABLED
+  initLocalApi(LOCAL_API_TOKEN);   // LAN control works without the broker (and the clock)
+#endif
+  discoverLanBroker();             // LAN modes: find the LAN broker before the first connect
+  setupMqtt();
+  if (timeSyncSettled()) {
+    connectMqtt();
+  } else {
+    Serial.println("[MQTT] Waiting for SNTP before connecting (TLS)");
+  }
+}
+
+/**
+ * Restores pump, valve and timer from the state store
+ * Runs before WiFi so the pool resumes within milliseconds of boot
+ */
+void restorePersistedState() {
+  initStateStore();
+  initRuntimeConfig();   // Before the restore below, which uses the valve delay
+  applyTelemetryStrategy();
+  initPumpUsage();       // Before the relays below, which report to it
+  const PersistedState& saved = getPersistedState();
+  bool hadTimers = saved.timerCount > 0;   // Read before the engine drops finished timers
+  initTimerEngine();
+
+  // A running timer decides the valve mode and keeps the pump on.
+  // If the pump only ran for timers that finished while powered off, leave it off.
+  TimerInfo primary;
+  bool resumeTimer = getPrimaryTimer(&primary);
+  int mode = resumeTimer ? primary.mode : saved.valveMode;
+  bool pumpOn = resumeTimer || (saved.pumpOn && !hadTimers);
+
+  setValveRelay(mode);
+
+  if (resumeTimer) {
+    Serial.print("[TIMER] Resuming ");
+    Serial.print(activeTimerCount());
+    Serial.print(" timer(s), pump stops in ");
+    Serial.print(primary.remainingSeconds);
+    Serial.println("s");
+  }
+
+  // The relay starts off and a restored ON goes through the policy, so the
+  // minimum off time counts from boot: a reboot loop cannot chatter the relay.
+  // The saved state is only rewritten once the relay actually switches.
+  initPumpPolicy(false);
+  if (pumpOn) requestPump(true);   // Applied by servicePump() (valves have settled by then)
+}
+
+#if BENCHMARK_ENABLED
+// ==================== Benchmarks ====================
+// Cases must not move the relays: commands repeat the current state, timers
+// are started on the engine only (no pump) and cancelled afterwards. The event
+// log is paused meanwhile, so dispatch cases do not write a record per iteration.
+// Cases whose path logs (command handlers, the streamed diagnostics) are quiet:
+// Serial is stopped while they are timed.
+
+/**
+ * A command as delivered by PubSubClient
+ */
+struct BenchMessage {
+  char topic[64];
+  char payload[96];
+};
+
+static BenchMessage benchPumpPlain;
+static BenchMessage benchValveEnveloped;
+static BenchMessage benchTimerJson;
+static BenchMessage benchInvalid;
+
+static void benchDispatch(void* context) {
+  BenchMessage* m = (BenchMessage*)context;
+  onMqttMessage(m->topic, (byte*)m->payload, strlen(m->payload));
+}
+
+static void benchCall(void* context) {
+  ((void (*)())context)();
+}
+
+static void setBenchMessage(BenchMessage& m, const char* topic, const char* payload) {
+  snprintf(m.topic, sizeof(m.topic), "%s", topic);
+  snprintf(m.payload, sizeof(m.payload), "%s", payload);
+}
+
+/**
+ * Runs the benchmark suite and prints BENCH lines (see benchmark.h)
+ */
+void runBenchmarks() {
+  Serial.println("[BENCH] Running hot-path benchmarks...");
+  pauseEventLog(true);
+
+  char payload[96];
+  setBenchMessage(benchPumpPlain, TOPIC_PUMP_SET, pumpTarget() ? "ON" : "OFF");
+  snprintf(payload, sizeof(payload), "{\"id\":\"bench\",\"ts\":1,\"cmd\":\"%d\"}", valveMode);
+  setBenchMessage(benchValveEnveloped, TOPIC_VALVE_SET, payload);
+  setBenchMessage(benchTimerJson, TOPIC_TIMER_SET,
+                  "{\"id\":\"bench\",\"ts\":1,\"name\":\"bench\",\"mode\":1,\"duration\":0}");
+  setBenchMessage(benchInvalid, TOPIC_PUMP_SET, "BOGUS");
+
+  const BenchCase idleCases[] = {
+    { "dispatch_pump_plain",      benchDispatch, &benchPumpPlain,      true },
+    { "dispatch_valve_enveloped", benchDispatch, &benchValveEnveloped, true },
+    { "dispatch_timer_json",      benchDispatch, &benchTimerJson,      true },
+    { "dispatch_invalid",         benchDispatch, &benchInvalid,        true },
+    { "publish_pump_state",       benchCall, (void*)publishPumpState },
+    { "publish_pump_policy",      benchCall, (void*)publishPumpPolicy },
+    { "publish_valve_state",      benchCall, (void*)publishValveState },
+    { "publish_wifi_state",       benchCall, (void*)publishWiFiState },
+    { "publish_timer_state",      benchCall, (void*)publishTimerState },
+    { "publish_temperature",      benchCall, (void*)publishTemperature },
+    { "publish_ota_state",        benchCall, (void*)publishOtaState },
+    { "publish_config_state",     benchCall, (void*)publishConfigState },
+    { "publish_diagnostics",      benchCall, (void*)publishDiagnostics, true },
+    { "update_timer_idle",        benchCall, (void*)updateTimer },
+  };
+  beginBenchmarkSuite(Serial);
+  runBenchmarkSuite(idleCases, sizeof(idleCases) / sizeof(idleCases[0]), Serial);
+
+  // Same paths with a running timer (engine only: the pump is not started)
+  bool started = startNamedTimer("bench", valveMode, 3600);
+  const BenchCase busyCases[] = {
+    { "publish_timer_state_busy", benchCall, (void*)publishTimerState },
+    { "update_timer_running",     benchCall, (void*)updateTimer },
+  };
+  if (started) runBenchmarkSuite(busyCases, sizeof(busyCases) / sizeof(busyCases[0]), Serial);
+  cancelNamedTimer("bench");
+
+  mqttDrain();
+  pauseEventLog(false);
+  Serial.println("[BENCH] Done");
+}
+#endif
+
 
 void setup() {
   Serial.begin(115200);
@@ -891,6 +2365,14 @@ void setup() {
   Serial.println("   ESP32 Pool Control System v2.0");
   Serial.println("========================================");
 
+  // Report the previous boot's stalls and watch this one (setup included)
+  initWatchdog();
+
+  // Event log: record this boot (reset reason, previous boot's longest stall)
+  WatchdogReport previousBoot;
+  getWatchdogReport(&previousBoot);
+  if (initEventLog()) logEvent(EVENT_BOOT, esp_reset_reason(), previousBoot.previous.durationMs);
+
   // Configure output pins (relays)
   pinMode(PUMP_RELAY_PIN, OUTPUT);
   pinMode(VALVE_RELAY_PIN, OUTPUT);
@@ -909,26 +2391,30 @@ void setup() {
   // Initialize DS18B20 temperature sensor
   Serial.println("[SENSOR] Initializing DS18B20...");
   tempSensor.begin();
+  tempSensor.setWaitForConversion(false);  // Readings are collected by serviceTemperature()
   int deviceCount = tempSensor.getDeviceCount();
   Serial.print("[SENSOR] DS18B20 devices found: ");
   Serial.println(deviceCount);
 
-  // Initial state
-  pumpState = false;
-  valveMode = 1;
+  // Initial state: restore actuators and timer from before the reboot (e.g. brownout)
   currentTemperature = 0.0;
+  restorePersistedState();
+  initBrokerPool();
+  initOta(OTA_SIGNING_KEY);
+  initWifiSurvey();   // Before provisioning, which lists networks from the survey
+
+#if BLE_CONTROL_ENABLED
+  // Local control is available from boot, independent of WiFi/MQTT
+  initBLEControl(BLE_CONTROL_PASSKEY);
+#endif
 
   // 1) Initialize WiFi with provisioning (BLE primary, WiFiManager fallback)
   bool wifiConnected = initWiFiProvisioning();
   
   if (wifiConnected) {
     // WiFi connected immediately (had saved credentials)
-    // 2) Synchronize time for TLS
-    syncTimeNTP();
-
-    // 3) Configure and connect MQTT
-    setupMqtt();
-    connectMqtt();
+    // 2) Start SNTP in the background, configure and connect MQTT (once the clock allows TLS)
+    startNetworkServices();
     
     Serial.println("========================================");
     Serial.println("   System ready");
@@ -940,61 +2426,122 @@ void setup() {
     Serial.println("   Open dashboard to provision device");
     Serial.println("========================================");
   }
+
+#if BENCHMARK_ENABLED
+  runBenchmarks();
+#endif
+}
+
+/**
+ * How long loop() may block waiting for a BLE event: until the nearest
+ * pending deadline (timer expiry, held pump switch, survey scan), at most
+ * BLE_EVENT_WAIT_TIMEOUT
+ */
+uint32_t bleEventWaitMs() {
+  uint32_t wait = BLE_EVENT_WAIT_TIMEOUT;
+
+  uint32_t timer = msUntilNextExpiry();
+  if (timer < wait) wait = timer;
+
+  PumpPolicyStatus pump;
+  getPumpPolicyStatus(&pump);
+  if (pump.pending && pump.holdMs < wait) wait = pump.holdMs;
+
+  uint32_t survey = wifiSurveyDueMs(currentSurveyMode());
+  if (survey < wait) wait = survey;
+  return wait;
 }
 
 /**
  * Main loop (executed continuously)
  * Responsibilities:
- * 1. Update timer countdown
+ * 1. Expire timers and publish their progress
  * 2. Publish WiFi state periodically
  * 3. Read and publish temperature periodically
  * 4. Detect and recover WiFi connection loss
  * 5. Detect and recover MQTT connection loss
  * 6. Process incoming MQTT messages (mqtt.loop)
+ * 7. Send queued publishes (mqttDrain)
  */
 void loop() {
+  // Feed the task watchdog, record stalls, check subsystem heartbeats
+  watchdogLoop();
+
+  // ===== BLE Local Control =====
+  // Served first so it keeps working while WiFi or the broker is down
+  processBLEControl();
+
+  // ===== Local HTTP API =====
+  // Commands answered and GET snapshots refreshed before anything that waits on the cloud
+  serviceLocalApi();
+
+  // Expire timers regardless of WiFi/BLE state (deadlines are absolute)
+  updateTimer();
+  servicePump();   // Held pump requests (anti-short-cycle)
+  watchdogHeartbeat(WDT_CONTROL);
+
+  // Clock resyncs (SNTP runs in the background)
+  serviceTimeSync();
+
+  // Firmware download, new image confirmation/rollback (also while offline)
+  serviceOta();
+
+  // Finish pending temperature conversions (also feeds BLE state)
+  serviceTemperature();
+
+  // Write coalesced actuator/timer changes to NVS
+  flushStateStore(false);
+
+  // Pump runtime/energy: day rollover and wear-aware saves (also while offline)
+  servicePumpUsage();
+
+  // Erase the next event log sector ahead of time
+  eventLogLoop();
+
+  // Background WiFi scans (also during provisioning) and roaming
+  serviceWifiSurvey();
+
   // ===== BLE Provisioning Check =====
-  // If BLE is active, check for new credentials from dashboard
-  static uint32_t lastBLECheck = 0;
+  // If BLE is active, block until the BLE task signals new credentials or the next deadline
   if (isBLEProvisioningActive()) {
-    // Give BLE stack time to process events (writes, notifications, etc.)
-    delay(10);
-    
-    if (millis() - lastBLECheck > BLE_CHECK_INTERVAL) {
-      lastBLECheck = millis();
+    waitForBLEEvent(bleEventWaitMs());
+    watchdogHeartbeat(WDT_BLE);
+
+    if (isClearWiFiRequested()) {
+      resetClearWiFiRequest();
+      clearWiFiCredentials();
+    }
+
+    if (hasNewWiFiCredentials()) {
+      char ssid[33];
+      char password[64];
       
-      if (hasNewWiFiCredentials()) {
-        char ssid[33];
-        char password[64];
+      if (getBLEWiFiSSID(ssid) && getBLEWiFiPassword(password)) {
+        Serial.println("[BLE] ✓ Credentials received from dashboard");
+        
+        // Stop BLE to free resources (~30-50KB RAM, CPU cycles)
+        // Dashboard can use MQTT to clear credentials remotely
+        stopBLEProvisioning();
+        watchdogIdle(WDT_BLE);
         
-        if (getBLEWiFiSSID(ssid) && getBLEWiFiPassword(password)) {
-          Serial.println("[BLE] ✓ Credentials received from dashboard");
+        // Try to connect with BLE credentials
+        if (connectWiFi(ssid, password)) {
+          // Save to NVS for future boots
+          saveWiFiCredentials(ssid, password);
+          clearBLECredentials();
           
-          // Stop BLE to free resources (~30-50KB RAM, CPU cycles)
-          // Dashboard can use MQTT to clear credentials remotely
-          stopBLEProvisioning();
+          // Complete system initialization
+          Serial.println("[System] Completing initialization...");
+          startNetworkServices();
           
-          // Try to connect with BLE credentials
-          if (connectWiFi(ssid, password)) {
-            // Save to NVS for future boots
-            saveWiFiCredentials(ssid, password);
-            clearBLECredentials();
-            
-            // Complete system initialization
-            Serial.println("[System] Completing initialization...");
-            syncTimeNTP();
-            setupMqtt();
-            connectMqtt();
-            
-            Serial.println("========================================");
-            Serial.println("   Sistema listo (via BLE)");
-            Serial.println("========================================");
-          } else {
-            // Connection failed - restart BLE for retry
-            Serial.println("[WiFi] BLE credentials failed - restarting BLE for retry...");
-            clearBLECredentials();
-            initBLEProvisioning();
-          }
+          Serial.println("========================================");
+          Serial.println("   Sistema listo (via BLE)");
+          Serial.println("========================================");
+        } else {
+          // Connection failed - restart BLE for retry
+          Serial.println("[WiFi] BLE credentials failed - restarting BLE for retry...");
+          clearBLECredentials();
+          initBLEProvisioning();
         }
       }
     }
@@ -1007,7 +2554,7 @@ void loop() {
   // Check WiFi status periodically, not every loop (prevents spam)
   static uint32_t lastWiFiCheck = 0;
   static int reconnectAttempts = 0;
-  if (WiFi.status() != WL_CONNECTED && millis() - lastWiFiCheck > WIFI_RECONNECT_INTERVAL) {
+  if (WiFi.status() != WL_CONNECTED && millis() - lastWiFiCheck > configValue(CFG_WIFI_RECONNECT_INTERVAL)) {
     lastWiFiCheck = millis();
     reconnectAttempts++;
     
@@ -1015,6 +2562,7 @@ void loop() {
     Serial.print("[WiFi] Connection lost (attempt ");
     Serial.print(reconnectAttempts);
     Serial.println("), attempting recovery...");
+    if (reconnectAttempts == 1) logEvent(EVENT_ERROR, EVENT_ERR_WIFI_LOST, 0);
     
     char ssid[33];
     char password[64];
@@ -1023,7 +2571,7 @@ void loop() {
       if (connectWiFi(ssid, password, 1)) {
         reconnectAttempts = 0;  // Reset counter on success
         // Reconnect MQTT after WiFi recovery
-        if (!mqtt.connected()) {
+        if (!mqtt.connected() && timeSyncSettled()) {
           Serial.println("[System] WiFi recovered, reconnecting MQTT...");
           connectMqtt();
         }
@@ -1050,34 +2598,55 @@ void loop() {
     return;
   }
   
-  // Update timer if active
-  updateTimer();
-  
-  // Publish WiFi state periodically
-  static uint32_t lastWiFiUpdate = 0;
-  if (millis() - lastWiFiUpdate > WIFI_STATE_INTERVAL) {
-    lastWiFiUpdate = millis();
-    if (mqtt.connected()) {
+  // Sample RSSI; the telemetry strategy decides whether it changed enough to publish
+  if (telemetrySampleDue(TELEMETRY_WIFI) && mqtt.connected()) {
+    int rssi = WiFi.RSSI();
+    if (telemetryOffer(TELEMETRY_WIFI, rssi)) {
       publishWiFiState();
+      telemetryPublished(TELEMETRY_WIFI, rssi);
     }
   }
   
-  // Read and publish temperature periodically (every 1 minute)
-  static uint32_t lastTempUpdate = 0;
-  if (millis() - lastTempUpdate > TEMP_PUBLISH_INTERVAL) {
-    lastTempUpdate = millis();
-    currentTemperature = readTemperature();
-    if (mqtt.connected()) {
-      publishTemperature();
-    }
+  // Track heap fragmentation between diagnostics publishes
+  static uint32_t lastHeapSample = 0;
+  if (millis() - lastHeapSample > HEAP_SAMPLE_INTERVAL) {
+    lastHeapSample = millis();
+    sampleHeap();
+  }
+
+  // Publish diagnostics periodically
+  static uint32_t lastDiagUpdate = 0;
+  if (millis() - lastDiagUpdate > configValue(CFG_DIAG_PUBLISH_INTERVAL)) {
+    lastDiagUpdate = millis();
+    publishDiagnostics();
+  }
+
+  // Read and publish temperature (interval from the telemetry strategy)
+  if (telemetrySampleDue(TELEMETRY_TEMPERATURE)) {
+    requestTemperatureRead();
   }
   
-  // If MQTT drops, reconnect
-  if (!mqtt.connected()) {
+  // If MQTT drops, reconnect (rate limited so the loop stays responsive while the broker is down)
+  static uint32_t lastMqttAttempt = 0;
+  if (!mqtt.connected() && timeSyncSettled() &&
+      millis() - lastMqttAttempt > configValue(CFG_MQTT_RECONNECT_INTERVAL)) {
+    lastMqttAttempt = millis();
     Serial.println("[MQTT] Connection lost, reconnecting...");
+    if (mqttSessionLogged) {
+      mqttSessionLogged = false;
+      logEvent(EVENT_MQTT, 0, 0, activeBrokerSlot());
+    }
     connectMqtt();
   }
 
   // Keep connection alive and process incoming messages
-  mqtt.loop();
+  if (mqtt.loop()) watchdogHeartbeat(WDT_NETWORK);
+
+  // Send queued publishes (state and acks first)
+  mqttDrain();
+  checkMqttReady();
+  serviceLanDiscovery();
+  serviceBrokerPool();
+  serviceCloudMqtt();
+  serviceEventQuery();
 }
@@ -0,0 +1,52 @@
+/**
+ * @file mqtt_routes.cpp
+ * @brief Topic routing rules for the LAN + cloud sessions
+ */
+
+#include "mqtt_routes.h"
+#include "config.h"
+
+/**
+ * One rule (exact topic match)
+ */
+struct MqttRouteRule {
+  const char* topic;
+  uint8_t route;         // MqttRoute
+  uint32_t cloudMinMs;   // 0 = every publish goes to the cloud too
+};
+
+// Edit here to change what leaves the LAN (unlisted topics go to both sessions)
+static const MqttRouteRule ROUTES[] = {
+  { TOPIC_DIAG_STATE,   MQTT_ROUTE_LAN,  0 },                              // Streamed, several KB
+  { TOPIC_PUMP_USAGE,   MQTT_ROUTE_LAN,  0 },                              // Every minute while running; daily summary goes out
+  { TOPIC_TEMP_STATE,   MQTT_ROUTE_BOTH, MQTT_CLOUD_TELEMETRY_INTERVAL },
+  { TOPIC_WIFI_STATE,   MQTT_ROUTE_BOTH, MQTT_CLOUD_TELEMETRY_INTERVAL },
+};
+
+#define ROUTE_COUNT (sizeof(ROUTES) / sizeof(ROUTES[0]))
+
+// ==================== State Variables ====================
+static uint32_t lastCloudMs[ROUTE_COUNT];   // millis() of the last cloud copy per thinned rule
+static bool cloudSent[ROUTE_COUNT];
+
+// ==================== Public Functions ====================
+
+uint8_t mqttRouteFor(const char* topic, MqttPriority priority) {
+  for (size_t i = 0; i < ROUTE_COUNT; i++) {
+    const MqttRouteRule& rule = ROUTES[i];
+    if (strcmp(rule.topic, topic) != 0) continue;
+    if (!(rule.route & MQTT_ROUTE_CLOUD) || rule.cloudMinMs == 0) return rule.route;
+    if (priority == MQTT_PRIO_CRITICAL) return rule.route;
+
+    uint32_t now = millis();
+    if (cloudSent[i] && now - lastCloudMs[i] < rule.cloudMinMs) return rule.route & ~MQTT_ROUTE_CLOUD;
+    cloudSent[i] = true;
+    lastCloudMs[i] = now;
+    return rule.route;
+  }
+  return MQTT_ROUTE_BOTH;
+}
+
+void resetMqttRoutes() {
+  memset(cloudSent, 0, sizeof(cloudSent));
+}
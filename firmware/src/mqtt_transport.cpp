@@ -0,0 +1,544 @@
+/**
+ * @file mqtt_transport.cpp
+ * @brief Prioritized outbound MQTT queue implementation
+ */
+
+#include "mqtt_transport.h"
+#include <PubSubClient.h>
+#include "coalescing_client.h"
+#include "mqtt_routes.h"
+
+/**
+ * One queued message
+ */
+struct OutboundMessage {
+  bool used;
+  bool retain;
+  bool qos1;                                // Kept until the broker acknowledges it
+  uint8_t priority;
+  uint8_t links;                            // Links still to reach (bit per MqttLink)
+  uint8_t written;                          // Links it was written to this burst (not yet flushed)
+  uint8_t awaiting;                         // QoS 1: links whose PUBACK is outstanding
+  uint8_t redeliver;                        // QoS 1: links to resend to with DUP and the same packet ID
+  uint16_t length;
+  uint16_t packetId[MQTT_LINK_COUNT];       // QoS 1: packet ID per link (0 = none)
+  uint32_t sentAt[MQTT_LINK_COUNT];         // QoS 1: millis() of the last write per link
+  uint32_t seq;                             // Enqueue order (FIFO within a priority)
+  char topic[MQTT_QUEUE_TOPIC_LEN];
+  char payload[MQTT_QUEUE_PAYLOAD_LEN];
+};
+
+// ==================== State Variables ====================
+static PubSubClient* clients[MQTT_LINK_COUNT] = {};
+static CoalescingClient* sockets[MQTT_LINK_COUNT] = {};
+static OutboundMessage queue[MQTT_QUEUE_LENGTH];   // Main loop only
+static uint32_t nextSeq = 0;
+static uint16_t lastPacketId[MQTT_LINK_COUNT] = {};
+static MqttQueueStats stats = {};
+
+// ==================== Streaming Writers ====================
+
+/**
+ * Counts bytes without storing them (first serializer pass)
+ */
+class LengthCounter : public Print {
+ public:
+  size_t length = 0;
+  size_t write(uint8_t) override { length++; return 1; }
+  size_t write(const uint8_t*, size_t size) override { length += size; return size; }
+};
+
+/**
+ * Buffers serializer output and writes it to the client in MQTT_STREAM_CHUNK pieces
+ */
+class ChunkedPublishWriter : public Print {
+ public:
+  explicit ChunkedPublishWriter(PubSubClient* client) : client(client) {}
+  size_t written = 0;   // Bytes accepted by the socket
+
+  size_t write(uint8_t b) override {
+    chunk[used++] = b;
+    if (used == sizeof(chunk)) writeChunk();
+    return 1;
+  }
+
+  size_t write(const uint8_t* data, size_t size) override {
+    for (size_t i = 0; i < size; i++) write(data[i]);
+    return size;
+  }
+
+  void writeChunk() {
+    if (used == 0) return;
+    written += client->write(chunk, used);
+    used = 0;
+  }
+
+ private:
+  PubSubClient* client;
+  uint8_t chunk[MQTT_STREAM_CHUNK];
+  size_t used = 0;
+};
+
+// ==================== Helper Functions ====================
+
+static bool linkConnected(uint8_t link) {
+  return clients[link] && clients[link]->connected();
+}
+
+/**
+ * Links a new publish goes to: by the routing rules while the cloud link is
+ * up, otherwise everything to the main link
+ */
+static uint8_t linksFor(const char* topic, MqttPriority priority) {
+  if (!linkConnected(MQTT_LINK_CLOUD)) return 1 << MQTT_LINK_MAIN;
+  uint8_t route = mqttRouteFor(topic, priority);
+  uint8_t links = 0;
+  if (route & MQTT_ROUTE_LAN) links |= 1 << MQTT_LINK_MAIN;
+  if (route & MQTT_ROUTE_CLOUD) links |= 1 << MQTT_LINK_CLOUD;
+  return links ? links : 1 << MQTT_LINK_MAIN;
+}
+
+static void releaseSlot(OutboundMessage& msg) {
+  if (msg.awaiting) {
+    for (uint8_t link = 0; link < MQTT_LINK_COUNT; link++) {
+      if (msg.awaiting & (1 << link)) stats.inflight--;
+    }
+  }
+  msg.used = false;
+  msg.links = 0;
+  msg.written = 0;
+  msg.awaiting = 0;
+  msg.redeliver = 0;
+  stats.depth--;
+}
+
+/**
+ * Stop waiting for a PUBACK; redeliver marks it for a DUP resend with the same packet ID
+ */
+static void clearAwaiting(OutboundMessage& msg, uint8_t link, bool redeliver) {
+  const uint8_t bit = 1 << link;
+  if (!(msg.awaiting & bit)) return;
+  msg.awaiting &= ~bit;
+  stats.inflight--;
+  if (redeliver) {
+    msg.redeliver |= bit;
+    stats.redelivered++;
+  }
+}
+
+/**
+ * QoS 1 publishes of a link written or waiting for their PUBACK
+ */
+static int inflightCount(uint8_t link) {
+  const uint8_t bit = 1 << link;
+  int count = 0;
+  for (int i = 0; i < MQTT_QUEUE_LENGTH; i++) {
+    if (queue[i].used && queue[i].qos1 && ((queue[i].written | queue[i].awaiting) & bit)) count++;
+  }
+  return count;
+}
+
+/**
+ * PUBACK from a link's broker (called from PubSubClient's read, main loop)
+ */
+static void onPuback(uint16_t packetId, void* context) {
+  uint8_t link = (uint8_t)(uintptr_t)context;
+  const uint8_t bit = 1 << link;
+  for (int i = 0; i < MQTT_QUEUE_LENGTH; i++) {
+    OutboundMessage& msg = queue[i];
+    if (!msg.used || !(msg.awaiting & bit) || msg.packetId[link] != packetId) continue;
+    clearAwaiting(msg, link, false);
+    msg.redeliver &= ~bit;
+    msg.links &= ~bit;
+    stats.acked++;
+    if (msg.links == 0) releaseSlot(msg);
+    return;
+  }
+}
+
+/**
+ * Link down: PUBACKs it owed will never come, resend those publishes after the reconnect
+ */
+static void resetLink(uint8_t link) {
+  for (int i = 0; i < MQTT_QUEUE_LENGTH; i++) {
+    if (queue[i].used) clearAwaiting(queue[i], link, true);
+  }
+}
+
+/**
+ * Resend QoS 1 publishes whose PUBACK is overdue
+ */
+static void expireAcks(uint8_t link) {
+  uint32_t now = millis();
+  for (int i = 0; i < MQTT_QUEUE_LENGTH; i++) {
+    OutboundMessage& msg = queue[i];
+    if (msg.used && (msg.awaiting & (1 << link)) && now - msg.sentAt[link] >= MQTT_ACK_TIMEOUT) {
+      clearAwaiting(msg, link, true);
+    }
+  }
+}
+
+/**
+ * Cloud link down: discard its pending copies (its reconnect queues the state again)
+ */
+static void releaseCloudLink() {
+  if (!clients[MQTT_LINK_CLOUD] || linkConnected(MQTT_LINK_CLOUD)) return;
+  const uint8_t bit = 1 << MQTT_LINK_CLOUD;
+  for (int i = 0; i < MQTT_QUEUE_LENGTH; i++) {
+    if (!queue[i].used || !(queue[i].links & bit)) continue;
+    clearAwaiting(queue[i], MQTT_LINK_CLOUD, false);
+    queue[i].links &= ~bit;
+    queue[i].written &= ~bit;
+    queue[i].redeliver &= ~bit;
+    stats.cloudReleased++;
+    if (queue[i].links == 0) releaseSlot(queue[i]);
+  }
+}
+
+/**
+ * Next message for a link: most important priority, oldest first
+ * QoS 1 publishes wait while MQTT_INFLIGHT_WINDOW of them are unacknowledged
+ * (unless useWindow is false).
+ */
+static int nextToSend(uint8_t link, bool useWindow = true) {
+  const uint8_t bit = 1 << link;
+  bool windowFull = useWindow && inflightCount(link) >= MQTT_INFLIGHT_WINDOW;
+  int best = -1;
+  for (int i = 0; i < MQTT_QUEUE_LENGTH; i++) {
+    if (!queue[i].used || !(queue[i].links & bit) || ((queue[i].written | queue[i].awaiting) & bit)) continue;
+    if (queue[i].qos1 && windowFull) continue;
+    if (best < 0 || queue[i].priority < queue[best].priority ||
+        (queue[i].priority == queue[best].priority && queue[i].seq < queue[best].seq)) {
+      best = i;
+    }
+  }
+  return best;
+}
+
+/**
+ * Drop candidate when full: least important priority, oldest first
+ */
+static int nextToDrop() {
+  int worst = -1;
+  for (int i = 0; i < MQTT_QUEUE_LENGTH; i++) {
+    if (!queue[i].used) continue;
+    if (worst < 0 || queue[i].priority > queue[worst].priority ||
+        (queue[i].priority == queue[worst].priority && queue[i].seq < queue[worst].seq)) {
+      worst = i;
+    }
+  }
+  return worst;
+}
+
+static void logDrop(const char* topic, const char* reason) {
+  Serial.print("[MQTT] DROP ");
+  Serial.print(topic);
+  Serial.print(" (");
+  Serial.print(reason);
+  Serial.println(")");
+}
+
+/**
+ * Write a QoS 1 PUBLISH (PubSubClient only builds QoS 0 ones)
+ * @return false if the packet was not written whole (the session is dropped)
+ */
+static bool publishQos1(PubSubClient* client, const OutboundMessage& msg, uint16_t packetId, bool dup) {
+  size_t topicLen = strlen(msg.topic);
+  size_t remaining = 2 + topicLen + 2 + msg.length;
+
+  uint8_t header[MQTT_MAX_HEADER_SIZE + 2];
+  size_t n = 0;
+  header[n++] = (MQTTPUBLISH) | (MQTTQOS1) | (dup ? 0x08 : 0) | (msg.retain ? 0x01 : 0);
+  do {
+    uint8_t digit = remaining % 128;
+    remaining /= 128;
+    header[n++] = remaining ? digit | 0x80 : digit;
+  } while (remaining);
+  header[n++] = topicLen >> 8;
+  header[n++] = topicLen & 0xFF;
+  uint8_t id[2] = { (uint8_t)(packetId >> 8), (uint8_t)(packetId & 0xFF) };
+
+  size_t expected = n + topicLen + sizeof(id) + msg.length;
+  size_t written = client->write(header, n);
+  written += client->write((const uint8_t*)msg.topic, topicLen);
+  written += client->write(id, sizeof(id));
+  written += client->write((const uint8_t*)msg.payload, msg.length);
+  if (written == expected) return true;
+
+  if (written > 0) client->disconnect();   // Part of a packet is on the wire
+  return false;
+}
+
+/**
+ * Write one message to a link's socket (buffered until finishBurst())
+ * @return false if the publish failed (message stays queued)
+ */
+static bool sendMessage(OutboundMessage& msg, uint8_t link) {
+  PubSubClient* client = clients[link];
+  const uint8_t bit = 1 << link;
+
+  // PubSubClient rejects packets larger than its buffer: retrying would never succeed
+  size_t packetSize = MQTT_MAX_HEADER_SIZE + 2 + strlen(msg.topic) + (msg.qos1 ? 2 : 0) + msg.length;
+  if (packetSize > client->getBufferSize()) {
+    logDrop(msg.topic, "exceeds client buffer");
+    releaseSlot(msg);
+    stats.oversize++;
+    return true;
+  }
+
+  bool ok;
+  bool dup = msg.redeliver & bit;
+  if (msg.qos1) {
+    if (!dup) {
+      if (++lastPacketId[link] == 0) lastPacketId[link] = 1;
+      msg.packetId[link] = lastPacketId[link];
+    }
+    ok = publishQos1(client, msg, msg.packetId[link], dup);
+  } else {
+    ok = client->publish(msg.topic, (const uint8_t*)msg.payload, msg.length, msg.retain);
+  }
+
+  Serial.print(link == MQTT_LINK_CLOUD ? "[MQTT] publish (cloud) " : "[MQTT] publish ");
+  Serial.print(msg.topic);
+  Serial.print(" = ");
+  Serial.print(msg.payload);
+  if (msg.qos1) {
+    Serial.print(dup ? " [qos1 dup id " : " [qos1 id ");
+    Serial.print(msg.packetId[link]);
+    Serial.print("]");
+  }
+  Serial.println(ok ? " OK" : " FAIL");
+
+  if (!ok) {
+    stats.failed++;
+    return false;
+  }
+  msg.written |= 1 << link;
+  return true;
+}
+
+/**
+ * Flush a link's socket and settle the messages written since the last flush:
+ * QoS 0 ones leave the queue once the record went out, QoS 1 ones once their
+ * PUBACK arrives. If the flush fails they are pending again and rewritten
+ * after the reconnect.
+ * @return false if the flush failed
+ */
+static bool finishBurst(uint8_t link) {
+  // A flush that fails stops the socket, also when an earlier read flushed for us
+  bool ok = sockets[link]->flushWrites() && linkConnected(link);
+  const uint8_t bit = 1 << link;
+
+  for (int i = 0; i < MQTT_QUEUE_LENGTH; i++) {
+    OutboundMessage& msg = queue[i];
+    if (!msg.used || !(msg.written & bit)) continue;
+    msg.written &= ~bit;
+    if (!ok) {
+      stats.failed++;
+      if (msg.qos1) msg.redeliver |= bit;   // The broker may have seen its packet ID
+      continue;
+    }
+    if (link == MQTT_LINK_CLOUD) {
+      stats.cloudSent++;
+    } else {
+      stats.sent++;
+    }
+    if (msg.qos1) {
+      msg.awaiting |= bit;
+      msg.sentAt[link] = millis();
+      stats.inflight++;
+      continue;
+    }
+    msg.links &= ~bit;
+    if (msg.links == 0) releaseSlot(msg);
+  }
+  return ok;
+}
+
+/**
+ * Stream one payload to one link
+ * @return false if the session did not get the whole payload
+ */
+static bool streamTo(uint8_t link, const char* topic, bool retain, size_t length,
+                     MqttPayloadWriter writer, void* context) {
+  PubSubClient* client = clients[link];
+  const char* tag = link == MQTT_LINK_CLOUD ? "[MQTT] stream (cloud) " : "[MQTT] stream ";
+
+  if (!client->beginPublish(topic, length, retain)) {
+    stats.failed++;
+    Serial.print(tag);
+    Serial.print(topic);
+    Serial.println(" FAIL (begin)");
+    return false;
+  }
+
+  // Pass 2: write in chunks
+  ChunkedPublishWriter out(client);
+  writer(out, context);
+  out.writeChunk();
+  client->endPublish();
+  if (!sockets[link]->flushWrites()) out.written = 0;
+
+  Serial.print(tag);
+  Serial.print(topic);
+  Serial.print(" = ");
+  Serial.print((unsigned long)out.written);
+  Serial.print("/");
+  Serial.print((unsigned long)length);
+  Serial.println(" bytes");
+
+  if (out.written != length) {
+    // The broker is still waiting for the declared length: the session is unusable
+    stats.truncated++;
+    Serial.println("[MQTT] ERROR: streamed publish truncated, dropping connection");
+    client->disconnect();
+    return false;
+  }
+
+  stats.streamed++;
+  stats.streamedBytes += length;
+  return true;
+}
+
+// ==================== Public Functions ====================
+
+void initMqttTransport(PubSubClient* client, CoalescingClient* socket) {
+  clients[MQTT_LINK_MAIN] = client;
+  sockets[MQTT_LINK_MAIN] = socket;
+  socket->onPuback(onPuback, (void*)(uintptr_t)MQTT_LINK_MAIN);
+}
+
+void attachMqttCloudLink(PubSubClient* client, CoalescingClient* socket) {
+  clients[MQTT_LINK_CLOUD] = client;
+  sockets[MQTT_LINK_CLOUD] = socket;
+  socket->onPuback(onPuback, (void*)(uintptr_t)MQTT_LINK_CLOUD);
+}
+
+bool mqttEnqueue(const char* topic, const char* payload, bool retain, MqttPriority priority) {
+  size_t topicLen = strlen(topic);
+  size_t length = strlen(payload);
+  if (topicLen >= MQTT_QUEUE_TOPIC_LEN || length >= MQTT_QUEUE_PAYLOAD_LEN) {
+    stats.oversize++;
+    logDrop(topic, "oversize");
+    return false;
+  }
+
+  // Retained state: a newer value replaces the queued one, keeping its place in line
+  int slot = -1;
+  if (retain) {
+    for (int i = 0; i < MQTT_QUEUE_LENGTH; i++) {
+      if (queue[i].used && queue[i].retain && strcmp(queue[i].topic, topic) == 0) {
+        slot = i;
+        stats.coalesced++;
+        break;
+      }
+    }
+  }
+
+  if (slot < 0) {
+    for (int i = 0; i < MQTT_QUEUE_LENGTH; i++) {
+      if (!queue[i].used) {
+        slot = i;
+        break;
+      }
+    }
+  }
+
+  if (slot < 0) {
+    // Full: make room by dropping the least important message
+    int victim = nextToDrop();
+    if (queue[victim].priority < priority) {
+      stats.dropped++;
+      logDrop(topic, "queue full");
+      return false;
+    }
+    stats.dropped++;
+    logDrop(queue[victim].topic, "queue full");
+    releaseSlot(queue[victim]);
+    slot = victim;
+  }
+
+  // A replaced value still owes the links the old one had not reached
+  // (including those still owing a PUBACK: the new value goes out with a new packet ID)
+  OutboundMessage& msg = queue[slot];
+  if (!msg.used) {
+    msg.used = true;
+    msg.links = 0;
+    msg.seq = nextSeq++;
+    stats.depth++;
+    if (stats.depth > stats.highWater) stats.highWater = stats.depth;
+  }
+  for (uint8_t link = 0; link < MQTT_LINK_COUNT; link++) clearAwaiting(msg, link, false);
+  msg.redeliver = 0;
+  msg.links |= linksFor(topic, priority);
+  msg.qos1 = retain && priority <= MQTT_PRIO_STATE;
+  msg.retain = retain;
+  msg.priority = priority;
+  msg.length = length;
+  memcpy(msg.topic, topic, topicLen + 1);
+  memcpy(msg.payload, payload, length + 1);
+  stats.enqueued++;
+  return true;
+}
+
+bool mqttPublishStreamed(const char* topic, bool retain, MqttPayloadWriter writer, void* context) {
+  if (!linkConnected(MQTT_LINK_MAIN)) return false;
+
+  // Pass 1: measure (MQTT needs the remaining length up front)
+  LengthCounter counter;
+  writer(counter, context);
+
+  uint8_t links = linksFor(topic, MQTT_PRIO_TELEMETRY);
+  bool ok = true;
+  for (uint8_t link = 0; link < MQTT_LINK_COUNT; link++) {
+    if (!(links & (1 << link)) || !linkConnected(link)) continue;
+    if (!streamTo(link, topic, retain, counter.length, writer, context)) ok = false;
+  }
+  return ok;
+}
+
+void mqttDrain() {
+  releaseCloudLink();
+
+  // Links share the burst budget, main link first
+  uint32_t start = millis();
+  int sent = 0;
+  for (uint8_t link = 0; link < MQTT_LINK_COUNT; link++) {
+    if (!linkConnected(link)) {
+      resetLink(link);
+      continue;
+    }
+    expireAcks(link);
+    for (; sent < MQTT_DRAIN_BURST && millis() - start < MQTT_DRAIN_BUDGET; sent++) {
+      int next = nextToSend(link);
+      if (next < 0) break;
+      if (!sendMessage(queue[next], link)) break;  // Socket trouble: retry after reconnect
+    }
+
+    // End of the burst: subscribes, pings and publishes leave as one record
+    finishBurst(link);
+  }
+}
+
+bool mqttFlush(uint32_t timeoutMs) {
+  uint32_t start = millis();
+  releaseCloudLink();
+  if (!linkConnected(MQTT_LINK_MAIN)) return false;
+
+  // The connection is about to close: the in-flight window and PUBACKs are not waited for
+  bool flushed = true;
+  for (uint8_t link = 0; link < MQTT_LINK_COUNT; link++) {
+    if (!linkConnected(link)) continue;
+    while (millis() - start < timeoutMs) {
+      int next = nextToSend(link, false);
+      if (next < 0) break;
+      if (!sendMessage(queue[next], link)) break;
+    }
+    if (!finishBurst(link) || nextToSend(link, false) >= 0) flushed = false;
+  }
+  return flushed;
+}
+
+void getMqttQueueStats(MqttQueueStats* out) {
+  *out = stats;
+}
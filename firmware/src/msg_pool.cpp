@@ -0,0 +1,62 @@
+/**
+ * @file msg_pool.cpp
+ * @brief Per-message buffer pool implementation
+ */
+
+#include "msg_pool.h"
+
+// ==================== State Variables ====================
+static char arena[MSG_POOL_BLOCKS][MSG_POOL_BLOCK_SIZE];   // Allocated once, at link time
+static uint8_t takenMask = 0;                              // Bit i = arena[i] in use
+static MsgPoolStats stats = {};
+
+// ==================== MsgBuffer ====================
+
+MsgBuffer::MsgBuffer() : data(nullptr), block(0) {
+  for (uint8_t i = 0; i < MSG_POOL_BLOCKS; i++) {
+    if (takenMask & (1 << i)) continue;
+    takenMask |= 1 << i;
+    block = i;
+    data = arena[i];
+    data[0] = '\0';
+
+    stats.acquired++;
+    stats.inUse++;
+    if (stats.inUse > stats.highWater) stats.highWater = stats.inUse;
+    return;
+  }
+
+  stats.exhausted++;
+  Serial.println("[POOL] ERROR: No free message buffer");
+}
+
+MsgBuffer::~MsgBuffer() {
+  if (!data) return;
+  takenMask &= ~(1 << block);
+  stats.inUse--;
+}
+
+size_t MsgBuffer::write(uint8_t b) {
+  return write(&b, 1);
+}
+
+size_t MsgBuffer::write(const uint8_t* src, size_t size) {
+  if (!data) return 0;
+
+  size_t room = MSG_POOL_BLOCK_SIZE - 1 - used;
+  if (size > room) {
+    if (!overflow) stats.truncated++;
+    overflow = true;
+    size = room;
+  }
+  memcpy(data + used, src, size);
+  used += size;
+  data[used] = '\0';
+  return size;
+}
+
+// ==================== Public Functions ====================
+
+void getMsgPoolStats(MsgPoolStats* out) {
+  *out = stats;
+}
@@ -0,0 +1,436 @@
+/**
+ * @file ota_update.cpp
+ * @brief Streaming OTA implementation (esp_ota_* with rollback)
+ */
+
+#include "ota_update.h"
+#include "delta_patch.h"
+#include "trust_store.h"
+#include "watchdog.h"
+#include <HTTPClient.h>
+#include <WiFiClientSecure.h>
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
+#include <mbedtls/pk.h>
+#include <mbedtls/sha256.h>
+
+#define OTA_HASH_BLOCK  1024   // Running image bytes hashed per read
+
+// ==================== State Variables ====================
+static OtaPhase phase = OTA_IDLE;
+static OtaRequest request;
+static const char* lastError = "";
+static bool pendingVerify = false;
+static mbedtls_pk_context signingKey;
+static bool signingKeyLoaded = false;
+
+static const esp_partition_t* running = nullptr;
+static const esp_partition_t* target = nullptr;
+static esp_ota_handle_t handle = 0;
+static mbedtls_sha256_context imageSha;
+static DeltaDecoder decoder;
+
+static uint32_t received = 0;         // Transferred bytes (image or patch)
+static uint32_t written = 0;          // Image bytes written
+static uint32_t lastData = 0;         // millis() of the last byte received
+static uint32_t lastReported = 0;     // received at the last progress report
+static OtaPhase reportedPhase = OTA_IDLE;
+static uint32_t doneAt = 0;
+
+static WiFiClientSecure httpsClient;
+static HTTPClient http;
+
+/**
+ * Keep the new image in "pending verify" until otaLoop() confirms it
+ * (overrides the Arduino core, which would confirm it right at boot)
+ */
+extern "C" bool verifyRollbackLater() {
+  return true;
+}
+
+// ==================== Helper Functions ====================
+
+static void fail(const char* reason) {
+  if (handle) {
+    esp_ota_abort(handle);
+    handle = 0;
+  }
+  if (request.url[0] != '\0') http.end();
+  mbedtls_sha256_free(&imageSha);
+
+  phase = OTA_FAILED;
+  lastError = reason;
+  Serial.print("[OTA] ERROR: ");
+  Serial.print(reason);
+  Serial.print(" after ");
+  Serial.print(received);
+  Serial.println(" bytes");
+}
+
+static bool writeImage(const uint8_t* buf, size_t len) {
+  if (esp_ota_write(handle, buf, len) != ESP_OK) return false;
+  mbedtls_sha256_update(&imageSha, buf, len);
+  written += len;
+  return true;
+}
+
+/**
+ * SHA-256 of the running image (ESP.getSketchSize() bytes of its partition)
+ */
+static bool hashRunningImage(uint32_t size, uint8_t* out) {
+  mbedtls_sha256_context sha;
+  mbedtls_sha256_init(&sha);
+  mbedtls_sha256_starts(&sha, 0);
+
+  watchdogEnterPhase("ota_hash");
+  uint8_t block[OTA_HASH_BLOCK];
+  bool ok = true;
+  for (uint32_t offset = 0; offset < size && ok; offset += sizeof(block)) {
+    size_t n = size - offset < sizeof(block) ? size - offset : sizeof(block);
+    ok = esp_partition_read(running, offset, block, n) == ESP_OK;
+    if (ok) mbedtls_sha256_update(&sha, block, n);
+  }
+  watchdogExitPhase();
+
+  mbedtls_sha256_finish(&sha, out);
+  mbedtls_sha256_free(&sha);
+  return ok;
+}
+
+/**
+ * Release key signature over an image SHA-256
+ */
+static bool signatureValid(const uint8_t* sha) {
+  return signingKeyLoaded && request.sigLen > 0 &&
+         mbedtls_pk_verify(&signingKey, MBEDTLS_MD_SHA256, sha, 32, request.sig, request.sigLen) == 0;
+}
+
+/**
+ * Hex digits to bytes
+ * @return false on a non-hex character (an odd length is rejected by the caller)
+ */
+static bool parseHex(const char* hex, size_t bytes, uint8_t* out) {
+  for (size_t i = 0; i < bytes; i++) {
+    uint8_t byte = 0;
+    for (int j = 0; j < 2; j++) {
+      char c = hex[i * 2 + j];
+      uint8_t nibble;
+      if (c >= '0' && c <= '9') nibble = c - '0';
+      else if (c >= 'a' && c <= 'f') nibble = c - 'a' + 10;
+      else if (c >= 'A' && c <= 'F') nibble = c - 'A' + 10;
+      else return false;
+      byte = (byte << 4) | nibble;
+    }
+    out[i] = byte;
+  }
+  return true;
+}
+
+// Delta decoder callbacks
+
+static bool patchHeader(void*, const DeltaHeader& header) {
+  uint32_t sourceSize = ESP.getSketchSize();
+  uint8_t sourceSha[32];
+  if (header.sourceSize != sourceSize || header.targetSize > target->size ||
+      !hashRunningImage(sourceSize, sourceSha) ||
+      memcmp(sourceSha, header.sourceSha256, sizeof(sourceSha)) != 0) {
+    Serial.println("[OTA] Patch was made against a different image");
+    return false;
+  }
+  return true;
+}
+
+static bool patchRead(void*, uint32_t offset, uint8_t* buf, size_t len) {
+  return esp_partition_read(running, offset, buf, len) == ESP_OK;
+}
+
+static bool patchWrite(void*, const uint8_t* buf, size_t len) {
+  return writeImage(buf, len);
+}
+
+/**
+ * Verify the written image and make it the boot partition
+ */
+static void finish() {
+  if (request.patch && !decoder.finished()) {
+    fail("patch_incomplete");
+    return;
+  }
+
+  uint8_t sha[32];
+  mbedtls_sha256_finish(&imageSha, sha);
+  if (memcmp(sha, request.sha256, sizeof(sha)) != 0) {
+    fail("sha256_mismatch");
+    return;
+  }
+  if (!signatureValid(sha)) {
+    fail("signature_invalid");
+    return;
+  }
+
+  esp_err_t err = esp_ota_end(handle);
+  handle = 0;
+  if (err != ESP_OK) {
+    fail("image_invalid");
+    return;
+  }
+  if (esp_ota_set_boot_partition(target) != ESP_OK) {
+    fail("set_boot");
+    return;
+  }
+
+  if (request.url[0] != '\0') http.end();
+  mbedtls_sha256_free(&imageSha);
+  phase = OTA_DONE;
+  doneAt = millis();
+  Serial.print("[OTA] Image verified (");
+  Serial.print(written);
+  Serial.print(" bytes), booting ");
+  Serial.println(target->label);
+}
+
+/**
+ * Consume received bytes: write them, or decode them as a patch
+ */
+static void consume(const uint8_t* data, size_t len) {
+  if (len > request.size - received) len = request.size - received;
+  received += len;
+  lastData = millis();
+
+  if (request.patch) {
+    DeltaResult result = decoder.feed(data, len);
+    if (result != DELTA_OK) {
+      fail(DeltaDecoder::resultName(result));
+      return;
+    }
+  } else if (!writeImage(data, len)) {
+    fail("flash_write");
+    return;
+  }
+
+  if (received == request.size) finish();
+}
+
+/**
+ * Progress worth publishing since the last report
+ */
+static bool progressDue() {
+  if (phase == reportedPhase && (phase != OTA_RECEIVING || received - lastReported < OTA_PROGRESS_STEP)) {
+    return false;
+  }
+  reportedPhase = phase;
+  lastReported = received;
+  return true;
+}
+
+static bool startDownload() {
+  http.setTimeout(OTA_HTTP_TIMEOUT);
+  if (!http.begin(httpsClient, request.url)) {
+    fail("bad_url");
+    return false;
+  }
+
+  watchdogEnterPhase("ota_connect");
+  int code = http.GET();
+  watchdogExitPhase();
+  if (code != HTTP_CODE_OK) {
+    Serial.print("[OTA] HTTP status ");
+    Serial.println(code);
+    fail("http_status");
+    return false;
+  }
+
+  int length = http.getSize();
+  if (request.size == 0 && length > 0) request.size = length;
+  if (request.size == 0 || (length > 0 && (uint32_t)length != request.size)) {
+    fail("size_mismatch");
+    return false;
+  }
+  return true;
+}
+
+// ==================== Public Functions ====================
+
+void initOta(const char* key) {
+  running = esp_ota_get_running_partition();
+  applyTrustStore(httpsClient);
+
+  mbedtls_pk_init(&signingKey);
+  if (key && mbedtls_pk_parse_public_key(&signingKey, (const unsigned char*)key, strlen(key) + 1) == 0 &&
+      mbedtls_pk_can_do(&signingKey, MBEDTLS_PK_ECKEY)) {
+    signingKeyLoaded = true;
+  } else {
+    Serial.println("[OTA] WARNING: no valid OTA_SIGNING_KEY, updates will be refused");
+  }
+
+  esp_ota_img_states_t state;
+  if (esp_ota_get_state_partition(running, &state) == ESP_OK && state == ESP_OTA_IMG_PENDING_VERIFY) {
+    pendingVerify = true;
+    Serial.print("[OTA] New image on ");
+    Serial.print(running->label);
+    Serial.println(" pending verification");
+  }
+}
+
+bool otaStart(const OtaRequest& req) {
+  if (phase == OTA_RECEIVING) otaAbort("restarted");
+  if (pendingVerify) {
+    // A second update would replace the image we would roll back to
+    lastError = "pending_verify";
+    phase = OTA_FAILED;
+    Serial.println("[OTA] ERROR: running image not confirmed yet");
+    return false;
+  }
+
+  request = req;
+  received = 0;
+  written = 0;
+  lastReported = 0;
+  lastError = "";
+  lastData = millis();
+  phase = OTA_RECEIVING;
+
+  // Checked before anything is erased; finish() checks it again over the written image
+  if (!signingKeyLoaded) {
+    fail("no_signing_key");
+    return false;
+  }
+  if (request.sigLen == 0) {
+    fail("unsigned");
+    return false;
+  }
+  if (!signatureValid(request.sha256)) {
+    fail("signature_invalid");
+    return false;
+  }
+
+  target = esp_ota_get_next_update_partition(nullptr);
+  if (!target) {
+    fail("no_partition");
+    return false;
+  }
+  if (!request.patch && request.size > target->size) {
+    fail("too_large");
+    return false;
+  }
+
+  // Sequential writes: sectors are erased as the image arrives, not all up front
+  if (esp_ota_begin(target, OTA_WITH_SEQUENTIAL_WRITES, &handle) != ESP_OK) {
+    handle = 0;
+    fail("ota_begin");
+    return false;
+  }
+  mbedtls_sha256_init(&imageSha);
+  mbedtls_sha256_starts(&imageSha, 0);
+
+  if (request.patch) {
+    DeltaCallbacks callbacks = { nullptr, patchHeader, patchRead, patchWrite };
+    decoder.begin(callbacks);
+  }
+
+  Serial.print("[OTA] Receiving ");
+  Serial.print(request.patch ? "patch" : "image");
+  Serial.print(request.url[0] != '\0' ? " over HTTPS into " : " over MQTT into ");
+  Serial.println(target->label);
+
+  if (request.url[0] != '\0' && !startDownload()) return false;
+  return true;
+}
+
+void otaAbort(const char* reason) {
+  if (phase != OTA_RECEIVING) return;
+  fail(reason);
+}
+
+bool otaReceiveChunk(const uint8_t* payload, unsigned int length) {
+  if (phase != OTA_RECEIVING || request.url[0] != '\0' || length < 4) return false;
+
+  uint32_t offset = ((uint32_t)payload[0] << 24) | ((uint32_t)payload[1] << 16) |
+                    ((uint32_t)payload[2] << 8) | payload[3];
+  if (offset != received) {
+    // Duplicates (sender rewound) are dropped quietly; a gap asks for a resend
+    return offset > received;
+  }
+
+  consume(payload + 4, length - 4);
+  return progressDue();
+}
+
+bool otaLoop(bool healthy) {
+  bool changed = false;
+
+  // Confirm the new image, or give up on it
+  if (pendingVerify) {
+    if (healthy && millis() >= OTA_CONFIRM_UPTIME) {
+      esp_ota_mark_app_valid_cancel_rollback();
+      pendingVerify = false;
+      changed = true;
+      Serial.println("[OTA] New image confirmed");
+    } else if (millis() >= OTA_CONFIRM_DEADLINE) {
+      Serial.println("[OTA] New image never came online, rolling back");
+      esp_ota_mark_app_invalid_rollback_and_reboot();
+    }
+  }
+
+  if (phase != OTA_RECEIVING) return changed;
+
+  if (request.url[0] != '\0') {
+    WiFiClient* stream = http.getStreamPtr();
+    uint8_t buf[1024];
+    uint32_t handled = 0;
+    while (phase == OTA_RECEIVING && handled < OTA_READ_BUDGET && stream->available() > 0) {
+      int n = stream->read(buf, sizeof(buf));
+      if (n <= 0) break;
+      consume(buf, n);
+      handled += n;
+    }
+    if (phase == OTA_RECEIVING && !stream->connected() && stream->available() == 0) {
+      fail("http_closed");
+    }
+  }
+
+  if (phase == OTA_RECEIVING && millis() - lastData > OTA_IDLE_TIMEOUT) {
+    fail("timeout");
+  }
+
+  return progressDue() || changed;
+}
+
+bool otaRebootDue() {
+  return phase == OTA_DONE && millis() - doneAt >= OTA_REBOOT_DELAY;
+}
+
+void getOtaStatus(OtaStatus* status) {
+  status->phase = phase;
+  status->https = request.url[0] != '\0';
+  status->patch = request.patch;
+  status->size = request.size;
+  status->offset = received;
+  status->written = written;
+  status->error = lastError;
+  status->partition = running ? running->label : "";
+  status->pendingVerify = pendingVerify;
+}
+
+const char* otaPhaseName(OtaPhase p) {
+  switch (p) {
+    case OTA_IDLE:      return "idle";
+    case OTA_RECEIVING: return "receiving";
+    case OTA_DONE:      return "done";
+    case OTA_FAILED:    return "failed";
+    default:            return "unknown";
+  }
+}
+
+bool otaParseSha256(const char* hex, uint8_t* out) {
+  return strlen(hex) == 64 && parseHex(hex, 32, out);
+}
+
+bool otaParseSignature(const char* hex, uint8_t* out, uint8_t* len) {
+  size_t digits = strlen(hex);
+  if (digits == 0 || digits % 2 != 0 || digits > OTA_SIG_MAX_LEN * 2 || !parseHex(hex, digits / 2, out)) {
+    return false;
+  }
+  *len = digits / 2;
+  return true;
+}
@@ -0,0 +1,78 @@
+/**
+ * @file pump_policy.cpp
+ * @brief Pump relay coalescing and minimum dwell implementation
+ */
+
+#include "pump_policy.h"
+
+// ==================== State Variables ====================
+static bool relayOn = false;
+static bool target = false;
+static bool pending = false;
+static uint32_t lastSwitch = 0;     // millis() of the last actuation (or boot)
+static PumpPolicyStatus counters = {};
+
+// ==================== Helper Functions ====================
+
+/**
+ * Time left before the relay may switch again
+ */
+static uint32_t holdRemaining() {
+  uint32_t hold = relayOn ? PUMP_MIN_ON_TIME : PUMP_MIN_OFF_TIME;
+  if (hold < PUMP_COALESCE_WINDOW) hold = PUMP_COALESCE_WINDOW;
+
+  uint32_t elapsed = millis() - lastSwitch;
+  return elapsed >= hold ? 0 : hold - elapsed;
+}
+
+// ==================== Public Functions ====================
+
+void initPumpPolicy(bool on) {
+  relayOn = on;
+  target = on;
+  pending = false;
+  lastSwitch = millis();
+}
+
+bool requestPump(bool on) {
+  counters.requests++;
+  if (pending) counters.superseded++;   // Previous intent never reached the relay
+
+  target = on;
+  pending = on != relayOn;
+  if (!pending) return false;
+
+  uint32_t hold = holdRemaining();
+  if (hold == 0) return true;
+
+  counters.deferred++;
+  Serial.print("[PUMP] Switch to ");
+  Serial.print(on ? "ON" : "OFF");
+  Serial.print(" held for ");
+  Serial.print(hold);
+  Serial.println(" ms (anti-short-cycle)");
+  return false;
+}
+
+bool pumpTarget() {
+  return target;
+}
+
+bool pollPumpSwitch(bool* on) {
+  if (!pending || holdRemaining() > 0) return false;
+
+  relayOn = target;
+  pending = false;
+  lastSwitch = millis();
+  counters.switches++;
+  *on = relayOn;
+  return true;
+}
+
+void getPumpPolicyStatus(PumpPolicyStatus* status) {
+  *status = counters;
+  status->relayOn = relayOn;
+  status->target = target;
+  status->pending = pending;
+  status->holdMs = pending ? holdRemaining() : 0;
+}
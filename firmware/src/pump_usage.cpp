@@ -0,0 +1,139 @@
+/**
+ * @file pump_usage.cpp
+ * @brief Pump usage accounting implementation
+ */
+
+#include "pump_usage.h"
+#include "config.h"
+#include "runtime_config.h"
+#include "time_sync.h"
+#include <time.h>
+
+#define SECONDS_PER_DAY  86400
+
+// ==================== State Variables ====================
+static PersistedUsage usage = {};
+static bool pumpOn = false;
+static int valveMode = 1;
+static uint32_t lastTickMs = 0;      // millis() runtime was accumulated up to
+static uint32_t pendingMs = 0;       // Runtime below one second, not counted yet
+static bool dirty = false;
+static uint32_t lastSaveMs = 0;
+static uint32_t offSinceMs = 0;
+
+// ==================== Helper Functions ====================
+
+static uint8_t modeIndex(int mode) {
+  return mode == 2 ? 1 : 0;
+}
+
+/**
+ * Add the runtime since the last call to the current mode
+ */
+static void accumulate() {
+  uint32_t now = millis();
+  uint32_t elapsed = now - lastTickMs;
+  lastTickMs = now;
+  if (!pumpOn) return;
+
+  pendingMs += elapsed;
+  if (pendingMs < 1000) return;
+
+  uint32_t seconds = pendingMs / 1000;
+  pendingMs %= 1000;
+  uint8_t i = modeIndex(valveMode);
+  usage.today.runtimeSeconds[i] += seconds;
+  usage.today.energyWs[i] += seconds * configValue(CFG_PUMP_WATTS);
+  dirty = true;
+}
+
+/**
+ * Local day number, 0 while the clock is not set
+ */
+static uint32_t currentDay() {
+  uint64_t epochMs = timeEpochMs();
+  if (epochMs == 0) return 0;
+  int64_t local = (int64_t)(epochMs / 1000) + LOCAL_UTC_OFFSET_MIN * 60;
+  return (uint32_t)(local / SECONDS_PER_DAY);
+}
+
+static void save() {
+  savePumpUsage(usage);
+  dirty = false;
+  lastSaveMs = millis();
+}
+
+// ==================== Public Functions ====================
+
+void initPumpUsage() {
+  if (loadPumpUsage(&usage)) {
+    char date[11];
+    Serial.print("[USAGE] Restored counters of ");
+    Serial.println(formatUsageDay(usage.today.day, date, sizeof(date)) ? date : "an unknown day");
+  }
+  lastTickMs = millis();
+  lastSaveMs = millis();
+  offSinceMs = millis();
+}
+
+void pumpUsageUpdate(bool on, int mode) {
+  accumulate();   // Up to now, in the previous mode
+
+  if (on && !pumpOn) {
+    usage.today.starts[modeIndex(mode)]++;
+    dirty = true;
+  }
+  if (!on && pumpOn) offSinceMs = millis();
+
+  pumpOn = on;
+  valveMode = mode;
+}
+
+bool pumpUsageLoop() {
+  accumulate();
+
+  bool closed = false;
+  uint32_t day = currentDay();
+  if (day != 0 && usage.today.day == 0) {
+    usage.today.day = day;   // Counted before the clock was set
+    dirty = true;
+  } else if (day != 0 && usage.today.day != day) {
+    char date[11];
+    formatUsageDay(usage.today.day, date, sizeof(date));
+    Serial.print("[USAGE] Closing day ");
+    Serial.println(date);
+
+    usage.lastDay = usage.today;
+    memset(&usage.today, 0, sizeof(usage.today));
+    usage.today.day = day;
+    save();
+    closed = true;
+  }
+
+  uint32_t now = millis();
+  if (dirty && (now - lastSaveMs >= USAGE_SAVE_INTERVAL ||
+                (!pumpOn && now - offSinceMs >= USAGE_SAVE_IDLE_DELAY))) {
+    save();
+  }
+  return closed;
+}
+
+void flushPumpUsage() {
+  accumulate();
+  if (dirty) save();
+}
+
+void getPumpUsage(PersistedUsageDay* today, PersistedUsageDay* lastDay) {
+  accumulate();
+  *today = usage.today;
+  *lastDay = usage.lastDay;
+}
+
+bool formatUsageDay(uint32_t day, char* out, size_t outLen) {
+  if (day == 0) return false;
+  time_t t = (time_t)day * SECONDS_PER_DAY;
+  struct tm parts;
+  gmtime_r(&t, &parts);
+  snprintf(out, outLen, "%04d-%02d-%02d", parts.tm_year + 1900, parts.tm_mon + 1, parts.tm_mday);
+  return true;
+}
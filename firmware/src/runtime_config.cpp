@@ -0,0 +1,113 @@
+/**
+ * @file runtime_config.cpp
+ * @brief Runtime settings registry implementation
+ */
+
+#include "runtime_config.h"
+#include "state_store.h"
+
+/**
+ * Registry: same order as ConfigKey
+ */
+static const ConfigEntry ENTRIES[CFG_KEY_COUNT] = {
+  //  name              type         default   min     max
+  { "wifi_state_ms",  CONFIG_UINT, 30000,    5000,   3600000  },
+  { "timer_pub_ms",   CONFIG_UINT, 10000,    1000,   300000   },
+  { "temp_pub_ms",    CONFIG_UINT, 60000,    5000,   3600000  },  // Min covers the sensor conversion
+  { "diag_pub_ms",    CONFIG_UINT, 300000,   30000,  86400000 },
+  { "wifi_retry_ms",  CONFIG_UINT, 10000,    1000,   600000   },
+  { "mqtt_retry_ms",  CONFIG_UINT, 5000,     1000,   600000   },
+  { "valve_delay_ms", CONFIG_UINT, 500,      100,    5000     },  // Blocking: keep well below the watchdog
+  { "telemetry_adapt", CONFIG_BOOL, 1,       0,      1        },
+  { "temp_fast_ms",   CONFIG_UINT, 20000,    5000,   600000   },
+  { "temp_idle_ms",   CONFIG_UINT, 300000,   60000,  3600000  },
+  { "rssi_delta_db",  CONFIG_UINT, 5,        1,      40       },
+  { "pump_watts",     CONFIG_UINT, 750,      50,     5000     },
+};
+
+// ==================== State Variables ====================
+static uint32_t values[CFG_KEY_COUNT];
+
+// ==================== Helper Functions ====================
+
+static bool inRange(const ConfigEntry& entry, uint32_t value) {
+  if (entry.type == CONFIG_BOOL) return value <= 1;
+  return value >= entry.minValue && value <= entry.maxValue;
+}
+
+// ==================== Public Functions ====================
+
+void initRuntimeConfig() {
+  for (int i = 0; i < CFG_KEY_COUNT; i++) {
+    const ConfigEntry& entry = ENTRIES[i];
+    values[i] = entry.defaultValue;
+
+    uint32_t saved;
+    if (!loadConfigValue(entry.name, &saved)) continue;
+    if (!inRange(entry, saved)) {
+      // Bounds changed in a newer firmware: the default is the safe choice
+      Serial.print("[CONFIG] Ignoring out-of-range ");
+      Serial.println(entry.name);
+      continue;
+    }
+    values[i] = saved;
+    Serial.print("[CONFIG] ");
+    Serial.print(entry.name);
+    Serial.print(" = ");
+    Serial.println(saved);
+  }
+}
+
+uint32_t configValue(ConfigKey key) {
+  return values[key];
+}
+
+const ConfigEntry& configEntry(ConfigKey key) {
+  return ENTRIES[key];
+}
+
+bool parseConfigValue(ConfigKey key, const char* text, uint32_t* value) {
+  const ConfigEntry& entry = ENTRIES[key];
+
+  if (entry.type == CONFIG_BOOL) {
+    if (strcmp(text, "true") == 0 || strcmp(text, "1") == 0) *value = 1;
+    else if (strcmp(text, "false") == 0 || strcmp(text, "0") == 0) *value = 0;
+    else return false;
+    return true;
+  }
+
+  // Digits only: no sign, no fraction, no overflow
+  if (*text == '\0' || strlen(text) > 10) return false;
+  uint64_t parsed = 0;
+  for (const char* c = text; *c; c++) {
+    if (!isdigit(*c)) return false;
+    parsed = parsed * 10 + (*c - '0');
+  }
+  if (parsed > UINT32_MAX || !inRange(entry, parsed)) return false;
+  *value = parsed;
+  return true;
+}
+
+bool setConfigValue(ConfigKey key, uint32_t value) {
+  if (values[key] == value) return false;
+  values[key] = value;
+
+  const ConfigEntry& entry = ENTRIES[key];
+  if (value == entry.defaultValue) {
+    removeConfigValue(entry.name);
+  } else {
+    saveConfigValue(entry.name, value);
+  }
+
+  Serial.print("[CONFIG] Set ");
+  Serial.print(entry.name);
+  Serial.print(" = ");
+  Serial.println(value);
+  return true;
+}
+
+void resetRuntimeConfig() {
+  for (int i = 0; i < CFG_KEY_COUNT; i++) {
+    setConfigValue((ConfigKey)i, ENTRIES[i].defaultValue);
+  }
+}
@@ -0,0 +1,268 @@
+/**
+ * @file state_store.cpp
+ * @brief RAM-cached persistent storage implementation (NVS via Preferences)
+ */
+
+#include "state_store.h"
+#include <Preferences.h>
+
+// ==================== NVS Layout ====================
+#define NVS_WIFI_NAMESPACE   "wifi"     // Keys: ssid, password
+#define NVS_STATE_NAMESPACE  "state"    // Key: actuators (StoredState blob)
+#define NVS_STATE_KEY        "actuators"
+#define STATE_LAYOUT_VERSION 2          // Bump when StoredState changes
+#define NVS_BROKER_NAMESPACE "broker"   // Key: endpoints (StoredBrokers blob)
+#define NVS_BROKER_KEY       "endpoints"
+#define BROKER_LAYOUT_VERSION 1         // Bump when PersistedBrokers changes
+#define NVS_CONFIG_NAMESPACE "config"   // One uint32 key per runtime setting
+#define NVS_USAGE_NAMESPACE  "usage"    // Key: days (StoredUsage blob)
+#define NVS_USAGE_KEY        "days"
+#define USAGE_LAYOUT_VERSION 1          // Bump when PersistedUsage changes
+
+/**
+ * On-flash representation of PersistedState (versioned)
+ */
+struct StoredState {
+  uint8_t version;
+  PersistedState state;
+};
+
+/**
+ * On-flash representation of PersistedBrokers (versioned)
+ */
+struct StoredBrokers {
+  uint8_t version;
+  PersistedBrokers config;
+};
+
+/**
+ * On-flash representation of PersistedUsage (versioned)
+ */
+struct StoredUsage {
+  uint8_t version;
+  PersistedUsage usage;
+};
+
+// ==================== State Variables ====================
+static Preferences preferences;
+
+static char cachedSSID[33] = "";
+static char cachedPassword[64] = "";
+
+static PersistedState cachedState = { false, 1, 0, {} };
+static PersistedBrokers cachedBrokers = {};
+static bool brokersSaved = false;           // cachedBrokers came from (or went to) NVS
+static PersistedUsage savedUsage = {};      // Last usage written (to skip identical writes)
+
+static bool stateDirty = false;
+static uint32_t dirtySince = 0;             // millis() of the first unsaved change
+
+// ==================== Helper Functions ====================
+
+static void markDirty() {
+  if (!stateDirty) {
+    stateDirty = true;
+    dirtySince = millis();
+  }
+}
+
+// ==================== Public Functions ====================
+
+void initStateStore() {
+  preferences.begin(NVS_WIFI_NAMESPACE, true); // read-only
+  preferences.getString("ssid", cachedSSID, sizeof(cachedSSID));
+  preferences.getString("password", cachedPassword, sizeof(cachedPassword));
+  preferences.end();
+
+  StoredState stored;
+  preferences.begin(NVS_STATE_NAMESPACE, true);
+  bool found = preferences.getBytesLength(NVS_STATE_KEY) == sizeof(stored) &&
+               preferences.getBytes(NVS_STATE_KEY, &stored, sizeof(stored)) == sizeof(stored) &&
+               stored.version == STATE_LAYOUT_VERSION;
+  preferences.end();
+
+  if (found && (stored.state.valveMode == 1 || stored.state.valveMode == 2) &&
+      stored.state.timerCount <= STATE_MAX_TIMERS) {
+    cachedState = stored.state;
+    Serial.print("[NVS] ✓ Restored state: pump=");
+    Serial.print(cachedState.pumpOn ? "ON" : "OFF");
+    Serial.print(", valve=");
+    Serial.print(cachedState.valveMode);
+    Serial.print(", timers=");
+    Serial.println(cachedState.timerCount);
+  } else {
+    Serial.println("[NVS] No saved actuator state, using defaults");
+  }
+
+  StoredBrokers brokers;
+  preferences.begin(NVS_BROKER_NAMESPACE, true);
+  brokersSaved = preferences.getBytesLength(NVS_BROKER_KEY) == sizeof(brokers) &&
+                 preferences.getBytes(NVS_BROKER_KEY, &brokers, sizeof(brokers)) == sizeof(brokers) &&
+                 brokers.version == BROKER_LAYOUT_VERSION &&
+                 brokers.config.selected < STATE_MAX_BROKERS;
+  preferences.end();
+  if (brokersSaved) cachedBrokers = brokers.config;
+}
+
+const PersistedState& getPersistedState() {
+  return cachedState;
+}
+
+void persistActuatorState(bool pumpOn, int valveMode) {
+  if (cachedState.pumpOn == pumpOn && cachedState.valveMode == valveMode) return;
+  cachedState.pumpOn = pumpOn;
+  cachedState.valveMode = valveMode;
+  markDirty();
+}
+
+void persistTimers(const PersistedTimer* timers, uint8_t count) {
+  if (count > STATE_MAX_TIMERS) count = STATE_MAX_TIMERS;
+  cachedState.timerCount = count;
+  memcpy(cachedState.timers, timers, count * sizeof(PersistedTimer));
+  markDirty();
+}
+
+void flushStateStore(bool force) {
+  if (!stateDirty) return;
+  if (!force && millis() - dirtySince < STATE_FLUSH_DELAY) return;
+
+  StoredState stored;
+  stored.version = STATE_LAYOUT_VERSION;
+  stored.state = cachedState;
+
+  preferences.begin(NVS_STATE_NAMESPACE, false);
+  size_t written = preferences.putBytes(NVS_STATE_KEY, &stored, sizeof(stored));
+  preferences.end();
+
+  stateDirty = false;
+  if (written != sizeof(stored)) {
+    Serial.println("[NVS] ERROR: failed to save actuator state");
+  }
+}
+
+bool loadWiFiCredentials(char* ssid, char* password) {
+  if (cachedSSID[0] == '\0') {
+    Serial.println("[NVS] No WiFi credentials stored");
+    return false;
+  }
+
+  strncpy(ssid, cachedSSID, 32);
+  ssid[32] = '\0';
+  strncpy(password, cachedPassword, 63);
+  password[63] = '\0';
+
+  Serial.print("[NVS] ✓ Loaded WiFi credentials for: ");
+  Serial.println(ssid);
+  return true;
+}
+
+void saveWiFiCredentials(const char* ssid, const char* password) {
+  // Skip the flash write when nothing changed (e.g. re-provisioning the same network)
+  if (strcmp(ssid, cachedSSID) == 0 && strcmp(password, cachedPassword) == 0) return;
+
+  preferences.begin(NVS_WIFI_NAMESPACE, false); // read-write
+  preferences.putString("ssid", ssid);
+  preferences.putString("password", password);
+  preferences.end();
+
+  strncpy(cachedSSID, ssid, 32);
+  cachedSSID[32] = '\0';
+  strncpy(cachedPassword, password, 63);
+  cachedPassword[63] = '\0';
+
+  Serial.print("[NVS] ✓ Saved WiFi credentials for: ");
+  Serial.println(ssid);
+}
+
+void clearWiFiCredentials() {
+  preferences.begin(NVS_WIFI_NAMESPACE, false);
+  preferences.clear();
+  preferences.end();
+
+  cachedSSID[0] = '\0';
+  cachedPassword[0] = '\0';
+  Serial.println("[NVS] WiFi credentials cleared");
+}
+
+bool loadBrokerConfig(PersistedBrokers* config) {
+  if (!brokersSaved) return false;
+  *config = cachedBrokers;
+  return true;
+}
+
+void saveBrokerConfig(const PersistedBrokers& config) {
+  if (brokersSaved && memcmp(&config, &cachedBrokers, sizeof(config)) == 0) return;
+
+  StoredBrokers stored;
+  stored.version = BROKER_LAYOUT_VERSION;
+  stored.config = config;
+
+  preferences.begin(NVS_BROKER_NAMESPACE, false);
+  size_t written = preferences.putBytes(NVS_BROKER_KEY, &stored, sizeof(stored));
+  preferences.end();
+
+  cachedBrokers = config;
+  brokersSaved = true;
+  if (written != sizeof(stored)) {
+    Serial.println("[NVS] ERROR: failed to save broker endpoints");
+    return;
+  }
+  Serial.println("[NVS] ✓ Saved broker endpoints");
+}
+
+bool loadConfigValue(const char* key, uint32_t* value) {
+  preferences.begin(NVS_CONFIG_NAMESPACE, true);
+  bool found = preferences.isKey(key);
+  if (found) *value = preferences.getUInt(key);
+  preferences.end();
+  return found;
+}
+
+void saveConfigValue(const char* key, uint32_t value) {
+  preferences.begin(NVS_CONFIG_NAMESPACE, false);
+  size_t written = preferences.putUInt(key, value);
+  preferences.end();
+
+  if (written != sizeof(value)) {
+    Serial.print("[NVS] ERROR: failed to save setting ");
+    Serial.println(key);
+  }
+}
+
+void removeConfigValue(const char* key) {
+  preferences.begin(NVS_CONFIG_NAMESPACE, false);
+  if (preferences.isKey(key)) preferences.remove(key);
+  preferences.end();
+}
+
+bool loadPumpUsage(PersistedUsage* usage) {
+  StoredUsage stored;
+  preferences.begin(NVS_USAGE_NAMESPACE, true);
+  bool found = preferences.getBytesLength(NVS_USAGE_KEY) == sizeof(stored) &&
+               preferences.getBytes(NVS_USAGE_KEY, &stored, sizeof(stored)) == sizeof(stored) &&
+               stored.version == USAGE_LAYOUT_VERSION;
+  preferences.end();
+
+  if (!found) return false;
+  *usage = stored.usage;
+  savedUsage = stored.usage;
+  return true;
+}
+
+void savePumpUsage(const PersistedUsage& usage) {
+  if (memcmp(&usage, &savedUsage, sizeof(usage)) == 0) return;
+
+  StoredUsage stored;
+  stored.version = USAGE_LAYOUT_VERSION;
+  stored.usage = usage;
+
+  preferences.begin(NVS_USAGE_NAMESPACE, false);
+  size_t written = preferences.putBytes(NVS_USAGE_KEY, &stored, sizeof(stored));
+  preferences.end();
+
+  if (written != sizeof(stored)) {
+    Serial.println("[NVS] ERROR: failed to save pump usage");
+    return;
+  }
+  savedUsage = usage;
+}
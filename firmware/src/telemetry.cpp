@@ -0,0 +1,149 @@
+/**
+ * @file telemetry.cpp
+ * @brief Telemetry scheduler and built-in strategies
+ */
+
+#include "telemetry.h"
+#include "runtime_config.h"
+
+#define TREND_SMOOTHING  0.5f   // Weight of the newest rate in the trend
+
+static const char* const STREAM_NAMES[TELEMETRY_STREAM_COUNT] = { "temperature", "wifi" };
+
+// ==================== State Variables ====================
+static FixedTelemetry defaultStrategy;
+static TelemetryStrategy* strategy = &defaultStrategy;
+static TelemetryContext context = { false, NAN, 0.0f, 0, {} };
+static bool seriesReady = false;
+static uint32_t lastTemperatureMs = 0;   // millis() of the last valid temperature sample
+
+// ==================== Helper Functions ====================
+
+/**
+ * Interval a fixed schedule uses (also the baseline for the saving)
+ */
+static uint32_t fixedInterval(TelemetryStream stream) {
+  return configValue(stream == TELEMETRY_TEMPERATURE ? CFG_TEMP_PUBLISH_INTERVAL : CFG_WIFI_STATE_INTERVAL);
+}
+
+static void initSeries() {
+  uint32_t now = millis();
+  for (int i = 0; i < TELEMETRY_STREAM_COUNT; i++) {
+    TelemetrySeries& s = context.series[i];
+    s.lastPublished = NAN;
+    s.lastSampleMs = now;
+    s.lastFixedMs = now;
+  }
+  seriesReady = true;
+}
+
+static void updateTemperatureContext(float value, uint32_t now) {
+  if (isnan(value)) return;
+
+  if (!isnan(context.lastTemperature)) {
+    uint32_t elapsed = now - lastTemperatureMs;
+    if (elapsed > 0) {
+      float rate = (value - context.lastTemperature) * 60000.0f / elapsed;
+      context.tempTrend = TREND_SMOOTHING * rate + (1.0f - TREND_SMOOTHING) * context.tempTrend;
+    }
+    bool stable = fabsf(value - context.lastTemperature) < TELEMETRY_STABLE_DELTA;
+    context.stableSamples = stable ? min(context.stableSamples + 1, 255) : 0;
+  }
+  context.lastTemperature = value;
+  lastTemperatureMs = now;
+}
+
+// ==================== Strategies ====================
+
+uint32_t FixedTelemetry::interval(TelemetryStream stream, const TelemetryContext&) const {
+  return fixedInterval(stream);
+}
+
+bool FixedTelemetry::worthPublishing(TelemetryStream, float, const TelemetryContext&) const {
+  return true;
+}
+
+uint32_t AdaptiveTelemetry::interval(TelemetryStream stream, const TelemetryContext& ctx) const {
+  if (stream == TELEMETRY_WIFI) return configValue(CFG_WIFI_STATE_INTERVAL);   // Cheap: only RSSI is read
+
+  if (ctx.pumpOn || fabsf(ctx.tempTrend) >= TELEMETRY_FAST_TREND) {
+    return configValue(CFG_TEMP_FAST_INTERVAL);
+  }
+
+  // Idle and stable: double the interval per stable sample, up to temp_idle_ms
+  uint32_t idle = configValue(CFG_TEMP_IDLE_INTERVAL);
+  uint32_t interval = configValue(CFG_TEMP_PUBLISH_INTERVAL);
+  for (uint8_t i = 0; i < ctx.stableSamples && interval < idle; i++) interval *= 2;
+  return interval < idle ? interval : idle;
+}
+
+bool AdaptiveTelemetry::worthPublishing(TelemetryStream stream, float value, const TelemetryContext& ctx) const {
+  if (stream == TELEMETRY_TEMPERATURE) return true;   // The interval already adapts
+
+  const TelemetrySeries& s = ctx.series[stream];
+  if (isnan(s.lastPublished) || millis() - s.lastPublishMs >= TELEMETRY_MAX_SILENCE) return true;
+  return fabsf(value - s.lastPublished) >= configValue(CFG_RSSI_DELTA);
+}
+
+// ==================== Public Functions ====================
+
+void setTelemetryStrategy(TelemetryStrategy* next) {
+  if (!next || next == strategy) return;
+  strategy = next;
+  Serial.print("[TELEMETRY] Strategy: ");
+  Serial.println(strategy->name());
+}
+
+void setTelemetryPumpState(bool on) {
+  context.pumpOn = on;
+}
+
+bool telemetrySampleDue(TelemetryStream stream) {
+  if (!seriesReady) initSeries();
+
+  uint32_t now = millis();
+  TelemetrySeries& s = context.series[stream];
+
+  // Baseline: what the fixed intervals would have published by now
+  if (now - s.lastFixedMs >= fixedInterval(stream)) {
+    s.fixedEquivalent++;
+    s.lastFixedMs = now;
+  }
+
+  // Re-evaluated every call: a pump start shortens a long idle wait at once
+  if (now - s.lastSampleMs < strategy->interval(stream, context)) return false;
+  s.lastSampleMs = now;
+  return true;
+}
+
+bool telemetryOffer(TelemetryStream stream, float value) {
+  if (!seriesReady) initSeries();
+
+  bool publish = strategy->worthPublishing(stream, value, context);
+
+  if (stream == TELEMETRY_TEMPERATURE) updateTemperatureContext(value, millis());
+  context.series[stream].samples++;
+  return publish;
+}
+
+void telemetryPublished(TelemetryStream stream, float value) {
+  TelemetrySeries& s = context.series[stream];
+  s.sent++;
+  s.lastPublished = value;
+  s.lastPublishMs = millis();
+}
+
+void getTelemetryStats(TelemetryStats* stats) {
+  stats->strategy = strategy->name();
+  for (int i = 0; i < TELEMETRY_STREAM_COUNT; i++) {
+    const TelemetrySeries& s = context.series[i];
+    stats->intervalMs[i] = strategy->interval((TelemetryStream)i, context);
+    stats->samples[i] = s.samples;
+    stats->sent[i] = s.sent;
+    stats->fixedEquivalent[i] = s.fixedEquivalent;
+  }
+}
+
+const char* telemetryStreamName(uint8_t stream) {
+  return stream < TELEMETRY_STREAM_COUNT ? STREAM_NAMES[stream] : "unknown";
+}
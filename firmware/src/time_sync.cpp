@@ -0,0 +1,128 @@
+/**
+ * @file time_sync.cpp
+ * @brief Background SNTP and epoch timestamps implementation
+ */
+
+#include "time_sync.h"
+#include <atomic>
+#include <esp_sntp.h>
+#include <esp_timer.h>
+#include <sys/time.h>
+
+#define DRIFT_SMOOTHING      0.3f    // Weight of the newest drift measurement
+#define DRIFT_MAX_STEP_US    1000000 // Larger steps are clock jumps, not drift
+
+// ==================== State Variables ====================
+// Written by the SNTP callback (lwIP task), consumed by timeSyncLoop()
+static volatile int64_t pendingEpochUs = 0;
+static volatile int64_t pendingMonoUs = 0;
+static std::atomic<bool> syncPending(false);
+
+static bool started = false;
+static uint32_t startMs = 0;
+static bool anchored = false;
+static int64_t anchorEpochUs = 0;    // Server time at the last sync
+static int64_t anchorMonoUs = 0;     // esp_timer_get_time() at the last sync
+static uint32_t syncCount = 0;
+static int32_t lastCorrectionMs = 0;
+static float driftPpm = 0.0f;
+static bool driftKnown = false;
+
+// ==================== Helper Functions ====================
+
+/**
+ * SNTP callback (lwIP task): only records the sync
+ */
+static void onSntpSync(struct timeval* tv) {
+  pendingEpochUs = (int64_t)tv->tv_sec * 1000000LL + tv->tv_usec;
+  pendingMonoUs = esp_timer_get_time();
+  syncPending.store(true);
+}
+
+/**
+ * Epoch estimate (µs) from the last sync, corrected for the drift
+ */
+static int64_t anchoredEpochUs(int64_t monoUs) {
+  int64_t elapsed = monoUs - anchorMonoUs;
+  return anchorEpochUs + elapsed - (int64_t)(elapsed * (driftPpm / 1e6f));
+}
+
+static void applySync(int64_t epochUs, int64_t monoUs) {
+  if (anchored) {
+    int64_t span = monoUs - anchorMonoUs;
+    int64_t correction = epochUs - anchoredEpochUs(monoUs);
+    lastCorrectionMs = (int32_t)(correction / 1000);
+
+    // Residual error over the span is the drift not yet corrected for
+    if (span >= (int64_t)TIME_DRIFT_MIN_SPAN * 1000 && llabs(correction) < DRIFT_MAX_STEP_US) {
+      float measured = driftPpm - (float)correction * 1e6f / span;
+      driftPpm = driftKnown ? DRIFT_SMOOTHING * measured + (1.0f - DRIFT_SMOOTHING) * driftPpm : measured;
+      driftKnown = true;
+    }
+  }
+
+  anchorEpochUs = epochUs;
+  anchorMonoUs = monoUs;
+  anchored = true;
+  syncCount++;
+
+  Serial.print("[TIME] Synced epoch ");
+  Serial.print((long)(epochUs / 1000000));
+  Serial.print(", correction ");
+  Serial.print(lastCorrectionMs);
+  Serial.print(" ms, drift ");
+  Serial.print(driftPpm, 1);
+  Serial.println(" ppm");
+}
+
+// ==================== Public Functions ====================
+
+void initTimeSync() {
+  if (started) return;
+  started = true;
+  startMs = millis();
+
+  sntp_set_time_sync_notification_cb(onSntpSync);
+  sntp_set_sync_interval(TIME_RESYNC_INTERVAL);
+  configTime(0, 0, TIME_SYNC_SERVER_1, TIME_SYNC_SERVER_2);
+  Serial.println("[TIME] SNTP started in background");
+}
+
+bool timeSyncLoop() {
+  if (!syncPending.exchange(false)) return false;
+  applySync(pendingEpochUs, pendingMonoUs);
+  return true;
+}
+
+bool timeIsValid() {
+  return timeEpochMs() != 0;
+}
+
+bool timeSyncSettled() {
+  if (timeIsValid()) return true;
+  return started && millis() - startMs >= TIME_SYNC_WAIT;
+}
+
+uint64_t timeEpochMs() {
+  if (anchored) return anchoredEpochUs(esp_timer_get_time()) / 1000;
+
+  // Not synced this boot: the RTC keeps the clock across a software restart
+  struct timeval tv;
+  gettimeofday(&tv, nullptr);
+  if (tv.tv_sec < TIME_MIN_VALID_EPOCH) return 0;
+  return (uint64_t)tv.tv_sec * 1000ULL + tv.tv_usec / 1000;
+}
+
+uint64_t timeEpochMsAt(uint32_t stampMs) {
+  uint64_t now = timeEpochMs();
+  if (now == 0) return 0;
+  return now - (uint32_t)(millis() - stampMs);
+}
+
+void getTimeSyncStatus(TimeSyncStatus* status) {
+  status->valid = timeIsValid();
+  status->syncs = syncCount;
+  status->sinceSyncMs = anchored ? (uint32_t)((esp_timer_get_time() - anchorMonoUs) / 1000) : 0;
+  status->lastCorrectionMs = lastCorrectionMs;
+  status->driftPpm = driftPpm;
+}
@@ -0,0 +1,256 @@
+/**
+ * @file timer_engine.cpp
+ * @brief Deadline-based timer engine implementation
+ */
+
+#include "timer_engine.h"
+#include <esp_timer.h>
+#include <time.h>
+#include "time_sync.h"
+
+#define US_PER_SECOND        1000000LL
+
+/**
+ * One running timer
+ */
+struct TimerSlot {
+  char name[TIMER_NAME_LEN];
+  uint8_t mode;
+  uint32_t durationSeconds;
+  int64_t deadlineUs;     // esp_timer_get_time() at which the timer expires
+  int64_t wallDeadline;   // Epoch seconds, 0 if not known yet
+  bool anchored;          // deadlineUs was derived from / agrees with wallDeadline
+};
+
+// ==================== State Variables ====================
+static TimerSlot slots[TIMER_MAX_COUNT];   // Compact: entries [0, slotCount) are valid
+static int slotCount = 0;
+static int64_t lastCheckpointUs = 0;
+
+// ==================== Helper Functions ====================
+
+static uint32_t remainingSeconds(const TimerSlot& slot, int64_t nowUs) {
+  int64_t left = slot.deadlineUs - nowUs;
+  if (left <= 0) return 0;
+  return (uint32_t)((left + US_PER_SECOND - 1) / US_PER_SECOND);  // Round up
+}
+
+static void toInfo(const TimerSlot& slot, int64_t nowUs, TimerInfo* info) {
+  memcpy(info->name, slot.name, TIMER_NAME_LEN);
+  info->mode = slot.mode;
+  info->durationSeconds = slot.durationSeconds;
+  info->remainingSeconds = remainingSeconds(slot, nowUs);
+}
+
+static int findSlot(const char* name) {
+  for (int i = 0; i < slotCount; i++) {
+    if (strncmp(slots[i].name, name, TIMER_NAME_LEN) == 0) return i;
+  }
+  return -1;
+}
+
+static void removeSlot(int index) {
+  for (int i = index; i < slotCount - 1; i++) slots[i] = slots[i + 1];
+  slotCount--;
+}
+
+static bool wallClockValid(time_t* now) {
+  *now = time(nullptr);
+  return *now >= TIME_MIN_VALID_EPOCH;
+}
+
+/**
+ * Hand the current timer set to the state store
+ */
+static void persistSlots() {
+  PersistedTimer persisted[TIMER_MAX_COUNT];
+  int64_t nowUs = esp_timer_get_time();
+
+  for (int i = 0; i < slotCount; i++) {
+    memcpy(persisted[i].name, slots[i].name, TIMER_NAME_LEN);
+    persisted[i].mode = slots[i].mode;
+    persisted[i].durationSeconds = slots[i].durationSeconds;
+    persisted[i].remainingSeconds = remainingSeconds(slots[i], nowUs);
+    persisted[i].wallDeadline = slots[i].wallDeadline;
+  }
+  persistTimers(persisted, slotCount);
+  lastCheckpointUs = nowUs;
+}
+
+// ==================== Public Functions ====================
+
+void initTimerEngine() {
+  const PersistedState& saved = getPersistedState();
+  int64_t nowUs = esp_timer_get_time();
+
+  slotCount = 0;
+  for (int i = 0; i < saved.timerCount && i < TIMER_MAX_COUNT; i++) {
+    const PersistedTimer& p = saved.timers[i];
+    if (p.remainingSeconds == 0 || (p.mode != 1 && p.mode != 2)) continue;
+
+    TimerSlot& slot = slots[slotCount++];
+    memcpy(slot.name, p.name, TIMER_NAME_LEN);
+    slot.name[TIMER_NAME_LEN - 1] = '\0';
+    slot.mode = p.mode;
+    slot.durationSeconds = p.durationSeconds;
+    slot.deadlineUs = nowUs + (int64_t)p.remainingSeconds * US_PER_SECOND;
+    slot.wallDeadline = p.wallDeadline;
+    slot.anchored = false;
+
+    Serial.print("[TIMER] Restored '");
+    Serial.print(slot.name);
+    Serial.print("': ");
+    Serial.print(p.remainingSeconds);
+    Serial.println("s remaining (last checkpoint)");
+  }
+  lastCheckpointUs = nowUs;
+
+  // Drop timers that finished on their last checkpoint
+  if (slotCount != saved.timerCount) persistSlots();
+
+  // The RTC keeps the wall clock across a software reset: correct right away
+  anchorTimersToWallClock();
+}
+
+bool startNamedTimer(const char* name, int mode, uint32_t durationSeconds) {
+  if (mode != 1 && mode != 2) {
+    Serial.println("[TIMER] ERROR: Invalid mode. Use 1 or 2");
+    return false;
+  }
+  if (durationSeconds == 0) {
+    Serial.println("[TIMER] ERROR: Duration must be > 0");
+    return false;
+  }
+
+  char key[TIMER_NAME_LEN];
+  strncpy(key, (name && name[0]) ? name : TIMER_DEFAULT_NAME, TIMER_NAME_LEN - 1);
+  key[TIMER_NAME_LEN - 1] = '\0';
+
+  int index = findSlot(key);
+  if (index < 0) {
+    if (slotCount >= TIMER_MAX_COUNT) {
+      Serial.println("[TIMER] ERROR: All timer slots in use");
+      return false;
+    }
+    index = slotCount++;
+  }
+
+  TimerSlot& slot = slots[index];
+  memcpy(slot.name, key, TIMER_NAME_LEN);
+  slot.mode = mode;
+  slot.durationSeconds = durationSeconds;
+  slot.deadlineUs = esp_timer_get_time() + (int64_t)durationSeconds * US_PER_SECOND;
+
+  time_t now;
+  slot.anchored = wallClockValid(&now);
+  slot.wallDeadline = slot.anchored ? (int64_t)now + durationSeconds : 0;
+
+  persistSlots();
+  return true;
+}
+
+bool cancelNamedTimer(const char* name) {
+  int index = findSlot((name && name[0]) ? name : TIMER_DEFAULT_NAME);
+  if (index < 0) return false;
+
+  removeSlot(index);
+  persistSlots();
+  return true;
+}
+
+void cancelAllTimers() {
+  if (slotCount == 0) return;
+  slotCount = 0;
+  persistSlots();
+}
+
+int activeTimerCount() {
+  return slotCount;
+}
+
+bool getTimerInfo(int index, TimerInfo* info) {
+  if (index < 0 || index >= slotCount) return false;
+  toInfo(slots[index], esp_timer_get_time(), info);
+  return true;
+}
+
+bool getPrimaryTimer(TimerInfo* info) {
+  if (slotCount == 0) return false;
+
+  int latest = 0;
+  for (int i = 1; i < slotCount; i++) {
+    if (slots[i].deadlineUs > slots[latest].deadlineUs) latest = i;
+  }
+  toInfo(slots[latest], esp_timer_get_time(), info);
+  return true;
+}
+
+bool pollExpiredTimer(TimerInfo* info) {
+  int64_t nowUs = esp_timer_get_time();
+
+  for (int i = 0; i < slotCount; i++) {
+    if (slots[i].deadlineUs <= nowUs) {
+      toInfo(slots[i], nowUs, info);
+      removeSlot(i);
+      persistSlots();
+      return true;
+    }
+  }
+  return false;
+}
+
+uint32_t msUntilNextExpiry() {
+  if (slotCount == 0) return UINT32_MAX;
+
+  int64_t earliest = slots[0].deadlineUs;
+  for (int i = 1; i < slotCount; i++) {
+    if (slots[i].deadlineUs < earliest) earliest = slots[i].deadlineUs;
+  }
+  int64_t left = earliest - esp_timer_get_time();
+  if (left <= 0) return 0;
+  return (uint32_t)((left + 999) / 1000);   // Round up: waking early would only wait again
+}
+
+void anchorTimersToWallClock() {
+  time_t now;
+  if (!wallClockValid(&now)) return;
+
+  int64_t nowUs = esp_timer_get_time();
+  bool changed = false;
+
+  for (int i = 0; i < slotCount; i++) {
+    TimerSlot& slot = slots[i];
+    if (slot.anchored) continue;
+
+    if (slot.wallDeadline != 0) {
+      // Restored from a previous boot: the wall deadline already covers the downtime
+      int64_t left = slot.wallDeadline - (int64_t)now;
+      slot.deadlineUs = nowUs + (left > 0 ? left : 0) * US_PER_SECOND;
+      Serial.print("[TIMER] Anchored '");
+      Serial.print(slot.name);
+      Serial.print("' to wall clock: ");
+      Serial.print((long)(left > 0 ? left : 0));
+      Serial.println("s remaining");
+    } else {
+      slot.wallDeadline = (int64_t)now + remainingSeconds(slot, nowUs);
+    }
+    slot.anchored = true;
+    changed = true;
+  }
+
+  if (changed) persistSlots();
+}
+
+void checkpointTimers() {
+  int64_t nowUs = esp_timer_get_time();
+  if (nowUs - lastCheckpointUs < (int64_t)TIMER_CHECKPOINT_INTERVAL * US_PER_SECOND) return;
+  lastCheckpointUs = nowUs;
+
+  // Anchored deadlines are absolute: persisting their progress would only wear flash
+  for (int i = 0; i < slotCount; i++) {
+    if (!slots[i].anchored) {
+      persistSlots();
+      return;
+    }
+  }
+}
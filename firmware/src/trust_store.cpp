@@ -0,0 +1,80 @@
+/**
+ * @file trust_store.cpp
+ * @brief Embedded certificate bundle validation and installation
+ */
+
+#include "trust_store.h"
+#include <WiFiClientSecure.h>
+#include "ca_cert.h"
+
+// Linker symbols for board_build.embed_files = data/cert/x509_crt_bundle.bin
+extern const uint8_t certBundleStart[] asm("_binary_data_cert_x509_crt_bundle_bin_start");
+extern const uint8_t certBundleEnd[] asm("_binary_data_cert_x509_crt_bundle_bin_end");
+
+#define BUNDLE_HEADER_LEN   2   // Certificate count (big endian)
+#define ENTRY_HEADER_LEN    4   // Subject length + public key length (big endian)
+
+// ==================== Helper Functions ====================
+
+static uint16_t readU16(const uint8_t* p) {
+  return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+/**
+ * Walk the bundle once at boot
+ * The lookup trusts the layout blindly, so check the entries fit the blob and
+ * are sorted by subject (the binary search misses anchors otherwise).
+ * @return Certificate count, 0 if the bundle is unusable
+ */
+static uint16_t validateBundle(const uint8_t* start, const uint8_t* end) {
+  size_t size = end - start;
+  if (size < BUNDLE_HEADER_LEN) return 0;
+
+  uint16_t count = readU16(start);
+  size_t offset = BUNDLE_HEADER_LEN;
+  const uint8_t* prevName = nullptr;
+  uint16_t prevLen = 0;
+
+  for (uint16_t i = 0; i < count; i++) {
+    if (offset + ENTRY_HEADER_LEN > size) return 0;
+    uint16_t nameLen = readU16(start + offset);
+    uint16_t keyLen = readU16(start + offset + 2);
+    const uint8_t* name = start + offset + ENTRY_HEADER_LEN;
+    offset += ENTRY_HEADER_LEN + nameLen + keyLen;
+    if (offset > size) return 0;
+
+    if (prevName) {
+      int cmp = memcmp(prevName, name, min(prevLen, nameLen));
+      if (cmp > 0 || (cmp == 0 && prevLen > nameLen)) {
+        Serial.println("[TLS] ERROR: Certificate bundle not sorted by subject");
+        return 0;
+      }
+    }
+    prevName = name;
+    prevLen = nameLen;
+  }
+  return count;
+}
+
+// ==================== Public Functions ====================
+
+uint16_t applyTrustStore(WiFiClientSecure& client) {
+#if TLS_USE_CERT_BUNDLE
+  uint16_t count = validateBundle(certBundleStart, certBundleEnd);
+  if (count > 0) {
+    client.setCACertBundle(certBundleStart);
+    Serial.print("[TLS] Trust store: ");
+    Serial.print(count);
+    Serial.print(" root CAs from embedded bundle (");
+    Serial.print((unsigned long)(certBundleEnd - certBundleStart));
+    Serial.println(" bytes)");
+    return count;
+  }
+  Serial.println("[TLS] WARNING: Embedded certificate bundle unusable, using pinned root CA");
+#endif
+
+  // Load root CA so ESP32 can validate broker certificate
+  client.setCACert(LETS_ENCRYPT_ISRG_ROOT_X1);
+  Serial.println("[TLS] Trust store: pinned ISRG Root X1");
+  return 1;
+}
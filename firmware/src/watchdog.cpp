@@ -0,0 +1,204 @@
+/**
+ * @file watchdog.cpp
+ * @brief Heartbeat watchdog and stall recorder implementation
+ */
+
+#include "watchdog.h"
+#include <esp_attr.h>
+#include <esp_system.h>
+#include <esp_task_wdt.h>
+
+#define RTC_RECORD_MAGIC  0x57445431UL   // "WDT1": bump when RtcRecord changes
+
+/**
+ * Survives software, panic and watchdog resets (not power loss)
+ */
+struct RtcRecord {
+  uint32_t magic;
+  StallRecord longest;                // Longest stall of the running boot
+  char phase[WATCHDOG_PHASE_LEN];     // Phase running right now ("" = none)
+};
+
+/**
+ * Heartbeat bookkeeping for one subsystem
+ */
+struct Heartbeat {
+  bool monitored;
+  bool overdue;           // Current miss already counted
+  uint32_t last;          // millis() of the last heartbeat
+};
+
+static const char* const SUBSYSTEM_NAMES[WDT_SUBSYSTEM_COUNT] = { "network", "control", "sensor", "ble" };
+static const uint32_t DEADLINES[WDT_SUBSYSTEM_COUNT] = {
+  WATCHDOG_NETWORK_DEADLINE, WATCHDOG_CONTROL_DEADLINE, WATCHDOG_SENSOR_DEADLINE, WATCHDOG_BLE_DEADLINE
+};
+
+// ==================== State Variables ====================
+RTC_NOINIT_ATTR static RtcRecord rtcRecord;
+
+static WatchdogReport report = {};
+static Heartbeat heartbeats[WDT_SUBSYSTEM_COUNT];
+
+static const char* phaseStack[WATCHDOG_PHASE_DEPTH];
+static uint32_t phaseStart[WATCHDOG_PHASE_DEPTH];
+static uint8_t phaseDepth = 0;
+
+static uint32_t iterationStart = 0;
+static const char* iterationPhase = nullptr;   // Longest phase finished in this iteration
+static uint32_t iterationPhaseMs = 0;
+
+// ==================== Helper Functions ====================
+
+static const char* resetReasonName(esp_reset_reason_t reason) {
+  switch (reason) {
+    case ESP_RST_POWERON:  return "power_on";
+    case ESP_RST_EXT:      return "external";
+    case ESP_RST_SW:       return "software";
+    case ESP_RST_PANIC:    return "panic";
+    case ESP_RST_INT_WDT:  return "interrupt_wdt";
+    case ESP_RST_TASK_WDT: return "task_wdt";
+    case ESP_RST_WDT:      return "other_wdt";
+    case ESP_RST_DEEPSLEEP: return "deep_sleep";
+    case ESP_RST_BROWNOUT: return "brownout";
+    default:               return "unknown";
+  }
+}
+
+static void copyPhase(char* dest, const char* phase) {
+  strncpy(dest, phase ? phase : "", WATCHDOG_PHASE_LEN - 1);
+  dest[WATCHDOG_PHASE_LEN - 1] = '\0';
+}
+
+/**
+ * Keep the phase that is running now in RTC memory (blamed if the chip resets)
+ */
+static void storeCurrentPhase() {
+  copyPhase(rtcRecord.phase, phaseDepth > 0 ? phaseStack[phaseDepth - 1] : "");
+}
+
+static void recordStall(const char* phase, uint32_t durationMs) {
+  report.stalls++;
+
+  Serial.print("[WDT] Stall: ");
+  Serial.print(durationMs);
+  Serial.print(" ms in ");
+  Serial.println(phase);
+
+  if (durationMs <= report.longest.durationMs) return;
+  report.longest.durationMs = durationMs;
+  copyPhase(report.longest.phase, phase);
+  report.longest.uptimeSeconds = millis() / 1000;
+  rtcRecord.longest = report.longest;
+}
+
+// ==================== Public Functions ====================
+
+void initWatchdog() {
+  esp_reset_reason_t reason = esp_reset_reason();
+  report.resetReason = resetReasonName(reason);
+
+  // RTC memory is random after power loss: only trust a record carrying the magic
+  if (reason != ESP_RST_POWERON && reason != ESP_RST_BROWNOUT && rtcRecord.magic == RTC_RECORD_MAGIC) {
+    report.previous = rtcRecord.longest;
+    report.previous.phase[WATCHDOG_PHASE_LEN - 1] = '\0';
+    rtcRecord.phase[WATCHDOG_PHASE_LEN - 1] = '\0';
+
+    // The task watchdog fired inside a phase: that hang outlasts any recorded stall
+    if (reason == ESP_RST_TASK_WDT && rtcRecord.phase[0] != '\0' &&
+        report.previous.durationMs < WATCHDOG_TIMEOUT_S * 1000UL) {
+      report.previous.durationMs = WATCHDOG_TIMEOUT_S * 1000UL;
+      copyPhase(report.previous.phase, rtcRecord.phase);
+      report.previous.uptimeSeconds = 0;   // Unknown
+    }
+  }
+
+  Serial.print("[WDT] Reset reason: ");
+  Serial.println(report.resetReason);
+  if (report.previous.durationMs > 0) {
+    Serial.print("[WDT] Previous boot longest stall: ");
+    Serial.print(report.previous.durationMs);
+    Serial.print(" ms in ");
+    Serial.println(report.previous.phase);
+  }
+
+  memset(&rtcRecord, 0, sizeof(rtcRecord));
+  rtcRecord.magic = RTC_RECORD_MAGIC;
+
+  // Reconfigure the task watchdog (the core starts it for the idle tasks) and watch the loop task
+  esp_task_wdt_init(WATCHDOG_TIMEOUT_S, true /*panic -> reset*/);
+  esp_task_wdt_add(nullptr);
+
+  iterationStart = millis();
+}
+
+void watchdogEnterPhase(const char* phase) {
+  esp_task_wdt_reset();
+  if (phaseDepth >= WATCHDOG_PHASE_DEPTH) return;
+  phaseStack[phaseDepth] = phase;
+  phaseStart[phaseDepth] = millis();
+  phaseDepth++;
+  storeCurrentPhase();
+}
+
+void watchdogExitPhase() {
+  esp_task_wdt_reset();
+  if (phaseDepth == 0) return;
+  phaseDepth--;
+
+  uint32_t elapsed = millis() - phaseStart[phaseDepth];
+  if (elapsed > iterationPhaseMs) {
+    iterationPhaseMs = elapsed;
+    iterationPhase = phaseStack[phaseDepth];
+  }
+  storeCurrentPhase();
+}
+
+void watchdogHeartbeat(WatchdogSubsystem subsystem) {
+  Heartbeat& hb = heartbeats[subsystem];
+  hb.last = millis();
+  if (hb.overdue) {
+    Serial.print("[WDT] ");
+    Serial.print(SUBSYSTEM_NAMES[subsystem]);
+    Serial.println(" heartbeat resumed");
+  }
+  hb.monitored = true;
+  hb.overdue = false;
+}
+
+void watchdogIdle(WatchdogSubsystem subsystem) {
+  heartbeats[subsystem].monitored = false;
+  heartbeats[subsystem].overdue = false;
+}
+
+void watchdogLoop() {
+  esp_task_wdt_reset();
+
+  uint32_t now = millis();
+  uint32_t iteration = now - iterationStart;
+  if (iteration > WATCHDOG_STALL_MIN) {
+    recordStall(iterationPhase ? iterationPhase : "loop", iteration);
+  }
+  iterationStart = now;
+  iterationPhase = nullptr;
+  iterationPhaseMs = 0;
+
+  for (uint8_t i = 0; i < WDT_SUBSYSTEM_COUNT; i++) {
+    Heartbeat& hb = heartbeats[i];
+    if (!hb.monitored || hb.overdue || now - hb.last <= DEADLINES[i]) continue;
+    hb.overdue = true;
+    report.missed[i]++;
+    Serial.print("[WDT] WARNING: ");
+    Serial.print(SUBSYSTEM_NAMES[i]);
+    Serial.print(" heartbeat missed (");
+    Serial.print(now - hb.last);
+    Serial.println(" ms)");
+  }
+}
+
+void getWatchdogReport(WatchdogReport* out) {
+  *out = report;
+}
+
+const char* watchdogSubsystemName(uint8_t subsystem) {
+  return subsystem < WDT_SUBSYSTEM_COUNT ? SUBSYSTEM_NAMES[subsystem] : "unknown";
+}
@@ -0,0 +1,318 @@
+/**
+ * @file wifi_survey.cpp
+ * @brief Background scan scheduler, access point table and roam selection
+ */
+
+#include "wifi_survey.h"
+#include <WiFi.h>
+#include <atomic>
+
+#define WIFI_SURVEY_SETTLE  60000   // First connected scan this long after joining (ms)
+
+/**
+ * One access point (BSSID)
+ */
+struct SurveyEntry {
+  bool used;
+  char ssid[33];                        // "" for hidden networks
+  uint8_t bssid[6];
+  uint8_t channel;
+  bool open;
+  int8_t rssi[WIFI_SURVEY_HISTORY];     // Newest first
+  uint8_t samples;                      // Valid readings in rssi
+  uint32_t lastSeen;                    // millis()
+  uint32_t lastScan;                    // Number of the last scan that saw it
+  uint32_t skipUntil;                   // Roam backoff (millis()), valid if skip
+  bool skip;
+};
+
+// ==================== State Variables ====================
+static SurveyEntry table[WIFI_SURVEY_ENTRIES];       // Written by the main loop under tableLock
+static SemaphoreHandle_t tableLock = nullptr;
+static std::atomic<uint32_t> scanCount(0);
+static std::atomic<bool> scanRequested(false);
+static uint32_t lastScanDone = 0;                    // millis() of the last completed scan (under tableLock)
+static bool scanRunning = false;
+static bool scanPassive = false;
+static uint32_t scanStart = 0;
+static uint32_t nextScan = 0;
+static WifiSurveyMode lastMode = WIFI_SURVEY_PAUSED;
+static uint8_t failStreak = 0;
+static bool roamCheckPending = false;
+static bool roamedOnce = false;
+static uint32_t lastRoam = 0;
+static WiFiSurveyStats stats = {};
+
+// ==================== Helper Functions ====================
+
+static int findEntry(const uint8_t* bssid) {
+  for (int i = 0; i < WIFI_SURVEY_ENTRIES; i++) {
+    if (table[i].used && memcmp(table[i].bssid, bssid, 6) == 0) return i;
+  }
+  return -1;
+}
+
+/**
+ * Slot for a new access point: a free one, else the one seen least recently
+ * (never one seen by the scan being stored)
+ */
+static int claimEntry(uint32_t scanNo) {
+  int oldest = -1;
+  for (int i = 0; i < WIFI_SURVEY_ENTRIES; i++) {
+    if (!table[i].used) return i;
+    if (table[i].lastScan == scanNo) continue;
+    if (oldest < 0 || (int32_t)(table[i].lastSeen - table[oldest].lastSeen) < 0) oldest = i;
+  }
+  return oldest;
+}
+
+/**
+ * Average of the last two readings (one if only one was taken)
+ */
+static int8_t recentRssi(const SurveyEntry& e) {
+  if (e.samples < 2) return e.rssi[0];
+  return (int8_t)(((int)e.rssi[0] + e.rssi[1]) / 2);
+}
+
+/**
+ * Store the results of a completed scan
+ */
+static void storeResults(int count) {
+  uint32_t now = millis();
+  uint32_t scanNo = scanCount.load() + 1;
+
+  xSemaphoreTake(tableLock, portMAX_DELAY);
+  for (int i = 0; i < count; i++) {
+    const uint8_t* bssid = WiFi.BSSID(i);
+    if (!bssid) continue;
+
+    int slot = findEntry(bssid);
+    if (slot < 0) {
+      slot = claimEntry(scanNo);
+      if (slot < 0) continue;   // Table full of this scan's stronger entries (results come strongest first)
+      memset(&table[slot], 0, sizeof(table[slot]));
+      table[slot].used = true;
+      memcpy(table[slot].bssid, bssid, 6);
+    }
+
+    SurveyEntry& e = table[slot];
+    strncpy(e.ssid, WiFi.SSID(i).c_str(), sizeof(e.ssid) - 1);
+    e.ssid[sizeof(e.ssid) - 1] = '\0';
+    e.channel = WiFi.channel(i);
+    e.open = WiFi.encryptionType(i) == WIFI_AUTH_OPEN;
+    memmove(&e.rssi[1], &e.rssi[0], WIFI_SURVEY_HISTORY - 1);
+    e.rssi[0] = (int8_t)WiFi.RSSI(i);
+    if (e.samples < WIFI_SURVEY_HISTORY) e.samples++;
+    e.lastSeen = now;
+    e.lastScan = scanNo;
+  }
+  lastScanDone = now;
+  xSemaphoreGive(tableLock);
+
+  scanCount.store(scanNo);
+}
+
+/**
+ * Start an asynchronous scan
+ */
+static void startScan(WifiSurveyMode mode) {
+  if (mode == WIFI_SURVEY_PROVISIONING) {
+    // After WiFi.disconnect(true, true) the radio is off, and a failed scan
+    // usually means the driver needs a reset (BLE coexistence)
+    if (failStreak > 0) {
+      WiFi.mode(WIFI_OFF);
+      delay(100);
+    }
+    if (WiFi.getMode() == WIFI_OFF) {
+      WiFi.mode(WIFI_STA);
+      delay(200);
+    }
+  }
+
+  scanPassive = mode == WIFI_SURVEY_BACKGROUND;
+  int16_t result = WiFi.scanNetworks(true /*async*/, false /*show_hidden*/, scanPassive, WIFI_SURVEY_DWELL);
+  if (result == WIFI_SCAN_FAILED) {
+    stats.failed++;
+    if (failStreak < UINT8_MAX) failStreak++;
+    Serial.println("[WiFi] Survey scan did not start");
+    return;
+  }
+  scanRunning = true;
+  scanStart = millis();
+}
+
+/**
+ * Check on the running scan
+ */
+static void collectScan() {
+  int16_t count = WiFi.scanComplete();
+  uint32_t elapsed = millis() - scanStart;
+  if (count == WIFI_SCAN_RUNNING && elapsed < WIFI_SURVEY_TIMEOUT) return;
+
+  if (count >= 0) {
+    storeResults(count);
+    stats.scans++;
+    stats.lastScanMs = elapsed;
+    failStreak = 0;
+    roamCheckPending = scanPassive;   // Background scans run while connected
+
+    Serial.print("[WiFi] Survey: ");
+    Serial.print(count);
+    Serial.print(scanPassive ? " access points (passive, " : " access points (active, ");
+    Serial.print(elapsed);
+    Serial.println(" ms)");
+  } else {
+    stats.failed++;
+    if (failStreak < UINT8_MAX) failStreak++;
+    Serial.println(count == WIFI_SCAN_RUNNING ? "[WiFi] Survey scan timed out" : "[WiFi] Survey scan failed");
+  }
+
+  WiFi.scanDelete();
+  scanRunning = false;
+}
+
+// ==================== Public Functions ====================
+
+void initWifiSurvey() {
+  if (!tableLock) tableLock = xSemaphoreCreateMutex();
+}
+
+void wifiSurveyLoop(WifiSurveyMode mode) {
+  if (scanRunning) {
+    collectScan();
+    return;
+  }
+
+  uint32_t now = millis();
+  if (mode != lastMode) {
+    // Provisioning wants a list at once; a fresh connection is left alone for a while
+    nextScan = now + (mode == WIFI_SURVEY_BACKGROUND ? WIFI_SURVEY_SETTLE : 0);
+    lastMode = mode;
+  }
+  if (mode == WIFI_SURVEY_PAUSED) return;
+  if (!scanRequested.load() && (int32_t)(now - nextScan) < 0) return;
+
+  scanRequested.store(false);
+  nextScan = now + (mode == WIFI_SURVEY_BACKGROUND ? WIFI_SURVEY_INTERVAL : WIFI_SURVEY_IDLE_INTERVAL);
+  startScan(mode);
+}
+
+uint32_t wifiSurveyDueMs(WifiSurveyMode mode) {
+  if (scanRunning) return WIFI_SURVEY_POLL;
+  if (mode != lastMode) return 0;
+  if (mode == WIFI_SURVEY_PAUSED) return UINT32_MAX;
+  if (scanRequested.load()) return 0;
+
+  int32_t left = (int32_t)(nextScan - millis());
+  return left > 0 ? (uint32_t)left : 0;
+}
+
+void requestWifiSurvey() {
+  scanRequested.store(true);
+}
+
+uint32_t wifiSurveyCount() {
+  return scanCount.load();
+}
+
+int getSurveyNetworks(WiFiNetworkInfo* networks, int maxNetworks, uint32_t* ageMs) {
+  int count = 0;
+  uint32_t now = millis();
+
+  xSemaphoreTake(tableLock, portMAX_DELAY);
+  *ageMs = scanCount.load() ? now - lastScanDone : UINT32_MAX;
+  for (int i = 0; i < WIFI_SURVEY_ENTRIES; i++) {
+    const SurveyEntry& e = table[i];
+    if (!e.used || e.ssid[0] == '\0' || now - e.lastSeen > WIFI_SURVEY_MAX_AGE) continue;
+
+    // One line per SSID: its strongest access point
+    int at = -1;
+    for (int j = 0; j < count; j++) {
+      if (strcmp(networks[j].ssid, e.ssid) == 0) at = j;
+    }
+    if (at >= 0) {
+      if (e.rssi[0] <= networks[at].rssi) continue;
+      networks[at].rssi = e.rssi[0];
+      networks[at].open = e.open;
+    } else {
+      if (count == maxNetworks) continue;
+      at = count++;
+      strcpy(networks[at].ssid, e.ssid);
+      networks[at].rssi = e.rssi[0];
+      networks[at].open = e.open;
+    }
+
+    // Keep the list sorted, strongest first
+    while (at > 0 && networks[at].rssi > networks[at - 1].rssi) {
+      WiFiNetworkInfo swap = networks[at - 1];
+      networks[at - 1] = networks[at];
+      networks[at] = swap;
+      at--;
+    }
+  }
+  xSemaphoreGive(tableLock);
+  return count;
+}
+
+bool findRoamTarget(WiFiRoamTarget* target) {
+  if (!roamCheckPending) return false;
+  roamCheckPending = false;
+  if (WiFi.status() != WL_CONNECTED) return false;
+
+  uint32_t now = millis();
+  if (roamedOnce && now - lastRoam < WIFI_ROAM_INTERVAL) return false;
+
+  // The table is only written by this task: no lock needed to read it here
+  uint32_t scanNo = scanCount.load();
+  String ssid = WiFi.SSID();
+  const uint8_t* current = WiFi.BSSID();
+  if (!current) return false;
+
+  int self = findEntry(current);
+  int currentRssi = self >= 0 && table[self].lastScan == scanNo ? recentRssi(table[self]) : WiFi.RSSI();
+  if (currentRssi >= WIFI_ROAM_TRIGGER) return false;
+
+  int best = -1;
+  for (int i = 0; i < WIFI_SURVEY_ENTRIES; i++) {
+    const SurveyEntry& e = table[i];
+    if (!e.used || i == self || e.lastScan != scanNo || e.samples < 2) continue;
+    if (strcmp(e.ssid, ssid.c_str()) != 0) continue;
+    if (e.skip && (int32_t)(now - e.skipUntil) < 0) continue;
+    if (recentRssi(e) < currentRssi + WIFI_ROAM_MARGIN) continue;
+    if (best < 0 || recentRssi(e) > recentRssi(table[best])) best = i;
+  }
+  if (best < 0) return false;
+
+  const SurveyEntry& e = table[best];
+  strcpy(target->ssid, e.ssid);
+  memcpy(target->bssid, e.bssid, 6);
+  target->channel = e.channel;
+  target->rssi = recentRssi(e);
+  target->currentRssi = (int8_t)currentRssi;
+  return true;
+}
+
+void reportRoam(const uint8_t* bssid, bool ok) {
+  roamedOnce = true;
+  lastRoam = millis();
+  if (ok) {
+    stats.roams++;
+    return;
+  }
+
+  stats.roamFailures++;
+  int slot = findEntry(bssid);
+  if (slot >= 0) {
+    table[slot].skip = true;
+    table[slot].skipUntil = lastRoam + WIFI_ROAM_BACKOFF;
+  }
+}
+
+void getWifiSurveyStats(WiFiSurveyStats* out) {
+  *out = stats;
+  out->entries = 0;
+  for (int i = 0; i < WIFI_SURVEY_ENTRIES; i++) {
+    if (table[i].used) out->entries++;
+  }
+  out->ageMs = scanCount.load() ? millis() - lastScanDone : UINT32_MAX;
+}
@@ -0,0 +1,234 @@
+/**
+ * @file test_main.cpp
+ * @brief Host check: TLS records per publish burst with and without write coalescing
+ *
+ * CoalescingStats::bytes is the plaintext handed to the TLS client, the same
+ * in both modes; what coalescing changes is how many records carry it. The
+ * fake socket here frames every write() as a TLS 1.2 AES-GCM record would
+ * (5-byte header, 8-byte explicit nonce, 16-byte tag) and runs a keystream
+ * and tag pass over the bytes: the wire size is exact, and writeUs carries a
+ * per-record and a per-byte share (host timing, indicative only; the chip's
+ * figures are in the "tls" block of diag/state). The burst is what a pump command produces:
+ * pump state, policy and usage at QoS 1 (four writes each) and the command ack.
+ *
+ * The suite is built in both modes; the expected record counts follow
+ * MQTT_COALESCE_WRITES and the measured writeUs is printed for comparison:
+ *   pio test -e native -f bench/test_coalesced_writes -v
+ *   pio test -e native-passthrough -v          (MQTT_COALESCE_WRITES=0)
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+#include <string>
+#include <vector>
+#include "coalescing_client.h"
+#include "config.h"
+#include "mqtt_transport.h"
+#include <PubSubClient.h>
+
+#define TLS_RECORD_HEADER     5
+#define TLS_RECORD_NONCE      8
+#define TLS_RECORD_TAG        16
+#define TLS_RECORD_OVERHEAD   (TLS_RECORD_HEADER + TLS_RECORD_NONCE + TLS_RECORD_TAG)
+
+#define BURST_QOS1_MESSAGES   3
+#define BURST_QOS0_MESSAGES   1
+#define WRITES_PER_QOS1       4   // Header, topic, packet ID, payload (publishQos1)
+#define BURST_WRITES          (BURST_QOS1_MESSAGES * WRITES_PER_QOS1 + BURST_QOS0_MESSAGES)
+#define BURST_REPEATS         1000
+
+/**
+ * Socket that seals every write as one TLS record
+ */
+class RecordSocket : public Client {
+ public:
+  std::vector<uint8_t> wire;    // Records as sent
+  std::string plain;            // What the broker decrypts, in order
+  std::vector<uint8_t> in;
+  uint64_t sequence = 0;
+
+  int connect(IPAddress, uint16_t) override { return 1; }
+  int connect(const char*, uint16_t) override { return 1; }
+  size_t write(uint8_t b) override { return write(&b, 1); }
+  size_t write(const uint8_t* buf, size_t size) override {
+    size_t length = TLS_RECORD_NONCE + size + TLS_RECORD_TAG;
+    const uint8_t header[TLS_RECORD_HEADER] = { 0x17, 0x03, 0x03, (uint8_t)(length >> 8), (uint8_t)length };
+    wire.insert(wire.end(), header, header + sizeof(header));
+    sequence++;
+    for (int i = 0; i < TLS_RECORD_NONCE; i++) wire.push_back(sequence >> (8 * i));
+
+    uint8_t tag[TLS_RECORD_TAG] = {};
+    for (size_t i = 0; i < size; i++) {
+      uint8_t c = buf[i] ^ keystream(i);
+      wire.push_back(c);
+      tag[i % TLS_RECORD_TAG] = (tag[i % TLS_RECORD_TAG] * 31) ^ c;
+    }
+    wire.insert(wire.end(), tag, tag + sizeof(tag));
+    plain.append((const char*)buf, size);
+    return size;
+  }
+  int available() override { return in.size(); }
+  int read() override {
+    if (in.empty()) return -1;
+    int b = in.front();
+    in.erase(in.begin());
+    return b;
+  }
+  int read(uint8_t* buf, size_t size) override {
+    size_t n = size < in.size() ? size : in.size();
+    memcpy(buf, in.data(), n);
+    in.erase(in.begin(), in.begin() + n);
+    return n;
+  }
+  int peek() override { return in.empty() ? -1 : in.front(); }
+  void flush() override {}
+  void stop() override {}
+  uint8_t connected() override { return 1; }
+  operator bool() override { return true; }
+
+  /**
+   * Acknowledge every QoS 1 PUBLISH in what was sent so far
+   */
+  void ackAll() {
+    size_t i = 0;
+    while (i < plain.size()) {
+      uint8_t h = plain[i++];
+      uint32_t remaining = 0;
+      uint32_t multiplier = 1;
+      uint8_t digit;
+      do {
+        digit = plain[i++];
+        remaining += (digit & 0x7F) * multiplier;
+        multiplier *= 128;
+      } while (digit & 0x80);
+      if ((h >> 4) == 3 && (h & 0x06) == 0x02) {
+        size_t topicLen = ((uint8_t)plain[i] << 8) | (uint8_t)plain[i + 1];
+        const uint8_t puback[4] = { 0x40, 0x02, (uint8_t)plain[i + 2 + topicLen], (uint8_t)plain[i + 3 + topicLen] };
+        in.insert(in.end(), puback, puback + sizeof(puback));
+      }
+      i += remaining;
+    }
+  }
+
+  void clear() {
+    wire.clear();
+    plain.clear();
+  }
+
+ private:
+  uint8_t keystream(size_t i) const {
+    uint32_t x = (uint32_t)(sequence * 0x9E3779B9u) ^ (uint32_t)(i * 0x85EBCA6Bu);
+    x ^= x >> 15;
+    return (uint8_t)(x * 0x2C1B3C6Du >> 24);
+  }
+};
+
+static RecordSocket socket;
+static CoalescingClient coalescer(socket);
+static PubSubClient mqtt(coalescer);
+
+static CoalescingStats coalescingStats() {
+  CoalescingStats s;
+  coalescer.getStats(&s);
+  return s;
+}
+
+/**
+ * What a pump command leaves in the queue, drained and acknowledged
+ */
+static void commandBurst(const char* payload) {
+  mqttEnqueue(TOPIC_PUMP_STATE, payload, true, MQTT_PRIO_CRITICAL);
+  mqttEnqueue(TOPIC_PUMP_POLICY, "{\"pending\":false,\"switches\":12,\"suppressed\":0}", true, MQTT_PRIO_STATE);
+  mqttEnqueue(TOPIC_PUMP_USAGE, "{\"today_s\":3600,\"today_wh\":275}", true, MQTT_PRIO_STATE);
+  mqttEnqueue(TOPIC_CMD_ACK, "{\"id\":\"42\",\"result\":\"ok\",\"us\":812}", false, MQTT_PRIO_CRITICAL);
+  mqttDrain();
+  socket.ackAll();
+  mqtt.loop();
+}
+
+void setUp() {
+  nativeMillis += 1000;
+  socket.clear();
+}
+
+void tearDown() {}
+
+void test_command_burst_records() {
+  CoalescingStats before = coalescingStats();
+  commandBurst("{\"state\":\"ON\"}");
+  CoalescingStats after = coalescingStats();
+
+  uint32_t writes = after.writes - before.writes;
+  uint32_t records = after.records - before.records;
+  uint32_t bytes = after.bytes - before.bytes;
+  TEST_ASSERT_EQUAL_UINT32(BURST_WRITES, writes);
+  TEST_ASSERT_EQUAL_UINT32(MQTT_COALESCE_WRITES ? 1 : BURST_WRITES, records);
+
+  // Same plaintext either way; each record adds its framing on the wire
+  TEST_ASSERT_EQUAL_size_t(bytes, socket.plain.size());
+  TEST_ASSERT_EQUAL_size_t(bytes + records * TLS_RECORD_OVERHEAD, socket.wire.size());
+
+  MqttQueueStats queue;
+  getMqttQueueStats(&queue);
+  TEST_ASSERT_EQUAL_UINT8(0, queue.depth);
+}
+
+void test_burst_larger_than_the_buffer_is_split() {
+  char payload[MQTT_QUEUE_PAYLOAD_LEN];
+  memset(payload, 'x', sizeof(payload) - 1);
+  payload[sizeof(payload) - 1] = '\0';
+  const char* topics[] = { TOPIC_PUMP_STATE, TOPIC_VALVE_STATE, TOPIC_TIMER_STATE };
+
+  CoalescingStats before = coalescingStats();
+  for (const char* topic : topics) mqttEnqueue(topic, payload, true, MQTT_PRIO_CRITICAL);
+  mqttDrain();
+  socket.ackAll();
+  mqtt.loop();
+  CoalescingStats after = coalescingStats();
+
+  uint32_t records = after.records - before.records;
+  uint32_t bytes = after.bytes - before.bytes;
+  TEST_ASSERT_EQUAL_UINT32(3 * WRITES_PER_QOS1, after.writes - before.writes);
+  if (MQTT_COALESCE_WRITES) {
+    // Split where the next write would not fit: at most one record more than the minimum
+    uint32_t minimum = (bytes + MQTT_COALESCE_BUFFER - 1) / MQTT_COALESCE_BUFFER;
+    TEST_ASSERT_TRUE(records >= minimum && records <= minimum + 1);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(MQTT_COALESCE_BUFFER, after.largest);
+  } else {
+    TEST_ASSERT_EQUAL_UINT32(3 * WRITES_PER_QOS1, records);
+  }
+  TEST_ASSERT_EQUAL_size_t(bytes + records * TLS_RECORD_OVERHEAD, socket.wire.size());
+}
+
+/**
+ * Time in TLS writes for BURST_REPEATS command bursts (reported, not asserted:
+ * the host is not the chip, but the per-record share shows)
+ */
+void test_command_burst_write_time() {
+  CoalescingStats before = coalescingStats();
+  for (int i = 0; i < BURST_REPEATS; i++) {
+    socket.clear();
+    nativeMillis += 1000;
+    commandBurst(i % 2 ? "{\"state\":\"ON\"}" : "{\"state\":\"OFF\"}");
+  }
+  CoalescingStats after = coalescingStats();
+
+  uint32_t records = after.records - before.records;
+  TEST_ASSERT_EQUAL_UINT32((MQTT_COALESCE_WRITES ? 1 : BURST_WRITES) * BURST_REPEATS, records);
+  printf("COALESCE {\"coalesce\":%d,\"bursts\":%d,\"writes_per_burst\":%u,\"records_per_burst\":%u,"
+         "\"wire_overhead_per_burst\":%u,\"write_us\":%u,\"write_ns_per_burst\":%u}\n",
+         MQTT_COALESCE_WRITES, BURST_REPEATS, (after.writes - before.writes) / BURST_REPEATS,
+         records / BURST_REPEATS, records / BURST_REPEATS * TLS_RECORD_OVERHEAD,
+         after.writeUs - before.writeUs, (after.writeUs - before.writeUs) * 1000 / BURST_REPEATS);
+}
+
+int main() {
+  mqtt.setBufferSize(MQTT_BUFFER_SIZE);
+  initMqttTransport(&mqtt, &coalescer);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_command_burst_records);
+  RUN_TEST(test_burst_larger_than_the_buffer_is_split);
+  RUN_TEST(test_command_burst_write_time);
+  return UNITY_END();
+}
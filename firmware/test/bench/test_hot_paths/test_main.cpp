@@ -0,0 +1,218 @@
+/**
+ * @file test_main.cpp
+ * @brief Host benchmarks: the platform-independent modules under the hot paths
+ *
+ * The command and publish paths measured on the chip (benchmark.h) sit on
+ * json_parse, msg_pool, mqtt_transport and coalescing_client. Here they run
+ * with the same runner on the host, where results are repeatable and need no
+ * board: a command parsed and its ack built in pooled buffers, publishes
+ * queued and drained through the CoalescingClient to a socket that discards
+ * them, and the PUBACK scan on the read path. No case may allocate.
+ *
+ * Results are BENCH lines, as on the device, for tools/bench_compare.py:
+ *   pio test -e native -f bench/test_hot_paths -v | tee host.log
+ *   python tools/bench_compare.py base.log host.log
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+#include "benchmark.h"
+#include "coalescing_client.h"
+#include "config.h"
+#include "json_parse.h"
+#include "mqtt_transport.h"
+#include "msg_pool.h"
+#include <PubSubClient.h>
+
+/**
+ * Socket that discards writes and plays back a fixed inbound stream
+ */
+class SinkSocket : public Client {
+ public:
+  uint8_t last[MQTT_COALESCE_BUFFER];
+  size_t lastLen = 0;
+  const uint8_t* in = nullptr;
+  size_t inLen = 0;
+
+  int connect(IPAddress, uint16_t) override { return 1; }
+  int connect(const char*, uint16_t) override { return 1; }
+  size_t write(uint8_t b) override { return write(&b, 1); }
+  size_t write(const uint8_t* buf, size_t size) override {
+    lastLen = size < sizeof(last) ? size : sizeof(last);
+    memcpy(last, buf, lastLen);
+    return size;
+  }
+  int available() override { return inLen; }
+  int read() override {
+    if (!inLen) return -1;
+    inLen--;
+    return *in++;
+  }
+  int read(uint8_t* buf, size_t size) override {
+    size_t n = size < inLen ? size : inLen;
+    memcpy(buf, in, n);
+    in += n;
+    inLen -= n;
+    return n;
+  }
+  int peek() override { return inLen ? *in : -1; }
+  void flush() override {}
+  void stop() override {}
+  uint8_t connected() override { return 1; }
+  operator bool() override { return true; }
+};
+
+/**
+ * BENCH lines to the test output (Serial is silent on the host)
+ */
+class StdoutPrint : public Print {
+ public:
+  size_t write(uint8_t b) override { return putchar(b) == EOF ? 0 : 1; }
+  using Print::write;
+};
+
+static SinkSocket socket;
+static CoalescingClient coalescer(socket);
+static PubSubClient mqtt(coalescer);
+static StdoutPrint out;
+
+static const char* const COMMAND = "{\"id\":\"42\",\"ts\":1700000000123,\"name\":\"morning\",\"mode\":1,\"duration\":3600}";
+static const char* const ESCAPED = "{\"slot\":\"secondary\",\"user\":\"pool\",\"pass\":\"p,a}s\\\"s\\\\w\"}";
+
+// ==================== Cases ====================
+
+static void benchJsonWellFormed(void*) {
+  TEST_ASSERT_TRUE(jsonWellFormed(COMMAND));
+}
+
+static void benchJsonValue(void*) {
+  char value[16];
+  TEST_ASSERT_EQUAL_INT(4, jsonValue(COMMAND, "duration", value, sizeof(value)));
+}
+
+static void benchJsonValueEscaped(void*) {
+  char value[24];
+  TEST_ASSERT_EQUAL_INT(9, jsonValue(ESCAPED, "pass", value, sizeof(value)));
+}
+
+/**
+ * The command path of handleCommand(): payload copied, parsed, ack built
+ */
+static void benchCommandInPool(void*) {
+  MsgBuffer raw;
+  raw.print(COMMAND);
+  char id[16];
+  jsonValue(raw.c_str(), "id", id, sizeof(id));
+  MsgBuffer ack;
+  ack.print("{\"id\":\"");
+  ack.print(id);
+  ack.print("\",\"result\":\"ok\"}");
+  TEST_ASSERT_TRUE(ack.ok());
+}
+
+static void benchEnqueueDrainQos0(void*) {
+  mqttEnqueue(TOPIC_CMD_ACK, "{\"id\":\"42\",\"result\":\"ok\",\"us\":812}", false, MQTT_PRIO_CRITICAL);
+  mqttEnqueue(TOPIC_TEMP_STATE, "{\"temp\":24.5,\"ts\":1700000000123}", true, MQTT_PRIO_TELEMETRY);
+  mqttDrain();
+}
+
+/**
+ * A state publish at QoS 1: written, then released by its PUBACK
+ */
+static void benchEnqueueDrainQos1(void*) {
+  mqttEnqueue(TOPIC_PUMP_STATE, "{\"state\":\"ON\",\"ts\":1700000000123}", true, MQTT_PRIO_CRITICAL);
+  mqttDrain();
+
+  // Fixed header, remaining length (one byte here), topic, packet ID
+  size_t topicLen = (socket.last[2] << 8) | socket.last[3];
+  uint8_t puback[4] = { 0x40, 0x02, socket.last[4 + topicLen], socket.last[5 + topicLen] };
+  socket.in = puback;
+  socket.inLen = sizeof(puback);
+  mqtt.loop();
+}
+
+static void benchEnqueueCoalesced(void*) {
+  mqttEnqueue(TOPIC_TEMP_STATE, "{\"temp\":24.5}", true, MQTT_PRIO_TELEMETRY);
+  mqttEnqueue(TOPIC_TEMP_STATE, "{\"temp\":24.6}", true, MQTT_PRIO_TELEMETRY);   // Replaces the first
+  mqttDrain();
+}
+
+/**
+ * The writes of a QoS 1 publish and an ack, then one record
+ */
+static void benchCoalescedBurst(void*) {
+  static const uint8_t header[] = { 0x33, 0x40, 0x00, 0x1F };
+  static const uint8_t topic[] = "devices/esp32-pool-01/pump/state";
+  static const uint8_t id[] = { 0x00, 0x01 };
+  static const uint8_t payload[] = "{\"state\":\"ON\",\"ts\":1700000000123}";
+  for (int i = 0; i < 2; i++) {
+    coalescer.write(header, sizeof(header));
+    coalescer.write(topic, sizeof(topic) - 1);
+    coalescer.write(id, sizeof(id));
+    coalescer.write(payload, sizeof(payload) - 1);
+  }
+  TEST_ASSERT_TRUE(coalescer.flushWrites());
+}
+
+/**
+ * Inbound bytes: an incoming command, then two PUBACKs
+ */
+static void benchInboundScan(void*) {
+  static const uint8_t stream[] = {
+    0x30, 0x1E, 0x00, 0x1A, 'd', 'e', 'v', 'i', 'c', 'e', 's', '/', 'x', '/', 'p', 'u', 'm', 'p', '/',
+    's', 'e', 't', '/', '/', '/', '/', '/', '/', '/', '/', 'O', 'N',
+    0x40, 0x02, 0x00, 0x01, 0x40, 0x02, 0x00, 0x02,
+  };
+  uint8_t buf[sizeof(stream)];
+  socket.in = stream;
+  socket.inLen = sizeof(stream);
+  TEST_ASSERT_EQUAL_INT(sizeof(stream), coalescer.read(buf, sizeof(buf)));
+}
+
+static const BenchCase CASES[] = {
+  { "host_json_well_formed",       benchJsonWellFormed,   nullptr },
+  { "host_json_value",             benchJsonValue,        nullptr },
+  { "host_json_value_escaped",     benchJsonValueEscaped, nullptr },
+  { "host_command_in_pool",        benchCommandInPool,    nullptr },
+  { "host_enqueue_drain_qos0",     benchEnqueueDrainQos0, nullptr },
+  { "host_enqueue_drain_qos1",     benchEnqueueDrainQos1, nullptr },
+  { "host_enqueue_coalesced",      benchEnqueueCoalesced, nullptr },
+  { "host_coalesced_burst",        benchCoalescedBurst,   nullptr },
+  { "host_inbound_scan",           benchInboundScan,      nullptr },
+};
+#define CASE_COUNT (sizeof(CASES) / sizeof(CASES[0]))
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_hot_paths() {
+  beginBenchmarkSuite(out);
+  runBenchmarkSuite(CASES, CASE_COUNT, out);
+}
+
+void test_hot_paths_do_not_allocate() {
+  for (size_t i = 0; i < CASE_COUNT; i++) {
+    BenchResult r;
+    runBenchmark(CASES[i], &r);
+    TEST_ASSERT_EQUAL_INT(0, (int)(r.allocsPerOp * 1000));
+  }
+}
+
+void test_queue_is_empty_afterwards() {
+  MqttQueueStats s;
+  getMqttQueueStats(&s);
+  TEST_ASSERT_EQUAL_UINT8(0, s.depth);
+  TEST_ASSERT_EQUAL_UINT8(0, s.inflight);
+}
+
+int main() {
+  mqtt.setBufferSize(MQTT_BUFFER_SIZE);
+  initMqttTransport(&mqtt, &coalescer);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_hot_paths);
+  RUN_TEST(test_hot_paths_do_not_allocate);
+  RUN_TEST(test_queue_is_empty_afterwards);
+  return UNITY_END();
+}
@@ -0,0 +1,186 @@
+/**
+ * @file Arduino.h
+ * @brief Minimal Arduino core for host tests (pio test -e native)
+ *
+ * Only what the modules under test use: Print, a silent Serial, a millisecond
+ * clock the tests set by hand and a real microsecond one, String, and the
+ * FreeRTOS semaphores and queues.
+ */
+
+#ifndef NATIVE_ARDUINO_H
+#define NATIVE_ARDUINO_H
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+#include <ctype.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+class Print {
+ public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t b) = 0;
+  virtual size_t write(const uint8_t* data, size_t size) {
+    size_t n = 0;
+    while (n < size && write(data[n])) n++;
+    return n;
+  }
+
+  size_t print(const char* s) { return write((const uint8_t*)s, strlen(s)); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(int v) { return printf("%d", v); }
+  size_t print(unsigned int v) { return printf("%u", v); }
+  size_t print(long v) { return printf("%ld", v); }
+  size_t print(unsigned long v) { return printf("%lu", v); }
+  size_t print(long long v) { return printf("%lld", v); }
+  size_t print(unsigned long long v) { return printf("%llu", v); }
+  size_t print(double v, int digits = 2) { return printf("%.*f", digits, v); }
+  size_t println() { return print("\r\n"); }
+  template <class T> size_t println(T v) { return print(v) + println(); }
+
+ private:
+  template <class... Args> size_t printf(const char* format, Args... args) {
+    char text[24];
+    int n = snprintf(text, sizeof(text), format, args...);
+    return write((const uint8_t*)text, n);
+  }
+};
+
+/**
+ * Discards output (set echo to see the firmware's log lines)
+ */
+class HardwareSerial : public Print {
+ public:
+  bool echo = false;
+  size_t write(uint8_t b) override {
+    if (echo) putchar(b);
+    return 1;
+  }
+  using Print::write;
+};
+
+inline HardwareSerial Serial;
+
+// millis() only moves when a test advances it; micros() is the host clock
+// (the modules use it to time work, e.g. CoalescingStats::writeUs)
+inline uint32_t nativeMillis = 0;
+inline uint32_t millis() { return nativeMillis; }
+inline uint32_t micros() {
+  using namespace std::chrono;
+  return (uint32_t)duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+inline void delay(uint32_t) {}
+
+/**
+ * Arduino String, as far as the modules use it (returned by WiFi calls)
+ */
+class String {
+ public:
+  String(const char* s = "") : value(s) {}
+  const char* c_str() const { return value.c_str(); }
+  size_t length() const { return value.size(); }
+
+ private:
+  std::string value;
+};
+
+// FreeRTOS semaphores and queues (the Arduino core includes FreeRTOS), on
+// std::mutex so a test can run an HTTP handler and the loop on two threads.
+// One tick is one millisecond of real time.
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+#define pdTRUE  1
+#define pdFALSE 0
+#define portMAX_DELAY 0xFFFFFFFF
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+struct NativeSemaphore {
+  std::mutex lock;
+  std::condition_variable changed;
+  UBaseType_t count = 0;
+};
+typedef NativeSemaphore* SemaphoreHandle_t;
+
+/**
+ * Wait up to ticks for ready() under the lock (false: timed out)
+ */
+template <class Ready>
+inline bool nativeWait(std::unique_lock<std::mutex>& lock, std::condition_variable& changed,
+                       TickType_t ticks, Ready ready) {
+  if (ticks == portMAX_DELAY) {
+    changed.wait(lock, ready);
+    return true;
+  }
+  return changed.wait_for(lock, std::chrono::milliseconds(ticks), ready);
+}
+
+inline SemaphoreHandle_t xSemaphoreCreateBinary() { return new NativeSemaphore(); }
+inline SemaphoreHandle_t xSemaphoreCreateMutex() {
+  SemaphoreHandle_t s = new NativeSemaphore();
+  s->count = 1;
+  return s;
+}
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t s, TickType_t ticks) {
+  std::unique_lock<std::mutex> lock(s->lock);
+  if (!nativeWait(lock, s->changed, ticks, [s] { return s->count > 0; })) return pdFALSE;
+  s->count--;
+  return pdTRUE;
+}
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t s) {
+  {
+    std::lock_guard<std::mutex> lock(s->lock);
+    if (s->count > 0) return pdFALSE;   // Binary semaphores and mutexes hold one
+    s->count = 1;
+  }
+  s->changed.notify_all();
+  return pdTRUE;
+}
+
+struct NativeQueue {
+  std::mutex lock;
+  std::condition_variable changed;
+  std::deque<std::vector<uint8_t>> items;
+  UBaseType_t depth;
+  UBaseType_t itemSize;
+};
+typedef NativeQueue* QueueHandle_t;
+
+inline QueueHandle_t xQueueCreate(UBaseType_t depth, UBaseType_t itemSize) {
+  QueueHandle_t q = new NativeQueue();
+  q->depth = depth;
+  q->itemSize = itemSize;
+  return q;
+}
+inline BaseType_t xQueueSend(QueueHandle_t q, const void* item, TickType_t ticks) {
+  {
+    std::unique_lock<std::mutex> lock(q->lock);
+    if (!nativeWait(lock, q->changed, ticks, [q] { return q->items.size() < q->depth; })) return pdFALSE;
+    q->items.emplace_back((const uint8_t*)item, (const uint8_t*)item + q->itemSize);
+  }
+  q->changed.notify_all();
+  return pdTRUE;
+}
+inline BaseType_t xQueueReceive(QueueHandle_t q, void* item, TickType_t ticks) {
+  {
+    std::unique_lock<std::mutex> lock(q->lock);
+    if (!nativeWait(lock, q->changed, ticks, [q] { return !q->items.empty(); })) return pdFALSE;
+    memcpy(item, q->items.front().data(), q->itemSize);
+    q->items.pop_front();
+  }
+  q->changed.notify_all();
+  return pdTRUE;
+}
+
+#endif // NATIVE_ARDUINO_H
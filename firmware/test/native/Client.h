@@ -0,0 +1,33 @@
+/**
+ * @file Client.h
+ * @brief Arduino Client interface for host tests (pio test -e native)
+ *
+ * Same virtual methods as the Arduino core's Client, so CoalescingClient and
+ * the fakes in the suites build unchanged.
+ */
+
+#ifndef NATIVE_CLIENT_H
+#define NATIVE_CLIENT_H
+
+#include <Arduino.h>
+
+class IPAddress {};
+
+class Client : public Print {
+ public:
+  virtual int connect(IPAddress ip, uint16_t port) = 0;
+  virtual int connect(const char* host, uint16_t port) = 0;
+  size_t write(uint8_t b) override = 0;
+  size_t write(const uint8_t* buf, size_t size) override = 0;
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int read(uint8_t* buf, size_t size) = 0;
+  virtual int peek() = 0;
+  virtual void flush() = 0;
+  virtual void stop() = 0;
+  virtual uint8_t connected() = 0;
+  virtual operator bool() = 0;
+  using Print::write;
+};
+
+#endif // NATIVE_CLIENT_H
@@ -0,0 +1,20 @@
+/**
+ * @file ESPmDNS.h
+ * @brief mDNS responder for host tests (pio test -e native): accepts everything
+ */
+
+#ifndef NATIVE_ESPMDNS_H
+#define NATIVE_ESPMDNS_H
+
+#include <Arduino.h>
+
+class MDNSResponder {
+ public:
+  bool begin(const char*) { return true; }
+  bool addService(const char*, const char*, uint16_t) { return true; }
+  bool addServiceTxt(const char*, const char*, const char*, const char*) { return true; }
+};
+
+inline MDNSResponder MDNS;
+
+#endif // NATIVE_ESPMDNS_H
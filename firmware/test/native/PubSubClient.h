@@ -0,0 +1,103 @@
+/**
+ * @file PubSubClient.h
+ * @brief PubSubClient 2.8 stand-in for host tests (pio test -e native)
+ *
+ * Covers the calls mqtt_transport.cpp makes and writes the same bytes as the
+ * library: a QoS 0 PUBLISH per publish() in one write, beginPublish() /
+ * write() / endPublish() for streamed payloads, DISCONNECT then stop().
+ * loop() reads whatever the client has (so CoalescingClient sees PUBACKs)
+ * without dispatching it. Header-only: every native suite links the transport.
+ */
+
+#ifndef NATIVE_PUBSUBCLIENT_H
+#define NATIVE_PUBSUBCLIENT_H
+
+#include <Arduino.h>
+#include <Client.h>
+
+#define MQTT_MAX_HEADER_SIZE 5
+
+#define MQTTPUBLISH     (3 << 4)
+#define MQTTPUBACK      (4 << 4)
+#define MQTTDISCONNECT  (14 << 4)
+#define MQTTQOS0        (0 << 1)
+#define MQTTQOS1        (1 << 1)
+
+class PubSubClient : public Print {
+ public:
+  PubSubClient() {}
+  explicit PubSubClient(Client& client) : client(&client) {}
+
+  PubSubClient& setClient(Client& c) {
+    client = &c;
+    return *this;
+  }
+  bool setBufferSize(uint16_t size) {
+    bufferSize = size;
+    return true;
+  }
+  uint16_t getBufferSize() { return bufferSize; }
+
+  boolean connected() { return client && client->connected(); }
+
+  boolean publish(const char* topic, const uint8_t* payload, unsigned int length, boolean retained) {
+    if (!connected()) return false;
+    size_t topicLen = strlen(topic);
+    uint8_t packet[MQTT_MAX_HEADER_SIZE + 2 + 1024];
+    if (MQTT_MAX_HEADER_SIZE + 2 + topicLen + length > bufferSize || bufferSize > sizeof(packet)) return false;
+    size_t n = header(packet, MQTTPUBLISH | (retained ? 1 : 0), 2 + topicLen + length);
+    packet[n++] = topicLen >> 8;
+    packet[n++] = topicLen & 0xFF;
+    memcpy(packet + n, topic, topicLen);
+    n += topicLen;
+    memcpy(packet + n, payload, length);
+    n += length;
+    return client->write(packet, n) == n;
+  }
+
+  boolean beginPublish(const char* topic, unsigned int length, boolean retained) {
+    if (!connected()) return false;
+    size_t topicLen = strlen(topic);
+    uint8_t packet[MQTT_MAX_HEADER_SIZE + 2 + 256];
+    size_t n = header(packet, MQTTPUBLISH | (retained ? 1 : 0), 2 + topicLen + length);
+    packet[n++] = topicLen >> 8;
+    packet[n++] = topicLen & 0xFF;
+    memcpy(packet + n, topic, topicLen);
+    n += topicLen;
+    return client->write(packet, n) == n;
+  }
+  int endPublish() { return 1; }
+
+  size_t write(uint8_t b) override { return client->write(b); }
+  size_t write(const uint8_t* buf, size_t size) override { return client->write(buf, size); }
+  using Print::write;
+
+  void disconnect() {
+    uint8_t packet[2] = { MQTTDISCONNECT, 0 };
+    if (client->connected()) client->write(packet, sizeof(packet));
+    client->stop();
+  }
+
+  boolean loop() {
+    if (!connected()) return false;
+    while (client->available() > 0) client->read();
+    return true;
+  }
+
+ private:
+  static size_t header(uint8_t* out, uint8_t type, size_t remaining) {
+    size_t n = 0;
+    out[n++] = type;
+    do {
+      uint8_t digit = remaining % 128;
+      remaining /= 128;
+      out[n++] = remaining ? digit | 0x80 : digit;
+    } while (remaining);
+    return n;
+  }
+
+  Client* client = nullptr;
+  uint16_t bufferSize = 256;
+};
+
+#endif // NATIVE_PUBSUBCLIENT_H
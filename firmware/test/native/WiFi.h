@@ -0,0 +1,94 @@
+/**
+ * @file WiFi.h
+ * @brief Scriptable WiFi (ESP32 Arduino core) for host tests (pio test -e native)
+ *
+ * Covers the scan and station calls wifi_survey.cpp makes. A test sets what
+ * the air looks like (aps), how the next scan ends (scanResult) and which
+ * access point the station is on; scanNetworks() starts a scan that
+ * scanComplete() reports as running until the test finishes it.
+ */
+
+#ifndef NATIVE_WIFI_H
+#define NATIVE_WIFI_H
+
+#include <Arduino.h>
+#include <vector>
+
+#define WIFI_SCAN_RUNNING   (-1)
+#define WIFI_SCAN_FAILED    (-2)
+
+typedef enum { WIFI_OFF = 0, WIFI_STA = 1 } wifi_mode_t;
+typedef enum { WIFI_AUTH_OPEN = 0, WIFI_AUTH_WPA2_PSK = 3 } wifi_auth_mode_t;
+typedef enum { WL_IDLE_STATUS = 0, WL_CONNECTED = 3, WL_DISCONNECTED = 6 } wl_status_t;
+
+/**
+ * One access point on the air
+ */
+struct NativeAccessPoint {
+  const char* ssid;
+  uint8_t bssid[6];
+  uint8_t channel;
+  int32_t rssi;
+  bool open;
+};
+
+class WiFiClass {
+ public:
+  // Scripted by the tests
+  std::vector<NativeAccessPoint> aps;        // Results of the next completed scan
+  bool scanStarts = true;                    // false: scanNetworks() fails
+  bool scanDone = false;                     // scanComplete() returns the results once set
+  bool scanFails = false;                    // A done scan reports WIFI_SCAN_FAILED
+  int scansStarted = 0;
+  bool lastScanPassive = false;
+  wl_status_t linkStatus = WL_DISCONNECTED;
+  int current = -1;                          // Index in aps of the joined access point
+  int32_t linkRssi = 0;
+
+  int16_t scanNetworks(bool async, bool, bool passive, uint32_t) {
+    if (!scanStarts) return WIFI_SCAN_FAILED;
+    scansStarted++;
+    lastScanPassive = passive;
+    scanning = true;
+    scanDone = false;
+    results = aps;
+    return async ? WIFI_SCAN_RUNNING : (int16_t)results.size();
+  }
+  int16_t scanComplete() {
+    if (!scanning) return WIFI_SCAN_FAILED;
+    if (!scanDone) return WIFI_SCAN_RUNNING;
+    return scanFails ? WIFI_SCAN_FAILED : (int16_t)results.size();
+  }
+  void scanDelete() {
+    scanning = false;
+    results.clear();
+  }
+
+  String SSID(uint8_t i) { return i < results.size() ? results[i].ssid : ""; }
+  uint8_t* BSSID(uint8_t i) { return i < results.size() ? results[i].bssid : nullptr; }
+  int32_t channel(uint8_t i) { return i < results.size() ? results[i].channel : 0; }
+  int32_t RSSI(uint8_t i) { return i < results.size() ? results[i].rssi : 0; }
+  wifi_auth_mode_t encryptionType(uint8_t i) {
+    return i < results.size() && results[i].open ? WIFI_AUTH_OPEN : WIFI_AUTH_WPA2_PSK;
+  }
+
+  wl_status_t status() { return linkStatus; }
+  String SSID() { return current >= 0 ? aps[current].ssid : ""; }
+  uint8_t* BSSID() { return current >= 0 ? aps[current].bssid : nullptr; }
+  int32_t RSSI() { return linkRssi; }
+
+  bool mode(wifi_mode_t m) {
+    radioMode = m;
+    return true;
+  }
+  wifi_mode_t getMode() { return radioMode; }
+
+ private:
+  std::vector<NativeAccessPoint> results;
+  bool scanning = false;
+  wifi_mode_t radioMode = WIFI_STA;
+};
+
+inline WiFiClass WiFi;
+
+#endif // NATIVE_WIFI_H
@@ -0,0 +1,125 @@
+/**
+ * @file esp_http_server.h
+ * @brief Scriptable esp_http_server for host tests (pio test -e native)
+ *
+ * Covers the calls local_api.cpp makes. There is no socket: a test fills in
+ * an httpd_req_t (method, URI, Authorization header, body) and hands it to
+ * nativeHttpServe(), which runs the registered handler on the calling thread,
+ * as the server task would; status, content type and body sent are kept in
+ * the request. sendDelayMs holds the send, like a slow client.
+ */
+
+#ifndef NATIVE_ESP_HTTP_SERVER_H
+#define NATIVE_ESP_HTTP_SERVER_H
+
+#include <Arduino.h>
+#include <sys/types.h>
+#include <string>
+#include <thread>
+
+typedef int esp_err_t;
+#define ESP_OK    0
+#define ESP_FAIL  (-1)
+#define HTTPD_SOCK_ERR_TIMEOUT (-3)
+
+typedef void* httpd_handle_t;
+typedef enum { HTTP_GET = 1, HTTP_POST = 3 } httpd_method_t;
+typedef bool (*httpd_uri_match_func_t)(const char* templ, const char* uri, size_t length);
+
+typedef struct {
+  uint16_t server_port;
+  uint16_t max_open_sockets;
+  bool lru_purge_enable;
+  httpd_uri_match_func_t uri_match_fn;
+} httpd_config_t;
+
+#define HTTPD_DEFAULT_CONFIG() httpd_config_t{ 80, 7, false, nullptr }
+
+typedef struct httpd_req {
+  int method;
+  char uri[513];
+  size_t content_len;
+
+  // Scripted by the test
+  std::string authorization;   // "Authorization" header ("" when absent)
+  std::string body;
+  uint32_t sendDelayMs = 0;
+
+  // Filled in by the handler
+  size_t received = 0;
+  std::string status;
+  std::string type;
+  std::string response;
+  bool sent = false;
+} httpd_req_t;
+
+typedef esp_err_t (*httpd_handler_t)(httpd_req_t* req);
+
+typedef struct {
+  const char* uri;
+  httpd_method_t method;
+  httpd_handler_t handler;
+  void* user_ctx;
+} httpd_uri_t;
+
+inline httpd_handler_t nativeHttpHandlers[2] = {};   // GET, POST
+
+inline bool httpd_uri_match_wildcard(const char*, const char*, size_t) { return true; }
+
+inline esp_err_t httpd_start(httpd_handle_t* handle, const httpd_config_t*) {
+  static int server;
+  *handle = &server;
+  return ESP_OK;
+}
+
+inline esp_err_t httpd_register_uri_handler(httpd_handle_t, const httpd_uri_t* uri) {
+  nativeHttpHandlers[uri->method == HTTP_POST] = uri->handler;
+  return ESP_OK;
+}
+
+inline size_t httpd_req_get_hdr_value_len(httpd_req_t* req, const char*) {
+  return req->authorization.size();
+}
+
+inline esp_err_t httpd_req_get_hdr_value_str(httpd_req_t* req, const char*, char* value, size_t size) {
+  if (req->authorization.empty() || req->authorization.size() >= size) return ESP_FAIL;
+  strcpy(value, req->authorization.c_str());
+  return ESP_OK;
+}
+
+inline int httpd_req_recv(httpd_req_t* req, char* buf, size_t size) {
+  size_t n = req->body.size() - req->received;
+  if (n > size) n = size;
+  memcpy(buf, req->body.data() + req->received, n);
+  req->received += n;
+  return n;
+}
+
+inline esp_err_t httpd_resp_set_status(httpd_req_t* req, const char* status) {
+  req->status = status;
+  return ESP_OK;
+}
+
+inline esp_err_t httpd_resp_set_type(httpd_req_t* req, const char* type) {
+  req->type = type;
+  return ESP_OK;
+}
+
+inline esp_err_t httpd_resp_set_hdr(httpd_req_t*, const char*, const char*) { return ESP_OK; }
+
+inline esp_err_t httpd_resp_send(httpd_req_t* req, const char* buf, ssize_t length) {
+  if (req->sendDelayMs) std::this_thread::sleep_for(std::chrono::milliseconds(req->sendDelayMs));
+  req->response.assign(buf, length);
+  req->sent = true;
+  return ESP_OK;
+}
+
+/**
+ * Run a request through the registered handler (on the calling thread)
+ */
+inline esp_err_t nativeHttpServe(httpd_req_t* req) {
+  req->content_len = req->body.size();
+  return nativeHttpHandlers[req->method == HTTP_POST](req);
+}
+
+#endif // NATIVE_ESP_HTTP_SERVER_H
@@ -0,0 +1,61 @@
+#!/usr/bin/env python3
+"""
+Regenerate patch_fixture.h: a patch made by tools/ota_tool.py diff between two
+synthetic images. test_main.cpp builds the same images (same recipe, same
+xorshift32 generator) and checks that delta_patch.cpp rebuilds the new one.
+
+  python3 test/test_delta_patch/make_fixture.py   (from firmware/)
+"""
+
+import os
+import sys
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+sys.path.insert(0, os.path.join(HERE, "..", "..", "tools"))
+import ota_tool  # noqa: E402
+
+OLD_SIZE = 6144
+
+
+def xorshift(seed, count):
+    out = bytearray()
+    x = seed
+    for _ in range(count):
+        x ^= (x << 13) & 0xFFFFFFFF
+        x ^= x >> 17
+        x ^= (x << 5) & 0xFFFFFFFF
+        out.append(x & 0xFF)
+    return out
+
+
+def images():
+    """Keep in sync with buildImages() in test_main.cpp"""
+    old = xorshift(0x12345678, OLD_SIZE)
+    changed = bytearray(old[1024:4096])
+    for i in range(0, len(changed), 700):
+        changed[i] ^= 0x5A                          # Scattered one-byte edits
+    new = old[:1024] + xorshift(0xCAFEBABE, 200) + changed + old[4400:] + old[:512]
+    return bytes(old), bytes(new)
+
+
+def main():
+    old, new = images()
+    patch = ota_tool.diff(old, new)
+    assert ota_tool.apply(old, patch) == new
+
+    lines = ["// Generated by make_fixture.py from tools/ota_tool.py diff output; do not edit",
+             "#pragma once",
+             "",
+             f"#define FIXTURE_OLD_SIZE {len(old)}",
+             f"#define FIXTURE_NEW_SIZE {len(new)}",
+             "",
+             f"static const uint8_t FIXTURE_PATCH[{len(patch)}] = {{"]
+    for pos in range(0, len(patch), 16):
+        lines.append("  " + ", ".join(f"0x{b:02x}" for b in patch[pos:pos + 16]) + ",")
+    lines.append("};")
+    open(os.path.join(HERE, "patch_fixture.h"), "w").write("\n".join(lines) + "\n")
+    print(f"Patch: {len(patch)} bytes for a {len(new)} byte image")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,27 @@
+// Generated by make_fixture.py from tools/ota_tool.py diff output; do not edit
+#pragma once
+
+#define FIXTURE_OLD_SIZE 6144
+#define FIXTURE_NEW_SIZE 6552
+
+static const uint8_t FIXTURE_PATCH[299] = {
+  0x45, 0x53, 0x50, 0x44, 0x00, 0x18, 0x00, 0x00, 0x98, 0x19, 0x00, 0x00, 0x8d, 0x18, 0x0c, 0x5f,
+  0xa7, 0x2c, 0xb8, 0xc1, 0x57, 0xcf, 0x4b, 0xc8, 0x12, 0xb5, 0x03, 0x4c, 0xb5, 0x6d, 0xe7, 0x53,
+  0x55, 0x4e, 0xc2, 0x94, 0xe1, 0xaa, 0x4e, 0xe0, 0x46, 0x0b, 0x8c, 0x90, 0x01, 0x00, 0x80, 0x08,
+  0x02, 0xc9, 0x01, 0x2a, 0x9b, 0xfa, 0xfb, 0x2d, 0x80, 0xe0, 0x56, 0xa1, 0x0d, 0x33, 0x03, 0x41,
+  0xba, 0x8a, 0x3f, 0x95, 0xe8, 0xb4, 0x37, 0xe2, 0xa2, 0x1e, 0x05, 0x8c, 0xe0, 0x0b, 0x0c, 0x03,
+  0xda, 0x81, 0xb3, 0x59, 0x89, 0x49, 0x3c, 0xf2, 0xa0, 0xb0, 0xad, 0xe6, 0x50, 0x1a, 0x50, 0x68,
+  0x37, 0xa2, 0x1d, 0xf7, 0x9b, 0x97, 0xbd, 0x4d, 0x50, 0xad, 0x02, 0xdc, 0xe6, 0x68, 0x2a, 0x44,
+  0x2a, 0xda, 0x6b, 0xaa, 0x4e, 0x9c, 0x66, 0x30, 0x5f, 0xa2, 0xac, 0xba, 0xf2, 0x9f, 0x7d, 0x92,
+  0x80, 0xf6, 0x4f, 0xd6, 0x07, 0x82, 0x16, 0xec, 0x2f, 0xeb, 0x47, 0x44, 0x01, 0x3a, 0x44, 0x8d,
+  0xeb, 0x5e, 0x51, 0x13, 0x58, 0xf3, 0xa8, 0x7d, 0xfd, 0xc0, 0x88, 0xfe, 0x7a, 0x37, 0xd7, 0xee,
+  0x03, 0x7a, 0xfc, 0xb0, 0x23, 0xa9, 0x07, 0x57, 0x1b, 0x5b, 0x08, 0x7d, 0xa2, 0xb9, 0xf7, 0x75,
+  0x06, 0x87, 0x41, 0xee, 0x12, 0x51, 0xd4, 0x70, 0x35, 0x07, 0x9f, 0x6b, 0xe0, 0x1d, 0xe3, 0x2e,
+  0xb6, 0x6e, 0x12, 0x5d, 0xfa, 0xd6, 0x25, 0x4b, 0xc1, 0xc0, 0x89, 0xf6, 0x4e, 0x0f, 0xd1, 0x82,
+  0x15, 0xb6, 0xd8, 0xf6, 0x66, 0x98, 0x03, 0x18, 0x28, 0x5e, 0x91, 0xb1, 0xa4, 0xf5, 0x1c, 0x0c,
+  0x66, 0xe8, 0x95, 0x70, 0xa7, 0x9d, 0x59, 0x38, 0x92, 0xc7, 0xec, 0xce, 0x45, 0xe4, 0x99, 0x17,
+  0x6f, 0xd3, 0xe4, 0xb8, 0x4e, 0x3a, 0xde, 0x7d, 0xf9, 0x77, 0x33, 0xec, 0x01, 0x81, 0x08, 0xbb,
+  0x05, 0x02, 0x01, 0xc3, 0x01, 0xbd, 0x0d, 0xbb, 0x05, 0x02, 0x01, 0x3f, 0x01, 0xf9, 0x12, 0xbb,
+  0x05, 0x02, 0x01, 0xea, 0x01, 0xb5, 0x18, 0xbb, 0x05, 0x02, 0x01, 0xf5, 0x01, 0xf1, 0x1d, 0x8f,
+  0x02, 0x01, 0xb0, 0x22, 0xd0, 0x0d, 0x01, 0x00, 0x80, 0x04, 0x00,
+};
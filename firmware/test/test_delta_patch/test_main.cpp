@@ -0,0 +1,164 @@
+/**
+ * @file test_main.cpp
+ * @brief Host check: patches made by tools/ota_tool.py diff decode on the device
+ *
+ * patch_fixture.h is the diff output for two synthetic images (make_fixture.py);
+ * buildImages() rebuilds the same images here. The patch is fed to DeltaDecoder
+ * in pieces of several sizes, as MQTT chunks and HTTPS reads arrive, and the
+ * target must equal the new image byte for byte. Damaged patches must stop
+ * with the error the OTA status reports.
+ *
+ *   pio test -e native -f test_delta_patch
+ */
+
+#include <unity.h>
+#include <string.h>
+#include "delta_patch.h"
+#include "patch_fixture.h"
+
+#define TARGET_CAPACITY  (FIXTURE_NEW_SIZE + 64)
+
+static uint8_t oldImage[FIXTURE_OLD_SIZE];
+static uint8_t newImage[FIXTURE_NEW_SIZE];
+static uint8_t target[TARGET_CAPACITY];
+static size_t targetLen = 0;
+static bool acceptHeader = true;
+
+/**
+ * xorshift32 bytes (same generator as make_fixture.py)
+ */
+static void xorshift(uint32_t seed, uint8_t* out, size_t count) {
+  uint32_t x = seed;
+  for (size_t i = 0; i < count; i++) {
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    out[i] = x & 0xFF;
+  }
+}
+
+/**
+ * The images the fixture was made from (keep in sync with images() in make_fixture.py)
+ */
+static void buildImages() {
+  xorshift(0x12345678, oldImage, sizeof(oldImage));
+
+  size_t n = 0;
+  memcpy(newImage, oldImage, 1024);                       n += 1024;
+  xorshift(0xCAFEBABE, newImage + n, 200);                n += 200;
+  memcpy(newImage + n, oldImage + 1024, 4096 - 1024);
+  for (size_t i = 0; i < 4096 - 1024; i += 700) newImage[n + i] ^= 0x5A;
+  n += 4096 - 1024;
+  memcpy(newImage + n, oldImage + 4400, FIXTURE_OLD_SIZE - 4400);  n += FIXTURE_OLD_SIZE - 4400;
+  memcpy(newImage + n, oldImage, 512);                    n += 512;
+  TEST_ASSERT_EQUAL_size_t(FIXTURE_NEW_SIZE, n);
+}
+
+// Decoder callbacks over the RAM images
+
+static bool onHeader(void*, const DeltaHeader& header) {
+  return acceptHeader && header.sourceSize == FIXTURE_OLD_SIZE && header.targetSize == FIXTURE_NEW_SIZE;
+}
+
+static bool onRead(void*, uint32_t offset, uint8_t* buf, size_t len) {
+  if (offset + len > sizeof(oldImage)) return false;
+  memcpy(buf, oldImage + offset, len);
+  return true;
+}
+
+static bool onWrite(void*, const uint8_t* buf, size_t len) {
+  if (targetLen + len > sizeof(target)) return false;
+  memcpy(target + targetLen, buf, len);
+  targetLen += len;
+  return true;
+}
+
+/**
+ * Feed a patch in pieces of `step` bytes
+ * @return the first error, or DELTA_OK
+ */
+static DeltaResult decode(DeltaDecoder& decoder, const uint8_t* patch, size_t len, size_t step) {
+  DeltaCallbacks callbacks = { nullptr, onHeader, onRead, onWrite };
+  decoder.begin(callbacks);
+  targetLen = 0;
+  for (size_t pos = 0; pos < len; pos += step) {
+    size_t n = len - pos < step ? len - pos : step;
+    DeltaResult result = decoder.feed(patch + pos, n);
+    if (result != DELTA_OK) return result;
+  }
+  return DELTA_OK;
+}
+
+void setUp() {
+  buildImages();
+  acceptHeader = true;
+}
+
+void tearDown() {}
+
+void test_diff_output_rebuilds_the_new_image() {
+  // 1 byte (worst case), odd sizes that split varints, an MQTT chunk, all at once
+  const size_t steps[] = { 1, 3, 7, 256, sizeof(FIXTURE_PATCH) };
+  for (size_t s = 0; s < sizeof(steps) / sizeof(steps[0]); s++) {
+    DeltaDecoder decoder;
+    TEST_ASSERT_EQUAL_INT(DELTA_OK, decode(decoder, FIXTURE_PATCH, sizeof(FIXTURE_PATCH), steps[s]));
+    TEST_ASSERT_TRUE(decoder.finished());
+    TEST_ASSERT_EQUAL_UINT32(FIXTURE_NEW_SIZE, decoder.written());
+    TEST_ASSERT_EQUAL_size_t(FIXTURE_NEW_SIZE, targetLen);
+    TEST_ASSERT_EQUAL_MEMORY(newImage, target, FIXTURE_NEW_SIZE);
+  }
+}
+
+void test_patch_against_another_image_is_rejected() {
+  acceptHeader = false;
+  DeltaDecoder decoder;
+  TEST_ASSERT_EQUAL_INT(DELTA_ERR_SOURCE, decode(decoder, FIXTURE_PATCH, sizeof(FIXTURE_PATCH), 64));
+  TEST_ASSERT_EQUAL_size_t(0, targetLen);
+}
+
+void test_truncated_patch_is_not_finished() {
+  DeltaDecoder decoder;
+  TEST_ASSERT_EQUAL_INT(DELTA_OK, decode(decoder, FIXTURE_PATCH, sizeof(FIXTURE_PATCH) - 1, 64));
+  TEST_ASSERT_FALSE(decoder.finished());   // OTA reports patch_incomplete
+}
+
+void test_bytes_after_end_are_rejected() {
+  uint8_t patch[sizeof(FIXTURE_PATCH) + 1];
+  memcpy(patch, FIXTURE_PATCH, sizeof(FIXTURE_PATCH));
+  patch[sizeof(FIXTURE_PATCH)] = DELTA_OP_END;
+  DeltaDecoder decoder;
+  TEST_ASSERT_EQUAL_INT(DELTA_ERR_TRAILING, decode(decoder, patch, sizeof(patch), 64));
+}
+
+void test_bad_magic_and_opcode_are_rejected() {
+  uint8_t patch[sizeof(FIXTURE_PATCH)];
+  memcpy(patch, FIXTURE_PATCH, sizeof(patch));
+  patch[0] = 'X';
+  DeltaDecoder decoder;
+  TEST_ASSERT_EQUAL_INT(DELTA_ERR_FORMAT, decode(decoder, patch, sizeof(patch), 64));
+
+  memcpy(patch, FIXTURE_PATCH, sizeof(patch));
+  patch[DELTA_HEADER_SIZE] = 0x7F;   // First operation
+  TEST_ASSERT_EQUAL_INT(DELTA_ERR_FORMAT, decode(decoder, patch, sizeof(patch), 64));
+}
+
+void test_copy_outside_the_source_is_rejected() {
+  // Header of the fixture, then COPY 6000+200 > source size
+  uint8_t patch[DELTA_HEADER_SIZE + 6];
+  memcpy(patch, FIXTURE_PATCH, DELTA_HEADER_SIZE);
+  const uint8_t op[] = { DELTA_OP_COPY, 0xF0, 0x2E, 0xC8, 0x01, DELTA_OP_END };   // 6000, 200
+  memcpy(patch + DELTA_HEADER_SIZE, op, sizeof(op));
+  DeltaDecoder decoder;
+  TEST_ASSERT_EQUAL_INT(DELTA_ERR_SOURCE, decode(decoder, patch, sizeof(patch), 64));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_diff_output_rebuilds_the_new_image);
+  RUN_TEST(test_patch_against_another_image_is_rejected);
+  RUN_TEST(test_truncated_patch_is_not_finished);
+  RUN_TEST(test_bytes_after_end_are_rejected);
+  RUN_TEST(test_bad_magic_and_opcode_are_rejected);
+  RUN_TEST(test_copy_outside_the_source_is_rejected);
+  return UNITY_END();
+}
@@ -0,0 +1,252 @@
+/**
+ * @file test_main.cpp
+ * @brief Host tests: local API hand-off between the HTTP task and the main loop
+ *
+ * local_api.cpp runs against the scriptable esp_http_server from test/native
+ * with real FreeRTOS-style semaphores and queues: the test thread plays the
+ * HTTP task and a second thread plays the main loop (polls commands, renders
+ * the state snapshot every few milliseconds, can be blocked as by an MQTT
+ * connect). Checked: GETs answered from the snapshot without the loop, also
+ * while it is blocked; commands answered by the loop, queued with 202 past
+ * LOCAL_API_TIMEOUT, refused with 503 when the queue is full and run in order
+ * when the loop returns; a slow GET send makes the loop skip refreshes instead
+ * of rewriting the buffer being sent.
+ *
+ * The module keeps its state static: tests run in order. The queueing test
+ * waits out LOCAL_API_TIMEOUT once per queue slot (about 8 s).
+ *
+ *   pio test -e native -f test_local_api
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+#include <esp_http_server.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include "local_api.h"
+
+#define TOKEN       "pool-secret"
+#define LOOP_MS     5      // Fake loop period
+#define PROMPT_MS   50     // "At once": well under LOCAL_API_TIMEOUT
+
+// ==================== Fake Main Loop ====================
+
+static std::thread loopThread;
+static std::atomic<bool> running{false};
+static std::atomic<bool> blocked{false};
+static std::atomic<bool> parked{false};     // Loop is inside the block
+static std::atomic<int> renders{0};
+static std::atomic<int> skipped{0};         // Snapshot refreshes skipped (HTTP task sending)
+static std::mutex handledLock;
+static std::vector<std::string> handled;    // "path=body" of each command, in order
+
+static void fakeLoop() {
+  while (running) {
+    if (blocked) {
+      parked = true;
+      std::this_thread::sleep_for(std::chrono::milliseconds(LOOP_MS));
+      continue;
+    }
+    parked = false;
+
+    LocalApiRequest request;
+    while (pollLocalApiRequest(&request)) {
+      std::string line = std::string(request.path) + "=" + std::string((const char*)request.body, request.length);
+      {
+        std::lock_guard<std::mutex> lock(handledLock);
+        handled.push_back(line);
+      }
+      localApiResponse().print(line.c_str());
+      completeLocalApiRequest(request.id, 200);
+    }
+
+    Print* out = beginLocalApiSnapshot(LOCAL_API_STATE);
+    if (out) {
+      out->print("{\"render\":");
+      out->print(++renders);
+      out->print("}");
+      endLocalApiSnapshot(LOCAL_API_STATE);
+    } else {
+      skipped++;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(LOOP_MS));
+  }
+}
+
+static void blockLoop(bool block) {
+  blocked = block;
+  while (parked != block) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+// ==================== Helpers ====================
+
+static httpd_req_t request(int method, const char* uri, const char* body = "", const char* token = TOKEN) {
+  httpd_req_t req;
+  req.method = method;
+  snprintf(req.uri, sizeof(req.uri), "%s", uri);
+  if (token) req.authorization = std::string("Bearer ") + token;
+  req.body = body;
+  return req;
+}
+
+static uint32_t elapsedMs(std::chrono::steady_clock::time_point start) {
+  using namespace std::chrono;
+  return duration_cast<milliseconds>(steady_clock::now() - start).count();
+}
+
+static LocalApiStats apiStats() {
+  LocalApiStats s;
+  getLocalApiStats(&s);
+  return s;
+}
+
+// ==================== Tests ====================
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_get_before_the_first_render_is_503() {
+  httpd_req_t req = request(HTTP_GET, "/api/state");
+  nativeHttpServe(&req);
+  TEST_ASSERT_EQUAL_STRING("503 Service Unavailable", req.status.c_str());
+  TEST_ASSERT_EQUAL_STRING("{\"error\":\"starting\"}", req.response.c_str());
+  TEST_ASSERT_EQUAL_UINT32(1, apiStats().stale);
+}
+
+void test_requests_are_authenticated_and_bounded() {
+  httpd_req_t none = request(HTTP_GET, "/api/state", "", nullptr);
+  httpd_req_t wrong = request(HTTP_GET, "/api/state", "", "pool-secreT");
+  httpd_req_t shorter = request(HTTP_GET, "/api/state", "", "pool");
+  nativeHttpServe(&none);
+  nativeHttpServe(&wrong);
+  nativeHttpServe(&shorter);
+  TEST_ASSERT_EQUAL_STRING("401 Unauthorized", none.status.c_str());
+  TEST_ASSERT_EQUAL_STRING("401 Unauthorized", wrong.status.c_str());
+  TEST_ASSERT_EQUAL_STRING("401 Unauthorized", shorter.status.c_str());
+
+  std::string path = "/api/" + std::string(LOCAL_API_PATH_LEN, 'p');
+  httpd_req_t longPath = request(HTTP_POST, path.c_str(), "ON");
+  std::string body(LOCAL_API_MAX_BODY + 1, 'b');
+  httpd_req_t bigBody = request(HTTP_POST, "/api/pump", body.c_str());
+  nativeHttpServe(&longPath);
+  nativeHttpServe(&bigBody);
+  TEST_ASSERT_EQUAL_STRING("414 URI Too Long", longPath.status.c_str());
+  TEST_ASSERT_EQUAL_STRING("413 Payload Too Large", bigBody.status.c_str());
+
+  LocalApiStats s = apiStats();
+  TEST_ASSERT_EQUAL_UINT32(3, s.unauthorized);
+  TEST_ASSERT_EQUAL_UINT32(2, s.rejected);
+}
+
+void test_get_is_served_from_the_snapshot() {
+  running = true;
+  loopThread = std::thread(fakeLoop);
+  while (renders == 0) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+  httpd_req_t state = request(HTTP_GET, "/api/state?fields=all");   // Query string ignored
+  httpd_req_t missing = request(HTTP_GET, "/api/nope");
+  nativeHttpServe(&state);
+  nativeHttpServe(&missing);
+  TEST_ASSERT_EQUAL_STRING("200 OK", state.status.c_str());
+  TEST_ASSERT_EQUAL_STRING("application/json", state.type.c_str());
+  TEST_ASSERT_EQUAL_STRING_LEN("{\"render\":", state.response.c_str(), 10);
+  TEST_ASSERT_EQUAL_STRING("404 Not Found", missing.status.c_str());
+}
+
+void test_command_is_answered_by_the_loop() {
+  httpd_req_t req = request(HTTP_POST, "/api/pump", "ON");
+  auto start = std::chrono::steady_clock::now();
+  nativeHttpServe(&req);
+  TEST_ASSERT_LESS_THAN_UINT32(PROMPT_MS, elapsedMs(start));
+  TEST_ASSERT_EQUAL_STRING("200 OK", req.status.c_str());
+  TEST_ASSERT_EQUAL_STRING("/api/pump=ON", req.response.c_str());
+}
+
+void test_get_is_answered_while_the_loop_is_blocked() {
+  blockLoop(true);
+  int rendered = renders;
+
+  httpd_req_t req = request(HTTP_GET, "/api/state");
+  auto start = std::chrono::steady_clock::now();
+  nativeHttpServe(&req);
+  TEST_ASSERT_LESS_THAN_UINT32(PROMPT_MS, elapsedMs(start));
+  TEST_ASSERT_EQUAL_STRING("200 OK", req.status.c_str());
+  TEST_ASSERT_EQUAL_STRING(("{\"render\":" + std::to_string(rendered) + "}").c_str(), req.response.c_str());
+}
+
+void test_commands_are_queued_while_the_loop_is_blocked() {
+  for (int i = 0; i < LOCAL_API_QUEUE_DEPTH; i++) {
+    std::string body = "OFF" + std::to_string(i);
+    httpd_req_t req = request(HTTP_POST, "/api/pump", body.c_str());
+    auto start = std::chrono::steady_clock::now();
+    nativeHttpServe(&req);
+    uint32_t waited = elapsedMs(start);
+    TEST_ASSERT_TRUE(waited >= LOCAL_API_TIMEOUT - LOOP_MS && waited < LOCAL_API_TIMEOUT + 500);
+    TEST_ASSERT_EQUAL_STRING("202 Accepted", req.status.c_str());
+    TEST_ASSERT_EQUAL_STRING("{\"result\":\"queued\"}", req.response.c_str());
+  }
+
+  // Queue full: refused at once, not after another timeout
+  httpd_req_t full = request(HTTP_POST, "/api/valve", "OPEN");
+  auto start = std::chrono::steady_clock::now();
+  nativeHttpServe(&full);
+  TEST_ASSERT_LESS_THAN_UINT32(PROMPT_MS, elapsedMs(start));
+  TEST_ASSERT_EQUAL_STRING("503 Service Unavailable", full.status.c_str());
+  TEST_ASSERT_EQUAL_STRING("{\"error\":\"busy\"}", full.response.c_str());
+
+  LocalApiStats s = apiStats();
+  TEST_ASSERT_EQUAL_UINT32(LOCAL_API_QUEUE_DEPTH, s.queued);
+  TEST_ASSERT_EQUAL_UINT32(1, s.busy);
+}
+
+void test_queued_commands_run_in_order_when_the_loop_returns() {
+  blockLoop(false);
+
+  // Answered with its own response, after the queued ones ran
+  httpd_req_t req = request(HTTP_POST, "/api/timer", "T");
+  nativeHttpServe(&req);
+  TEST_ASSERT_EQUAL_STRING("200 OK", req.status.c_str());
+  TEST_ASSERT_EQUAL_STRING("/api/timer=T", req.response.c_str());
+
+  std::lock_guard<std::mutex> lock(handledLock);
+  TEST_ASSERT_EQUAL_size_t(2 + LOCAL_API_QUEUE_DEPTH, handled.size());
+  TEST_ASSERT_EQUAL_STRING("/api/pump=ON", handled[0].c_str());
+  for (int i = 0; i < LOCAL_API_QUEUE_DEPTH; i++) {
+    TEST_ASSERT_EQUAL_STRING(("/api/pump=OFF" + std::to_string(i)).c_str(), handled[1 + i].c_str());
+  }
+  TEST_ASSERT_EQUAL_STRING("/api/timer=T", handled.back().c_str());
+}
+
+void test_slow_get_send_holds_the_snapshot() {
+  int before = skipped;
+  httpd_req_t req = request(HTTP_GET, "/api/state");
+  req.sendDelayMs = 20 * LOOP_MS;
+  nativeHttpServe(&req);
+
+  // The loop skipped its refreshes while the buffer was sent, and the body is one render
+  TEST_ASSERT_GREATER_THAN_INT(before, (int)skipped);
+  TEST_ASSERT_EQUAL_STRING("200 OK", req.status.c_str());
+  TEST_ASSERT_EQUAL_STRING_LEN("{\"render\":", req.response.c_str(), 10);
+  TEST_ASSERT_EQUAL_INT('}', req.response.back());
+
+  running = false;
+  loopThread.join();
+}
+
+int main() {
+  initLocalApi(TOKEN);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_get_before_the_first_render_is_503);
+  RUN_TEST(test_requests_are_authenticated_and_bounded);
+  RUN_TEST(test_get_is_served_from_the_snapshot);
+  RUN_TEST(test_command_is_answered_by_the_loop);
+  RUN_TEST(test_get_is_answered_while_the_loop_is_blocked);
+  RUN_TEST(test_commands_are_queued_while_the_loop_is_blocked);
+  RUN_TEST(test_queued_commands_run_in_order_when_the_loop_returns);
+  RUN_TEST(test_slow_get_send_holds_the_snapshot);
+  return UNITY_END();
+}
@@ -0,0 +1,420 @@
+/**
+ * @file test_main.cpp
+ * @brief Host tests: outbound queue, QoS 1 tracking and LAN/cloud routing
+ *
+ * The transport runs on its real CoalescingClient over a fake socket that
+ * records the bytes of every flush and plays back what the broker sends
+ * (PUBACKs), with the PubSubClient stand-in from test/native. The packets
+ * written are decoded and checked, as the broker would see them.
+ *
+ * The transport keeps its queue in static state, so every test ends with the
+ * queue empty and nothing in flight (settle()); the cloud link is attached by
+ * the routing tests, which run last.
+ *
+ *   pio test -e native -f test_mqtt_transport
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include "config.h"
+#include "coalescing_client.h"
+#include "mqtt_routes.h"
+#include "mqtt_transport.h"
+#include <PubSubClient.h>
+
+/**
+ * Broker side of one session: what was written, what comes back
+ */
+class FakeSocket : public Client {
+ public:
+  std::vector<uint8_t> out;
+  std::deque<uint8_t> in;
+  bool up = true;
+  bool failWrites = false;
+
+  int connect(IPAddress, uint16_t) override { return up = true; }
+  int connect(const char*, uint16_t) override { return up = true; }
+  size_t write(uint8_t b) override { return write(&b, 1); }
+  size_t write(const uint8_t* buf, size_t size) override {
+    if (!up || failWrites) return 0;
+    out.insert(out.end(), buf, buf + size);
+    return size;
+  }
+  int available() override { return in.size(); }
+  int read() override {
+    if (in.empty()) return -1;
+    int b = in.front();
+    in.pop_front();
+    return b;
+  }
+  int read(uint8_t* buf, size_t size) override {
+    size_t n = 0;
+    while (n < size && !in.empty()) buf[n++] = read();
+    return n;
+  }
+  int peek() override { return in.empty() ? -1 : in.front(); }
+  void flush() override {}
+  void stop() override { up = false; }
+  uint8_t connected() override { return up; }
+  operator bool() override { return up; }
+};
+
+/**
+ * One packet as the broker received it
+ */
+struct Packet {
+  uint8_t type;
+  bool dup;
+  uint8_t qos;
+  bool retain;
+  std::string topic;
+  uint16_t id;
+  std::string payload;
+};
+
+static FakeSocket mainSocket;
+static FakeSocket cloudSocket;
+static CoalescingClient mainCoalescer(mainSocket);
+static CoalescingClient cloudCoalescer(cloudSocket);
+static PubSubClient mainMqtt(mainCoalescer);
+static PubSubClient cloudMqtt(cloudCoalescer);
+static bool cloudAttached = false;
+
+/**
+ * Decode (and consume) everything written to a socket
+ */
+static std::vector<Packet> received(FakeSocket& socket) {
+  std::vector<Packet> packets;
+  const std::vector<uint8_t>& o = socket.out;
+  size_t i = 0;
+  while (i < o.size()) {
+    Packet p = {};
+    uint8_t h = o[i++];
+    p.type = h >> 4;
+    p.dup = h & 0x08;
+    p.qos = (h >> 1) & 0x03;
+    p.retain = h & 0x01;
+    uint32_t remaining = 0;
+    uint32_t multiplier = 1;
+    uint8_t digit;
+    do {
+      digit = o[i++];
+      remaining += (digit & 0x7F) * multiplier;
+      multiplier *= 128;
+    } while (digit & 0x80);
+    size_t end = i + remaining;
+    if (p.type == 3) {
+      size_t topicLen = (o[i] << 8) | o[i + 1];
+      i += 2;
+      p.topic.assign((const char*)&o[i], topicLen);
+      i += topicLen;
+      if (p.qos > 0) {
+        p.id = (o[i] << 8) | o[i + 1];
+        i += 2;
+      }
+      p.payload.assign((const char*)&o[i], end - i);
+    }
+    i = end;
+    packets.push_back(p);
+  }
+  socket.out.clear();
+  return packets;
+}
+
+static void puback(FakeSocket& socket, uint16_t id) {
+  const uint8_t packet[] = { 0x40, 0x02, (uint8_t)(id >> 8), (uint8_t)(id & 0xFF) };
+  socket.in.insert(socket.in.end(), packet, packet + sizeof(packet));
+}
+
+static MqttQueueStats queueStats() {
+  MqttQueueStats s;
+  getMqttQueueStats(&s);
+  return s;
+}
+
+/**
+ * Acknowledge every QoS 1 publish until the queue is empty (publishes the
+ * test left unacknowledged come again once the ack timeout has passed)
+ */
+static void settle() {
+  mainSocket.up = true;
+  mainSocket.failWrites = false;
+  for (int round = 0; round < 8 && (queueStats().depth > 0 || queueStats().inflight > 0); round++) {
+    nativeMillis += MQTT_ACK_TIMEOUT;
+    mqttFlush(100);
+    for (FakeSocket* s : { &mainSocket, &cloudSocket }) {
+      for (const Packet& p : received(*s)) {
+        if (p.type == 3 && p.qos == 1) puback(*s, p.id);
+      }
+    }
+    mainMqtt.loop();
+    if (cloudAttached) cloudMqtt.loop();
+    mqttDrain();
+  }
+  received(mainSocket);
+  received(cloudSocket);
+}
+
+static size_t countTopic(const std::vector<Packet>& packets, const char* topic) {
+  size_t n = 0;
+  for (const Packet& p : packets) n += p.topic == topic;
+  return n;
+}
+
+void setUp() {
+  nativeMillis += 1000;
+}
+
+void tearDown() {
+  settle();
+}
+
+// ==================== QoS 1 ====================
+
+void test_state_goes_out_at_qos1_and_leaves_on_puback() {
+  mqttEnqueue(TOPIC_PUMP_STATE, "{\"state\":\"ON\"}", true, MQTT_PRIO_CRITICAL);
+  mqttEnqueue(TOPIC_CMD_ACK, "{\"id\":\"1\"}", false, MQTT_PRIO_CRITICAL);
+  mqttDrain();
+
+  std::vector<Packet> packets = received(mainSocket);
+  TEST_ASSERT_EQUAL_size_t(2, packets.size());
+  TEST_ASSERT_EQUAL_STRING(TOPIC_PUMP_STATE, packets[0].topic.c_str());
+  TEST_ASSERT_EQUAL_UINT8(1, packets[0].qos);
+  TEST_ASSERT_TRUE(packets[0].retain);
+  TEST_ASSERT_EQUAL_STRING("{\"state\":\"ON\"}", packets[0].payload.c_str());
+  TEST_ASSERT_EQUAL_UINT8(0, packets[1].qos);   // Acks stay QoS 0
+
+  MqttQueueStats before = queueStats();
+  TEST_ASSERT_EQUAL_UINT8(1, before.depth);     // Kept until acknowledged
+  TEST_ASSERT_EQUAL_UINT8(1, before.inflight);
+
+  puback(mainSocket, packets[0].id);
+  mainMqtt.loop();
+  MqttQueueStats after = queueStats();
+  TEST_ASSERT_EQUAL_UINT8(0, after.depth);
+  TEST_ASSERT_EQUAL_UINT8(0, after.inflight);
+  TEST_ASSERT_EQUAL_UINT32(before.acked + 1, after.acked);
+}
+
+void test_puback_bytes_inside_an_incoming_publish_are_ignored() {
+  mqttEnqueue(TOPIC_VALVE_STATE, "{\"mode\":1}", true, MQTT_PRIO_CRITICAL);
+  mqttDrain();
+  std::vector<Packet> packets = received(mainSocket);
+  TEST_ASSERT_EQUAL_size_t(1, packets.size());
+  uint16_t id = packets[0].id;
+
+  // Incoming PUBLISH whose payload looks like a PUBACK for our packet
+  const uint8_t incoming[] = { 0x30, 0x08, 0x00, 0x02, 'a', 'b', 0x40, 0x02, (uint8_t)(id >> 8), (uint8_t)id };
+  mainSocket.in.insert(mainSocket.in.end(), incoming, incoming + sizeof(incoming));
+  mainMqtt.loop();
+  TEST_ASSERT_EQUAL_UINT8(1, queueStats().inflight);
+
+  puback(mainSocket, id);
+  mainMqtt.loop();
+  TEST_ASSERT_EQUAL_UINT8(0, queueStats().inflight);
+}
+
+void test_inflight_window_and_redelivery_after_timeout() {
+  const char* topics[] = { TOPIC_PUMP_STATE, TOPIC_VALVE_STATE, TOPIC_TIMER_STATE,
+                           TOPIC_CONFIG_STATE, TOPIC_PUMP_POLICY, TOPIC_OTA_STATE };
+  for (const char* topic : topics) mqttEnqueue(topic, "v", true, MQTT_PRIO_STATE);
+  mqttEnqueue(TOPIC_TEMP_STATE, "20.5", true, MQTT_PRIO_TELEMETRY);
+  mqttDrain();
+
+  std::vector<Packet> first = received(mainSocket);
+  size_t qos1 = 0;
+  for (const Packet& p : first) qos1 += p.qos == 1;
+  TEST_ASSERT_EQUAL_size_t(MQTT_INFLIGHT_WINDOW, qos1);
+  TEST_ASSERT_EQUAL_size_t(1, countTopic(first, TOPIC_TEMP_STATE));   // QoS 0 not held by the window
+
+  // Nothing new while the window is full
+  mqttDrain();
+  TEST_ASSERT_EQUAL_size_t(0, received(mainSocket).size());
+
+  // Unacknowledged past the timeout: same packet IDs again, with DUP
+  MqttQueueStats before = queueStats();
+  nativeMillis += MQTT_ACK_TIMEOUT;
+  mqttDrain();
+  std::vector<Packet> resent = received(mainSocket);
+  TEST_ASSERT_EQUAL_size_t(MQTT_INFLIGHT_WINDOW, resent.size());
+  for (size_t i = 0; i < resent.size(); i++) {
+    TEST_ASSERT_TRUE(resent[i].dup);
+    TEST_ASSERT_EQUAL_UINT16(first[i].id, resent[i].id);
+    TEST_ASSERT_EQUAL_STRING(first[i].topic.c_str(), resent[i].topic.c_str());
+  }
+  TEST_ASSERT_EQUAL_UINT32(before.redelivered + MQTT_INFLIGHT_WINDOW, queueStats().redelivered);
+
+  // One PUBACK opens one slot of the window
+  puback(mainSocket, first[0].id);
+  mainMqtt.loop();
+  mqttDrain();
+  std::vector<Packet> next = received(mainSocket);
+  TEST_ASSERT_EQUAL_size_t(1, next.size());
+  TEST_ASSERT_FALSE(next[0].dup);
+}
+
+void test_disconnect_resends_with_dup_after_reconnect() {
+  mqttEnqueue(TOPIC_TIMER_STATE, "{\"active\":false}", true, MQTT_PRIO_STATE);
+  mqttDrain();
+  std::vector<Packet> first = received(mainSocket);
+  TEST_ASSERT_EQUAL_size_t(1, first.size());
+
+  mainSocket.up = false;
+  mqttDrain();
+  mainSocket.up = true;
+  mqttDrain();
+  std::vector<Packet> again = received(mainSocket);
+  TEST_ASSERT_EQUAL_size_t(1, again.size());
+  TEST_ASSERT_TRUE(again[0].dup);
+  TEST_ASSERT_EQUAL_UINT16(first[0].id, again[0].id);
+}
+
+void test_newer_value_replaces_an_unacknowledged_one() {
+  mqttEnqueue(TOPIC_VALVE_STATE, "{\"mode\":1}", true, MQTT_PRIO_CRITICAL);
+  mqttDrain();
+  std::vector<Packet> first = received(mainSocket);
+  TEST_ASSERT_EQUAL_size_t(1, first.size());
+
+  MqttQueueStats before = queueStats();
+  mqttEnqueue(TOPIC_VALVE_STATE, "{\"mode\":2}", true, MQTT_PRIO_CRITICAL);
+  TEST_ASSERT_EQUAL_UINT32(before.coalesced + 1, queueStats().coalesced);
+  mqttDrain();
+  std::vector<Packet> second = received(mainSocket);
+  TEST_ASSERT_EQUAL_size_t(1, second.size());
+  TEST_ASSERT_FALSE(second[0].dup);
+  TEST_ASSERT_TRUE(second[0].id != first[0].id);
+  TEST_ASSERT_EQUAL_STRING("{\"mode\":2}", second[0].payload.c_str());
+}
+
+// ==================== Flush ====================
+
+void test_failed_flush_keeps_messages_queued() {
+  mqttEnqueue(TOPIC_CMD_ACK, "{\"id\":\"7\"}", false, MQTT_PRIO_CRITICAL);
+  MqttQueueStats before = queueStats();
+  mainSocket.failWrites = true;
+  mqttDrain();
+  TEST_ASSERT_EQUAL_UINT8(before.depth, queueStats().depth);   // Written to the buffer only
+  TEST_ASSERT_EQUAL_UINT32(before.sent, queueStats().sent);
+  TEST_ASSERT_FALSE(mainSocket.up);                            // The coalescer stopped the socket
+
+  mainSocket.failWrites = false;
+  mainSocket.up = true;
+  mqttDrain();
+  std::vector<Packet> packets = received(mainSocket);
+  TEST_ASSERT_EQUAL_size_t(1, countTopic(packets, TOPIC_CMD_ACK));
+  TEST_ASSERT_EQUAL_UINT8(0, queueStats().depth);
+}
+
+// ==================== LAN + cloud routing ====================
+
+static void attachCloud() {
+  if (!cloudAttached) attachMqttCloudLink(&cloudMqtt, &cloudCoalescer);
+  cloudAttached = true;
+  cloudSocket.up = true;
+  resetMqttRoutes();
+}
+
+void test_routes_keep_bulky_topics_on_the_lan_and_thin_telemetry() {
+  attachCloud();
+  mqttEnqueue(TOPIC_DIAG_STATE, "{\"heap\":1}", true, MQTT_PRIO_TELEMETRY);
+  mqttEnqueue(TOPIC_TEMP_STATE, "21.0", true, MQTT_PRIO_TELEMETRY);
+  mqttEnqueue(TOPIC_PUMP_STATE, "{\"state\":\"OFF\"}", true, MQTT_PRIO_CRITICAL);
+  mqttDrain();
+
+  std::vector<Packet> lan = received(mainSocket);
+  std::vector<Packet> cloud = received(cloudSocket);
+  TEST_ASSERT_EQUAL_size_t(1, countTopic(lan, TOPIC_DIAG_STATE));
+  TEST_ASSERT_EQUAL_size_t(0, countTopic(cloud, TOPIC_DIAG_STATE));
+  TEST_ASSERT_EQUAL_size_t(1, countTopic(cloud, TOPIC_TEMP_STATE));
+  TEST_ASSERT_EQUAL_size_t(1, countTopic(cloud, TOPIC_PUMP_STATE));
+  for (FakeSocket* s : { &mainSocket, &cloudSocket }) {
+    for (const Packet& p : s == &mainSocket ? lan : cloud) {
+      if (p.qos == 1) puback(*s, p.id);
+    }
+  }
+  mainMqtt.loop();
+  cloudMqtt.loop();
+
+  // Within the interval only the LAN gets the reading; critical ones always go out
+  nativeMillis += 1000;
+  mqttEnqueue(TOPIC_TEMP_STATE, "21.5", true, MQTT_PRIO_TELEMETRY);
+  mqttDrain();
+  TEST_ASSERT_EQUAL_size_t(1, countTopic(received(mainSocket), TOPIC_TEMP_STATE));
+  TEST_ASSERT_EQUAL_size_t(0, countTopic(received(cloudSocket), TOPIC_TEMP_STATE));
+
+  mqttEnqueue(TOPIC_WIFI_STATE, "{\"status\":\"connected\"}", true, MQTT_PRIO_TELEMETRY);
+  mqttDrain();
+  received(mainSocket);
+  received(cloudSocket);
+  mqttEnqueue(TOPIC_WIFI_STATE, "{\"status\":\"disconnected\"}", true, MQTT_PRIO_CRITICAL);
+  mqttDrain();
+  TEST_ASSERT_EQUAL_size_t(1, countTopic(received(cloudSocket), TOPIC_WIFI_STATE));
+
+  nativeMillis += MQTT_CLOUD_TELEMETRY_INTERVAL;
+  mqttEnqueue(TOPIC_TEMP_STATE, "22.0", true, MQTT_PRIO_TELEMETRY);
+  mqttDrain();
+  TEST_ASSERT_EQUAL_size_t(1, countTopic(received(cloudSocket), TOPIC_TEMP_STATE));
+}
+
+void test_cloud_loss_releases_its_copies() {
+  attachCloud();
+  cloudSocket.up = false;
+  mqttEnqueue(TOPIC_CONFIG_STATE, "{\"temp_pub_ms\":30000}", true, MQTT_PRIO_STATE);   // Cloud down: LAN only
+  MqttQueueStats before = queueStats();
+
+  cloudSocket.up = true;
+  mqttEnqueue(TOPIC_TIMER_STATE, "{\"active\":true}", true, MQTT_PRIO_STATE);
+  cloudSocket.up = false;
+  mqttDrain();
+  std::vector<Packet> lan = received(mainSocket);
+  TEST_ASSERT_EQUAL_size_t(1, countTopic(lan, TOPIC_TIMER_STATE));
+  for (const Packet& p : lan) {
+    if (p.qos == 1) puback(mainSocket, p.id);
+  }
+  mainMqtt.loop();
+
+  MqttQueueStats after = queueStats();
+  TEST_ASSERT_TRUE(after.cloudReleased > before.cloudReleased);
+  TEST_ASSERT_EQUAL_UINT8(0, after.depth);   // Nothing waits for the cloud
+}
+
+static void writeResult(Print& out, void*) {
+  for (int i = 0; i < 40; i++) out.print("{\"seq\":12345678},");
+}
+
+void test_streamed_publish_reaches_every_routed_session_whole() {
+  attachCloud();
+  TEST_ASSERT_TRUE(mqttPublishStreamed(TOPIC_EVENTS_RESULT, false, writeResult, nullptr));
+  std::vector<Packet> lan = received(mainSocket);
+  std::vector<Packet> cloud = received(cloudSocket);
+  TEST_ASSERT_EQUAL_size_t(1, lan.size());
+  TEST_ASSERT_EQUAL_size_t(1, cloud.size());
+  TEST_ASSERT_EQUAL_size_t(40 * 17, lan[0].payload.size());
+  TEST_ASSERT_EQUAL_STRING(lan[0].payload.c_str(), cloud[0].payload.c_str());
+
+  // Diagnostics stay on the LAN
+  TEST_ASSERT_TRUE(mqttPublishStreamed(TOPIC_DIAG_STATE, true, writeResult, nullptr));
+  TEST_ASSERT_EQUAL_size_t(1, received(mainSocket).size());
+  TEST_ASSERT_EQUAL_size_t(0, received(cloudSocket).size());
+}
+
+int main() {
+  mainMqtt.setBufferSize(MQTT_BUFFER_SIZE);
+  cloudMqtt.setBufferSize(MQTT_BUFFER_SIZE);
+  initMqttTransport(&mainMqtt, &mainCoalescer);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_state_goes_out_at_qos1_and_leaves_on_puback);
+  RUN_TEST(test_puback_bytes_inside_an_incoming_publish_are_ignored);
+  RUN_TEST(test_inflight_window_and_redelivery_after_timeout);
+  RUN_TEST(test_disconnect_resends_with_dup_after_reconnect);
+  RUN_TEST(test_newer_value_replaces_an_unacknowledged_one);
+  RUN_TEST(test_failed_flush_keeps_messages_queued);
+  RUN_TEST(test_routes_keep_bulky_topics_on_the_lan_and_thin_telemetry);
+  RUN_TEST(test_cloud_loss_releases_its_copies);
+  RUN_TEST(test_streamed_publish_reaches_every_routed_session_whole);
+  return UNITY_END();
+}
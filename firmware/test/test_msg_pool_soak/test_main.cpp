@@ -0,0 +1,143 @@
+/**
+ * @file test_main.cpp
+ * @brief Soak test: command handling on pooled buffers keeps pool and heap flat
+ *
+ * Runs the message path of handleCommand() SOAK_MESSAGES times on the host:
+ * the payload is copied into a MsgBuffer, validated and parsed with
+ * jsonValue(), and an ack plus a state message are built in nested buffers,
+ * as the publishers do. Every SOAK_SAMPLE messages the pool must be empty
+ * again and the heap in use must equal the value before the first message.
+ *
+ *   pio test -e native -f test_msg_pool_soak
+ *   (-DSOAK_MESSAGES=... in build_flags for a longer run)
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+#include "json_parse.h"
+#include "msg_pool.h"
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+#ifndef SOAK_MESSAGES
+#define SOAK_MESSAGES   2000000
+#endif
+#define SOAK_SAMPLE     100000
+
+/**
+ * Bytes allocated on the heap now (glibc; elsewhere only the pool is checked)
+ */
+static size_t heapInUse() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+  return mallinfo2().uordblks;
+#elif defined(__GLIBC__)
+  return mallinfo().uordblks;
+#else
+  return 0;
+#endif
+}
+
+// Payloads as they arrive on the command topics (values contain , } and escapes)
+static const char* const PAYLOADS[] = {
+  "{\"name\":\"morning\",\"mode\":1,\"duration\":3600}",
+  "{\"id\":42,\"ts\":1700000000123,\"cmd\":\"ON\"}",
+  "{\"slot\":\"secondary\",\"host\":\"x.hivemq.cloud\",\"port\":8883,\"tls\":true,"
+  "\"user\":\"pool\",\"pass\":\"p,a}s\\\"s\\\\w\"}",
+  "{\"temp_pub_ms\":30000,\"wifi_state_ms\":60000,\"nested\":{\"a\":[1,\"}\"]}}",
+  "{\"name\":\"evening\",\"mode\":2,\"duration\":0",   // Malformed: rejected
+};
+#define PAYLOAD_COUNT (sizeof(PAYLOADS) / sizeof(PAYLOADS[0]))
+
+/**
+ * One command through the pooled message path
+ * @return false if the payload was rejected as malformed
+ */
+static bool handleOne(const char* payload, uint32_t seq) {
+  MsgBuffer raw;
+  raw.write((const uint8_t*)payload, strlen(payload));
+  TEST_ASSERT_TRUE(raw.ok());
+  if (!jsonWellFormed(raw.c_str())) return false;
+
+  char id[16];
+  char mode[8];
+  char pass[24];
+  jsonValue(raw.c_str(), "id", id, sizeof(id));
+  jsonValue(raw.c_str(), "mode", mode, sizeof(mode));
+  int passLen = jsonValue(raw.c_str(), "pass", pass, sizeof(pass));
+  if (passLen >= 0) TEST_ASSERT_EQUAL_STRING("p,a}s\"s\\w", pass);
+
+  // Ack and state published while the command buffer is still alive
+  MsgBuffer ack;
+  ack.print("{\"id\":\"");
+  ack.print(id);
+  ack.print("\",\"seq\":");
+  ack.print(seq);
+  ack.print("}");
+  TEST_ASSERT_TRUE(ack.ok());
+
+  MsgBuffer state;
+  state.print("{\"mode\":");
+  state.print(mode[0] ? mode : "0");
+  state.print("}");
+  TEST_ASSERT_TRUE(state.ok());
+  return true;
+}
+
+void test_pool_and_heap_stay_flat() {
+  MsgPoolStats before;
+  getMsgPoolStats(&before);
+  size_t heapBefore = heapInUse();
+  uint32_t rejected = 0;
+
+  for (uint32_t i = 0; i < SOAK_MESSAGES; i++) {
+    if (!handleOne(PAYLOADS[i % PAYLOAD_COUNT], i)) rejected++;
+
+    if ((i + 1) % SOAK_SAMPLE == 0) {
+      MsgPoolStats now;
+      getMsgPoolStats(&now);
+      TEST_ASSERT_EQUAL_UINT8(0, now.inUse);
+      TEST_ASSERT_EQUAL_UINT32(heapBefore, heapInUse());
+    }
+  }
+
+  MsgPoolStats after;
+  getMsgPoolStats(&after);
+  TEST_ASSERT_EQUAL_UINT8(0, after.inUse);
+  TEST_ASSERT_LESS_OR_EQUAL_UINT8(3, after.highWater);
+  TEST_ASSERT_EQUAL_UINT32(0, after.exhausted - before.exhausted);
+  TEST_ASSERT_EQUAL_UINT32(SOAK_MESSAGES / PAYLOAD_COUNT, rejected);
+  TEST_ASSERT_EQUAL_UINT32(heapBefore, heapInUse());
+}
+
+void test_exhausted_and_truncated_buffers_are_returned() {
+  MsgPoolStats before;
+  getMsgPoolStats(&before);
+  size_t heapBefore = heapInUse();
+
+  for (uint32_t i = 0; i < SOAK_SAMPLE; i++) {
+    MsgBuffer taken[MSG_POOL_BLOCKS];
+    MsgBuffer extra;
+    TEST_ASSERT_FALSE(extra.ok());
+
+    // Overflow the first block: truncated, still returned
+    for (int j = 0; j < MSG_POOL_BLOCK_SIZE / 8 + 1; j++) taken[0].print("12345678");
+    TEST_ASSERT_FALSE(taken[0].ok());
+    TEST_ASSERT_EQUAL_size_t(MSG_POOL_BLOCK_SIZE - 1, taken[0].length());
+  }
+
+  MsgPoolStats after;
+  getMsgPoolStats(&after);
+  TEST_ASSERT_EQUAL_UINT8(0, after.inUse);
+  TEST_ASSERT_EQUAL_UINT32(SOAK_SAMPLE, after.exhausted - before.exhausted);
+  TEST_ASSERT_EQUAL_UINT32(SOAK_SAMPLE, after.truncated - before.truncated);
+  TEST_ASSERT_EQUAL_UINT32(heapBefore, heapInUse());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_pool_and_heap_stay_flat);
+  RUN_TEST(test_exhausted_and_truncated_buffers_are_returned);
+  return UNITY_END();
+}
@@ -0,0 +1,301 @@
+/**
+ * @file test_main.cpp
+ * @brief Host tests: WiFi survey scheduling, network lists and roam selection
+ *
+ * wifi_survey.cpp runs against the scriptable WiFi from test/native: each
+ * test sets the access points on the air, lets wifiSurveyLoop() start a scan
+ * and finishes it. Checked: the settle delay before the first connected scan,
+ * one list line per SSID (strongest first, hidden skipped), the roam margin
+ * and trigger, the two-scan average and the backoff after a failed roam, and
+ * the due time a sleeping loop waits for.
+ *
+ * The survey keeps its table in static state: tests run in order, and the
+ * roam tests use their own SSID so the provisioning entries do not matter.
+ *
+ *   pio test -e native -f test_wifi_survey
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+#include <WiFi.h>
+#include "wifi_survey.h"
+
+#define SETTLE_MS   60000   // WIFI_SURVEY_SETTLE in wifi_survey.cpp
+
+static const NativeAccessPoint HOME_WEAK  = { "Home",  { 0xAA, 0, 0, 0, 0, 0x01 }, 1,  -70, false };
+static const NativeAccessPoint HOME_NEAR  = { "Home",  { 0xAA, 0, 0, 0, 0, 0x02 }, 6,  -55, false };
+static const NativeAccessPoint GUEST      = { "Guest", { 0xAA, 0, 0, 0, 0, 0x03 }, 6,  -60, true };
+static const NativeAccessPoint HIDDEN     = { "",      { 0xAA, 0, 0, 0, 0, 0x04 }, 11, -40, false };
+static const NativeAccessPoint NEIGHBOR   = { "Casa",  { 0xAA, 0, 0, 0, 0, 0x05 }, 11, -80, false };
+
+// The roam tests: the station is on poolHere
+static NativeAccessPoint poolHere  = { "Pool", { 0xBB, 0, 0, 0, 0, 0x01 }, 1,  -75, false };
+static NativeAccessPoint poolNear  = { "Pool", { 0xBB, 0, 0, 0, 0, 0x02 }, 6,  -60, false };
+static NativeAccessPoint poolOther = { "Pool", { 0xBB, 0, 0, 0, 0, 0x03 }, 11, -70, false };
+
+/**
+ * Let the survey start a scan now and finish it
+ * @return false if no scan was started
+ */
+static bool completeScan(WifiSurveyMode mode) {
+  int started = WiFi.scansStarted;
+  wifiSurveyLoop(mode);
+  if (WiFi.scansStarted == started) return false;
+  WiFi.scanDone = true;
+  wifiSurveyLoop(mode);
+  return true;
+}
+
+/**
+ * Connected scan of the Pool network with the given readings
+ */
+static void poolScan(int32_t here, int32_t near, int32_t other) {
+  poolHere.rssi = here;
+  poolNear.rssi = near;
+  poolOther.rssi = other;
+  WiFi.aps = { poolHere, poolNear, poolOther };
+  WiFi.current = 0;
+  WiFi.linkRssi = here;
+  requestWifiSurvey();
+  TEST_ASSERT_TRUE(completeScan(WIFI_SURVEY_BACKGROUND));
+}
+
+void setUp() {
+  nativeMillis += 1000;
+  WiFi.scanStarts = true;
+  WiFi.scanFails = false;
+}
+
+void tearDown() {}
+
+// ==================== Scheduling and lists ====================
+
+void test_provisioning_scans_at_once_and_lists_one_line_per_ssid() {
+  initWifiSurvey();
+  WiFi.aps = { HOME_WEAK, HOME_NEAR, GUEST, HIDDEN, NEIGHBOR };
+
+  // Started in the first iteration, active; nothing to list until it completes
+  wifiSurveyLoop(WIFI_SURVEY_PROVISIONING);
+  TEST_ASSERT_EQUAL_INT(1, WiFi.scansStarted);
+  TEST_ASSERT_FALSE(WiFi.lastScanPassive);
+
+  WiFiNetworkInfo networks[8];
+  uint32_t age;
+  TEST_ASSERT_EQUAL_INT(0, getSurveyNetworks(networks, 8, &age));
+  TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, age);
+
+  WiFi.scanDone = true;
+  nativeMillis += 2000;
+  wifiSurveyLoop(WIFI_SURVEY_PROVISIONING);
+  TEST_ASSERT_EQUAL_UINT32(1, wifiSurveyCount());
+
+  int count = getSurveyNetworks(networks, 8, &age);
+  TEST_ASSERT_EQUAL_INT(3, count);
+  TEST_ASSERT_EQUAL_UINT32(0, age);
+  TEST_ASSERT_EQUAL_STRING("Home", networks[0].ssid);   // Strongest of its two BSSIDs
+  TEST_ASSERT_EQUAL_INT(-55, networks[0].rssi);
+  TEST_ASSERT_EQUAL_STRING("Guest", networks[1].ssid);
+  TEST_ASSERT_TRUE(networks[1].open);
+  TEST_ASSERT_EQUAL_STRING("Casa", networks[2].ssid);
+  TEST_ASSERT_FALSE(networks[0].open);
+
+  // A short list keeps the strongest
+  TEST_ASSERT_EQUAL_INT(2, getSurveyNetworks(networks, 2, &age));
+  TEST_ASSERT_EQUAL_STRING("Guest", networks[1].ssid);
+}
+
+void test_provisioning_rescans_on_its_interval_or_on_request() {
+  TEST_ASSERT_FALSE(completeScan(WIFI_SURVEY_PROVISIONING));
+
+  // The near access point moved away: the list follows the latest readings
+  NativeAccessPoint moved = HOME_NEAR;
+  moved.rssi = -90;
+  WiFi.aps = { HOME_WEAK, moved, GUEST };
+  requestWifiSurvey();
+  TEST_ASSERT_TRUE(completeScan(WIFI_SURVEY_PROVISIONING));
+
+  WiFiNetworkInfo networks[8];
+  uint32_t age;
+  getSurveyNetworks(networks, 8, &age);
+  TEST_ASSERT_EQUAL_STRING("Guest", networks[0].ssid);
+  TEST_ASSERT_EQUAL_STRING("Home", networks[1].ssid);
+  TEST_ASSERT_EQUAL_INT(-70, networks[1].rssi);
+
+  nativeMillis += WIFI_SURVEY_IDLE_INTERVAL;
+  TEST_ASSERT_TRUE(completeScan(WIFI_SURVEY_PROVISIONING));
+  TEST_ASSERT_EQUAL_UINT32(3, wifiSurveyCount());
+}
+
+void test_connected_scans_wait_for_the_settle_delay() {
+  WiFi.linkStatus = WL_CONNECTED;
+  WiFi.aps = { poolHere, poolNear, poolOther };
+  WiFi.current = 0;
+
+  TEST_ASSERT_FALSE(completeScan(WIFI_SURVEY_PAUSED));
+  TEST_ASSERT_FALSE(completeScan(WIFI_SURVEY_BACKGROUND));   // Just joined
+  nativeMillis += SETTLE_MS - 1;
+  TEST_ASSERT_FALSE(completeScan(WIFI_SURVEY_BACKGROUND));
+  nativeMillis += 1;
+  TEST_ASSERT_TRUE(completeScan(WIFI_SURVEY_BACKGROUND));
+  TEST_ASSERT_TRUE(WiFi.lastScanPassive);
+
+  nativeMillis += WIFI_SURVEY_INTERVAL - 1;
+  TEST_ASSERT_FALSE(completeScan(WIFI_SURVEY_BACKGROUND));
+  nativeMillis += 1;
+  TEST_ASSERT_TRUE(completeScan(WIFI_SURVEY_BACKGROUND));
+}
+
+void test_due_time_follows_the_schedule() {
+  // Connected, one full interval before the next background scan
+  TEST_ASSERT_FALSE(completeScan(WIFI_SURVEY_BACKGROUND));
+  TEST_ASSERT_EQUAL_UINT32(WIFI_SURVEY_INTERVAL - 1000, wifiSurveyDueMs(WIFI_SURVEY_BACKGROUND));
+  TEST_ASSERT_EQUAL_UINT32(0, wifiSurveyDueMs(WIFI_SURVEY_PROVISIONING));   // Mode change: scan at once
+  TEST_ASSERT_EQUAL_UINT32(0, wifiSurveyDueMs(WIFI_SURVEY_PAUSED));         // Mode change is handled at once
+
+  // A request is due now; a running scan is polled until it finishes
+  requestWifiSurvey();
+  TEST_ASSERT_EQUAL_UINT32(0, wifiSurveyDueMs(WIFI_SURVEY_BACKGROUND));
+  wifiSurveyLoop(WIFI_SURVEY_BACKGROUND);
+  TEST_ASSERT_EQUAL_UINT32(WIFI_SURVEY_POLL, wifiSurveyDueMs(WIFI_SURVEY_BACKGROUND));
+  WiFi.scanDone = true;
+  wifiSurveyLoop(WIFI_SURVEY_BACKGROUND);
+  TEST_ASSERT_EQUAL_UINT32(WIFI_SURVEY_INTERVAL, wifiSurveyDueMs(WIFI_SURVEY_BACKGROUND));
+
+  // Paused: nothing to wake up for
+  wifiSurveyLoop(WIFI_SURVEY_PAUSED);
+  requestWifiSurvey();
+  TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, wifiSurveyDueMs(WIFI_SURVEY_PAUSED));
+  TEST_ASSERT_TRUE(completeScan(WIFI_SURVEY_PROVISIONING));   // Taken up by the next mode that scans
+}
+
+void test_failed_and_stuck_scans_are_counted() {
+  WiFiSurveyStats before;
+  getWifiSurveyStats(&before);
+
+  WiFi.scanStarts = false;
+  requestWifiSurvey();
+  wifiSurveyLoop(WIFI_SURVEY_BACKGROUND);
+
+  WiFi.scanStarts = true;
+  WiFi.scanFails = true;
+  requestWifiSurvey();
+  TEST_ASSERT_TRUE(completeScan(WIFI_SURVEY_BACKGROUND));
+
+  // Never completes: abandoned after WIFI_SURVEY_TIMEOUT
+  WiFi.scanFails = false;
+  requestWifiSurvey();
+  wifiSurveyLoop(WIFI_SURVEY_BACKGROUND);
+  nativeMillis += WIFI_SURVEY_TIMEOUT;
+  wifiSurveyLoop(WIFI_SURVEY_BACKGROUND);
+
+  WiFiSurveyStats after;
+  getWifiSurveyStats(&after);
+  TEST_ASSERT_EQUAL_UINT32(before.failed + 3, after.failed);
+  TEST_ASSERT_EQUAL_UINT32(before.scans, after.scans);
+}
+
+// ==================== Roaming ====================
+
+void test_roam_needs_two_readings_of_the_candidate() {
+  WiFiRoamTarget target;
+  NativeAccessPoint newcomer = { "Pool", { 0xBB, 0, 0, 0, 0, 0x04 }, 11, -50, false };
+
+  // Strong, but seen by one scan only; the known ones are below the margin
+  poolHere.rssi = -75;
+  poolNear.rssi = -80;
+  poolOther.rssi = -70;
+  WiFi.aps = { poolHere, poolNear, poolOther, newcomer };
+  WiFi.linkRssi = -75;
+  requestWifiSurvey();
+  TEST_ASSERT_TRUE(completeScan(WIFI_SURVEY_BACKGROUND));
+  TEST_ASSERT_FALSE(findRoamTarget(&target));
+
+  requestWifiSurvey();
+  TEST_ASSERT_TRUE(completeScan(WIFI_SURVEY_BACKGROUND));
+  TEST_ASSERT_TRUE(findRoamTarget(&target));
+  TEST_ASSERT_EQUAL_MEMORY(newcomer.bssid, target.bssid, 6);
+}
+
+void test_roam_picks_the_strongest_candidate_above_the_margin() {
+  WiFiRoamTarget target;
+
+  // Candidates average -61 and -70 against -75: only the first is 8 dB stronger
+  poolScan(-75, -62, -70);
+  poolScan(-75, -60, -70);
+  TEST_ASSERT_TRUE(findRoamTarget(&target));
+  TEST_ASSERT_EQUAL_STRING("Pool", target.ssid);
+  TEST_ASSERT_EQUAL_MEMORY(poolNear.bssid, target.bssid, 6);
+  TEST_ASSERT_EQUAL_UINT8(6, target.channel);
+  TEST_ASSERT_EQUAL_INT(-61, target.rssi);
+  TEST_ASSERT_EQUAL_INT(-75, target.currentRssi);
+  TEST_ASSERT_FALSE(findRoamTarget(&target));   // Each finding once
+}
+
+void test_failed_roam_backs_off_that_access_point() {
+  WiFiRoamTarget target;
+  reportRoam(poolNear.bssid, false);
+
+  // No roam at all within WIFI_ROAM_INTERVAL of the attempt
+  poolScan(-75, -60, -70);
+  TEST_ASSERT_FALSE(findRoamTarget(&target));
+
+  // Later, the failed access point is still skipped (the other one is too weak)
+  nativeMillis += WIFI_ROAM_INTERVAL;
+  poolScan(-75, -60, -70);
+  TEST_ASSERT_FALSE(findRoamTarget(&target));
+
+  // ...until its backoff has passed
+  nativeMillis += WIFI_ROAM_BACKOFF - WIFI_ROAM_INTERVAL;
+  poolScan(-75, -60, -70);
+  TEST_ASSERT_TRUE(findRoamTarget(&target));
+  TEST_ASSERT_EQUAL_MEMORY(poolNear.bssid, target.bssid, 6);
+  reportRoam(target.bssid, true);
+
+  WiFiSurveyStats stats;
+  getWifiSurveyStats(&stats);
+  TEST_ASSERT_EQUAL_UINT32(1, stats.roams);
+  TEST_ASSERT_EQUAL_UINT32(1, stats.roamFailures);
+}
+
+void test_no_roam_from_a_good_link() {
+  WiFiRoamTarget target;
+  nativeMillis += WIFI_ROAM_INTERVAL;
+
+  // Above WIFI_ROAM_TRIGGER: a much stronger access point is not a reason
+  poolScan(WIFI_ROAM_TRIGGER, -40, -70);
+  poolScan(WIFI_ROAM_TRIGGER, -40, -70);
+  TEST_ASSERT_FALSE(findRoamTarget(&target));
+
+  // Just below it, the same candidate is taken
+  poolScan(WIFI_ROAM_TRIGGER - 2, -40, -70);
+  TEST_ASSERT_TRUE(findRoamTarget(&target));
+}
+
+void test_no_roam_while_disconnected_or_without_a_scan() {
+  WiFiRoamTarget target;
+  nativeMillis += WIFI_ROAM_INTERVAL;
+  poolScan(-80, -50, -70);
+  WiFi.linkStatus = WL_DISCONNECTED;
+  TEST_ASSERT_FALSE(findRoamTarget(&target));
+
+  // Provisioning (active) scans are not roam checks
+  WiFi.linkStatus = WL_CONNECTED;
+  requestWifiSurvey();
+  TEST_ASSERT_TRUE(completeScan(WIFI_SURVEY_PROVISIONING));
+  TEST_ASSERT_FALSE(findRoamTarget(&target));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_provisioning_scans_at_once_and_lists_one_line_per_ssid);
+  RUN_TEST(test_provisioning_rescans_on_its_interval_or_on_request);
+  RUN_TEST(test_connected_scans_wait_for_the_settle_delay);
+  RUN_TEST(test_due_time_follows_the_schedule);
+  RUN_TEST(test_failed_and_stuck_scans_are_counted);
+  RUN_TEST(test_roam_needs_two_readings_of_the_candidate);
+  RUN_TEST(test_roam_picks_the_strongest_candidate_above_the_margin);
+  RUN_TEST(test_failed_roam_backs_off_that_access_point);
+  RUN_TEST(test_no_roam_from_a_good_link);
+  RUN_TEST(test_no_roam_while_disconnected_or_without_a_scan);
+  return UNITY_END();
+}
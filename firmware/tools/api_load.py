@@ -0,0 +1,125 @@
+#!/usr/bin/env python3
+"""
+Load test for the local HTTP API of the pool controller (see include/local_api.h)
+
+  api_load.py --token <LOCAL_API_TOKEN> [--host esp32-pool-01.local] [--clients 4]
+              [--requests 200] [--get /api/state] [--post /api/pump=ON] [--json]
+
+Each client keeps one connection open and sends its share of requests back to
+back, cycling through the --get and --post targets (default: GET /api/state).
+Prints throughput, latency percentiles and the status codes seen, and exits
+with 1 if any request failed. Only the standard library is needed.
+
+POSTs change the pool: repeat the current state (e.g. --post /api/valve=1 while
+the valve is in mode 1) unless the relays are not wired.
+"""
+
+import argparse
+import http.client
+import json
+import sys
+import threading
+import time
+from collections import Counter
+
+
+def percentile(sorted_values, pct):
+    if not sorted_values:
+        return 0.0
+    index = min(len(sorted_values) - 1, int(round(pct / 100.0 * (len(sorted_values) - 1))))
+    return sorted_values[index]
+
+
+def client_worker(args, targets, count, latencies, statuses, lock):
+    conn = None
+    for i in range(count):
+        method, path, body = targets[i % len(targets)]
+        start = time.perf_counter()
+        try:
+            if conn is None:
+                conn = http.client.HTTPConnection(args.host, args.port, timeout=args.timeout)
+            headers = {"Authorization": f"Bearer {args.token}"}
+            if body is not None:
+                headers["Content-Type"] = "text/plain"
+            conn.request(method, path, body=body, headers=headers)
+            response = conn.getresponse()
+            response.read()
+            status = str(response.status)
+            if response.getheader("Connection", "").lower() == "close":
+                conn.close()
+                conn = None
+        except (OSError, http.client.HTTPException) as e:
+            status = type(e).__name__
+            if conn is not None:
+                conn.close()
+            conn = None
+        elapsed = (time.perf_counter() - start) * 1000.0
+        with lock:
+            latencies.append(elapsed)
+            statuses[status] += 1
+    if conn is not None:
+        conn.close()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--host", default="esp32-pool-01.local")
+    parser.add_argument("--port", type=int, default=80)
+    parser.add_argument("--token", required=True)
+    parser.add_argument("--clients", type=int, default=4, help="concurrent connections")
+    parser.add_argument("--requests", type=int, default=200, help="total requests")
+    parser.add_argument("--get", action="append", default=[], metavar="PATH")
+    parser.add_argument("--post", action="append", default=[], metavar="PATH=BODY")
+    parser.add_argument("--timeout", type=float, default=10.0, help="per request (s)")
+    parser.add_argument("--json", action="store_true", help="print the result as JSON")
+    args = parser.parse_args()
+
+    targets = [("GET", path, None) for path in args.get]
+    for spec in args.post:
+        path, _, body = spec.partition("=")
+        targets.append(("POST", path, body))
+    if not targets:
+        targets = [("GET", "/api/state", None)]
+
+    latencies, statuses, lock = [], Counter(), threading.Lock()
+    share = [args.requests // args.clients + (1 if i < args.requests % args.clients else 0)
+             for i in range(args.clients)]
+    threads = [threading.Thread(target=client_worker, args=(args, targets, n, latencies, statuses, lock))
+               for n in share if n > 0]
+
+    start = time.perf_counter()
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    elapsed = time.perf_counter() - start
+
+    latencies.sort()
+    failed = sum(n for status, n in statuses.items() if status != "200")
+    result = {
+        "host": args.host,
+        "clients": len(threads),
+        "requests": len(latencies),
+        "seconds": round(elapsed, 2),
+        "req_per_s": round(len(latencies) / elapsed, 1) if elapsed > 0 else 0.0,
+        "p50_ms": round(percentile(latencies, 50), 1),
+        "p90_ms": round(percentile(latencies, 90), 1),
+        "p99_ms": round(percentile(latencies, 99), 1),
+        "max_ms": round(latencies[-1], 1) if latencies else 0.0,
+        "statuses": dict(statuses),
+        "failed": failed,
+    }
+
+    if args.json:
+        print(json.dumps(result, indent=2))
+    else:
+        print(f"{result['requests']} requests, {result['clients']} clients, {result['seconds']} s "
+              f"({result['req_per_s']} req/s)")
+        print(f"latency p50 {result['p50_ms']} ms  p90 {result['p90_ms']} ms  "
+              f"p99 {result['p99_ms']} ms  max {result['max_ms']} ms")
+        print("status " + "  ".join(f"{s}: {n}" for s, n in sorted(statuses.items())))
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,87 @@
+#!/usr/bin/env python3
+"""
+Compare two benchmark runs of the pool controller (see include/benchmark.h)
+
+  bench_compare.py <base.log> <new.log> [--threshold 10] [--json]
+
+Each log is a serial monitor capture of an esp32dev-bench boot, or the
+verbose output of the host suite (pio test -e native -f bench/test_hot_paths -v);
+only the "BENCH {...}" lines are read. Prints ns/op and allocs/op per case with the
+change from base to new, and exits with 1 if any case got slower than
+--threshold percent or started allocating more, so it can gate a change.
+"""
+
+import argparse
+import json
+import sys
+
+PREFIX = "BENCH "
+
+
+def load(path):
+    cases, header = {}, {}
+    with open(path, errors="replace") as f:
+        for line in f:
+            start = line.find(PREFIX)
+            if start < 0:
+                continue
+            try:
+                record = json.loads(line[start + len(PREFIX):])
+            except json.JSONDecodeError:
+                continue          # Line cut by other log output
+            if "case" in record:
+                cases[record["case"]] = record
+            else:
+                header = record
+    return header, cases
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("base")
+    parser.add_argument("new")
+    parser.add_argument("--threshold", type=float, default=10.0, help="slowdown (%%) counted as a regression")
+    parser.add_argument("--json", action="store_true", help="print the comparison as JSON")
+    args = parser.parse_args()
+
+    base_header, base = load(args.base)
+    new_header, new = load(args.new)
+    if not base or not new:
+        print("No BENCH lines found", file=sys.stderr)
+        return 2
+    if base_header.get("cpu_mhz") != new_header.get("cpu_mhz"):
+        print(f"Warning: CPU clock differs ({base_header.get('cpu_mhz')} vs {new_header.get('cpu_mhz')} MHz)",
+              file=sys.stderr)
+
+    rows, regressions = [], 0
+    for name in sorted(set(base) | set(new)):
+        b, n = base.get(name), new.get(name)
+        row = {"case": name}
+        if b and n:
+            change = 100.0 * (n["ns_per_op"] - b["ns_per_op"]) / max(b["ns_per_op"], 1)
+            regressed = change > args.threshold or n["allocs_per_op"] > b["allocs_per_op"]
+            regressions += regressed
+            row.update(base_ns=b["ns_per_op"], new_ns=n["ns_per_op"], change_pct=round(change, 1),
+                       base_allocs=b["allocs_per_op"], new_allocs=n["allocs_per_op"], regressed=regressed)
+        else:
+            row.update(only_in="base" if b else "new")
+        rows.append(row)
+
+    if args.json:
+        print(json.dumps({"threshold_pct": args.threshold, "regressions": regressions, "cases": rows}, indent=2))
+    else:
+        print(f"{'case':28} {'base ns':>10} {'new ns':>10} {'change':>8} {'allocs':>13}")
+        for row in rows:
+            if "only_in" in row:
+                print(f"{row['case']:28} (only in {row['only_in']})")
+                continue
+            flag = "  <-- regression" if row["regressed"] else ""
+            allocs = f"{row['base_allocs']:.2f}->{row['new_allocs']:.2f}"
+            print(f"{row['case']:28} {row['base_ns']:>10} {row['new_ns']:>10} {row['change_pct']:>+7.1f}% "
+                  f"{allocs:>13}{flag}")
+        print(f"{regressions} regression(s) above {args.threshold}%")
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,278 @@
+#!/usr/bin/env python3
+"""
+OTA helper for the pool controller
+
+  diff   <old.bin> <new.bin> <patch.bin>  Make a delta patch (see include/delta_patch.h)
+  apply  <old.bin> <patch.bin> <out.bin>  Apply a patch on the host (same rules as the device)
+  keygen <release.pem>                    Make the release key, print OTA_SIGNING_KEY for secrets.h
+  sign   <new.bin> --key <release.pem>    Print the image SHA-256 and its signature ("sig")
+  send   <file> --sha256 <image sha> --key <release.pem>
+                                          Stream an image or patch over MQTT chunks
+
+diff and apply need only the standard library, so patches can be checked on
+the host before they are sent:
+  ota_tool.py diff old.bin new.bin p.bin && ota_tool.py apply old.bin p.bin out.bin && cmp new.bin out.bin
+
+The device only installs images signed with the release key: "sig" is an
+ECDSA P-256 signature (DER, hex) over the SHA-256 of the resulting image, also
+for patches. keygen/sign run the openssl command line tool; keep release.pem
+off the devices and out of the repository.
+
+send needs paho-mqtt (as test_simulator.py). Each chunk is a 4-byte big-endian
+offset followed by data; the device reports the next offset it expects on
+ota/state and the sender rewinds to it when a chunk was lost.
+"""
+
+import argparse
+import hashlib
+import json
+import os
+import struct
+import subprocess
+import sys
+import time
+
+MAGIC = b"ESPD"
+OP_END, OP_COPY, OP_DATA = 0x00, 0x01, 0x02
+KEY_LEN = 8          # Bytes hashed to find match candidates
+MIN_MATCH = 24       # Shorter matches cost more as COPY than as DATA
+
+
+def varint(value):
+    out = bytearray()
+    while True:
+        byte = value & 0x7F
+        value >>= 7
+        if value:
+            out.append(byte | 0x80)
+        else:
+            out.append(byte)
+            return bytes(out)
+
+
+def read_varint(data, pos):
+    value = shift = 0
+    while True:
+        byte = data[pos]
+        pos += 1
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            return value, pos
+
+
+def match_length(old, new, o, n):
+    """Length of the common run starting at old[o] / new[n]"""
+    length = 0
+    limit = min(len(old) - o, len(new) - n)
+    step = 256
+    while length + step <= limit and old[o + length:o + length + step] == new[n + length:n + length + step]:
+        length += step
+    while length < limit and old[o + length] == new[n + length]:
+        length += 1
+    return length
+
+
+def diff(old, new):
+    index = {}
+    for pos in range(len(old) - KEY_LEN + 1):
+        index.setdefault(old[pos:pos + KEY_LEN], pos)
+
+    ops = bytearray()
+    literal = bytearray()
+    expected = 0     # Where a COPY continuing the previous one would start (firmware changes are local)
+
+    def flush_literal():
+        if literal:
+            ops.extend(bytes([OP_DATA]) + varint(len(literal)) + literal)
+            literal.clear()
+
+    n = 0
+    while n < len(new):
+        best_pos, best_len = -1, 0
+        for candidate in (expected, index.get(new[n:n + KEY_LEN], -1)):
+            if 0 <= candidate < len(old):
+                length = match_length(old, new, candidate, n)
+                if length > best_len:
+                    best_pos, best_len = candidate, length
+        if best_len >= MIN_MATCH:
+            flush_literal()
+            ops.extend(bytes([OP_COPY]) + varint(best_pos) + varint(best_len))
+            n += best_len
+            expected = best_pos + best_len
+        else:
+            literal.append(new[n])
+            n += 1
+            expected += 1
+    flush_literal()
+    ops.append(OP_END)
+
+    header = MAGIC + struct.pack("<II", len(old), len(new)) + hashlib.sha256(old).digest()
+    return header + bytes(ops)
+
+
+def apply(old, patch):
+    if patch[:4] != MAGIC:
+        raise ValueError("not a delta patch")
+    source_size, target_size = struct.unpack("<II", patch[4:12])
+    if source_size != len(old) or patch[12:44] != hashlib.sha256(old).digest():
+        raise ValueError("patch was made against a different image")
+
+    out = bytearray()
+    pos = 44
+    while True:
+        op = patch[pos]
+        pos += 1
+        if op == OP_END:
+            break
+        if op == OP_COPY:
+            offset, pos = read_varint(patch, pos)
+            length, pos = read_varint(patch, pos)
+            if offset + length > len(old):
+                raise ValueError("COPY outside the source image")
+            out += old[offset:offset + length]
+        elif op == OP_DATA:
+            length, pos = read_varint(patch, pos)
+            out += patch[pos:pos + length]
+            pos += length
+        else:
+            raise ValueError(f"bad opcode {op:#x}")
+        if len(out) > target_size:
+            raise ValueError("output longer than the target")
+    if len(out) != target_size or pos != len(patch):
+        raise ValueError("size mismatch")
+    return bytes(out)
+
+
+def keygen(path):
+    if os.path.exists(path):
+        raise SystemExit(f"{path} exists, not overwriting a release key")
+    subprocess.run(["openssl", "ecparam", "-name", "prime256v1", "-genkey", "-noout", "-out", path], check=True)
+    os.chmod(path, 0o600)
+    public = subprocess.run(["openssl", "ec", "-in", path, "-pubout"], check=True,
+                            capture_output=True, text=True).stdout
+    return "#define OTA_SIGNING_KEY \"" + public.strip().replace("\n", "\\n\" \\\n  \"") + "\\n\""
+
+
+def sign_digest(key, digest):
+    """DER ECDSA signature over a SHA-256 digest, as mbedtls_pk_verify() expects"""
+    return subprocess.run(["openssl", "pkeyutl", "-sign", "-inkey", key], input=digest, check=True,
+                          capture_output=True).stdout
+
+
+def send(args):
+    import paho.mqtt.client as mqtt
+
+    data = open(args.file, "rb").read()
+    base = f"devices/{args.device}/ota"
+    expected = {"offset": 0, "state": None, "error": None}
+
+    def on_message(client, userdata, msg):
+        state = json.loads(msg.payload.decode())
+        expected["state"] = state.get("state")
+        expected["offset"] = state.get("offset", expected["offset"])
+        expected["error"] = state.get("error")
+
+    client = mqtt.Client()
+    if args.user:
+        client.username_pw_set(args.user, args.password)
+    if args.port != 1883:
+        client.tls_set()
+    client.on_message = on_message
+    client.connect(args.host, args.port)
+    client.subscribe(base + "/state")
+    client.loop_start()
+    time.sleep(1)
+    expected.update(offset=0, state=None, error=None)   # Forget the retained result of a previous update
+
+    sig = args.sig or sign_digest(args.key, bytes.fromhex(args.sha256)).hex()
+    start = {"size": len(data), "sha256": args.sha256, "sig": sig, "patch": args.patch}
+    client.publish(base + "/set", json.dumps(start))
+    time.sleep(2)
+
+    sent = 0
+    last_progress = time.monotonic()
+    acked, last_ack = 0, time.monotonic()
+    while expected["state"] == "receiving" or expected["state"] is None:
+        if expected["offset"] != acked:
+            acked, last_ack = expected["offset"], time.monotonic()
+        elif time.monotonic() - last_ack > 60:
+            print("\nNo progress from the device, giving up")
+            break
+        if expected["offset"] < sent and time.monotonic() - last_progress > 1:
+            sent = expected["offset"]          # Lost chunk: rewind
+        if sent < len(data) and sent - expected["offset"] < args.window:
+            chunk = data[sent:sent + args.chunk]
+            client.publish(base + "/chunk", struct.pack(">I", sent) + chunk)
+            sent += len(chunk)
+            last_progress = time.monotonic()
+        else:
+            time.sleep(0.05)
+        print(f"\r{expected['offset']}/{len(data)} bytes", end="")
+    print()
+    client.loop_stop()
+    print(f"Result: {expected['state']} {expected['error'] or ''}")
+    return 0 if expected["state"] == "done" else 1
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    p = sub.add_parser("diff")
+    p.add_argument("old")
+    p.add_argument("new")
+    p.add_argument("patch")
+
+    p = sub.add_parser("apply")
+    p.add_argument("old")
+    p.add_argument("patch")
+    p.add_argument("out")
+
+    p = sub.add_parser("keygen")
+    p.add_argument("key")
+
+    p = sub.add_parser("sign")
+    p.add_argument("image", help="resulting image (the new.bin of a patch)")
+    p.add_argument("--key", required=True, help="release private key (keygen)")
+
+    p = sub.add_parser("send")
+    p.add_argument("file")
+    p.add_argument("--sha256", required=True, help="SHA-256 of the resulting image")
+    signer = p.add_mutually_exclusive_group(required=True)
+    signer.add_argument("--key", help="release private key, signs --sha256")
+    signer.add_argument("--sig", help="signature from sign (hex)")
+    p.add_argument("--patch", action="store_true", help="file is a delta patch")
+    p.add_argument("--device", default="esp32-pool-01")
+    p.add_argument("--host", required=True)
+    p.add_argument("--port", type=int, default=8883)
+    p.add_argument("--user")
+    p.add_argument("--password")
+    p.add_argument("--chunk", type=int, default=256, help="data bytes per chunk (must fit MQTT_BUFFER_SIZE)")
+    p.add_argument("--window", type=int, default=16384, help="bytes sent ahead of the device")
+
+    args = parser.parse_args()
+    if args.command == "diff":
+        old, new = open(args.old, "rb").read(), open(args.new, "rb").read()
+        patch = diff(old, new)
+        open(args.patch, "wb").write(patch)
+        print(f"Patch: {len(patch)} bytes ({100 * len(patch) // max(len(new), 1)}% of {len(new)})")
+        print(f"Image SHA-256: {hashlib.sha256(new).hexdigest()}")
+    elif args.command == "apply":
+        out = apply(open(args.old, "rb").read(), open(args.patch, "rb").read())
+        open(args.out, "wb").write(out)
+        print(f"Image: {len(out)} bytes, SHA-256 {hashlib.sha256(out).hexdigest()}")
+    elif args.command == "keygen":
+        print("Add to secrets.h:")
+        print(keygen(args.key))
+    elif args.command == "sign":
+        digest = hashlib.sha256(open(args.image, "rb").read()).digest()
+        print(f"Image SHA-256: {digest.hex()}")
+        print(f"Signature: {sign_digest(args.key, digest).hex()}")
+    else:
+        return send(args)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
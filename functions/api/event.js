@@ -14,16 +14,21 @@
  * {
  *   "deviceId": "esp32-01" (optional, default: "esp32-01"),
  *   "state": "ON" | "OFF" (required),
- *   "ts": number (required, epoch milliseconds),
+ *   "ts": number (epoch milliseconds, device-side event time from pump/state;
+ *                 receive time if missing),
  *   "valveId": 1 | 2 (optional, default: 1)
  * }
+ *
+ * Events are stored at the device's event time, so data delivered out of
+ * order lines up in history. A replay (same device, ts, state and valve, e.g.
+ * the retained pump/state after a reconnect) is acknowledged but not inserted.
  * 
  * Response (Success 200):
  * {
  *   "ok": true,
- *   "inserted": 1,
- *   "eventId": number,
- *   "ts": number
+ *   "inserted": { deviceId, ts, state, valveId },
+ *   "duplicate": boolean,
+ *   "meta": { success }
  * }
  * 
  * Response (Error):
@@ -61,6 +66,9 @@ function requireApiKey(request, env) {
   return { ok: true };
 }
 
+// Device clocks are SNTP-synced: a ts further ahead than this is a bad clock, not an event
+const MAX_FUTURE_SKEW_MS = 5 * 60 * 1000;
+
 function normalizeState(state) {
   const s = String(state || "").toUpperCase().trim();
   if (s === "ON" || s === "OFF") return s;
@@ -90,9 +98,19 @@ export async function onRequest({ request, env }) {
   if (!deviceId) return json({ ok: false, error: "deviceId is required" }, 400);
   if (!state) return json({ ok: false, error: 'state must be "ON" or "OFF"' }, 400);
   if (!Number.isFinite(ts) || ts <= 0) return json({ ok: false, error: "ts must be a positive number (epoch ms)" }, 400);
+  if (ts > Date.now() + MAX_FUTURE_SKEW_MS) return json({ ok: false, error: "ts is in the future (device clock not synced?)" }, 400);
   if (valveId !== 1 && valveId !== 2) return json({ ok: false, error: "valveId must be 1 or 2" }, 400);
 
   try {
+    // Replayed event (retained state re-delivered, retried POST): already stored
+    const existing = await env.DB
+      .prepare("SELECT id FROM events WHERE device_id = ? AND ts = ? AND state = ? AND valve_id = ? LIMIT 1")
+      .bind(deviceId, ts, state, valveId)
+      .first();
+    if (existing) {
+      return json({ ok: true, inserted: { deviceId, ts, state, valveId }, duplicate: true });
+    }
+
     // Insert new event with valve_id
     const stmt = env.DB
       .prepare("INSERT INTO events (device_id, ts, state, valve_id) VALUES (?, ?, ?, ?)")
@@ -120,6 +138,7 @@ export async function onRequest({ request, env }) {
         state,
         valveId,
       },
+      duplicate: false,
       meta: {
         success: result.success,
       },
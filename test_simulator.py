@@ -24,6 +24,7 @@ TOPIC_TEMP_STATE = "devices/esp32-pool-01/temperature/state"
 TOPIC_PUMP_CMD = "devices/esp32-pool-01/pump/set"
 TOPIC_VALVE_CMD = "devices/esp32-pool-01/valve/set"
 TOPIC_TIMER_CMD = "devices/esp32-pool-01/timer/set"
+TOPIC_CMD_ACK = "devices/esp32-pool-01/cmd/ack"
 
 # Simulated state
 pump_state = "OFF"
@@ -34,6 +35,10 @@ timer_duration = 0
 timer_remaining = 0
 timer_last_update = 0
 
+def stamped(**fields):
+    """State payload as the firmware sends it: JSON with the event time (epoch ms)"""
+    return json.dumps({**fields, "ts": int(time.time() * 1000)})
+
 def on_connect(client, userdata, flags, rc):
     if rc == 0:
         print("✓ Connected to MQTT broker")
@@ -55,9 +60,36 @@ def on_message(client, userdata, msg):
     
     payload = msg.payload.decode().strip()
     topic = msg.topic
+    received = time.monotonic()
     
     print(f"\n[RX] {topic}: '{payload}'")
+
+    # Unwrap command envelopes: {"id":42,"ts":...,"cmd":"ON"} (timer JSON carries id/ts inline)
+    command_id = None
+    if payload.startswith("{"):
+        try:
+            envelope = json.loads(payload)
+            command_id = envelope.get("id")
+            if topic != TOPIC_TIMER_CMD:
+                payload = str(envelope.get("cmd", ""))
+        except json.JSONDecodeError:
+            pass
     
+    handle_command(client, topic, payload)
+
+    if command_id is not None:
+        ack = {
+            "id": str(command_id),
+            "topic": topic.split("esp32-pool-01/", 1)[-1],
+            "result": "ok",
+            "proc_us": int((time.monotonic() - received) * 1_000_000),
+        }
+        client.publish(TOPIC_CMD_ACK, json.dumps(ack))
+        print(f"[TX] {TOPIC_CMD_ACK}: {ack}")
+
+def handle_command(client, topic, payload):
+    global pump_state, valve_mode, timer_active, timer_mode, timer_duration, timer_remaining, timer_last_update
+
     if topic == TOPIC_PUMP_CMD:
         payload_upper = payload.upper()
         if payload_upper in ["ON", "OFF"]:
@@ -67,7 +99,7 @@ def on_message(client, userdata, msg):
             elif pump_state != payload_upper:
                 pump_state = payload_upper
                 print(f"→ Pump state changed to: {pump_state}")
-                client.publish(TOPIC_PUMP_STATE, pump_state, retain=True)
+                client.publish(TOPIC_PUMP_STATE, stamped(state=pump_state), retain=True)
                 print(f"[TX] {TOPIC_PUMP_STATE}: {pump_state}")
             else:
                 print(f"→ Pump already in state: {pump_state}")
@@ -80,7 +112,7 @@ def on_message(client, userdata, msg):
             if valve_mode != payload:
                 valve_mode = payload
                 print(f"→ Valve mode changed to: {valve_mode}")
-                client.publish(TOPIC_VALVE_STATE, valve_mode, retain=True)
+                client.publish(TOPIC_VALVE_STATE, stamped(mode=int(valve_mode)), retain=True)
                 print(f"[TX] {TOPIC_VALVE_STATE}: {valve_mode}")
             else:
                 print(f"→ Valve already in mode: {valve_mode}")
@@ -109,17 +141,17 @@ def publish_states(client):
     global pump_state, valve_mode
     
     # Publish pump state
-    client.publish(TOPIC_PUMP_STATE, pump_state, retain=True)
+    client.publish(TOPIC_PUMP_STATE, stamped(state=pump_state), retain=True)
     print(f"[TX] {TOPIC_PUMP_STATE}: {pump_state}")
     
     # Publish valve state
-    client.publish(TOPIC_VALVE_STATE, valve_mode, retain=True)
+    client.publish(TOPIC_VALVE_STATE, stamped(mode=int(valve_mode)), retain=True)
     print(f"[TX] {TOPIC_VALVE_STATE}: {valve_mode}")
     
     # Publish temperature (simulated)
     import random
     temp = round(random.uniform(20.0, 28.0), 1)
-    client.publish(TOPIC_TEMP_STATE, str(temp), retain=True)
+    client.publish(TOPIC_TEMP_STATE, stamped(value=temp), retain=True)
     print(f"[TX] {TOPIC_TEMP_STATE}: {temp}°C")
     
     # Publish WiFi state (simulated)
@@ -148,12 +180,12 @@ def start_timer(client, mode, duration):
     
     # Set valve mode
     valve_mode = str(mode)
-    client.publish(TOPIC_VALVE_STATE, valve_mode, retain=True)
+    client.publish(TOPIC_VALVE_STATE, stamped(mode=int(valve_mode)), retain=True)
     print(f"[TX] {TOPIC_VALVE_STATE}: {valve_mode}")
     
     # Turn on pump
     pump_state = "ON"
-    client.publish(TOPIC_PUMP_STATE, pump_state, retain=True)
+    client.publish(TOPIC_PUMP_STATE, stamped(state=pump_state), retain=True)
     print(f"[TX] {TOPIC_PUMP_STATE}: {pump_state}")
     
     # Publish timer state
@@ -171,7 +203,7 @@ def stop_timer(client):
     
     # Turn off pump
     pump_state = "OFF"
-    client.publish(TOPIC_PUMP_STATE, pump_state, retain=True)
+    client.publish(TOPIC_PUMP_STATE, stamped(state=pump_state), retain=True)
     print(f"[TX] {TOPIC_PUMP_STATE}: {pump_state}")
     
     # Publish timer state
@@ -259,7 +291,7 @@ def main():
                 last_temp_update = now
                 import random
                 temp = round(random.uniform(20.0, 28.0), 1)
-                client.publish(TOPIC_TEMP_STATE, str(temp), retain=True)
+                client.publish(TOPIC_TEMP_STATE, stamped(value=temp), retain=True)
                 print(f"[TX] Temperature: {temp}°C")
             
             # WiFi updates every 30 seconds